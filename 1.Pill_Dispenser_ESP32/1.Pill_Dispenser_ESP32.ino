@@ -7,36 +7,122 @@
 // Include all module headers
 #include "Config.h"
 #include "ConfigurationSettings.h"
+#include "ConfigurationStore.h"
 #include "SensorManager.h"
 #include "HardwareController.h"
 #include "DispenserController.h"
 #include "BLEManager.h"
 #include "UIManager.h"
+#include "DispenseSimulator.h"
+#include "ConfigurationOptimizer.h"
+#include "HotPathBenchmarks.h"
+#include "PowerManager.h"
+#include "DispenseJournal.h"
+#include "DoseScheduler.h"
+#include "EnduranceBenchmark.h"
+#include "DosePrepositioner.h"
+#include "PillInventory.h"
+#include "DispenseStatistics.h"
+#include "SweepRangeLearner.h"
+#include "DispenseJobQueue.h"
+#include "CancellationToken.h"
+#include "MemoryReport.h"
+#include "MemoryTelemetry.h"
+#include "SerialConsole.h"
 
 SystemConfiguration systemConfig;
-SensorManager* sensorManager;
-HardwareController* hardwareController;
-DispenserController* dispenserController;
-BLEManager* bleManager;
-UIManager* uiManager;
+#if USE_COMPILE_TIME_CONFIGURATION
+FixedSystemConfiguration fixedSystemConfig;     // Empty: every field is static constexpr
+ControllerConfiguration* controllerConfig = &fixedSystemConfig;
+#else
+ControllerConfiguration* controllerConfig = &systemConfig;
+#endif
+ConfigurationStore configurationStore(&systemConfig);
+SensorTrace sensorTrace;
+DispenseJournal dispenseJournal;
+DoseScheduler doseScheduler(&systemConfig);
+PillInventory pillInventory(&systemConfig, &doseScheduler);
+DispenseStatistics dispenseStatistics(&doseScheduler);
+SweepRangeLearner sweepRangeLearner(&systemConfig);
+DispenseJobQueue dispenseJobQueue;
+CancellationToken operationCancellationToken;
+volatile bool wasBackButtonPressUsedForAbort = false;
+
+// Core objects are static (no heap): constructed in this order before setup()
+SensorManager sensorManager(controllerConfig);
+HardwareController hardwareController(controllerConfig);
+DispenserController dispenserController(controllerConfig, &hardwareController, &sensorManager);
+BLEManager bleManager(&systemConfig);
+UIManager uiManager(&systemConfig);
+PowerManager powerManager(&systemConfig, &hardwareController);
+EnduranceBenchmark enduranceBenchmark(&dispenserController);
+DispenseSimulator backgroundSimulator(&systemConfig);  // SIMULATE, advanced a slice per loop pass
+bool isSimulationFromSerialConsole = false;
+DosePrepositioner dosePrepositioner(&systemConfig, &dispenserController, &hardwareController, &doseScheduler);
+MemoryReport memoryReport;
+MemoryTelemetry memoryTelemetry(&systemConfig);
+SerialConsole serialConsole(&Serial);
+BufferedSerialWriter serialConsoleOutput(&Serial);     // Reports and dumps requested at run time
+bool isProcessingSerialConsoleCommand = false;
+
+const StaticObjectSize staticObjectSizes[] = {
+    STATIC_OBJECT_SIZE(systemConfig),
+    STATIC_OBJECT_SIZE(configurationStore),
+    STATIC_OBJECT_SIZE(sensorTrace),
+    STATIC_OBJECT_SIZE(dispenseJournal),
+    STATIC_OBJECT_SIZE(doseScheduler),
+    STATIC_OBJECT_SIZE(pillInventory),
+    STATIC_OBJECT_SIZE(dispenseStatistics),
+    STATIC_OBJECT_SIZE(sweepRangeLearner),
+    STATIC_OBJECT_SIZE(dispenseJobQueue),
+    STATIC_OBJECT_SIZE(sensorManager),
+    STATIC_OBJECT_SIZE(hardwareController),
+    STATIC_OBJECT_SIZE(dispenserController),
+    STATIC_OBJECT_SIZE(bleManager),
+    STATIC_OBJECT_SIZE(uiManager),
+    STATIC_OBJECT_SIZE(powerManager),
+    STATIC_OBJECT_SIZE(enduranceBenchmark),
+    STATIC_OBJECT_SIZE(backgroundSimulator),
+    STATIC_OBJECT_SIZE(dosePrepositioner),
+    STATIC_OBJECT_SIZE(memoryTelemetry),
+    STATIC_OBJECT_SIZE(serialConsoleOutput)
+};
+const int NUMBER_OF_STATIC_OBJECTS = sizeof(staticObjectSizes) / sizeof(staticObjectSizes[0]);
 
 void setup() {
     Serial.begin(115200);
     
-    sensorManager = new SensorManager(&systemConfig);
-    hardwareController = new HardwareController(&systemConfig);
-    dispenserController = new DispenserController(&systemConfig, hardwareController, sensorManager);
-    bleManager = new BLEManager(&systemConfig);
-    uiManager = new UIManager(&systemConfig);
+    int numberOfStoredFields = configurationStore.beginAndLoadStoredConfiguration();
+    Serial.print("Stored configuration fields applied: ");
+    Serial.println(numberOfStoredFields);
+    
+    // The static controller derived step positions from the defaults; redo it with stored tuning
+    dispenserController.calculateCompartmentStepPositions();
+    
+    // Counts are rebuilt from flash so reboots and brownouts don't lose them
+    dispenseJournal.beginAndRecoverCounts();
+    dispenserController.attachDispenseJournal(&dispenseJournal);
+    dispenseJournal.printJournalReport(Serial);
+    
+    doseScheduler.beginAndLoadSchedule();
+    doseScheduler.printSchedule(Serial);
+    
+    // Stock is derived from the recovered counts, so attach after the journal
+    pillInventory.beginAndLoadInventory();
+    dispenserController.attachPillInventory(&pillInventory);
+    pillInventory.printInventory(Serial);
+    dispenserController.attachDispenseStatistics(&dispenseStatistics);
+    dispenserController.attachSweepRangeLearner(&sweepRangeLearner);
     
-    uiManager->initializeLCDAndButtonPins();
-    uiManager->displayInitializationMessage();
+    uiManager.initializeLCDAndButtonPins();
+    uiManager.displayInitializationMessage();
     
-    sensorManager->initializeAllSensors();
-    hardwareController->initializeAllHardwareActuators();
-    dispenserController->initializeDispenserSystem();
+    sensorManager.initializeAllSensors();
+    hardwareController.initializeAllHardwareActuators();
+    dispenserController.initializeDispenserSystem();
     
-    globalSensorManagerInstance = sensorManager;
+    globalSensorManagerInstance = &sensorManager;
+    sensorManager.attachSensorTrace(&sensorTrace);
     
     attachInterrupt(digitalPinToInterrupt(PIN_FOR_ENCODER_CHANNEL_1), 
                     encoderInterruptServiceRoutine, 
@@ -45,29 +131,55 @@ void setup() {
                     encoderInterruptServiceRoutine, 
                     CHANGE);
     
-    globalBLEManagerInstance = bleManager;
-    bleManager->initializeBluetoothLEServer();
+    // ABORT (BLE) and BACK (while busy) stop the running operation at its next safe point
+    dispenserController.attachCancellationToken(&operationCancellationToken);
+    bleManager.attachCancellationToken(&operationCancellationToken);
+    attachInterrupt(digitalPinToInterrupt(PIN_FOR_NAVIGATION_BACK_BUTTON), 
+                    backButtonAbortInterruptServiceRoutine, 
+                    FALLING);
+    
+    globalBLEManagerInstance = &bleManager;
+    bleManager.initializeBluetoothLEServer();
     
     delay(300);
     
-    uiManager->displayHomingInProgressMessage();
-    bool homingSuccessful = dispenserController->performHomingWithRetryAndEscalation();
+    uiManager.displayHomingInProgressMessage();
+    bool homingSuccessful = dispenserController.performHomingWithRetryAndEscalation();
     
     if (homingSuccessful) {
-        uiManager->displayHomingCompleteMessage();
+        uiManager.displayHomingCompleteMessage();
         delay(systemConfig.delayAfterHomingCompleteMilliseconds);
     } else {
-        uiManager->displayCustomMessageOnRow(1, "Homing FAILED!");
+        uiManager.displayMessageOnRow(1, MSG_HOMING_FAILED);
         delay(2000);
     }
     
-    hardwareController->performServoHomingSequence();
+    hardwareController.performServoHomingSequence();
+    
+    hardwareController.turnOnReadyStatusLED();
+    
+    // Button chord: BACK + SELECT held through power-up starts the endurance benchmark
+    if (digitalRead(PIN_FOR_NAVIGATION_BACK_BUTTON) == LOW && 
+        digitalRead(PIN_FOR_NAVIGATION_SELECT_BUTTON) == LOW) {
+        uiManager.displayMessageOnRow(0, MSG_ENDURANCE_TEST);
+        uiManager.displayMessageOnRow(1, MSG_RELEASE_BUTTONS);
+        while (digitalRead(PIN_FOR_NAVIGATION_BACK_BUTTON) == LOW || 
+               digitalRead(PIN_FOR_NAVIGATION_SELECT_BUTTON) == LOW) {
+            delay(10);
+        }
+        enduranceBenchmark.startBenchmark(ENDURANCE_DEFAULT_ROUNDS, 0, ENDURANCE_DEFAULT_PAUSE_MILLISECONDS);
+    }
     
-    hardwareController->turnOnReadyStatusLED();
-    uiManager->displayReadyStatusWithCompartmentSelection(
-        uiManager->getCurrentlySelectedCompartmentNumber(),
-        bleManager->isBluetoothDeviceConnected()
+    uiManager.displayReadyStatusWithCompartmentSelection(
+        uiManager.getCurrentlySelectedCompartmentNumber(),
+        bleManager.isBluetoothDeviceConnected()
     );
+    
+    // Baseline for MEMORY: nothing the sketch owns is heap-allocated after this point
+    memoryReport.recordHeapAfterBoot();
+    memoryReport.printMemoryReport(Serial, staticObjectSizes, NUMBER_OF_STATIC_OBJECTS);
+    memoryTelemetry.takeSnapshot(millis());
+    Serial.println("Serial console ready, type HELP");
 }
 
 void loop() {
@@ -78,56 +190,32 @@ void loop() {
     
     if (lastHomingButtonState == HIGH && currentHomingButtonState == LOW) {
         buttonPressStartTime = millis();
+        powerManager.recordWakeToActionLatency();
+        powerManager.noteActivity();
     }
     
     if (lastHomingButtonState == LOW && currentHomingButtonState == HIGH) {
         unsigned long pressDuration = millis() - buttonPressStartTime;
         
-        if (millis() - lastHomingButtonTime > systemConfig.homingButtonDebounceMilliseconds) {
+        if (wasBackButtonPressUsedForAbort) {
+            wasBackButtonPressUsedForAbort = false;  // That press aborted; don't start homing
+        } else if (millis() - lastHomingButtonTime > systemConfig.homingButtonDebounceMilliseconds) {
             lastHomingButtonTime = millis();
             
-            if (pressDuration >= 3000) {
-                uiManager->displayCustomMessageOnRow(0, "Calibration...");
-                uiManager->displayCustomMessageOnRow(1, "Measuring...");
-                
-                bool calibrationSuccessful = dispenserController->calibrateFullRotationTiming();
-                
-                if (calibrationSuccessful) {
-                    uiManager->displayCustomMessageOnRow(0, "Calibration OK");
-                    uiManager->displayCustomMessageOnRow(1, "Check Serial");
-                    delay(3000);
-                } else {
-                    uiManager->displayCustomMessageOnRow(0, "Calibration");
-                    uiManager->displayCustomMessageOnRow(1, "FAILED!");
-                    delay(3000);
-                }
-            } else {
-                uiManager->displayHomingInProgressMessage();
-                
-                bool homingSuccessful = dispenserController->performHomingWithRetryAndEscalation();
-                
-                if (homingSuccessful) {
-                    uiManager->displayHomingCompleteMessage();
-                    delay(systemConfig.statusMessageDisplayTimeMilliseconds);
-                } else {
-                    uiManager->displayCustomMessageOnRow(1, "Homing FAILED!");
-                    delay(systemConfig.errorMessageDisplayTimeMilliseconds);
-                }
-            }
-            
-            uiManager->displayReadyStatusWithCompartmentSelection(
-                uiManager->getCurrentlySelectedCompartmentNumber(),
-                bleManager->isBluetoothDeviceConnected()
-            );
+            dispenseJobQueue.enqueueJob(pressDuration >= 3000 ? JOB_CALIBRATE : JOB_MANUAL_HOME);
         }
     }
     
     lastHomingButtonState = currentHomingButtonState;
     
-    bleManager->updateConnectionStateInMainLoop();
+    serviceSerialConsole();
+    bleManager.updateConnectionStateInMainLoop();
     
-    if (bleManager->hasNewCommandAvailableToProcess()) {
-        BLECommand command = bleManager->getAndClearMostRecentCommand();
+    if (bleManager.hasNewCommandAvailableToProcess()) {
+        BLECommand command = bleManager.getAndRemoveNextCommand();
+        powerManager.recordWakeToActionLatency();
+        isProcessingSerialConsoleCommand = command.isFromSerialConsole;
+        bleManager.setResponseRedirect(command.isFromSerialConsole ? &serialConsoleOutput : nullptr);
         
         switch (command.commandType) {
             case BLECommand::DISPENSE:
@@ -139,165 +227,1076 @@ void loop() {
                 break;
                 
             case BLECommand::RESET:
-                handleBLEResetCommand();
+                admitDispenseJobOrReportBusy(JOB_RESET_STATISTICS, 0, 0);
                 break;
                 
             case BLECommand::HOME:
-                handleBLEHomeCommand();
+                admitDispenseJobOrReportBusy(JOB_BLE_HOME, 0, 0);
+                break;
+                
+            case BLECommand::SIMULATE:
+                handleBLESimulateCommand(command);
+                break;
+                
+            case BLECommand::TRACE:
+                handleBLETraceCommand(command);
+                break;
+                
+            case BLECommand::OPTIMIZE:
+                handleBLEOptimizeCommand(command);
+                break;
+                
+            case BLECommand::BENCHMARK:
+                handleBLEBenchmarkCommand();
+                break;
+                
+            case BLECommand::CONFIG:
+                handleBLEConfigCommand(command);
+                break;
+                
+            case BLECommand::POWER:
+                handleBLEPowerCommand();
+                break;
+                
+            case BLECommand::STATS:
+                handleBLEStatsCommand();
+                break;
+                
+            case BLECommand::MEMORY:
+                handleBLEMemoryCommand(command);
+                break;
+                
+            case BLECommand::TIME_SYNC:
+                handleBLETimeSyncCommand(command);
+                break;
+                
+            case BLECommand::SCHEDULE:
+                handleBLEScheduleCommand(command);
+                break;
+                
+            case BLECommand::ENDURANCE:
+                handleBLEEnduranceCommand(command);
+                break;
+                
+            case BLECommand::STOCK:
+                handleBLEStockCommand(command);
+                break;
+                
+            case BLECommand::ABORT:
+                handleBLEAbortCommand();
                 break;
                 
             default:
                 Serial.println("Unknown BLE command type");
                 break;
         }
+        
+        bleManager.setResponseRedirect(nullptr);
+        isProcessingSerialConsoleCommand = false;
     }
     
-    ButtonAction buttonPressed = uiManager->checkIfAnyButtonPressedWithDebounce();
+    DoseDecision dueDose;
+    if (doseScheduler.getNextDueDose((uint32_t)time(NULL), &dueDose)) {
+        powerManager.noteActivity();
+        // Missed doses only need reporting; a full queue must not lose a dose
+        if (!dueDose.shouldDispense || !dispenseJobQueue.enqueueScheduledDose(dueDose)) {
+            handleScheduledDose(dueDose);
+        }
+    }
+    
+    ButtonAction buttonPressed = uiManager.checkIfAnyButtonPressedWithDebounce();
     
     if (buttonPressed != NO_BUTTON_PRESSED) {
+        powerManager.recordWakeToActionLatency();
         handleButtonPress(buttonPressed);
     }
     
-    delay(10);
+    // A waiting dispense gets the servo attached (at its parked position) now,
+    // so the sweep never waits for it
+    if (dispenseJobQueue.hasPatientJobQueued()) {
+        hardwareController.prepareServoForUpcomingSweep();
+    }
+    
+    // One job per pass, so work admitted meanwhile is ordered before the next
+    runNextDispenseJob();
+    
+    // Pure computation, so it runs alongside the mechanism
+    if (backgroundSimulator.isSimulationRunning()) {
+        serviceBackgroundSimulation();
+    }
+    
+    bool isMechanismFree = dispenseJobQueue.isEmpty();
+    if (isMechanismFree && enduranceBenchmark.isRunning()) {
+        operationCancellationToken.armForOperation();
+        handleEnduranceBenchmarkRound();
+        finishCancellableOperation();
+    }
+    
+    // Park at the next dose's compartment ahead of time (overdue doses above go first)
+    bool isHoldingForDose = false;
+    if (isMechanismFree && !enduranceBenchmark.isRunning()) {
+        operationCancellationToken.armForOperation();
+        isHoldingForDose = dosePrepositioner.servicePrepositioning((uint32_t)time(NULL));
+        finishCancellableOperation();
+    }
+    
+    // A servo held still only hums; a servo parked for a dose stays attached
+    if (isMechanismFree && !isHoldingForDose && !enduranceBenchmark.isRunning() &&
+        !sensorManager.isSensorTraceReplaying()) {
+        hardwareController.serviceServoIdleDetach(millis());
+    }
+    
+    dispenseJournal.serviceJournal();
+    memoryTelemetry.serviceTelemetry(millis());
+    
+    // Alerts wait for a connection so none is lost while the phone is away
+    if (bleManager.isBluetoothDeviceConnected()) {
+        sendPendingLowStockAlert();
+        sendPendingMemoryAlert();
+    }
+    
+    // Motion, BLE traffic and held buttons all keep the chip awake
+    if (bleManager.isBluetoothDeviceConnected() || buttonPressed != NO_BUTTON_PRESSED ||
+        currentHomingButtonState == LOW || enduranceBenchmark.isRunning()) {
+        powerManager.noteActivity();
+    }
+    
+    bool isSystemIdle = !bleManager.isBluetoothDeviceConnected() &&
+                        !bleManager.hasNewCommandAvailableToProcess() &&
+                        !dispenseJournal.hasPendingRecords() &&
+                        dispenseJobQueue.isEmpty() &&
+                        !enduranceBenchmark.isRunning() &&
+                        !backgroundSimulator.isSimulationRunning() &&
+                        !isHoldingForDose &&
+                        !sensorManager.isSensorTraceRecording() &&
+                        !sensorManager.isSensorTraceReplaying() &&
+                        !serialConsoleOutput.hasPendingOutput() &&
+                        currentHomingButtonState == HIGH;
+    
+    // Wake early enough to pre-position before the dose
+    long secondsUntilWake = dosePrepositioner.getSecondsUntilPreparation(
+        doseScheduler.getSecondsUntilNextDose((uint32_t)time(NULL)));
+    if (secondsUntilWake >= 0) {
+        powerManager.setTimedWake(millis() + (unsigned long)secondsUntilWake * 1000UL);
+    } else {
+        powerManager.clearTimedWake();
+    }
+    
+    if (!powerManager.enterLightSleepIfIdle(isSystemIdle)) {
+        delay(10);
+    }
 }
 
 void handleBLEDispenseCommand(BLECommand command) {
     if (command.compartmentNumber < 1 || 
         command.compartmentNumber > systemConfig.numberOfCompartmentsInDispenser) {
-        bleManager->sendErrorResponseToConnectedDevice("Invalid compartment number");
+        bleManager.sendErrorResponseToConnectedDevice("Invalid compartment number");
+        return;
+    }
+    
+    if (pillInventory.isCompartmentKnownEmpty(command.compartmentNumber)) {
+        bleManager.sendErrorResponseToConnectedDevice(
+            "Compartment " + String(command.compartmentNumber) + " empty, refill and send STOCK");
         return;
     }
     
-    uiManager->displayDispensingInProgressMessage(command.compartmentNumber);
+    admitDispenseJobOrReportBusy(JOB_BLE_DISPENSE, command.compartmentNumber, command.pillCount);
+}
+
+void handleBLEDispenseJob(const DispenseJob& job) {
+    uiManager.displayDispensingInProgressMessage(job.compartmentNumber);
     
-    int successCount = dispenserController->dispensePillsFromCompartment(
-        command.compartmentNumber,
-        command.pillCount
+    int successCount = dispenserController.dispensePillsFromCompartment(
+        job.compartmentNumber,
+        job.pillCount
     );
     
-    bleManager->sendDispenseResultToConnectedDevice(successCount, command.pillCount);
+    bleManager.sendDispenseResultToConnectedDevice(successCount, job.pillCount);
+    if (dispenserController.wasLastOperationCancelled()) {
+        return;  // The abort handler reports and restores the display
+    }
     
     if (successCount == 0) {
-        Serial.println("ERROR: Failed to dispense from compartment " + String(command.compartmentNumber));
+        printMessageLineWithNumber(Serial, MSG_ERROR_DISPENSE_FAILED, job.compartmentNumber);
         
-        uiManager->displayFailureMessage();
+        uiManager.displayFailureMessage();
         delay(systemConfig.errorMessageDisplayTimeMilliseconds);
 
-        uiManager->clearLCDDisplay();
-        uiManager->displayCustomMessageOnRow(0, String("Override slot ") + String(command.compartmentNumber));
-        uiManager->displayCustomMessageOnRow(1, "Check pill levels");
-        delay(systemConfig.statusMessageDisplayTimeMilliseconds);
-
-        uiManager->displayHomingInProgressMessage();
-        bool homingSuccessful = dispenserController->performHomingWithRetryAndEscalation();
-        if (homingSuccessful) {
-            uiManager->displayHomingCompleteMessage();
+        // Nothing moved for a known-empty compartment, so there is nothing to re-home
+        if (pillInventory.isCompartmentKnownEmpty(job.compartmentNumber)) {
+            uiManager.clearLCDDisplay();
+            uiManager.displayMessageWithNumberOnRow(0, MSG_SLOT, job.compartmentNumber, MSG_EMPTY);
+            uiManager.displayMessageOnRow(1, MSG_PLEASE_REFILL);
             delay(systemConfig.statusMessageDisplayTimeMilliseconds);
         } else {
-            uiManager->displayCustomMessageOnRow(1, "Homing FAILED!");
-            delay(systemConfig.errorMessageDisplayTimeMilliseconds);
+            uiManager.clearLCDDisplay();
+            uiManager.displayMessageWithNumberOnRow(0, MSG_OVERRIDE_SLOT, job.compartmentNumber);
+            uiManager.displayMessageOnRow(1, MSG_CHECK_PILL_LEVELS);
+            delay(systemConfig.statusMessageDisplayTimeMilliseconds);
+
+            uiManager.displayHomingInProgressMessage();
+            bool homingSuccessful = dispenserController.performHomingWithRetryAndEscalation();
+            if (homingSuccessful) {
+                uiManager.displayHomingCompleteMessage();
+                delay(systemConfig.statusMessageDisplayTimeMilliseconds);
+            } else {
+                uiManager.displayMessageOnRow(1, MSG_HOMING_FAILED);
+                delay(systemConfig.errorMessageDisplayTimeMilliseconds);
+            }
         }
     }
 
-    uiManager->displayReadyStatusWithCompartmentSelection(
-        uiManager->getCurrentlySelectedCompartmentNumber(),
-        bleManager->isBluetoothDeviceConnected()
+    uiManager.displayReadyStatusWithCompartmentSelection(
+        uiManager.getCurrentlySelectedCompartmentNumber(),
+        bleManager.isBluetoothDeviceConnected()
     );
 }
 
 void handleBLEStatusCommand() {
-    int compartmentCounts[5];
+    int compartmentCounts[NUMBER_OF_COMPARTMENTS_IN_DISPENSER];
     for (int i = 0; i < systemConfig.numberOfCompartmentsInDispenser; i++) {
-        compartmentCounts[i] = dispenserController->getDispenseCountForCompartment(i + 1);
+        compartmentCounts[i] = dispenserController.getDispenseCountForCompartment(i + 1);
     }
     
-    bleManager->sendStatisticsStatusToConnectedDevice(
+    bleManager.sendStatisticsStatusToConnectedDevice(
         compartmentCounts, 
         systemConfig.numberOfCompartmentsInDispenser
     );
+    
+    dispenseJobQueue.printJobQueueReport(serialConsoleOutput);
+}
+
+void handleBLEStatsCommand() {
+    uint32_t now = (uint32_t)time(NULL);
+    dispenseStatistics.printStatistics(serialConsoleOutput, now);
+    sweepRangeLearner.printSweepRanges(serialConsoleOutput, hardwareController.getServoMinSafe(),
+                                       hardwareController.getServoMaxSafe());
+    
+    uint32_t hourlyPills[DISPENSE_STATISTICS_HOURLY_BUCKETS];
+    uint32_t dailyPills[DISPENSE_STATISTICS_DAILY_BUCKETS];
+    dispenseStatistics.getHourlyPillCounts(now, hourlyPills);
+    dispenseStatistics.getDailyPillCounts(now, dailyPills);
+    
+    bleManager.sendDispenseStatisticsToConnectedDevice(
+        dispenseStatistics.getTotalPillsDispensed(),
+        dispenseStatistics.getTotalRequests(),
+        dispenseStatistics.getTotalFailedRequests(),
+        dispenseStatistics.getTotalRetries(),
+        hourlyPills, DISPENSE_STATISTICS_HOURLY_BUCKETS,
+        dailyPills, DISPENSE_STATISTICS_DAILY_BUCKETS);
 }
 
 void handleBLEResetCommand() {
-    dispenserController->resetAllDispenseStatistics();
-    bleManager->sendSuccessResponseToConnectedDevice("Statistics reset");
+    if (dispenserController.resetAllDispenseStatistics()) {
+        bleManager.sendSuccessResponseToConnectedDevice("Statistics reset");
+    } else {
+        bleManager.sendErrorResponseToConnectedDevice("Statistics reset, journal not written (stock levels unchanged)");
+    }
     
-    uiManager->displayReadyStatusWithCompartmentSelection(
-        uiManager->getCurrentlySelectedCompartmentNumber(),
-        bleManager->isBluetoothDeviceConnected()
+    uiManager.displayReadyStatusWithCompartmentSelection(
+        uiManager.getCurrentlySelectedCompartmentNumber(),
+        bleManager.isBluetoothDeviceConnected()
     );
 }
 
 void handleBLEHomeCommand() {
-    uiManager->displayHomingInProgressMessage();
+    uiManager.displayHomingInProgressMessage();
     
-    bool homingSuccessful = dispenserController->performHomingWithRetryAndEscalation();
+    bool homingSuccessful = dispenserController.performHomingWithRetryAndEscalation();
+    if (dispenserController.wasLastOperationPreempted() || dispenserController.wasLastOperationCancelled()) {
+        return;  // Queued again behind the dispense that preempted it, or aborted
+    }
     
     if (homingSuccessful) {
-        uiManager->displayHomingCompleteMessage();
-        bleManager->sendSuccessResponseToConnectedDevice("Homing complete");
+        uiManager.displayHomingCompleteMessage();
+        bleManager.sendSuccessResponseToConnectedDevice("Homing complete");
         delay(systemConfig.statusMessageDisplayTimeMilliseconds);
     } else {
-        bleManager->sendErrorResponseToConnectedDevice("Homing failed");
-        uiManager->displayFailureMessage();
+        bleManager.sendErrorResponseToConnectedDevice("Homing failed");
+        uiManager.displayFailureMessage();
+        delay(systemConfig.errorMessageDisplayTimeMilliseconds);
+    }
+    
+    uiManager.displayReadyStatusWithCompartmentSelection(
+        uiManager.getCurrentlySelectedCompartmentNumber(),
+        bleManager.isBluetoothDeviceConnected()
+    );
+}
+
+void handleBLESimulateCommand(BLECommand command) {
+    if (backgroundSimulator.isSimulationRunning()) {
+        bleManager.sendErrorResponseToConnectedDevice("Simulation already running");
+        return;
+    }
+    
+    backgroundSimulator.configureSyntheticDoseSchedule(command.simulatedDoseCount, 
+                                                       command.simulatedDosesPerHour, 
+                                                       1);
+    backgroundSimulator.beginSimulation();
+    isSimulationFromSerialConsole = command.isFromSerialConsole;
+    
+    // The summary follows when the run ends (serviceBackgroundSimulation)
+    bleManager.sendSuccessResponseToConnectedDevice(
+        "Simulating " + String(backgroundSimulator.getSyntheticDoseCount()) + " doses");
+}
+
+void serviceBackgroundSimulation() {
+    if (backgroundSimulator.runSimulationSlice(SIMULATOR_EVENTS_PER_SLICE)) {
+        return;
+    }
+    
+    backgroundSimulator.printSimulationReport(serialConsoleOutput);
+    
+    bleManager.setResponseRedirect(isSimulationFromSerialConsole ? &serialConsoleOutput : nullptr);
+    bleManager.sendSimulationSummaryToConnectedDevice(
+        backgroundSimulator.getSustainedDosesPerHour(),
+        backgroundSimulator.getLatencyPercentileMilliseconds(50),
+        backgroundSimulator.getLatencyPercentileMilliseconds(99),
+        backgroundSimulator.getDroppedDoseCount()
+    );
+    bleManager.setResponseRedirect(nullptr);
+}
+
+void handleBLEConfigCommand(BLECommand command) {
+    ConfigurationFieldDescriptor descriptor;
+    
+    switch (command.configAction) {
+        case BLECommand::CONFIG_LIST:
+            configurationStore.printConfigurationFields(serialConsoleOutput);
+            bleManager.sendSuccessResponseToConnectedDevice("Field list on Serial");
+            break;
+            
+        case BLECommand::CONFIG_RESET:
+            if (configurationStore.resetToDefaults()) {
+                bleManager.sendSuccessResponseToConnectedDevice("Defaults restored");
+            } else {
+                bleManager.sendErrorResponseToConnectedDevice("Defaults restored, flash not cleared");
+            }
+            dispenserController.calculateCompartmentStepPositions();
+            hardwareController.reattachServoWithCurrentLimits();
+            break;
+            
+        case BLECommand::CONFIG_GET:
+            if (ConfigurationStore::getFieldDescriptor(command.configFieldId, &descriptor)) {
+                bleManager.sendConfigurationFieldToConnectedDevice(
+                    command.configFieldId,
+                    descriptor.fieldName,
+                    configurationStore.formatFieldValue(command.configFieldId)
+                );
+            } else {
+                bleManager.sendErrorResponseToConnectedDevice("Unknown field id");
+            }
+            break;
+            
+        case BLECommand::CONFIG_SET: {
+            ConfigurationUpdateResult result =
+                configurationStore.setFieldValue(command.configFieldId, command.configValue);
+            if (result != CONFIGURATION_UPDATE_OK) {
+                bleManager.sendErrorResponseToConnectedDevice(getConfigurationUpdateResultMessage(result));
+                break;
+            }
+            
+            // Apply live: refresh everything derived from the configuration
+            dispenserController.calculateCompartmentStepPositions();
+            if (ConfigurationStore::isServoAttachLimitField(command.configFieldId)) {
+                hardwareController.reattachServoWithCurrentLimits();
+            }
+            
+            ConfigurationStore::getFieldDescriptor(command.configFieldId, &descriptor);
+            bleManager.sendConfigurationFieldToConnectedDevice(
+                command.configFieldId,
+                descriptor.fieldName,
+                configurationStore.formatFieldValue(command.configFieldId)
+            );
+            break;
+        }
+    }
+}
+
+void handleBLEBenchmarkCommand() {
+    static HotPathBenchmarks benchmarks(&systemConfig);
+    
+    uiManager.displayMessageOnRow(0, MSG_BENCHMARKING);
+    int numberOfCases = benchmarks.runAllBenchmarks();
+    benchmarks.printResultsAsJson(serialConsoleOutput);
+    
+    bleManager.sendSuccessResponseToConnectedDevice(
+        String(numberOfCases) + " benchmarks done, JSON on Serial");
+    
+    uiManager.displayReadyStatusWithCompartmentSelection(
+        uiManager.getCurrentlySelectedCompartmentNumber(),
+        bleManager.isBluetoothDeviceConnected()
+    );
+}
+
+void handleBLEPowerCommand() {
+    powerManager.printPowerReport(serialConsoleOutput);
+    
+    bleManager.sendSuccessResponseToConnectedDevice(
+        "asleep " + String(powerManager.getSleepFraction() * 100.0, 1) +
+        "%, est saving " + String(powerManager.getEstimatedCurrentReductionPercent(), 1) +
+        "%, wake avg/max " + String(powerManager.getAverageWakeToActionMicroseconds()) +
+        "/" + String(powerManager.getMaximumWakeToActionMicroseconds()) + " us");
+}
+
+void handleBLEMemoryCommand(BLECommand command) {
+    if (command.memoryAction == BLECommand::MEMORY_DUMP) {
+        memoryTelemetry.printSnapshotsAsCsv(serialConsoleOutput);
+        bleManager.sendSuccessResponseToConnectedDevice(
+            String(memoryTelemetry.getNumberOfSnapshots()) + " snapshots on Serial");
+        return;
+    }
+    
+    memoryReport.printMemoryReport(serialConsoleOutput, staticObjectSizes, NUMBER_OF_STATIC_OBJECTS);
+    const MemorySnapshot& snapshot = memoryTelemetry.takeSnapshot(millis());
+    int lowestStackTaskIndex = 0;
+    uint16_t lowestStackBytes = MemoryTelemetry::getLowestStackHighWaterBytes(snapshot, &lowestStackTaskIndex);
+    
+    bleManager.sendSuccessResponseToConnectedDevice(
+        "free " + String(snapshot.freeHeap) +
+        ", min " + String(snapshot.minimumFreeHeap) +
+        ", largest " + String(snapshot.largestFreeBlock) +
+        ", boot " + String(memoryReport.getFreeHeapAfterBoot()) +
+        ", stack " + String(lowestStackBytes) + " (" + MEMORY_TELEMETRY_WATCHED_TASKS[lowestStackTaskIndex] + ")" +
+        ", alerts " + String(memoryTelemetry.getActiveAlertFlags()));
+}
+
+void sendPendingMemoryAlert() {
+    uint8_t alertFlags = memoryTelemetry.takeMemoryAlert();
+    if (alertFlags != 0) {
+        const MemorySnapshot& snapshot = memoryTelemetry.getSnapshot(0);
+        bleManager.sendMemoryAlertToConnectedDevice(
+            alertFlags, snapshot.freeHeap, snapshot.largestFreeBlock,
+            MemoryTelemetry::getLowestStackHighWaterBytes(snapshot, nullptr));
+    }
+}
+
+void handleBLETimeSyncCommand(BLECommand command) {
+    if (!DoseScheduler::isValidTime(command.timeEpochSeconds)) {
+        bleManager.sendErrorResponseToConnectedDevice("Invalid time");
+        return;
+    }
+    
+    doseScheduler.synchronizeClock(command.timeEpochSeconds, command.utcOffsetMinutes);
+    
+    long secondsUntilNextDose = doseScheduler.getSecondsUntilNextDose(command.timeEpochSeconds);
+    bleManager.sendSuccessResponseToConnectedDevice(
+        secondsUntilNextDose >= 0 
+            ? "Clock set, next dose in " + String(secondsUntilNextDose / 60) + " min"
+            : String("Clock set, no doses scheduled"));
+}
+
+void handleBLEScheduleCommand(BLECommand command) {
+    uint32_t now = (uint32_t)time(NULL);
+    
+    switch (command.scheduleAction) {
+        case BLECommand::SCHEDULE_SET:
+            if (doseScheduler.setScheduleEntry(command.scheduleSlot, command.scheduleMinuteOfDay,
+                                               command.compartmentNumber, command.pillCount,
+                                               command.missedDosePolicy, now)) {
+                bleManager.sendSuccessResponseToConnectedDevice(
+                    doseScheduler.isClockSynchronized() 
+                        ? "Schedule " + String(command.scheduleSlot) + " saved"
+                        : "Schedule " + String(command.scheduleSlot) + " saved, send TIME to activate");
+            } else {
+                bleManager.sendErrorResponseToConnectedDevice("Invalid schedule entry");
+            }
+            break;
+            
+        case BLECommand::SCHEDULE_DELETE:
+            if (doseScheduler.deleteScheduleEntry(command.scheduleSlot, now)) {
+                bleManager.sendSuccessResponseToConnectedDevice("Schedule " + String(command.scheduleSlot) + " deleted");
+            } else {
+                bleManager.sendErrorResponseToConnectedDevice("Invalid schedule slot");
+            }
+            break;
+            
+        case BLECommand::SCHEDULE_CLEAR:
+            doseScheduler.clearSchedule();
+            bleManager.sendSuccessResponseToConnectedDevice("Schedule cleared");
+            break;
+            
+        case BLECommand::SCHEDULE_LIST:
+        default:
+            doseScheduler.printSchedule(serialConsoleOutput);
+            bleManager.sendSuccessResponseToConnectedDevice(
+                String(doseScheduler.getNumberOfEnabledEntries()) + " entries, next slot " + 
+                String(doseScheduler.getNextDoseSlot()) + " in " + 
+                String(doseScheduler.getSecondsUntilNextDose(now) / 60) + " min (list on Serial)");
+            break;
+    }
+}
+
+void handleBLEStockCommand(BLECommand command) {
+    if (command.stockAction == BLECommand::STOCK_SET) {
+        if (pillInventory.setFillLevel(command.compartmentNumber, command.pillCount, (uint32_t)time(NULL))) {
+            bleManager.sendSuccessResponseToConnectedDevice(
+                command.pillCount < 0
+                    ? "Compartment " + String(command.compartmentNumber) + " not tracked"
+                    : "Compartment " + String(command.compartmentNumber) + " set to " + String(command.pillCount));
+        } else {
+            bleManager.sendErrorResponseToConnectedDevice("Invalid stock update");
+        }
+        return;
+    }
+    
+    // <compartment>:<left>/<days> for each tracked compartment
+    uint32_t now = (uint32_t)time(NULL);
+    String summary = "";
+    for (int compartmentNumber = 1; compartmentNumber <= systemConfig.numberOfCompartmentsInDispenser; compartmentNumber++) {
+        if (!pillInventory.isCompartmentTracked(compartmentNumber)) {
+            continue;
+        }
+        float daysUntilEmpty = pillInventory.getPredictedDaysUntilEmpty(compartmentNumber, now);
+        summary += String(compartmentNumber) + ":" + String(pillInventory.getRemainingPills(compartmentNumber)) + "/" +
+                   (daysUntilEmpty < 0 ? String("?") : String(daysUntilEmpty, 1)) + "d ";
+    }
+    pillInventory.printInventory(serialConsoleOutput);
+    bleManager.sendSuccessResponseToConnectedDevice(summary.length() > 0 ? summary : String("No compartment tracked"));
+}
+
+void sendPendingLowStockAlert() {
+    uint32_t now = (uint32_t)time(NULL);
+    int compartmentNumber = pillInventory.takeLowStockAlert(now);
+    if (compartmentNumber > 0) {
+        printMessageLineWithNumber(Serial, MSG_LOW_STOCK, compartmentNumber);
+        bleManager.sendLowStockAlertToConnectedDevice(
+            compartmentNumber,
+            pillInventory.getRemainingPills(compartmentNumber),
+            pillInventory.getPredictedDaysUntilEmpty(compartmentNumber, now));
+    }
+}
+
+void handleScheduledDose(DoseDecision decision) {
+    if (!decision.shouldDispense) {
+        Serial.println("Scheduled dose " + String(decision.dose.slot) + " missed (" + 
+                       String(decision.secondsLate / 60) + " min late)");
+        bleManager.sendScheduledDoseOutcomeToConnectedDevice(
+            decision.dose.slot, getDoseOutcomeName(DOSE_MISSED), 0, decision.pillCount);
+        return;
+    }
+    
+    uiManager.displayDispensingInProgressMessage(decision.compartmentNumber);
+    uiManager.displayMessageOnRow(0, MSG_SCHEDULED_DOSE);
+    
+    int successCount = dispenserController.dispensePillsFromCompartment(
+        decision.compartmentNumber,
+        decision.pillCount
+    );
+    
+    DispensePhaseTimings timings = dispenserController.getLastDispensePhaseTimings();
+    Serial.println("Scheduled dose move: " + String(timings.moveMicroseconds / 1000) + 
+                   " ms, actuation: " + String(timings.actuationMicroseconds / 1000) + " ms");
+    
+    DoseOutcome outcome = doseScheduler.completeScheduledDose(decision, successCount, (uint32_t)time(NULL));
+    bleManager.sendScheduledDoseOutcomeToConnectedDevice(
+        decision.dose.slot, getDoseOutcomeName(outcome), successCount, decision.pillCount);
+    if (dispenserController.wasLastOperationCancelled()) {
+        return;
+    }
+    
+    if (successCount > 0) {
+        uiManager.displaySuccessMessage();
+        delay(systemConfig.successMessageDisplayTimeMilliseconds);
+    } else {
+        printMessageLineWithNumber(Serial, MSG_ERROR_SCHEDULED_DOSE_FAILED, decision.compartmentNumber);
+        
+        uiManager.displayFailureMessage();
         delay(systemConfig.errorMessageDisplayTimeMilliseconds);
+        
+        // Nothing moved for a known-empty compartment, so there is nothing to re-home
+        if (pillInventory.isCompartmentKnownEmpty(decision.compartmentNumber)) {
+            uiManager.displayMessageOnRow(1, MSG_PLEASE_REFILL);
+            delay(systemConfig.statusMessageDisplayTimeMilliseconds);
+        } else {
+            uiManager.displayHomingInProgressMessage();
+            if (!dispenserController.performHomingWithRetryAndEscalation()) {
+                uiManager.displayMessageOnRow(1, MSG_HOMING_FAILED);
+                delay(systemConfig.errorMessageDisplayTimeMilliseconds);
+            }
+        }
     }
     
-    uiManager->displayReadyStatusWithCompartmentSelection(
-        uiManager->getCurrentlySelectedCompartmentNumber(),
-        bleManager->isBluetoothDeviceConnected()
+    uiManager.displayReadyStatusWithCompartmentSelection(
+        uiManager.getCurrentlySelectedCompartmentNumber(),
+        bleManager.isBluetoothDeviceConnected()
     );
 }
 
+void handleBLEEnduranceCommand(BLECommand command) {
+    switch (command.enduranceAction) {
+        case BLECommand::ENDURANCE_START:
+            if (enduranceBenchmark.startBenchmark(command.enduranceRoundCount,
+                                                   command.enduranceCompartmentMask,
+                                                   command.endurancePauseMilliseconds)) {
+                bleManager.sendSuccessResponseToConnectedDevice(
+                    "Endurance started, " + String(enduranceBenchmark.getNumberOfRequestedRounds()) + 
+                    " rounds (CSV on Serial)");
+            } else {
+                bleManager.sendErrorResponseToConnectedDevice("No valid compartment selected");
+            }
+            break;
+            
+        case BLECommand::ENDURANCE_STOP:
+            enduranceBenchmark.stopBenchmark();
+            sendEnduranceSummaryToConnectedDevice();
+            uiManager.displayReadyStatusWithCompartmentSelection(
+                uiManager.getCurrentlySelectedCompartmentNumber(),
+                bleManager.isBluetoothDeviceConnected()
+            );
+            break;
+            
+        case BLECommand::ENDURANCE_DUMP:
+        default:
+            enduranceBenchmark.printResultsAsCsv(serialConsoleOutput);
+            sendEnduranceSummaryToConnectedDevice();
+            break;
+    }
+}
+
+void handleEnduranceBenchmarkRound() {
+    if (!enduranceBenchmark.runNextRoundIfDue()) {
+        return;
+    }
+    
+    uiManager.displayMessageOnRow(0, MSG_ENDURANCE_TEST);
+    LCDRowText progressText;
+    progressText.appendNumber(enduranceBenchmark.getNumberOfCompletedRounds())
+                .appendCharacter('/')
+                .appendNumber(enduranceBenchmark.getNumberOfRequestedRounds());
+    uiManager.displayTextOnRow(1, progressText);
+    
+    if (!enduranceBenchmark.isRunning()) {
+        sendEnduranceSummaryToConnectedDevice();
+        uiManager.displayReadyStatusWithCompartmentSelection(
+            uiManager.getCurrentlySelectedCompartmentNumber(),
+            bleManager.isBluetoothDeviceConnected()
+        );
+    }
+}
+
+void sendEnduranceSummaryToConnectedDevice() {
+    bleManager.sendSuccessResponseToConnectedDevice(
+        String(enduranceBenchmark.getNumberOfCompletedRounds()) + " rounds, " +
+        String(enduranceBenchmark.getSuccessRatePercent(), 1) + "% ok, p50/p95/p99 " +
+        String(enduranceBenchmark.getCycleTimePercentileMilliseconds(50)) + "/" +
+        String(enduranceBenchmark.getCycleTimePercentileMilliseconds(95)) + "/" +
+        String(enduranceBenchmark.getCycleTimePercentileMilliseconds(99)) + " ms, " +
+        String(enduranceBenchmark.getPillsPerMinute(), 1) + " pills/min");
+}
+
+void handleBLEOptimizeCommand(BLECommand command) {
+    static ConfigurationOptimizer optimizer(&systemConfig);
+    
+    uiManager.displayMessageOnRow(0, MSG_OPTIMIZING);
+    optimizer.setTargetSuccessRate(command.optimizerTargetSuccessPercent / 100.0);
+    bool foundFeasibleProfile = optimizer.optimize(command.optimizerIterationCount);
+    optimizer.printOptimizationReport(serialConsoleOutput);
+    
+    if (foundFeasibleProfile) {
+        bleManager.sendSuccessResponseToConnectedDevice(
+            "Predicted speedup " + String(optimizer.getPredictedSpeedup(), 2) + "x, profile on Serial");
+    } else {
+        bleManager.sendErrorResponseToConnectedDevice("No profile meets the success target");
+    }
+    
+    uiManager.displayReadyStatusWithCompartmentSelection(
+        uiManager.getCurrentlySelectedCompartmentNumber(),
+        bleManager.isBluetoothDeviceConnected()
+    );
+}
+
+void handleBLETraceCommand(BLECommand command) {
+    switch (command.traceAction) {
+        case BLECommand::TRACE_RECORD:
+            sensorManager.startSensorTraceRecording();
+            attachInterrupt(digitalPinToInterrupt(PIN_FOR_HOME_POSITION_SWITCH),
+                            homeSwitchInterruptServiceRoutine,
+                            CHANGE);
+            attachInterrupt(digitalPinToInterrupt(PIN_FOR_INFRARED_PILL_DETECTOR),
+                            infraredSensorInterruptServiceRoutine,
+                            CHANGE);
+            bleManager.sendSuccessResponseToConnectedDevice("Trace recording");
+            break;
+            
+        case BLECommand::TRACE_REPLAY:
+            if (sensorManager.startSensorTraceReplay()) {
+                hardwareController.setActuatorOutputsSuppressed(true);
+                bleManager.sendSuccessResponseToConnectedDevice("Trace replay armed, motors disabled");
+            } else {
+                bleManager.sendErrorResponseToConnectedDevice("No trace to replay");
+            }
+            break;
+            
+        case BLECommand::TRACE_LOAD:
+            if (sensorManager.isSensorTraceRecording() || sensorManager.isSensorTraceReplaying()) {
+                bleManager.sendErrorResponseToConnectedDevice("Send TRACE:STOP before loading");
+            } else if (command.traceChunkOffset < 0 ||
+                       !sensorTrace.loadTraceChunk(command.traceChunkOffset, command.traceChunkBytes,
+                                                   command.traceChunkLength)) {
+                bleManager.sendErrorResponseToConnectedDevice(
+                    "Trace chunk rejected, resend from offset " + String((unsigned long)sensorTrace.getTraceLength()));
+            } else {
+                bleManager.sendSuccessResponseToConnectedDevice(
+                    "Trace " + String((unsigned long)sensorTrace.getTraceLength()) + " bytes loaded");
+            }
+            break;
+            
+        case BLECommand::TRACE_DUMP:
+            sensorTrace.printTraceAsHex(serialConsoleOutput);
+            bleManager.sendSuccessResponseToConnectedDevice(
+                "Trace " + String((unsigned long)sensorTrace.getTraceLength()) + " bytes on Serial");
+            break;
+            
+        case BLECommand::TRACE_STOP:
+        default:
+            detachInterrupt(digitalPinToInterrupt(PIN_FOR_HOME_POSITION_SWITCH));
+            detachInterrupt(digitalPinToInterrupt(PIN_FOR_INFRARED_PILL_DETECTOR));
+            sensorManager.stopSensorTrace();
+            hardwareController.setActuatorOutputsSuppressed(false);
+            if (sensorTrace.didTraceOverflow()) {
+                bleManager.sendErrorResponseToConnectedDevice("Trace stopped, buffer overflowed");
+            } else {
+                bleManager.sendSuccessResponseToConnectedDevice("Trace stopped");
+            }
+            break;
+    }
+}
+
 void handleButtonPress(ButtonAction action) {
     if (action == NAVIGATION_SELECT_PRESSED) {
-        handleManualDispenseRequest();
+        dispenseJobQueue.enqueueJob(JOB_MANUAL_DISPENSE, uiManager.getCurrentlySelectedCompartmentNumber(), 1);
     } else {
-        uiManager->handleButtonActionAndUpdateSelection(
+        uiManager.handleButtonActionAndUpdateSelection(
             action, 
             systemConfig.numberOfCompartmentsInDispenser
         );
         
-        uiManager->displayReadyStatusWithCompartmentSelection(
-            uiManager->getCurrentlySelectedCompartmentNumber(),
-            bleManager->isBluetoothDeviceConnected()
+        uiManager.displayReadyStatusWithCompartmentSelection(
+            uiManager.getCurrentlySelectedCompartmentNumber(),
+            bleManager.isBluetoothDeviceConnected()
         );
     }
 }
 
-void handleManualDispenseRequest() {
-    int selectedCompartment = uiManager->getCurrentlySelectedCompartmentNumber();
+void handleManualDispenseRequest(int selectedCompartment) {
+    if (pillInventory.isCompartmentKnownEmpty(selectedCompartment)) {
+        uiManager.clearLCDDisplay();
+        uiManager.displayMessageWithNumberOnRow(0, MSG_SLOT, selectedCompartment, MSG_EMPTY);
+        uiManager.displayMessageOnRow(1, MSG_PLEASE_REFILL);
+        delay(systemConfig.statusMessageDisplayTimeMilliseconds);
+        uiManager.displayReadyStatusWithCompartmentSelection(
+            selectedCompartment,
+            bleManager.isBluetoothDeviceConnected()
+        );
+        return;
+    }
     
-    uiManager->displayDispensingInProgressMessage(selectedCompartment);
+    uiManager.displayDispensingInProgressMessage(selectedCompartment);
     
-    int successCount = dispenserController->dispensePillsFromCompartment(selectedCompartment, 1);
+    int successCount = dispenserController.dispensePillsFromCompartment(selectedCompartment, 1);
+    if (dispenserController.wasLastOperationCancelled()) {
+        return;
+    }
     
     if (successCount > 0) {
-        uiManager->displaySuccessMessage();
+        uiManager.displaySuccessMessage();
         delay(systemConfig.successMessageDisplayTimeMilliseconds);
     } else {
-        Serial.println("ERROR: Failed to dispense from compartment " + String(selectedCompartment));
+        printMessageLineWithNumber(Serial, MSG_ERROR_DISPENSE_FAILED, selectedCompartment);
 
-        uiManager->displayFailureMessage();
+        uiManager.displayFailureMessage();
         delay(systemConfig.errorMessageDisplayTimeMilliseconds);
 
-        uiManager->clearLCDDisplay();
-        uiManager->displayCustomMessageOnRow(0, "Check pill levels");
-        uiManager->displayCustomMessageOnRow(1, String("Override slot ") + String(selectedCompartment));
+        uiManager.clearLCDDisplay();
+        uiManager.displayMessageOnRow(0, MSG_CHECK_PILL_LEVELS);
+        uiManager.displayMessageWithNumberOnRow(1, MSG_OVERRIDE_SLOT, selectedCompartment);
         delay(systemConfig.statusMessageDisplayTimeMilliseconds);
 
-        uiManager->displayHomingInProgressMessage();
-        bool homingSuccessful = dispenserController->performHomingWithRetryAndEscalation();
+        uiManager.displayHomingInProgressMessage();
+        bool homingSuccessful = dispenserController.performHomingWithRetryAndEscalation();
         if (homingSuccessful) {
-            uiManager->displayHomingCompleteMessage();
+            uiManager.displayHomingCompleteMessage();
             delay(systemConfig.statusMessageDisplayTimeMilliseconds);
         } else {
-            uiManager->displayCustomMessageOnRow(1, "Homing FAILED!");
+            uiManager.displayMessageOnRow(1, MSG_HOMING_FAILED);
             delay(systemConfig.errorMessageDisplayTimeMilliseconds);
         }
     }
     
-    uiManager->displayReadyStatusWithCompartmentSelection(
-        uiManager->getCurrentlySelectedCompartmentNumber(),
-        bleManager->isBluetoothDeviceConnected()
+    uiManager.displayReadyStatusWithCompartmentSelection(
+        uiManager.getCurrentlySelectedCompartmentNumber(),
+        bleManager.isBluetoothDeviceConnected()
+    );
+}
+
+// ============================================================================
+// Dispense Job Queue
+// ============================================================================
+
+/**
+ * Safe-point check for maintenance jobs: is a patient-facing job waiting,
+ * or about to be admitted on the next pass?
+ */
+bool isPatientJobWaiting() {
+    return dispenseJobQueue.hasPatientJobQueued() ||
+           bleManager.isDispenseCommandPending() ||
+           digitalRead(PIN_FOR_NAVIGATION_SELECT_BUTTON) == LOW ||
+           doseScheduler.getSecondsUntilNextDose((uint32_t)time(NULL)) == 0;
+}
+
+// ============================================================================
+// Serial Console
+// ============================================================================
+
+void serviceSerialConsole() {
+    serialConsoleOutput.serviceOutput();
+    
+    // Every byte typed postpones sleep, so a line is not cut off halfway
+    bool isLineWaiting = serialConsole.pollForCompleteLine();
+    if (serialConsole.wasInputReceived()) {
+        powerManager.noteActivity();
+    }
+    
+    // Typed commands share the BLE command queue; a line waits while it is full
+    if (!isLineWaiting || bleManager.isCommandQueueFull()) {
+        return;
+    }
+    String line = serialConsole.getLine();
+    serialConsole.consumeLine();
+    serialConsoleOutput.print("> ");
+    serialConsoleOutput.println(line);
+    
+    if (line == "HELP") {
+        printSerialConsoleHelp();
+    } else if (line == "SENSORS") {
+        printSensorReadings();
+    } else if (line.startsWith("JOG:")) {
+        handleSerialConsoleJogCommand(line.substring(4).toInt());
+    } else {
+        bleManager.submitCommandFromSerialConsole(line, &serialConsoleOutput);
+    }
+}
+
+void printSerialConsoleHelp() {
+    serialConsoleOutput.println("Console commands:");
+    serialConsoleOutput.println("  HELP           this list");
+    serialConsoleOutput.println("  SENSORS        home switch, IR, encoder, position, magnet, servo");
+    serialConsoleOutput.println("  JOG:<steps>    move the carousel (negative = backward)");
+    serialConsoleOutput.println("Every BLE command works here too (DISPENSE:3:1, STATUS, STATS, TRACE:DUMP,");
+    serialConsoleOutput.println("BENCH, CONFIG:SET:12:80, SCHEDULE:LIST, MEMORY, ...); replies print here.");
+}
+
+void printSensorReadings() {
+    serialConsoleOutput.print("Home switch: ");
+    serialConsoleOutput.print(sensorManager.isHomePositionSwitchActivated() ? "active" : "open");
+    serialConsoleOutput.print(" (raw ");
+    serialConsoleOutput.print(sensorManager.getRawHomeSwitchPinState());
+    serialConsoleOutput.println(")");
+    serialConsoleOutput.print("IR sensor: ");
+    serialConsoleOutput.println(sensorManager.isPillCurrentlyDetectedByInfraredSensor() ? "pill" : "clear");
+    serialConsoleOutput.print("Encoder: ");
+    serialConsoleOutput.println(sensorManager.getCurrentEncoderPosition());
+    serialConsoleOutput.print("Position: ");
+    serialConsoleOutput.print(dispenserController.getCurrentPositionSteps());
+    serialConsoleOutput.print(" steps (");
+    serialConsoleOutput.print(dispenserController.getCurrentPositionDegrees(), 1);
+    serialConsoleOutput.print(" deg), compartment ");
+    serialConsoleOutput.print(dispenserController.getCurrentCompartmentNumber());
+    serialConsoleOutput.println(dispenserController.isDispenserSystemHomed() ? ", homed" : ", not homed");
+    serialConsoleOutput.print("Electromagnet: ");
+    serialConsoleOutput.println(hardwareController.isElectromagnetActive() ? "on" : "off");
+    serialConsoleOutput.print("Servo: ");
+    serialConsoleOutput.print(hardwareController.getCurrentServoPosition());
+    serialConsoleOutput.println(" us");
+    serialConsoleOutput.print("Console output stalls: ");
+    serialConsoleOutput.println(serialConsoleOutput.getNumberOfStalls());
+}
+
+void handleSerialConsoleJogCommand(long steps) {
+    if (steps == 0) {
+        serialConsoleOutput.println("ERROR: JOG:<steps>, steps non-zero (negative = backward)");
+        return;
+    }
+    if (!dispenseJobQueue.isEmpty() || enduranceBenchmark.isRunning()) {
+        serialConsoleOutput.println("ERROR: Dispenser busy, try again");
+        return;
+    }
+    
+    operationCancellationToken.armForOperation();
+    long stepsMoved = dispenserController.jogStepperBySteps(steps);
+    if (finishCancellableOperation()) {
+        return;
+    }
+    serialConsoleOutput.print("Jogged ");
+    serialConsoleOutput.print(stepsMoved);
+    serialConsoleOutput.print(" steps, position ");
+    serialConsoleOutput.print(dispenserController.getCurrentPositionSteps());
+    serialConsoleOutput.println(" steps");
+}
+
+void admitDispenseJobOrReportBusy(DispenseJobType type, int compartmentNumber, int pillCount) {
+    if (!dispenseJobQueue.enqueueJob(type, compartmentNumber, pillCount, isProcessingSerialConsoleCommand)) {
+        bleManager.sendErrorResponseToConnectedDevice("Dispenser busy, try again");
+    }
+}
+
+void runNextDispenseJob() {
+    DispenseJob job;
+    if (!dispenseJobQueue.takeNextJob(&job)) {
+        return;
+    }
+    powerManager.noteActivity();
+    
+    bool isPreemptible = getDispenseJobPriority(job.type) != JOB_PRIORITY_PATIENT;
+    dispenserController.setPreemptionCheck(isPreemptible ? isPatientJobWaiting : NULL);
+    bleManager.setResponseRedirect(job.isFromSerialConsole ? &serialConsoleOutput : nullptr);
+    operationCancellationToken.armForOperation();
+    
+    switch (job.type) {
+        case JOB_BLE_DISPENSE:
+            handleBLEDispenseJob(job);
+            break;
+            
+        case JOB_MANUAL_DISPENSE:
+            handleManualDispenseRequest(job.compartmentNumber);
+            break;
+            
+        case JOB_SCHEDULED_DOSE:
+            handleScheduledDose(job.doseDecision);
+            break;
+            
+        case JOB_BLE_HOME:
+            handleBLEHomeCommand();
+            break;
+            
+        case JOB_MANUAL_HOME:
+            handleManualHomingJob();
+            break;
+            
+        case JOB_CALIBRATE:
+            handleManualCalibrationJob();
+            break;
+            
+        case JOB_RESET_STATISTICS:
+            handleBLEResetCommand();
+            break;
+    }
+    
+    bleManager.setResponseRedirect(nullptr);
+    dispenserController.setPreemptionCheck(NULL);
+    if (finishCancellableOperation()) {
+        return;  // Aborted jobs are not resumed
+    }
+    if (isPreemptible && dispenserController.wasLastOperationPreempted()) {
+        if (dispenseJobQueue.requeuePreemptedJob(job)) {
+            Serial.println("Maintenance job preempted by a dispense, resuming afterwards");
+            return;
+        }
+        Serial.println("ERROR: Job queue full, preempted maintenance job dropped");
+        bleManager.setResponseRedirect(job.isFromSerialConsole ? &serialConsoleOutput : nullptr);
+        bleManager.sendErrorResponseToConnectedDevice("Interrupted by a dispense and queue full, resend");
+        bleManager.setResponseRedirect(nullptr);
+    }
+}
+
+void handleManualHomingJob() {
+    uiManager.displayHomingInProgressMessage();
+    
+    bool homingSuccessful = dispenserController.performHomingWithRetryAndEscalation();
+    if (dispenserController.wasLastOperationPreempted() || dispenserController.wasLastOperationCancelled()) {
+        return;
+    }
+    
+    if (homingSuccessful) {
+        uiManager.displayHomingCompleteMessage();
+        delay(systemConfig.statusMessageDisplayTimeMilliseconds);
+    } else {
+        uiManager.displayMessageOnRow(1, MSG_HOMING_FAILED);
+        delay(systemConfig.errorMessageDisplayTimeMilliseconds);
+    }
+    
+    uiManager.displayReadyStatusWithCompartmentSelection(
+        uiManager.getCurrentlySelectedCompartmentNumber(),
+        bleManager.isBluetoothDeviceConnected()
     );
 }
+
+void handleManualCalibrationJob() {
+    uiManager.displayMessageOnRow(0, MSG_CALIBRATION_IN_PROGRESS);
+    uiManager.displayMessageOnRow(1, MSG_MEASURING);
+    
+    bool calibrationSuccessful = dispenserController.calibrateFullRotationTiming();
+    if (dispenserController.wasLastOperationPreempted() || dispenserController.wasLastOperationCancelled()) {
+        return;
+    }
+    
+    if (calibrationSuccessful) {
+        uiManager.displayMessageOnRow(0, MSG_CALIBRATION_OK);
+        uiManager.displayMessageOnRow(1, MSG_CHECK_SERIAL);
+        delay(3000);
+    } else {
+        uiManager.displayMessageOnRow(0, MSG_CALIBRATION);
+        uiManager.displayMessageOnRow(1, MSG_FAILED_UPPERCASE);
+        delay(3000);
+    }
+    
+    uiManager.displayReadyStatusWithCompartmentSelection(
+        uiManager.getCurrentlySelectedCompartmentNumber(),
+        bleManager.isBluetoothDeviceConnected()
+    );
+}
+
+// ============================================================================
+// Abort
+// ============================================================================
+
+void IRAM_ATTR backButtonAbortInterruptServiceRoutine() {
+    if (operationCancellationToken.requestCancellation()) {
+        wasBackButtonPressUsedForAbort = true;
+    }
+}
+
+/**
+ * Stop everything that moves and drop queued work (nothing is resumed)
+ */
+void enterSafeStateAndDropPendingWork() {
+    hardwareController.enterSafeState();
+    int numberOfDroppedJobs = dispenseJobQueue.clearAllJobs(&doseScheduler, (uint32_t)time(NULL));
+    enduranceBenchmark.stopBenchmark();
+    Serial.println("ABORT: safe state, " + String(numberOfDroppedJobs) + " queued job(s) dropped");
+}
+
+/**
+ * Disarm the token after a cancellable operation and handle an abort
+ * @return true if the operation was aborted
+ */
+bool finishCancellableOperation() {
+    operationCancellationToken.disarm();
+    if (!operationCancellationToken.isCancellationRequested()) {
+        return false;
+    }
+    
+    enterSafeStateAndDropPendingWork();
+    // A press and release both inside the operation never reach loop()'s edge check
+    if (digitalRead(PIN_FOR_NAVIGATION_BACK_BUTTON) == HIGH) {
+        wasBackButtonPressUsedForAbort = false;
+    }
+    
+    uiManager.clearLCDDisplay();
+    uiManager.displayMessageOnRow(0, MSG_ABORTED);
+    uiManager.displayMessageOnRow(1, dispenserController.isDispenserSystemHomed() ? MSG_SAFE_STATE : MSG_HOME_NEEDED);
+    delay(systemConfig.statusMessageDisplayTimeMilliseconds);
+    uiManager.displayReadyStatusWithCompartmentSelection(
+        uiManager.getCurrentlySelectedCompartmentNumber(),
+        bleManager.isBluetoothDeviceConnected()
+    );
+    return true;
+}
+
+void handleBLEAbortCommand() {
+    // A running operation was already cancelled from the BLE task; this also
+    // covers an ABORT sent between jobs
+    enterSafeStateAndDropPendingWork();
+    bleManager.sendSuccessResponseToConnectedDevice("Aborted, safe state");
+}
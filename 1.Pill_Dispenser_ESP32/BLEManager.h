@@ -8,6 +8,10 @@
 #include <BLE2902.h>
 #include "Config.h"
 #include "ConfigurationSettings.h"
+#include "CancellationToken.h"
+#include "SensorTrace.h"
+
+#define BLE_COMMAND_QUEUE_CAPACITY      4       // Commands waiting for the main loop (BLE and console)
 
 /**
  * Command structure for parsed BLE commands
@@ -18,14 +22,100 @@ struct BLECommand {
         DISPENSE,
         STATUS,
         RESET,
-        HOME
+        HOME,
+        SIMULATE,
+        TRACE,
+        OPTIMIZE,
+        BENCHMARK,
+        CONFIG,
+        POWER,
+        TIME_SYNC,
+        SCHEDULE,
+        ENDURANCE,
+        STOCK,
+        ABORT,
+        MEMORY,
+        STATS
+    };
+    
+    enum TraceAction {
+        TRACE_RECORD,
+        TRACE_STOP,
+        TRACE_REPLAY,
+        TRACE_DUMP,
+        TRACE_LOAD
+    };
+    
+    enum ConfigAction {
+        CONFIG_GET,
+        CONFIG_SET,
+        CONFIG_LIST,
+        CONFIG_RESET
+    };
+    
+    enum ScheduleAction {
+        SCHEDULE_SET,
+        SCHEDULE_DELETE,
+        SCHEDULE_LIST,
+        SCHEDULE_CLEAR
+    };
+    
+    enum EnduranceAction {
+        ENDURANCE_START,
+        ENDURANCE_STOP,
+        ENDURANCE_DUMP
+    };
+    
+    enum StockAction {
+        STOCK_LIST,
+        STOCK_SET
+    };
+    
+    enum MemoryAction {
+        MEMORY_SUMMARY,
+        MEMORY_DUMP
     };
     
     CommandType commandType;
     int compartmentNumber;
     int pillCount;
+    int simulatedDoseCount;
+    int simulatedDosesPerHour;
+    TraceAction traceAction;
+    int traceChunkOffset;                   // TRACE:LOAD byte offset (-1 = malformed chunk)
+    int traceChunkLength;
+    uint8_t traceChunkBytes[SENSOR_TRACE_LOAD_CHUNK_BYTES];
+    int optimizerIterationCount;
+    int optimizerTargetSuccessPercent;
+    ConfigAction configAction;
+    int configFieldId;
+    float configValue;
+    unsigned long timeEpochSeconds;
+    int utcOffsetMinutes;
+    ScheduleAction scheduleAction;
+    int scheduleSlot;
+    int scheduleMinuteOfDay;
+    int missedDosePolicy;
+    EnduranceAction enduranceAction;
+    int enduranceRoundCount;
+    uint32_t enduranceCompartmentMask;      // Bit i = compartment i + 1, 0 = all
+    int endurancePauseMilliseconds;
+    StockAction stockAction;
+    MemoryAction memoryAction;
+    bool isFromSerialConsole;               // Reply on the console, not over BLE
     
-    BLECommand() : commandType(NONE), compartmentNumber(0), pillCount(1) {}
+    BLECommand() : commandType(NONE), compartmentNumber(0), pillCount(1),
+                   simulatedDoseCount(100), simulatedDosesPerHour(1000),
+                   traceAction(TRACE_STOP), traceChunkOffset(-1), traceChunkLength(0),
+                   optimizerIterationCount(300), optimizerTargetSuccessPercent(99),
+                   configAction(CONFIG_LIST), configFieldId(-1), configValue(0),
+                   timeEpochSeconds(0), utcOffsetMinutes(0),
+                   scheduleAction(SCHEDULE_LIST), scheduleSlot(-1), scheduleMinuteOfDay(-1),
+                   missedDosePolicy(0),
+                   enduranceAction(ENDURANCE_DUMP), enduranceRoundCount(50),
+                   enduranceCompartmentMask(0), endurancePauseMilliseconds(500),
+                   stockAction(STOCK_LIST), memoryAction(MEMORY_SUMMARY),
+                   isFromSerialConsole(false) {}
 };
 
 /**
@@ -53,12 +143,105 @@ private:
     BLECharacteristic* commandCharacteristic;
     bool isDeviceCurrentlyConnectedViaBluetooth;
     bool wasDeviceConnectedInPreviousLoop;
-    BLECommand mostRecentCommandReceived;
-    bool hasNewCommandToProcess;
+    // FIFO filled by the BLE task and the console, drained by the main loop at
+    // safe points; every access holds commandQueueLock
+    BLECommand queuedCommands[BLE_COMMAND_QUEUE_CAPACITY];
+    volatile int numberOfQueuedCommands;
+    int firstQueuedCommand;
+    portMUX_TYPE commandQueueLock = portMUX_INITIALIZER_UNLOCKED;
+    CancellationToken* cancellationToken;      // Cancelled directly on ABORT (NULL = none)
+    
+    Print* responseRedirect;                   // Main loop only: replies for the command being handled (NULL = BLE)
     
     friend class BLEConnectionCallbacks;
     friend class BLECharacteristicWriteCallbacks;
     
+    bool isResponseWanted() {
+        return responseRedirect != nullptr ||
+               (commandCharacteristic != nullptr && isDeviceCurrentlyConnectedViaBluetooth);
+    }
+    
+    void deliverResponse(const String& response) {
+        if (responseRedirect != nullptr) {
+            responseRedirect->println(response);
+            return;
+        }
+        commandCharacteristic->setValue(response.c_str());
+        commandCharacteristic->notify();
+    }
+    
+    static String formatErrorResponse(const String& errorMessage) {
+        return "{status:ERROR, message:\"" + errorMessage + "\"}";
+    }
+    
+    /**
+     * Error for a BLE write, sent from the BLE task without the redirect
+     */
+    void sendErrorResponseOverBLE(const String& errorMessage) {
+        if (commandCharacteristic != nullptr && isDeviceCurrentlyConnectedViaBluetooth) {
+            commandCharacteristic->setValue(formatErrorResponse(errorMessage).c_str());
+            commandCharacteristic->notify();
+        }
+    }
+    
+    /**
+     * @return false if the queue is full (the command is dropped)
+     */
+    bool enqueueCommand(const BLECommand& command) {
+        bool isQueued = false;
+        portENTER_CRITICAL(&commandQueueLock);
+        if (numberOfQueuedCommands < BLE_COMMAND_QUEUE_CAPACITY) {
+            queuedCommands[(firstQueuedCommand + numberOfQueuedCommands) % BLE_COMMAND_QUEUE_CAPACITY] = command;
+            numberOfQueuedCommands++;
+            isQueued = true;
+        }
+        portEXIT_CRITICAL(&commandQueueLock);
+        return isQueued;
+    }
+    
+    /**
+     * @return Field fieldIndex of a colon-separated command ("" if absent)
+     */
+    static int getHexDigitValue(char digit) {
+        if (digit >= '0' && digit <= '9') return digit - '0';
+        if (digit >= 'A' && digit <= 'F') return digit - 'A' + 10;
+        if (digit >= 'a' && digit <= 'f') return digit - 'a' + 10;
+        return -1;
+    }
+    
+    /**
+     * Decode a TRACE:LOAD hex chunk (as printed by TRACE:DUMP)
+     * @return Number of bytes, or -1 if the text is not whole hex bytes or too long
+     */
+    static int decodeHexChunk(const String& hexText, uint8_t* bytes, int maximumLength) {
+        int length = hexText.length() / 2;
+        if ((hexText.length() % 2) != 0 || length > maximumLength) {
+            return -1;
+        }
+        for (int i = 0; i < length; i++) {
+            int high = getHexDigitValue(hexText.charAt(2 * i));
+            int low = getHexDigitValue(hexText.charAt(2 * i + 1));
+            if (high < 0 || low < 0) {
+                return -1;
+            }
+            bytes[i] = (uint8_t)((high << 4) | low);
+        }
+        return length;
+    }
+    
+    static String getColonSeparatedField(const String& commandString, int fieldIndex) {
+        int start = 0;
+        for (int i = 0; i < fieldIndex; i++) {
+            start = commandString.indexOf(':', start);
+            if (start < 0) {
+                return "";
+            }
+            start++;
+        }
+        int end = commandString.indexOf(':', start);
+        return commandString.substring(start, end < 0 ? commandString.length() : end);
+    }
+    
 public:
     /**
      * Constructor
@@ -70,7 +253,49 @@ public:
         commandCharacteristic = nullptr;
         isDeviceCurrentlyConnectedViaBluetooth = false;
         wasDeviceConnectedInPreviousLoop = false;
-        hasNewCommandToProcess = false;
+        numberOfQueuedCommands = 0;
+        firstQueuedCommand = 0;
+        cancellationToken = nullptr;
+        responseRedirect = nullptr;
+    }
+    
+    /**
+     * ABORT cancels the running operation as soon as it is received, without
+     * waiting for the main loop (which is blocked in that operation)
+     * @param token Token shared with the dispenser controller
+     */
+    void attachCancellationToken(CancellationToken* token) {
+        cancellationToken = token;
+    }
+    
+    /**
+     * Send replies somewhere other than the BLE client (Serial console)
+     * Main loop only: set from the command being handled, then reset.
+     * @param output Where replies go until reset (NULL = back to BLE)
+     */
+    void setResponseRedirect(Print* output) {
+        responseRedirect = output;
+    }
+    
+    /**
+     * Parse a command typed on the Serial console and queue it; it is then
+     * processed like a BLE command, with its replies going to the console
+     * @param commandString Command text (same syntax as BLE)
+     * @param output Where a parse error, if any, is written
+     * @return false if the command was rejected (error written to output)
+     */
+    bool submitCommandFromSerialConsole(const String& commandString, Print* output) {
+        BLECommand command;
+        if (!parseCommandString(commandString, &command)) {
+            output->println(formatErrorResponse("Unknown command: " + commandString));
+            return false;
+        }
+        command.isFromSerialConsole = true;
+        if (!enqueueCommand(command)) {
+            output->println(formatErrorResponse("Busy, command dropped: " + commandString));
+            return false;
+        }
+        return true;
     }
     
     /**
@@ -107,16 +332,48 @@ public:
      * @return true if new command is available
      */
     bool hasNewCommandAvailableToProcess() {
-        return hasNewCommandToProcess;
+        return numberOfQueuedCommands > 0;
+    }
+    
+    /**
+     * @return true if no further command can be queued right now
+     */
+    bool isCommandQueueFull() {
+        return numberOfQueuedCommands >= BLE_COMMAND_QUEUE_CAPACITY;
+    }
+    
+    /**
+     * @return true if an unprocessed DISPENSE is waiting (safe to poll from
+     *         a blocking loop; nothing is consumed)
+     */
+    bool isDispenseCommandPending() {
+        bool isPending = false;
+        portENTER_CRITICAL(&commandQueueLock);
+        for (int i = 0; i < numberOfQueuedCommands; i++) {
+            if (queuedCommands[(firstQueuedCommand + i) % BLE_COMMAND_QUEUE_CAPACITY].commandType ==
+                BLECommand::DISPENSE) {
+                isPending = true;
+                break;
+            }
+        }
+        portEXIT_CRITICAL(&commandQueueLock);
+        return isPending;
     }
     
     /**
-     * Get the most recent command (and mark as processed)
-     * @return BLECommand structure with command details
+     * Take the oldest queued command
+     * @return The command, or one of type NONE if the queue is empty
      */
-    BLECommand getAndClearMostRecentCommand() {
-        hasNewCommandToProcess = false;
-        return mostRecentCommandReceived;
+    BLECommand getAndRemoveNextCommand() {
+        BLECommand command;
+        portENTER_CRITICAL(&commandQueueLock);
+        if (numberOfQueuedCommands > 0) {
+            command = queuedCommands[firstQueuedCommand];
+            firstQueuedCommand = (firstQueuedCommand + 1) % BLE_COMMAND_QUEUE_CAPACITY;
+            numberOfQueuedCommands--;
+        }
+        portEXIT_CRITICAL(&commandQueueLock);
+        return command;
     }
     
     /**
@@ -124,52 +381,207 @@ public:
      * @param message Success message to send
      */
     void sendSuccessResponseToConnectedDevice(String message) {
-        if (commandCharacteristic != nullptr && isDeviceCurrentlyConnectedViaBluetooth) {
+        if (isResponseWanted()) {
             String response = "{status:OK, message:\"" + message + "\"}";
-            commandCharacteristic->setValue(response.c_str());
-            commandCharacteristic->notify();
+            deliverResponse(response);
         }
     }
     
     void sendErrorResponseToConnectedDevice(String errorMessage) {
-        if (commandCharacteristic != nullptr && isDeviceCurrentlyConnectedViaBluetooth) {
-            String response = "{status:ERROR, message:\"" + errorMessage + "\"}";
-            commandCharacteristic->setValue(response.c_str());
-            commandCharacteristic->notify();
+        if (isResponseWanted()) {
+            deliverResponse(formatErrorResponse(errorMessage));
         }
     }
     
     void sendDispenseResultToConnectedDevice(int successCount, int requestedCount) {
-        if (commandCharacteristic != nullptr && isDeviceCurrentlyConnectedViaBluetooth) {
-            String response = "{status:OK, dispensed:" + String(successCount) + 
-                            ", requested:" + String(requestedCount) + "}";
-            commandCharacteristic->setValue(response.c_str());
-            commandCharacteristic->notify();
+        if (isResponseWanted()) {
+            String response = formatDispenseResultResponse(successCount, requestedCount);
+            deliverResponse(response);
         }
     }
     
-    void sendStatisticsStatusToConnectedDevice(int* compartmentCounts, int numberOfCompartments) {
-        if (commandCharacteristic != nullptr && isDeviceCurrentlyConnectedViaBluetooth) {
-            String response = "{status:OK, compartments:[";
-            for (int i = 0; i < numberOfCompartments; i++) {
-                response += String(compartmentCounts[i]);
-                if (i < numberOfCompartments - 1) response += ",";
+    /**
+     * Build the DISPENSE result notification
+     * @param successCount Pills dispensed
+     * @param requestedCount Pills requested
+     * @return Response string
+     */
+    static String formatDispenseResultResponse(int successCount, int requestedCount) {
+        return "{status:OK, dispensed:" + String(successCount) + 
+               ", requested:" + String(requestedCount) + "}";
+    }
+    
+    /**
+     * Append values as a comma-separated list (no brackets)
+     * Runs of 3+ equal values are written as value*repeat (e.g. 4,0*9,2).
+     */
+    template <typename Value>
+    static void appendRunLengthEncodedList(String& response, const Value* values, int numberOfValues) {
+        int i = 0;
+        while (i < numberOfValues) {
+            int runLength = 1;
+            while (i + runLength < numberOfValues && values[i + runLength] == values[i]) {
+                runLength++;
             }
+            
+            if (i > 0) response += ",";
+            if (runLength >= 3) {
+                response += String(values[i]) + "*" + String(runLength);
+                i += runLength;
+            } else {
+                response += String(values[i]);
+                i++;
+            }
+        }
+    }
+    
+    /**
+     * Build the STATUS notification
+     * Counts are run-length encoded (e.g. [4,0*9,2]) so large carousels fit a
+     * notification; n is the number of compartments.
+     * @param compartmentCounts Dispense count per compartment
+     * @param numberOfCompartments Entries in compartmentCounts
+     * @return Response string
+     */
+    static String formatStatisticsStatusResponse(const int* compartmentCounts, int numberOfCompartments) {
+        String response;
+        response.reserve(32 + numberOfCompartments * 3);
+        response = "{status:OK, n:" + String(numberOfCompartments) + ", compartments:[";
+        appendRunLengthEncodedList(response, compartmentCounts, numberOfCompartments);
+        response += "]}";
+        return response;
+    }
+    
+    void sendStatisticsStatusToConnectedDevice(int* compartmentCounts, int numberOfCompartments) {
+        if (isResponseWanted()) {
+            String response = formatStatisticsStatusResponse(compartmentCounts, numberOfCompartments);
+            deliverResponse(response);
+        }
+    }
+    
+    /**
+     * Send the STATS notification
+     * Hourly and daily pill counts are newest first and run-length encoded.
+     * @param totalPills Pills dispensed
+     * @param totalRequests Dispense requests
+     * @param failedRequests Requests with no pill detected
+     * @param totalRetries Actuation attempts beyond the first per pill
+     * @param hourlyPills Pills per hour, current hour first
+     * @param numberOfHours Entries in hourlyPills
+     * @param dailyPills Pills per day, today first
+     * @param numberOfDays Entries in dailyPills
+     */
+    void sendDispenseStatisticsToConnectedDevice(uint64_t totalPills, uint64_t totalRequests,
+                                                 uint64_t failedRequests, uint64_t totalRetries,
+                                                 const uint32_t* hourlyPills, int numberOfHours,
+                                                 const uint32_t* dailyPills, int numberOfDays) {
+        if (isResponseWanted()) {
+            String response;
+            response.reserve(96 + (numberOfHours + numberOfDays) * 3);
+            response = "{status:OK, pills:" + String((unsigned long long)totalPills) + 
+                       ", req:" + String((unsigned long long)totalRequests) + 
+                       ", fail:" + String((unsigned long long)failedRequests) + 
+                       ", retry:" + String((unsigned long long)totalRetries) + ", h:[";
+            appendRunLengthEncodedList(response, hourlyPills, numberOfHours);
+            response += "], d:[";
+            appendRunLengthEncodedList(response, dailyPills, numberOfDays);
             response += "]}";
-            commandCharacteristic->setValue(response.c_str());
-            commandCharacteristic->notify();
+            deliverResponse(response);
+        }
+    }
+    
+    void sendSimulationSummaryToConnectedDevice(float sustainedDosesPerHour, 
+                                                unsigned long medianLatencyMilliseconds,
+                                                unsigned long tailLatencyMilliseconds,
+                                                int droppedDoseCount) {
+        if (isResponseWanted()) {
+            String response = "{status:OK, dosesPerHour:" + String(sustainedDosesPerHour, 1) + 
+                            ", p50:" + String(medianLatencyMilliseconds) + 
+                            ", p99:" + String(tailLatencyMilliseconds) +
+                            ", dropped:" + String(droppedDoseCount) + "}";
+            deliverResponse(response);
         }
     }
     
     /**
-     * Parse incoming BLE command string
-     * @param commandString Raw command string from BLE
+     * Send one configuration field
+     * @param fieldId Field id
+     * @param fieldName Field name
+     * @param value Formatted value
      */
-    void parseBLECommandAndExtractParameters(String commandString) {
-        mostRecentCommandReceived = BLECommand();
+    void sendConfigurationFieldToConnectedDevice(int fieldId, const char* fieldName, String value) {
+        if (isResponseWanted()) {
+            String response = "{status:OK, id:" + String(fieldId) + 
+                            ", name:" + String(fieldName) + 
+                            ", value:" + value + "}";
+            deliverResponse(response);
+        }
+    }
+    
+    /**
+     * Report a scheduled dose (dispensed, late, missed or failed)
+     * @param slot Schedule slot
+     * @param outcome Outcome name
+     * @param successCount Pills dispensed
+     * @param requestedCount Pills scheduled
+     */
+    void sendScheduledDoseOutcomeToConnectedDevice(int slot, const char* outcome, 
+                                                   int successCount, int requestedCount) {
+        if (isResponseWanted()) {
+            String response = "{status:OK, schedule:" + String(slot) + 
+                            ", outcome:" + String(outcome) + 
+                            ", dispensed:" + String(successCount) + 
+                            ", requested:" + String(requestedCount) + "}";
+            deliverResponse(response);
+        }
+    }
+    
+    /**
+     * Notify that a compartment is running low
+     * @param compartmentNumber Compartment (1-based)
+     * @param remainingPills Pills left
+     * @param daysUntilEmpty Predicted days left, or -1 if unknown
+     */
+    void sendLowStockAlertToConnectedDevice(int compartmentNumber, int remainingPills, float daysUntilEmpty) {
+        if (isResponseWanted()) {
+            String response = "{status:LOW_STOCK, compartment:" + String(compartmentNumber) + 
+                            ", remaining:" + String(remainingPills) + 
+                            ", days:" + (daysUntilEmpty < 0 ? String("unknown") : String(daysUntilEmpty, 1)) + "}";
+            deliverResponse(response);
+        }
+    }
+    
+    /**
+     * Send memory alert notification to connected device
+     * @param alertFlags MemoryAlertFlag bits that were raised
+     * @param freeHeap Free heap in bytes
+     * @param largestFreeBlock Largest allocatable block in bytes
+     * @param lowestStackBytes Smallest stack headroom among the watched tasks
+     */
+    void sendMemoryAlertToConnectedDevice(uint8_t alertFlags, uint32_t freeHeap,
+                                          uint32_t largestFreeBlock, uint16_t lowestStackBytes) {
+        if (isResponseWanted()) {
+            String response = "{status:LOW_MEMORY, flags:" + String(alertFlags) + 
+                            ", free:" + String(freeHeap) + 
+                            ", largest:" + String(largestFreeBlock) + 
+                            ", stack:" + String(lowestStackBytes) + "}";
+            deliverResponse(response);
+        }
+    }
+    
+    /**
+     * Parse a command (BLE or Serial console syntax) into command
+     * ABORT also requests cancellation right here, from whichever task parses it.
+     * @param commandString Raw command string
+     * @param command Filled with the parsed command
+     * @return false if the command is unknown or malformed
+     */
+    bool parseCommandString(const String& commandString, BLECommand* command) {
+        *command = BLECommand();
+        bool isCommandValid = false;
         
         if (commandString.startsWith("DISPENSE:")) {
-            mostRecentCommandReceived.commandType = BLECommand::DISPENSE;
+            command->commandType = BLECommand::DISPENSE;
             
             int firstColonPosition = commandString.indexOf(':');
             int secondColonPosition = commandString.indexOf(':', firstColonPosition + 1);
@@ -178,33 +590,256 @@ public:
                 firstColonPosition + 1,
                 secondColonPosition > 0 ? secondColonPosition : commandString.length()
             );
-            mostRecentCommandReceived.compartmentNumber = compartmentString.toInt();
+            command->compartmentNumber = compartmentString.toInt();
             
             if (secondColonPosition > 0) {
                 String countString = commandString.substring(secondColonPosition + 1);
-                mostRecentCommandReceived.pillCount = countString.toInt();
-                if (mostRecentCommandReceived.pillCount < 1) {
-                    mostRecentCommandReceived.pillCount = 1;
+                command->pillCount = countString.toInt();
+                if (command->pillCount < 1) {
+                    command->pillCount = 1;
                 }
             }
             
-            hasNewCommandToProcess = true;
+            isCommandValid = true;
         }
         else if (commandString == "STATUS") {
-            mostRecentCommandReceived.commandType = BLECommand::STATUS;
-            hasNewCommandToProcess = true;
+            command->commandType = BLECommand::STATUS;
+            isCommandValid = true;
         }
         else if (commandString == "RESET") {
-            mostRecentCommandReceived.commandType = BLECommand::RESET;
-            hasNewCommandToProcess = true;
+            command->commandType = BLECommand::RESET;
+            isCommandValid = true;
         }
         else if (commandString == "HOME") {
-            mostRecentCommandReceived.commandType = BLECommand::HOME;
-            hasNewCommandToProcess = true;
+            command->commandType = BLECommand::HOME;
+            isCommandValid = true;
+        }
+        else if (commandString == "ABORT") {
+            command->commandType = BLECommand::ABORT;
+            if (cancellationToken != nullptr) {
+                cancellationToken->requestCancellation();
+            }
+            isCommandValid = true;
+        }
+        else if (commandString.startsWith("SIMULATE")) {
+            // SIMULATE[:<doses>[:<dosesPerHour>]]
+            command->commandType = BLECommand::SIMULATE;
+            
+            int firstColonPosition = commandString.indexOf(':');
+            if (firstColonPosition > 0) {
+                int secondColonPosition = commandString.indexOf(':', firstColonPosition + 1);
+                String doseCountString = commandString.substring(
+                    firstColonPosition + 1,
+                    secondColonPosition > 0 ? secondColonPosition : commandString.length()
+                );
+                if (doseCountString.toInt() > 0) {
+                    command->simulatedDoseCount = doseCountString.toInt();
+                }
+                if (secondColonPosition > 0) {
+                    String rateString = commandString.substring(secondColonPosition + 1);
+                    if (rateString.toInt() > 0) {
+                        command->simulatedDosesPerHour = rateString.toInt();
+                    }
+                }
+            }
+            
+            isCommandValid = true;
         }
-        else {
+        else if (commandString.startsWith("CONFIG:")) {
+            // CONFIG:GET:<id> | CONFIG:SET:<id>:<value> | CONFIG:LIST | CONFIG:RESET
+            command->commandType = BLECommand::CONFIG;
+            String arguments = commandString.substring(7);
+            
+            if (arguments == "LIST") {
+                command->configAction = BLECommand::CONFIG_LIST;
+                isCommandValid = true;
+            }
+            else if (arguments == "RESET") {
+                command->configAction = BLECommand::CONFIG_RESET;
+                isCommandValid = true;
+            }
+            else if (arguments.startsWith("GET:")) {
+                command->configAction = BLECommand::CONFIG_GET;
+                command->configFieldId = arguments.substring(4).toInt();
+                isCommandValid = true;
+            }
+            else if (arguments.startsWith("SET:")) {
+                int valueColonPosition = arguments.indexOf(':', 4);
+                if (valueColonPosition > 0) {
+                    command->configAction = BLECommand::CONFIG_SET;
+                    command->configFieldId = arguments.substring(4, valueColonPosition).toInt();
+                    command->configValue = arguments.substring(valueColonPosition + 1).toFloat();
+                    isCommandValid = true;
+                }
+            }
+        }
+        else if (commandString == "BENCH") {
+            command->commandType = BLECommand::BENCHMARK;
+            isCommandValid = true;
+        }
+        else if (commandString == "POWER") {
+            command->commandType = BLECommand::POWER;
+            isCommandValid = true;
+        }
+        else if (commandString == "STATS") {
+            command->commandType = BLECommand::STATS;
+            isCommandValid = true;
+        }
+        else if (commandString == "MEMORY" || commandString == "MEMORY:DUMP") {
+            command->commandType = BLECommand::MEMORY;
+            command->memoryAction = (commandString == "MEMORY:DUMP")
+                ? BLECommand::MEMORY_DUMP : BLECommand::MEMORY_SUMMARY;
+            isCommandValid = true;
+        }
+        else if (commandString.startsWith("TIME:")) {
+            // TIME:<utcEpochSeconds>[:<utcOffsetMinutes>]
+            command->commandType = BLECommand::TIME_SYNC;
+            command->timeEpochSeconds = 
+                strtoul(getColonSeparatedField(commandString, 1).c_str(), NULL, 10);
+            command->utcOffsetMinutes = getColonSeparatedField(commandString, 2).toInt();
+            isCommandValid = true;
+        }
+        else if (commandString.startsWith("ENDURANCE")) {
+            // ENDURANCE[:<rounds>[:<compartments, e.g. 1,3,5>[:<pauseMs>]]] | ENDURANCE:STOP | ENDURANCE:DUMP
+            command->commandType = BLECommand::ENDURANCE;
+            String firstArgument = getColonSeparatedField(commandString, 1);
+            
+            if (firstArgument == "STOP") {
+                command->enduranceAction = BLECommand::ENDURANCE_STOP;
+            }
+            else if (firstArgument == "DUMP") {
+                command->enduranceAction = BLECommand::ENDURANCE_DUMP;
+            }
+            else {
+                command->enduranceAction = BLECommand::ENDURANCE_START;
+                if (firstArgument.toInt() > 0) {
+                    command->enduranceRoundCount = firstArgument.toInt();
+                }
+                
+                String compartmentList = getColonSeparatedField(commandString, 2);
+                int start = 0;
+                while (start < (int)compartmentList.length()) {
+                    int comma = compartmentList.indexOf(',', start);
+                    int compartmentNumber = compartmentList.substring(
+                        start, comma < 0 ? compartmentList.length() : comma).toInt();
+                    if (compartmentNumber >= 1 && compartmentNumber <= 32) {
+                        command->enduranceCompartmentMask |= 1UL << (compartmentNumber - 1);
+                    }
+                    if (comma < 0) break;
+                    start = comma + 1;
+                }
+                
+                String pauseString = getColonSeparatedField(commandString, 3);
+                if (pauseString.length() > 0) {
+                    command->endurancePauseMilliseconds = pauseString.toInt();
+                }
+            }
+            isCommandValid = true;
+        }
+        else if (commandString.startsWith("STOCK")) {
+            // STOCK | STOCK:<compartment>:<pills> (pills -1 stops tracking)
+            command->commandType = BLECommand::STOCK;
+            if (getColonSeparatedField(commandString, 2).length() > 0) {
+                command->stockAction = BLECommand::STOCK_SET;
+                command->compartmentNumber = getColonSeparatedField(commandString, 1).toInt();
+                command->pillCount = getColonSeparatedField(commandString, 2).toInt();
+            }
+            isCommandValid = true;
+        }
+        else if (commandString.startsWith("SCHEDULE:")) {
+            // SCHEDULE:SET:<slot>:<minuteOfDay>:<compartment>:<pills>[:<policy>]
+            // SCHEDULE:DEL:<slot> | SCHEDULE:LIST | SCHEDULE:CLEAR
+            command->commandType = BLECommand::SCHEDULE;
+            String action = getColonSeparatedField(commandString, 1);
+            
+            if (action == "LIST") {
+                command->scheduleAction = BLECommand::SCHEDULE_LIST;
+                isCommandValid = true;
+            }
+            else if (action == "CLEAR") {
+                command->scheduleAction = BLECommand::SCHEDULE_CLEAR;
+                isCommandValid = true;
+            }
+            else if (action == "DEL") {
+                command->scheduleAction = BLECommand::SCHEDULE_DELETE;
+                command->scheduleSlot = getColonSeparatedField(commandString, 2).toInt();
+                isCommandValid = true;
+            }
+            else if (action == "SET" && getColonSeparatedField(commandString, 5).length() > 0) {
+                command->scheduleAction = BLECommand::SCHEDULE_SET;
+                command->scheduleSlot = getColonSeparatedField(commandString, 2).toInt();
+                command->scheduleMinuteOfDay = getColonSeparatedField(commandString, 3).toInt();
+                command->compartmentNumber = getColonSeparatedField(commandString, 4).toInt();
+                command->pillCount = getColonSeparatedField(commandString, 5).toInt();
+                command->missedDosePolicy = getColonSeparatedField(commandString, 6).toInt();
+                isCommandValid = true;
+            }
+        }
+        else if (commandString.startsWith("OPTIMIZE")) {
+            // OPTIMIZE[:<iterations>[:<targetSuccessPercent>]]
+            command->commandType = BLECommand::OPTIMIZE;
+            
+            int firstColonPosition = commandString.indexOf(':');
+            if (firstColonPosition > 0) {
+                int secondColonPosition = commandString.indexOf(':', firstColonPosition + 1);
+                String iterationString = commandString.substring(
+                    firstColonPosition + 1,
+                    secondColonPosition > 0 ? secondColonPosition : commandString.length()
+                );
+                if (iterationString.toInt() > 0) {
+                    command->optimizerIterationCount = iterationString.toInt();
+                }
+                if (secondColonPosition > 0) {
+                    int targetPercent = commandString.substring(secondColonPosition + 1).toInt();
+                    if (targetPercent > 0 && targetPercent <= 100) {
+                        command->optimizerTargetSuccessPercent = targetPercent;
+                    }
+                }
+            }
+            
+            isCommandValid = true;
+        }
+        else if (commandString.startsWith("TRACE:")) {
+            String action = commandString.substring(6);
+            command->commandType = BLECommand::TRACE;
+            
+            if (action == "RECORD") {
+                command->traceAction = BLECommand::TRACE_RECORD;
+            } else if (action == "REPLAY") {
+                command->traceAction = BLECommand::TRACE_REPLAY;
+            } else if (action == "DUMP") {
+                command->traceAction = BLECommand::TRACE_DUMP;
+            } else if (action.startsWith("LOAD:")) {
+                // TRACE:LOAD:<offset>:<hex>, one TRACE:DUMP line per chunk
+                command->traceAction = BLECommand::TRACE_LOAD;
+                String offsetText = getColonSeparatedField(commandString, 2);
+                command->traceChunkLength = decodeHexChunk(
+                    getColonSeparatedField(commandString, 3),
+                    command->traceChunkBytes, SENSOR_TRACE_LOAD_CHUNK_BYTES);
+                command->traceChunkOffset =
+                    (offsetText.length() > 0 && command->traceChunkLength >= 0) ?
+                    offsetText.toInt() : -1;
+            } else {
+                command->traceAction = BLECommand::TRACE_STOP;
+            }
+            
+            isCommandValid = true;
+        }
+        return isCommandValid;
+    }
+    
+    /**
+     * Parse a command received over BLE and queue it (BLE task)
+     * Errors go back over BLE only: the reply redirect belongs to the main loop.
+     * @param commandString Raw command string from BLE
+     */
+    void parseBLECommandAndExtractParameters(String commandString) {
+        BLECommand command;
+        if (!parseCommandString(commandString, &command)) {
             Serial.println("ERROR: Unknown BLE command");
-            sendErrorResponseToConnectedDevice("Unknown command: " + commandString);
+            sendErrorResponseOverBLE("Unknown command: " + commandString);
+        } else if (!enqueueCommand(command)) {
+            sendErrorResponseOverBLE("Busy, command dropped: " + commandString);
         }
     }
 };
@@ -250,11 +885,16 @@ class BLECharacteristicWriteCallbacks: public BLECharacteristicCallbacks {
 /**
  * Initialize BLE server (implementation must be after callback class definitions)
  */
+// Static: the BLE stack keeps these for the life of the server
+BLEConnectionCallbacks bleConnectionCallbacks;
+BLECharacteristicWriteCallbacks bleCharacteristicWriteCallbacks;
+BLE2902 bleClientCharacteristicConfigurationDescriptor;
+
 void BLEManager::initializeBluetoothLEServer() {
     BLEDevice::init(BLE_DEVICE_NAME);
     
     bluetoothLEServer = BLEDevice::createServer();
-    bluetoothLEServer->setCallbacks(new BLEConnectionCallbacks());
+    bluetoothLEServer->setCallbacks(&bleConnectionCallbacks);
     
     BLEService* pillDispenserService = bluetoothLEServer->createService(BLE_SERVICE_UUID);
     
@@ -265,8 +905,8 @@ void BLEManager::initializeBluetoothLEServer() {
         BLECharacteristic::PROPERTY_NOTIFY
     );
     
-    commandCharacteristic->setCallbacks(new BLECharacteristicWriteCallbacks());
-    commandCharacteristic->addDescriptor(new BLE2902());
+    commandCharacteristic->setCallbacks(&bleCharacteristicWriteCallbacks);
+    commandCharacteristic->addDescriptor(&bleClientCharacteristicConfigurationDescriptor);
     
     pillDispenserService->start();
     
@@ -0,0 +1,57 @@
+#ifndef CANCELLATION_TOKEN_H
+#define CANCELLATION_TOKEN_H
+
+#include <Arduino.h>
+
+/**
+ * CancellationToken Class
+ *
+ * Abort request shared by the BLE task, the BACK button interrupt and the
+ * blocking operations in HardwareController and DispenserController, which
+ * poll it at safe points (between steps, servo writes and wait slices).
+ *
+ * Requests only count while an operation is armed, so an ABORT sent while
+ * idle cannot cancel the next job. The request stays set after disarm() so
+ * the caller can still see that the operation was cancelled.
+ */
+class CancellationToken {
+private:
+    volatile bool isArmed;
+    volatile bool isRequested;
+
+public:
+    CancellationToken() {
+        isArmed = false;
+        isRequested = false;
+    }
+
+    /**
+     * Start accepting abort requests for a new operation
+     */
+    void armForOperation() {
+        isRequested = false;
+        isArmed = true;
+    }
+
+    void disarm() {
+        isArmed = false;
+    }
+
+    /**
+     * Request an abort (safe to call from an ISR or the BLE task)
+     * @return true if an operation was running to be cancelled
+     */
+    bool requestCancellation() {
+        if (!isArmed) {
+            return false;
+        }
+        isRequested = true;
+        return true;
+    }
+
+    bool isCancellationRequested() const {
+        return isRequested;
+    }
+};
+
+#endif // CANCELLATION_TOKEN_H
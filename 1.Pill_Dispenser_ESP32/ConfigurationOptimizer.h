@@ -0,0 +1,276 @@
+#ifndef CONFIGURATION_OPTIMIZER_H
+#define CONFIGURATION_OPTIMIZER_H
+
+#include <stdint.h>
+#include "ConfigurationSettings.h"
+#include "DispenseSimulator.h"
+
+/**
+ * One SystemConfiguration timing field the optimizer may change
+ */
+struct TunableTimingParameter {
+    const char* fieldName;
+    int SystemConfiguration::* field;
+    int minimumValue;
+    int maximumValue;
+};
+
+/**
+ * Search space: timing fields that only cost time, with bounds that keep the
+ * hardware within its rated limits. Stepper pulse width is bounded further by
+ * stepperMin/MaxStepPulseWidthMicroseconds at run time.
+ */
+static const TunableTimingParameter TUNABLE_TIMING_PARAMETERS[] = {
+    {"stepperStepPulseWidthMicroseconds",           &SystemConfiguration::stepperStepPulseWidthMicroseconds,           0,   50000},
+    {"servoStepMicroseconds",                       &SystemConfiguration::servoStepMicroseconds,                       10,  200},
+    {"servoMovementDelayMilliseconds",              &SystemConfiguration::servoMovementDelayMilliseconds,              0,   1000},
+    {"pillDetectionTimeoutMilliseconds",            &SystemConfiguration::pillDetectionTimeoutMilliseconds,            200, 3000},
+    {"pillDetectionCheckIntervalMilliseconds",      &SystemConfiguration::pillDetectionCheckIntervalMilliseconds,      1,   50},
+    {"electromagnetActivationDelayMilliseconds",    &SystemConfiguration::electromagnetActivationDelayMilliseconds,    0,   500},
+    {"electromagnetDeactivationDelayMilliseconds",  &SystemConfiguration::electromagnetDeactivationDelayMilliseconds,  0,   500},
+    {"delayAfterHomingSwitchActivationMilliseconds",&SystemConfiguration::delayAfterHomingSwitchActivationMilliseconds,0,   500},
+    {"delayBetweenDispenseAttemptsMilliseconds",    &SystemConfiguration::delayBetweenDispenseAttemptsMilliseconds,    0,   3000},
+    {"delayBetweenMultipleDispensesMilliseconds",   &SystemConfiguration::delayBetweenMultipleDispensesMilliseconds,   0,   2000},
+    {"delayAfterCompartmentMoveMilliseconds",       &SystemConfiguration::delayAfterCompartmentMoveMilliseconds,       0,   1000},
+};
+
+#define NUMBER_OF_TUNABLE_TIMING_PARAMETERS \
+    (int)(sizeof(TUNABLE_TIMING_PARAMETERS) / sizeof(TUNABLE_TIMING_PARAMETERS[0]))
+
+/**
+ * ConfigurationOptimizer Class
+ *
+ * Monte Carlo search over SystemConfiguration timings against the
+ * DispenseSimulator model. Minimizes mean dose service time subject to a
+ * target pill success rate. Every candidate is evaluated on the same random
+ * seed (common random numbers) so differences come from the settings, not
+ * from noise.
+ *
+ * Search: (1+1) evolution strategy - each iteration either perturbs a few
+ * fields of the best feasible profile or, occasionally, samples every field
+ * uniformly to escape local minima.
+ */
+class ConfigurationOptimizer {
+private:
+    SystemConfiguration baselineConfiguration;
+    SystemConfiguration bestConfiguration;
+    SystemConfiguration candidateConfiguration;
+    DispenseSimulator simulator;
+    uint32_t randomState;
+
+    float targetSuccessRate;
+    int dosesPerEvaluation;
+    uint32_t evaluationSeed;
+
+    float baselineMeanServiceMilliseconds;
+    float baselineSuccessRate;
+    float bestMeanServiceMilliseconds;
+    float bestSuccessRate;
+    int evaluatedCandidateCount;
+    int feasibleCandidateCount;
+
+    uint32_t nextRandom() {
+        randomState ^= randomState << 13;
+        randomState ^= randomState >> 17;
+        randomState ^= randomState << 5;
+        return randomState;
+    }
+
+    int randomIntegerInRange(int minimum, int maximum) {
+        if (maximum <= minimum) {
+            return minimum;
+        }
+        return minimum + (int)(nextRandom() % (uint32_t)(maximum - minimum + 1));
+    }
+
+    void getParameterBounds(int index, int* minimum, int* maximum) {
+        *minimum = TUNABLE_TIMING_PARAMETERS[index].minimumValue;
+        *maximum = TUNABLE_TIMING_PARAMETERS[index].maximumValue;
+        if (TUNABLE_TIMING_PARAMETERS[index].field == &SystemConfiguration::stepperStepPulseWidthMicroseconds) {
+            *minimum = baselineConfiguration.stepperMinStepPulseWidthMicroseconds;
+            *maximum = baselineConfiguration.stepperMaxStepPulseWidthMicroseconds;
+        }
+    }
+
+    /**
+     * Simulate a profile
+     * @return Mean service time in ms; success rate via pointer
+     */
+    float evaluateConfiguration(const SystemConfiguration& configuration, float* successRate) {
+        candidateConfiguration = configuration;
+        simulator.setRandomSeed(evaluationSeed);
+        // Sparse arrivals: no queueing, so busy time per dose is pure service time
+        simulator.configureSyntheticDoseSchedule(dosesPerEvaluation, 1, 1);
+        simulator.runSimulation();
+        *successRate = simulator.getPillSuccessRate();
+        evaluatedCandidateCount++;
+        return simulator.getMeanServiceMilliseconds();
+    }
+
+    void perturbBestIntoCandidate(SystemConfiguration* candidate, bool sampleUniformly) {
+        *candidate = bestConfiguration;
+        bool changedAny = false;
+
+        while (!changedAny) {
+            for (int i = 0; i < NUMBER_OF_TUNABLE_TIMING_PARAMETERS; i++) {
+                int minimum;
+                int maximum;
+                getParameterBounds(i, &minimum, &maximum);
+                int SystemConfiguration::* field = TUNABLE_TIMING_PARAMETERS[i].field;
+
+                if (sampleUniformly) {
+                    candidate->*field = randomIntegerInRange(minimum, maximum);
+                    changedAny = true;
+                } else if ((nextRandom() % 4) == 0) {
+                    // Step of up to a quarter of the range in either direction
+                    int span = (maximum - minimum) / 4 + 1;
+                    int value = candidate->*field + randomIntegerInRange(-span, span);
+                    candidate->*field = (value < minimum) ? minimum : (value > maximum) ? maximum : value;
+                    changedAny = true;
+                }
+            }
+        }
+    }
+
+public:
+    /**
+     * Constructor
+     * @param config Configuration to start from (not modified)
+     */
+    ConfigurationOptimizer(const SystemConfiguration* config)
+        : baselineConfiguration(*config),
+          bestConfiguration(*config),
+          candidateConfiguration(*config),
+          simulator(&candidateConfiguration) {
+        randomState = 0x9E3779B9;
+        targetSuccessRate = 0.99;
+        dosesPerEvaluation = 200;
+        evaluationSeed = 12345;
+        baselineMeanServiceMilliseconds = 0;
+        baselineSuccessRate = 0;
+        bestMeanServiceMilliseconds = 0;
+        bestSuccessRate = 0;
+        evaluatedCandidateCount = 0;
+        feasibleCandidateCount = 0;
+    }
+
+    DispenserBehaviourModel& getBehaviourModel() {
+        return simulator.getBehaviourModel();
+    }
+
+    /**
+     * @param successRate Minimum acceptable fraction of pills detected (0-1)
+     */
+    void setTargetSuccessRate(float successRate) {
+        targetSuccessRate = successRate;
+    }
+
+    void setDosesPerEvaluation(int doses) {
+        dosesPerEvaluation = (doses > 0) ? doses : 1;
+    }
+
+    /**
+     * Run the search
+     * @param iterations Candidate profiles to evaluate
+     * @return true if a feasible profile was found (the baseline counts if it meets the target)
+     */
+    bool optimize(int iterations) {
+        evaluatedCandidateCount = 0;
+        feasibleCandidateCount = 0;
+        bestConfiguration = baselineConfiguration;
+
+        baselineMeanServiceMilliseconds = evaluateConfiguration(baselineConfiguration, &baselineSuccessRate);
+        bestMeanServiceMilliseconds = baselineMeanServiceMilliseconds;
+        bestSuccessRate = baselineSuccessRate;
+        bool haveFeasibleBest = baselineSuccessRate >= targetSuccessRate;
+        if (haveFeasibleBest) {
+            feasibleCandidateCount++;
+        }
+
+        SystemConfiguration candidate;
+        for (int iteration = 0; iteration < iterations; iteration++) {
+            bool sampleUniformly = (nextRandom() % 5) == 0;
+            perturbBestIntoCandidate(&candidate, sampleUniformly);
+
+            float successRate;
+            float meanServiceMilliseconds = evaluateConfiguration(candidate, &successRate);
+            bool isFeasible = successRate >= targetSuccessRate;
+            if (isFeasible) {
+                feasibleCandidateCount++;
+            }
+
+            // Feasible and faster wins; before any feasible profile, chase success rate
+            bool isBetter = haveFeasibleBest
+                ? (isFeasible && meanServiceMilliseconds < bestMeanServiceMilliseconds)
+                : (successRate > bestSuccessRate);
+            if (isBetter) {
+                bestConfiguration = candidate;
+                bestMeanServiceMilliseconds = meanServiceMilliseconds;
+                bestSuccessRate = successRate;
+                haveFeasibleBest = haveFeasibleBest || isFeasible;
+            }
+        }
+
+        return haveFeasibleBest;
+    }
+
+    const SystemConfiguration& getBestConfiguration() {
+        return bestConfiguration;
+    }
+
+    float getBaselineMeanServiceMilliseconds() { return baselineMeanServiceMilliseconds; }
+    float getBestMeanServiceMilliseconds() { return bestMeanServiceMilliseconds; }
+
+    /**
+     * Predicted speedup of the best profile over the baseline (e.g. 1.8 = 1.8x faster)
+     */
+    float getPredictedSpeedup() {
+        return (bestMeanServiceMilliseconds > 0) ? baselineMeanServiceMilliseconds / bestMeanServiceMilliseconds : 0;
+    }
+
+    /**
+     * Print the search report and the best profile as ConfigurationSettings.h lines
+     */
+    template <typename Output>
+    void printOptimizationReport(Output& out) {
+        out.println("OPTIMIZATION RESULTS:");
+        out.print("Candidates evaluated: ");
+        out.print(evaluatedCandidateCount);
+        out.print(" (feasible ");
+        out.print(feasibleCandidateCount);
+        out.println(")");
+        out.print("Target success rate: ");
+        out.print(targetSuccessRate * 100.0);
+        out.println(" %");
+        out.print("Baseline: ");
+        out.print(baselineMeanServiceMilliseconds);
+        out.print(" ms/dose, ");
+        out.print(baselineSuccessRate * 100.0);
+        out.println(" % success");
+        out.print("Best:     ");
+        out.print(bestMeanServiceMilliseconds);
+        out.print(" ms/dose, ");
+        out.print(bestSuccessRate * 100.0);
+        out.println(" % success");
+        out.print("Predicted speedup: ");
+        out.print(getPredictedSpeedup());
+        out.println("x");
+
+        out.println("Profile (paste into ConfigurationSettings.h):");
+        for (int i = 0; i < NUMBER_OF_TUNABLE_TIMING_PARAMETERS; i++) {
+            int SystemConfiguration::* field = TUNABLE_TIMING_PARAMETERS[i].field;
+            out.print("    int ");
+            out.print(TUNABLE_TIMING_PARAMETERS[i].fieldName);
+            out.print(" = ");
+            out.print(bestConfiguration.*field);
+            out.print(";");
+            if (bestConfiguration.*field != baselineConfiguration.*field) {
+                out.print("    // was ");
+                out.print(baselineConfiguration.*field);
+            }
+            out.println();
+        }
+    }
+};
+
+#endif // CONFIGURATION_OPTIMIZER_H
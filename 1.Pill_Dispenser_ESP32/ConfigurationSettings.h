@@ -1,6 +1,30 @@
 #ifndef CONFIGURATION_SETTINGS_H
 #define CONFIGURATION_SETTINGS_H
 
+// ============================================================================
+// Carousel Size
+// ============================================================================
+// Compartment count is fixed at compile time: it sizes every per-compartment
+// array. When changing it, also define CONTAINER_POSITIONS_IN_DEGREES with one
+// angle per compartment (build flags or above this point).
+#ifndef NUMBER_OF_COMPARTMENTS_IN_DISPENSER
+#define NUMBER_OF_COMPARTMENTS_IN_DISPENSER 5
+#endif
+
+#ifndef CONTAINER_POSITIONS_IN_DEGREES
+#if NUMBER_OF_COMPARTMENTS_IN_DISPENSER == 5
+#define CONTAINER_POSITIONS_IN_DEGREES { 0.0, 65.0, 144.0, 216.0, 288.0 }
+#else
+#error "Define CONTAINER_POSITIONS_IN_DEGREES with one angle per compartment"
+#endif
+#endif
+
+// A short position list would silently leave compartments at 0 degrees
+static constexpr float DEFAULT_CONTAINER_POSITIONS_IN_DEGREES[] = CONTAINER_POSITIONS_IN_DEGREES;
+static_assert(sizeof(DEFAULT_CONTAINER_POSITIONS_IN_DEGREES) / sizeof(DEFAULT_CONTAINER_POSITIONS_IN_DEGREES[0]) ==
+              NUMBER_OF_COMPARTMENTS_IN_DISPENSER,
+              "CONTAINER_POSITIONS_IN_DEGREES needs one angle per compartment");
+
 /**
  * SystemConfiguration Structure
  * 
@@ -29,6 +53,11 @@ struct SystemConfiguration {
     int servoStepDelayMilliseconds = 1;
     
     int servoMovementDelayMilliseconds = 500;  // Wait time after servo movement completes
+    int servoSlewMicrosecondsPerSecond = 5000; // Modeled horn speed; waits shrink to the model (0 = fixed waits)
+    int servoSettleMilliseconds = 100;         // Modeled settle time once the horn reaches the setpoint
+    int servoIdleDetachMilliseconds = 3000;    // Stop pulsing a still servo after this long (0 = stay attached)
+    bool enableSweepRangeLearning = true;      // End each compartment's sweep past where its pills release
+    int sweepLearningMarginMicroseconds = 200; // Sweep this far past the learned release; widened by as much per miss
     
     // ========================================================================
     // Pill Detection Settings
@@ -57,15 +86,9 @@ struct SystemConfiguration {
     // Dispenser Mechanical Settings
     // ========================================================================
     int maximumDispenseAttempts = 3;                   // Retry attempts if pill not detected
-    int numberOfCompartmentsInDispenser = 5;           // Total compartments in rotary dispenser
+    static constexpr int numberOfCompartmentsInDispenser = NUMBER_OF_COMPARTMENTS_IN_DISPENSER;
 
-	float containerPositionsInDegrees[5] = {
-		0.0,
-		65.0,
-		144.0,
-		216.0,
-		288.0
-	};
+	float containerPositionsInDegrees[NUMBER_OF_COMPARTMENTS_IN_DISPENSER] = CONTAINER_POSITIONS_IN_DEGREES;
     
     // ========================================================================
     // Homing Sequence Settings
@@ -96,6 +119,33 @@ struct SystemConfiguration {
     int errorMessageDisplayTimeMilliseconds = 1500;            // How long to show "Failed!" message
     int statusMessageDisplayTimeMilliseconds = 1000;           // General status message duration
     
+    // ========================================================================
+    // Power Management Settings
+    // ========================================================================
+    bool enableLightSleepWhenIdle = true;                      // Light sleep between events when nothing is pending
+    int idleTimeBeforeSleepMilliseconds = 5000;                // Stay awake this long after the last activity
+    int maximumLightSleepMilliseconds = 1000;                  // Longest sleep slice (bounds BLE discovery latency)
+    int awakeWindowAfterWakeMilliseconds = 100;                // Time awake after each wake (advertising, debounce)
+    
+    // ========================================================================
+    // Dose Schedule Settings
+    // ========================================================================
+    int missedDoseGraceMinutes = 60;                           // A late dose is still dispensed within this window
+    int onTimeDoseToleranceMinutes = 2;                        // Later than this counts as late
+    bool enableDosePrepositioning = true;                      // Home and park at the next dose's compartment early
+    int dosePrepositionLeadSeconds = 60;                       // How long before the dose to move there
+    bool preEnergizeElectromagnetBeforeDose = true;            // Magnet on just before the dose (stabilization done)
+    int lowStockPillThreshold = 5;                             // Tracked compartment at or below this is low
+    int lowStockWarningDays = 3;                               // Predicted to run out within this many days is low
+    
+    // ========================================================================
+    // Memory Telemetry Settings
+    // ========================================================================
+    int memoryTelemetryIntervalSeconds = 300;                  // Time between heap/stack snapshots
+    int lowFreeHeapAlertBytes = 20000;                         // Alert when free heap drops below this
+    int lowLargestFreeBlockAlertBytes = 8000;                  // Alert when the largest free block drops below this
+    int lowStackAlertBytes = 512;                              // Alert when a watched task has less stack left
+    
     // ========================================================================
     // BLE Communication Settings
     // ========================================================================
@@ -104,5 +154,95 @@ struct SystemConfiguration {
     int bleMaximumConnectionIntervalPreference = 0x12;         // BLE connection interval (units of 1.25ms)
 };
 
+/**
+ * FixedSystemConfiguration Structure
+ * 
+ * Compile-time copy of the SystemConfiguration defaults above. Every field is
+ * static constexpr, so controllers instantiated on this type fold the values
+ * into their loops and conversions instead of reading them through a pointer.
+ * Edit the defaults in SystemConfiguration; this copy follows automatically.
+ */
+struct FixedSystemConfiguration {
+    static constexpr int   stepperStepsPerRevolution                    = SystemConfiguration().stepperStepsPerRevolution;
+    static constexpr int   stepperMicrostepping                         = SystemConfiguration().stepperMicrostepping;
+    static constexpr float stepperGearRatio                             = SystemConfiguration().stepperGearRatio;
+    static constexpr int   stepperStepPulseWidthMicroseconds            = SystemConfiguration().stepperStepPulseWidthMicroseconds;
+    static constexpr int   stepperHomingStepDelayMicroseconds           = SystemConfiguration().stepperHomingStepDelayMicroseconds;
+    static constexpr int   stepperRunningStepDelayMicroseconds          = SystemConfiguration().stepperRunningStepDelayMicroseconds;
+    static constexpr int   stepperMinStepPulseWidthMicroseconds         = SystemConfiguration().stepperMinStepPulseWidthMicroseconds;
+    static constexpr int   stepperMaxStepPulseWidthMicroseconds         = SystemConfiguration().stepperMaxStepPulseWidthMicroseconds;
+    static constexpr int   servoMinMicroseconds                         = SystemConfiguration().servoMinMicroseconds;
+    static constexpr int   servoMaxMicroseconds                         = SystemConfiguration().servoMaxMicroseconds;
+    static constexpr int   servoEndMarginMicroseconds                   = SystemConfiguration().servoEndMarginMicroseconds;
+    static constexpr int   servoStepMicroseconds                        = SystemConfiguration().servoStepMicroseconds;
+    static constexpr int   servoStepDelayMilliseconds                   = SystemConfiguration().servoStepDelayMilliseconds;
+    static constexpr int   servoMovementDelayMilliseconds               = SystemConfiguration().servoMovementDelayMilliseconds;
+    static constexpr int   servoSlewMicrosecondsPerSecond               = SystemConfiguration().servoSlewMicrosecondsPerSecond;
+    static constexpr int   servoSettleMilliseconds                      = SystemConfiguration().servoSettleMilliseconds;
+    static constexpr int   servoIdleDetachMilliseconds                  = SystemConfiguration().servoIdleDetachMilliseconds;
+    static constexpr bool  enableSweepRangeLearning                     = SystemConfiguration().enableSweepRangeLearning;
+    static constexpr int   sweepLearningMarginMicroseconds              = SystemConfiguration().sweepLearningMarginMicroseconds;
+    static constexpr int   pillDetectionTimeoutMilliseconds             = SystemConfiguration().pillDetectionTimeoutMilliseconds;
+    static constexpr int   pillDetectionCheckIntervalMilliseconds       = SystemConfiguration().pillDetectionCheckIntervalMilliseconds;
+    static constexpr int   electromagnetActivationDelayMilliseconds     = SystemConfiguration().electromagnetActivationDelayMilliseconds;
+    static constexpr int   electromagnetDeactivationDelayMilliseconds   = SystemConfiguration().electromagnetDeactivationDelayMilliseconds;
+    static constexpr int   buttonDebounceDelayMilliseconds              = SystemConfiguration().buttonDebounceDelayMilliseconds;
+    static constexpr int   homingButtonDebounceMilliseconds             = SystemConfiguration().homingButtonDebounceMilliseconds;
+    static constexpr bool  autoHomeAfterDispense                        = SystemConfiguration().autoHomeAfterDispense;
+    static constexpr int   maximumDispenseAttempts                      = SystemConfiguration().maximumDispenseAttempts;
+    static constexpr int   numberOfCompartmentsInDispenser              = NUMBER_OF_COMPARTMENTS_IN_DISPENSER;
+    static constexpr float containerPositionsInDegrees[NUMBER_OF_COMPARTMENTS_IN_DISPENSER] = CONTAINER_POSITIONS_IN_DEGREES;
+    static constexpr int   delayAfterHomingSwitchActivationMilliseconds = SystemConfiguration().delayAfterHomingSwitchActivationMilliseconds;
+    static constexpr int   delayAfterHomingCompleteMilliseconds         = SystemConfiguration().delayAfterHomingCompleteMilliseconds;
+    static constexpr int   homingRetryAttempts                          = SystemConfiguration().homingRetryAttempts;
+    static constexpr int   homingDelayDecrementPerRetry                 = SystemConfiguration().homingDelayDecrementPerRetry;
+    static constexpr int   homingTimeoutIncrementPerRetry               = SystemConfiguration().homingTimeoutIncrementPerRetry;
+    static constexpr int   delayBetweenDispenseAttemptsMilliseconds     = SystemConfiguration().delayBetweenDispenseAttemptsMilliseconds;
+    static constexpr int   delayBetweenMultipleDispensesMilliseconds    = SystemConfiguration().delayBetweenMultipleDispensesMilliseconds;
+    static constexpr int   delayAfterCompartmentMoveMilliseconds        = SystemConfiguration().delayAfterCompartmentMoveMilliseconds;
+    static constexpr float encoderPositionMultiplierForCompartment      = SystemConfiguration().encoderPositionMultiplierForCompartment;
+    static constexpr int   successMessageDisplayTimeMilliseconds        = SystemConfiguration().successMessageDisplayTimeMilliseconds;
+    static constexpr int   errorMessageDisplayTimeMilliseconds          = SystemConfiguration().errorMessageDisplayTimeMilliseconds;
+    static constexpr int   statusMessageDisplayTimeMilliseconds         = SystemConfiguration().statusMessageDisplayTimeMilliseconds;
+    static constexpr bool  enableLightSleepWhenIdle                     = SystemConfiguration().enableLightSleepWhenIdle;
+    static constexpr int   idleTimeBeforeSleepMilliseconds              = SystemConfiguration().idleTimeBeforeSleepMilliseconds;
+    static constexpr int   maximumLightSleepMilliseconds                = SystemConfiguration().maximumLightSleepMilliseconds;
+    static constexpr int   awakeWindowAfterWakeMilliseconds             = SystemConfiguration().awakeWindowAfterWakeMilliseconds;
+    static constexpr int   missedDoseGraceMinutes                       = SystemConfiguration().missedDoseGraceMinutes;
+    static constexpr int   onTimeDoseToleranceMinutes                   = SystemConfiguration().onTimeDoseToleranceMinutes;
+    static constexpr bool  enableDosePrepositioning                     = SystemConfiguration().enableDosePrepositioning;
+    static constexpr int   dosePrepositionLeadSeconds                   = SystemConfiguration().dosePrepositionLeadSeconds;
+    static constexpr bool  preEnergizeElectromagnetBeforeDose           = SystemConfiguration().preEnergizeElectromagnetBeforeDose;
+    static constexpr int   lowStockPillThreshold                        = SystemConfiguration().lowStockPillThreshold;
+    static constexpr int   lowStockWarningDays                          = SystemConfiguration().lowStockWarningDays;
+    static constexpr int   memoryTelemetryIntervalSeconds               = SystemConfiguration().memoryTelemetryIntervalSeconds;
+    static constexpr int   lowFreeHeapAlertBytes                        = SystemConfiguration().lowFreeHeapAlertBytes;
+    static constexpr int   lowLargestFreeBlockAlertBytes                = SystemConfiguration().lowLargestFreeBlockAlertBytes;
+    static constexpr int   lowStackAlertBytes                           = SystemConfiguration().lowStackAlertBytes;
+    static constexpr int   bleReconnectionDelayMilliseconds             = SystemConfiguration().bleReconnectionDelayMilliseconds;
+    static constexpr int   bleMinimumConnectionIntervalPreference       = SystemConfiguration().bleMinimumConnectionIntervalPreference;
+    static constexpr int   bleMaximumConnectionIntervalPreference       = SystemConfiguration().bleMaximumConnectionIntervalPreference;
+};
+
+// Static members that may be odr-used need a definition (pre-C++17)
+constexpr int SystemConfiguration::numberOfCompartmentsInDispenser;
+constexpr int FixedSystemConfiguration::numberOfCompartmentsInDispenser;
+constexpr float FixedSystemConfiguration::containerPositionsInDegrees[NUMBER_OF_COMPARTMENTS_IN_DISPENSER];
+
+// ============================================================================
+// Controller Configuration Selection
+// ============================================================================
+// 0 = controllers read SystemConfiguration at run time (tunable over BLE)
+// 1 = controllers are specialized on FixedSystemConfiguration at compile time
+#ifndef USE_COMPILE_TIME_CONFIGURATION
+#define USE_COMPILE_TIME_CONFIGURATION 0
+#endif
+
+#if USE_COMPILE_TIME_CONFIGURATION
+typedef FixedSystemConfiguration ControllerConfiguration;
+#else
+typedef SystemConfiguration ControllerConfiguration;
+#endif
+
 #endif // CONFIGURATION_SETTINGS_H
 
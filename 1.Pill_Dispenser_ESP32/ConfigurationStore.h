@@ -0,0 +1,514 @@
+#ifndef CONFIGURATION_STORE_H
+#define CONFIGURATION_STORE_H
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include <stddef.h>
+#include <string.h>
+#include "ConfigurationSettings.h"
+#include "StoredRecordChecksum.h"
+
+// ============================================================================
+// Storage Format
+// ============================================================================
+// One NVS key per field ("f<id>"), so a change rewrites only that record.
+// Record: <format version> <field type> <CRC-16/CCITT> <value, 4 bytes>
+// Only fields changed from the compiled-in defaults are stored.
+#define CONFIGURATION_STORE_NAMESPACE               "sysconfig"
+#define CONFIGURATION_STORE_FORMAT_VERSION          2       // 2: shared CRC-32 based checksum
+#define CONFIGURATION_POSITION_FIELD_ID_BASE        64      // containerPositionsInDegrees[i] is field 64 + i
+
+enum ConfigurationFieldType {
+    CONFIGURATION_FIELD_INT,
+    CONFIGURATION_FIELD_FLOAT,
+    CONFIGURATION_FIELD_BOOL
+};
+
+enum ConfigurationUpdateResult {
+    CONFIGURATION_UPDATE_OK,
+    CONFIGURATION_UNKNOWN_FIELD,
+    CONFIGURATION_VALUE_OUT_OF_RANGE,
+    CONFIGURATION_INCONSISTENT_LIMITS,
+    CONFIGURATION_STORAGE_FAILED,
+    CONFIGURATION_FIXED_AT_COMPILE_TIME
+};
+
+inline const char* getConfigurationUpdateResultMessage(ConfigurationUpdateResult result) {
+    switch (result) {
+        case CONFIGURATION_UPDATE_OK:           return "OK";
+        case CONFIGURATION_UNKNOWN_FIELD:       return "Unknown field id";
+        case CONFIGURATION_VALUE_OUT_OF_RANGE:  return "Value out of range";
+        case CONFIGURATION_INCONSISTENT_LIMITS: return "Value conflicts with min/max limits";
+        case CONFIGURATION_STORAGE_FAILED:      return "Could not write to flash";
+        case CONFIGURATION_FIXED_AT_COMPILE_TIME: return "Fixed at compile time (USE_COMPILE_TIME_CONFIGURATION)";
+        default:                                return "Unknown error";
+    }
+}
+
+/**
+ * Describes one persisted SystemConfiguration field
+ * Field ids are part of the storage format: never renumber or reuse them.
+ */
+struct ConfigurationFieldDescriptor {
+    int fieldId;
+    const char* fieldName;
+    ConfigurationFieldType fieldType;
+    size_t fieldOffset;             // offsetof(SystemConfiguration, field)
+    float minimumValue;
+    float maximumValue;
+};
+
+#define CONFIGURATION_FIELD(id, type, field, minimum, maximum) \
+    {id, #field, type, offsetof(SystemConfiguration, field), minimum, maximum}
+
+static constexpr ConfigurationFieldDescriptor CONFIGURATION_FIELD_DESCRIPTORS[] = {
+    CONFIGURATION_FIELD(1,  CONFIGURATION_FIELD_INT,   stepperStepsPerRevolution,                    1,    10000),
+    CONFIGURATION_FIELD(2,  CONFIGURATION_FIELD_INT,   stepperMicrostepping,                         1,    256),
+    CONFIGURATION_FIELD(3,  CONFIGURATION_FIELD_FLOAT, stepperGearRatio,                             0.1,  100),
+    CONFIGURATION_FIELD(4,  CONFIGURATION_FIELD_INT,   stepperStepPulseWidthMicroseconds,            1,    100000),
+    CONFIGURATION_FIELD(5,  CONFIGURATION_FIELD_INT,   stepperHomingStepDelayMicroseconds,           2,    200000),
+    CONFIGURATION_FIELD(6,  CONFIGURATION_FIELD_INT,   stepperRunningStepDelayMicroseconds,          2,    200000),
+    CONFIGURATION_FIELD(7,  CONFIGURATION_FIELD_INT,   stepperMinStepPulseWidthMicroseconds,         1,    100000),
+    CONFIGURATION_FIELD(8,  CONFIGURATION_FIELD_INT,   stepperMaxStepPulseWidthMicroseconds,         1,    100000),
+    // 9-11 re-attach the servo when changed live (see isServoAttachLimitField)
+    CONFIGURATION_FIELD(9,  CONFIGURATION_FIELD_INT,   servoMinMicroseconds,                         100,  3000),
+    CONFIGURATION_FIELD(10, CONFIGURATION_FIELD_INT,   servoMaxMicroseconds,                         100,  3000),
+    CONFIGURATION_FIELD(11, CONFIGURATION_FIELD_INT,   servoEndMarginMicroseconds,                   0,    1000),
+    CONFIGURATION_FIELD(12, CONFIGURATION_FIELD_INT,   servoStepMicroseconds,                        1,    1000),
+    CONFIGURATION_FIELD(13, CONFIGURATION_FIELD_INT,   servoStepDelayMilliseconds,                   0,    100),
+    CONFIGURATION_FIELD(14, CONFIGURATION_FIELD_INT,   servoMovementDelayMilliseconds,               0,    10000),
+    CONFIGURATION_FIELD(15, CONFIGURATION_FIELD_INT,   pillDetectionTimeoutMilliseconds,             10,   30000),
+    CONFIGURATION_FIELD(16, CONFIGURATION_FIELD_INT,   pillDetectionCheckIntervalMilliseconds,       1,    1000),
+    CONFIGURATION_FIELD(17, CONFIGURATION_FIELD_INT,   electromagnetActivationDelayMilliseconds,     0,    10000),
+    CONFIGURATION_FIELD(18, CONFIGURATION_FIELD_INT,   electromagnetDeactivationDelayMilliseconds,   0,    10000),
+    CONFIGURATION_FIELD(19, CONFIGURATION_FIELD_INT,   buttonDebounceDelayMilliseconds,              0,    5000),
+    CONFIGURATION_FIELD(20, CONFIGURATION_FIELD_INT,   homingButtonDebounceMilliseconds,             0,    10000),
+    CONFIGURATION_FIELD(21, CONFIGURATION_FIELD_BOOL,  autoHomeAfterDispense,                        0,    1),
+    CONFIGURATION_FIELD(22, CONFIGURATION_FIELD_INT,   maximumDispenseAttempts,                      1,    20),
+    CONFIGURATION_FIELD(23, CONFIGURATION_FIELD_INT,   delayAfterHomingSwitchActivationMilliseconds, 0,    10000),
+    CONFIGURATION_FIELD(24, CONFIGURATION_FIELD_INT,   delayAfterHomingCompleteMilliseconds,         0,    10000),
+    CONFIGURATION_FIELD(25, CONFIGURATION_FIELD_INT,   homingRetryAttempts,                          1,    10),
+    CONFIGURATION_FIELD(26, CONFIGURATION_FIELD_INT,   homingDelayDecrementPerRetry,                 0,    100000),
+    CONFIGURATION_FIELD(27, CONFIGURATION_FIELD_INT,   homingTimeoutIncrementPerRetry,               0,    100000),
+    CONFIGURATION_FIELD(28, CONFIGURATION_FIELD_INT,   delayBetweenDispenseAttemptsMilliseconds,     0,    30000),
+    CONFIGURATION_FIELD(29, CONFIGURATION_FIELD_INT,   delayBetweenMultipleDispensesMilliseconds,    0,    30000),
+    CONFIGURATION_FIELD(30, CONFIGURATION_FIELD_INT,   delayAfterCompartmentMoveMilliseconds,        0,    10000),
+    CONFIGURATION_FIELD(31, CONFIGURATION_FIELD_FLOAT, encoderPositionMultiplierForCompartment,      0.01, 10000),
+    CONFIGURATION_FIELD(32, CONFIGURATION_FIELD_INT,   successMessageDisplayTimeMilliseconds,        0,    30000),
+    CONFIGURATION_FIELD(33, CONFIGURATION_FIELD_INT,   errorMessageDisplayTimeMilliseconds,          0,    30000),
+    CONFIGURATION_FIELD(34, CONFIGURATION_FIELD_INT,   statusMessageDisplayTimeMilliseconds,         0,    30000),
+    CONFIGURATION_FIELD(35, CONFIGURATION_FIELD_INT,   bleReconnectionDelayMilliseconds,             0,    10000),
+    CONFIGURATION_FIELD(36, CONFIGURATION_FIELD_INT,   bleMinimumConnectionIntervalPreference,       6,    3200),
+    CONFIGURATION_FIELD(37, CONFIGURATION_FIELD_INT,   bleMaximumConnectionIntervalPreference,       6,    3200),
+    CONFIGURATION_FIELD(38, CONFIGURATION_FIELD_BOOL,  enableLightSleepWhenIdle,                     0,    1),
+    CONFIGURATION_FIELD(39, CONFIGURATION_FIELD_INT,   idleTimeBeforeSleepMilliseconds,              0,    600000),
+    CONFIGURATION_FIELD(40, CONFIGURATION_FIELD_INT,   maximumLightSleepMilliseconds,                10,   60000),
+    CONFIGURATION_FIELD(41, CONFIGURATION_FIELD_INT,   awakeWindowAfterWakeMilliseconds,             0,    10000),
+    CONFIGURATION_FIELD(42, CONFIGURATION_FIELD_INT,   missedDoseGraceMinutes,                       0,    1440),
+    CONFIGURATION_FIELD(43, CONFIGURATION_FIELD_INT,   onTimeDoseToleranceMinutes,                   0,    1440),
+    CONFIGURATION_FIELD(44, CONFIGURATION_FIELD_BOOL,  enableDosePrepositioning,                     0,    1),
+    CONFIGURATION_FIELD(45, CONFIGURATION_FIELD_INT,   dosePrepositionLeadSeconds,                   5,    3600),
+    CONFIGURATION_FIELD(46, CONFIGURATION_FIELD_BOOL,  preEnergizeElectromagnetBeforeDose,           0,    1),
+    CONFIGURATION_FIELD(47, CONFIGURATION_FIELD_INT,   lowStockPillThreshold,                        0,    1000),
+    CONFIGURATION_FIELD(48, CONFIGURATION_FIELD_INT,   lowStockWarningDays,                          0,    365),
+    CONFIGURATION_FIELD(49, CONFIGURATION_FIELD_INT,   memoryTelemetryIntervalSeconds,               10,   86400),
+    CONFIGURATION_FIELD(50, CONFIGURATION_FIELD_INT,   lowFreeHeapAlertBytes,                        0,    300000),
+    CONFIGURATION_FIELD(51, CONFIGURATION_FIELD_INT,   lowLargestFreeBlockAlertBytes,                0,    300000),
+    CONFIGURATION_FIELD(52, CONFIGURATION_FIELD_INT,   lowStackAlertBytes,                           0,    16384),
+    CONFIGURATION_FIELD(53, CONFIGURATION_FIELD_INT,   servoSlewMicrosecondsPerSecond,               0,    100000),
+    CONFIGURATION_FIELD(54, CONFIGURATION_FIELD_INT,   servoSettleMilliseconds,                      0,    5000),
+    CONFIGURATION_FIELD(55, CONFIGURATION_FIELD_INT,   servoIdleDetachMilliseconds,                  0,    600000),
+    CONFIGURATION_FIELD(56, CONFIGURATION_FIELD_BOOL,  enableSweepRangeLearning,                     0,    1),
+    CONFIGURATION_FIELD(57, CONFIGURATION_FIELD_INT,   sweepLearningMarginMicroseconds,              0,    2000),
+};
+
+#define NUMBER_OF_CONFIGURATION_SCALAR_FIELDS \
+    (int)(sizeof(CONFIGURATION_FIELD_DESCRIPTORS) / sizeof(CONFIGURATION_FIELD_DESCRIPTORS[0]))
+
+constexpr int getHighestScalarConfigurationFieldId(int index = 0, int highestSoFar = 0) {
+    return index >= NUMBER_OF_CONFIGURATION_SCALAR_FIELDS ? highestSoFar :
+           getHighestScalarConfigurationFieldId(index + 1,
+               CONFIGURATION_FIELD_DESCRIPTORS[index].fieldId > highestSoFar ?
+               CONFIGURATION_FIELD_DESCRIPTORS[index].fieldId : highestSoFar);
+}
+
+static_assert(getHighestScalarConfigurationFieldId() < CONFIGURATION_POSITION_FIELD_ID_BASE,
+              "Scalar field ids would collide with the container position ids");
+
+// Fields the controllers read through ControllerConfiguration (container
+// positions included). With USE_COMPILE_TIME_CONFIGURATION these come from
+// FixedSystemConfiguration, so changing them in SystemConfiguration does nothing.
+static const uint8_t CONTROLLER_CONFIGURATION_FIELD_IDS[] = {
+    1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18,
+    21, 22, 23, 25, 26, 27, 28, 29, 30, 53, 54, 55
+};
+
+/**
+ * Stored form of one field
+ */
+struct StoredConfigurationRecord {
+    uint8_t formatVersion;
+    uint8_t fieldType;
+    uint16_t checksum;              // Low 16 bits of CRC-32 of the record with checksum = 0
+    uint32_t valueBits;             // int / bool value, or float bit pattern
+};
+
+/**
+ * ConfigurationStore Class
+ *
+ * Persists SystemConfiguration fields in NVS and applies field updates with
+ * validation. Loading happens once at boot, before the controllers derive
+ * anything from the configuration; updates take effect immediately in RAM.
+ */
+class ConfigurationStore {
+private:
+    SystemConfiguration* systemConfiguration;
+    Preferences preferences;
+    bool isStorageOpen;
+    int numberOfRejectedRecords;
+
+    static uint16_t calculateRecordChecksum(StoredConfigurationRecord record) {
+        record.checksum = 0;
+        return calculateStoredRecordChecksum(&record, sizeof(record));
+    }
+
+    static void makeStorageKey(int fieldId, char* key) {
+        snprintf(key, 8, "f%d", fieldId);
+    }
+
+    static float readFieldFrom(const SystemConfiguration& configuration,
+                               const ConfigurationFieldDescriptor& descriptor) {
+        const uint8_t* fieldAddress = (const uint8_t*)&configuration + descriptor.fieldOffset;
+        if (descriptor.fieldType == CONFIGURATION_FIELD_FLOAT) {
+            float value;
+            memcpy(&value, fieldAddress, sizeof(value));
+            return value;
+        }
+        if (descriptor.fieldType == CONFIGURATION_FIELD_BOOL) {
+            bool value;
+            memcpy(&value, fieldAddress, sizeof(value));
+            return value ? 1 : 0;
+        }
+        int value;
+        memcpy(&value, fieldAddress, sizeof(value));
+        return value;
+    }
+
+    static void writeFieldTo(SystemConfiguration* configuration,
+                             const ConfigurationFieldDescriptor& descriptor, float value) {
+        uint8_t* fieldAddress = (uint8_t*)configuration + descriptor.fieldOffset;
+        if (descriptor.fieldType == CONFIGURATION_FIELD_FLOAT) {
+            memcpy(fieldAddress, &value, sizeof(value));
+        } else if (descriptor.fieldType == CONFIGURATION_FIELD_BOOL) {
+            bool flag = value != 0;
+            memcpy(fieldAddress, &flag, sizeof(flag));
+        } else {
+            int integer = (int)lroundf(value);
+            memcpy(fieldAddress, &integer, sizeof(integer));
+        }
+    }
+
+    /**
+     * Cross-field checks against the existing min/max limits
+     */
+    static bool areLimitsConsistent(const SystemConfiguration& configuration) {
+        if (configuration.stepperMinStepPulseWidthMicroseconds > configuration.stepperMaxStepPulseWidthMicroseconds) {
+            return false;
+        }
+        if (configuration.stepperStepPulseWidthMicroseconds < configuration.stepperMinStepPulseWidthMicroseconds ||
+            configuration.stepperStepPulseWidthMicroseconds > configuration.stepperMaxStepPulseWidthMicroseconds) {
+            return false;
+        }
+        if (configuration.servoMinMicroseconds + 2 * configuration.servoEndMarginMicroseconds >=
+            configuration.servoMaxMicroseconds) {
+            return false;
+        }
+        if (configuration.bleMinimumConnectionIntervalPreference > configuration.bleMaximumConnectionIntervalPreference) {
+            return false;
+        }
+        return true;
+    }
+
+    static bool isValueInRange(const ConfigurationFieldDescriptor& descriptor, float value) {
+        return value >= descriptor.minimumValue && value <= descriptor.maximumValue;
+    }
+
+    /**
+     * Read and verify a stored record
+     * @return true if the record exists, is intact and in range
+     */
+    bool readStoredRecord(const ConfigurationFieldDescriptor& descriptor, float* value) {
+        char key[8];
+        makeStorageKey(descriptor.fieldId, key);
+        if (preferences.getBytesLength(key) != sizeof(StoredConfigurationRecord)) {
+            return false;
+        }
+
+        StoredConfigurationRecord record;
+        preferences.getBytes(key, &record, sizeof(record));
+        if (record.formatVersion != CONFIGURATION_STORE_FORMAT_VERSION ||
+            record.fieldType != descriptor.fieldType ||
+            record.checksum != calculateRecordChecksum(record)) {
+            numberOfRejectedRecords++;
+            return false;
+        }
+
+        float storedValue;
+        if (descriptor.fieldType == CONFIGURATION_FIELD_FLOAT) {
+            memcpy(&storedValue, &record.valueBits, sizeof(storedValue));
+        } else {
+            storedValue = (float)(int32_t)record.valueBits;
+        }
+        if (!isValueInRange(descriptor, storedValue)) {
+            numberOfRejectedRecords++;
+            return false;
+        }
+        *value = storedValue;
+        return true;
+    }
+
+    bool writeStoredRecord(const ConfigurationFieldDescriptor& descriptor, float value) {
+        char key[8];
+        makeStorageKey(descriptor.fieldId, key);
+
+        StoredConfigurationRecord record;
+        record.formatVersion = CONFIGURATION_STORE_FORMAT_VERSION;
+        record.fieldType = (uint8_t)descriptor.fieldType;
+        record.checksum = 0;
+        if (descriptor.fieldType == CONFIGURATION_FIELD_FLOAT) {
+            memcpy(&record.valueBits, &value, sizeof(value));
+        } else {
+            record.valueBits = (uint32_t)(int32_t)lroundf(value);
+        }
+        record.checksum = calculateRecordChecksum(record);
+
+        return preferences.putBytes(key, &record, sizeof(record)) == sizeof(record);
+    }
+
+public:
+    /**
+     * Constructor
+     * @param config Pointer to system configuration (updated in place)
+     */
+    ConfigurationStore(SystemConfiguration* config) {
+        systemConfiguration = config;
+        isStorageOpen = false;
+        numberOfRejectedRecords = 0;
+    }
+
+    /**
+     * Look up a field (scalar or container position)
+     * @param fieldId Field id
+     * @param descriptor Receives the descriptor
+     * @return false if the id is unknown
+     */
+    static bool getFieldDescriptor(int fieldId, ConfigurationFieldDescriptor* descriptor) {
+        for (int i = 0; i < NUMBER_OF_CONFIGURATION_SCALAR_FIELDS; i++) {
+            if (CONFIGURATION_FIELD_DESCRIPTORS[i].fieldId == fieldId) {
+                *descriptor = CONFIGURATION_FIELD_DESCRIPTORS[i];
+                return true;
+            }
+        }
+
+        int positionIndex = fieldId - CONFIGURATION_POSITION_FIELD_ID_BASE;
+        if (positionIndex >= 0 && positionIndex < NUMBER_OF_COMPARTMENTS_IN_DISPENSER) {
+            descriptor->fieldId = fieldId;
+            descriptor->fieldName = "containerPositionsInDegrees";
+            descriptor->fieldType = CONFIGURATION_FIELD_FLOAT;
+            descriptor->fieldOffset = offsetof(SystemConfiguration, containerPositionsInDegrees) +
+                                      positionIndex * sizeof(float);
+            descriptor->minimumValue = 0;
+            descriptor->maximumValue = 359.99;
+            return true;
+        }
+        return false;
+    }
+
+    /**
+     * @return true if the field changes the pulse range the servo is attached with
+     * (servoMin/MaxMicroseconds, servoEndMarginMicroseconds); the servo must be
+     * re-attached for a live change to take effect
+     */
+    static bool isServoAttachLimitField(int fieldId) {
+        return fieldId == 9 || fieldId == 10 || fieldId == 11;
+    }
+
+    /**
+     * @return true if the controllers ignore run-time changes to the field
+     */
+    static bool isFieldFixedAtCompileTime(int fieldId) {
+#if USE_COMPILE_TIME_CONFIGURATION
+        if (fieldId >= CONFIGURATION_POSITION_FIELD_ID_BASE) {
+            return true;
+        }
+        for (size_t i = 0; i < sizeof(CONTROLLER_CONFIGURATION_FIELD_IDS); i++) {
+            if (CONTROLLER_CONFIGURATION_FIELD_IDS[i] == fieldId) {
+                return true;
+            }
+        }
+#endif
+        return false;
+    }
+
+    /**
+     * Number of persisted fields (scalars followed by container positions)
+     */
+    static int getNumberOfFields() {
+        return NUMBER_OF_CONFIGURATION_SCALAR_FIELDS + NUMBER_OF_COMPARTMENTS_IN_DISPENSER;
+    }
+
+    /**
+     * @param index 0 .. getNumberOfFields() - 1
+     * @return Field id at that position in the listing order
+     */
+    static int getFieldIdAt(int index) {
+        if (index < NUMBER_OF_CONFIGURATION_SCALAR_FIELDS) {
+            return CONFIGURATION_FIELD_DESCRIPTORS[index].fieldId;
+        }
+        return CONFIGURATION_POSITION_FIELD_ID_BASE + (index - NUMBER_OF_CONFIGURATION_SCALAR_FIELDS);
+    }
+
+    /**
+     * Open NVS and apply stored fields over the compiled-in defaults
+     * Call before constructing the controllers.
+     * @return Number of stored fields applied
+     */
+    int beginAndLoadStoredConfiguration() {
+        isStorageOpen = preferences.begin(CONFIGURATION_STORE_NAMESPACE, false);
+        if (!isStorageOpen) {
+            Serial.println("WARNING: Configuration storage unavailable, using defaults");
+            return 0;
+        }
+
+        SystemConfiguration loadedConfiguration = *systemConfiguration;
+        int numberOfAppliedFields = 0;
+        numberOfRejectedRecords = 0;
+
+        for (int i = 0; i < getNumberOfFields(); i++) {
+            int fieldId = getFieldIdAt(i);
+            ConfigurationFieldDescriptor descriptor;
+            float value;
+            // Stored controller fields stay in NVS for a run-time configuration build
+            if (isFieldFixedAtCompileTime(fieldId)) {
+                continue;
+            }
+            if (getFieldDescriptor(fieldId, &descriptor) && readStoredRecord(descriptor, &value)) {
+                writeFieldTo(&loadedConfiguration, descriptor, value);
+                numberOfAppliedFields++;
+            }
+        }
+
+        if (!areLimitsConsistent(loadedConfiguration)) {
+            Serial.println("WARNING: Stored configuration violates min/max limits, using defaults");
+            return 0;
+        }
+        if (numberOfRejectedRecords > 0) {
+            Serial.print("WARNING: Ignored corrupt/outdated configuration records: ");
+            Serial.println(numberOfRejectedRecords);
+        }
+
+        *systemConfiguration = loadedConfiguration;
+        return numberOfAppliedFields;
+    }
+
+    /**
+     * Read a field's current value
+     * @return false if the id is unknown
+     */
+    bool getFieldValue(int fieldId, float* value) {
+        ConfigurationFieldDescriptor descriptor;
+        if (!getFieldDescriptor(fieldId, &descriptor)) {
+            return false;
+        }
+        *value = readFieldFrom(*systemConfiguration, descriptor);
+        return true;
+    }
+
+    /**
+     * Format a field's current value (ints without decimals)
+     */
+    String formatFieldValue(int fieldId) {
+        ConfigurationFieldDescriptor descriptor;
+        if (!getFieldDescriptor(fieldId, &descriptor)) {
+            return "";
+        }
+        float value = readFieldFrom(*systemConfiguration, descriptor);
+        if (descriptor.fieldType == CONFIGURATION_FIELD_FLOAT) {
+            return String(value, 2);
+        }
+        return String((long)value);
+    }
+
+    /**
+     * Validate, persist and apply one field
+     * Only the field's own record is rewritten.
+     * @param fieldId Field id
+     * @param value New value (ints are rounded, bools are 0/1)
+     * Controller fields are rejected when USE_COMPILE_TIME_CONFIGURATION is set.
+     * @return CONFIGURATION_UPDATE_OK or the reason it was rejected
+     */
+    ConfigurationUpdateResult setFieldValue(int fieldId, float value) {
+        ConfigurationFieldDescriptor descriptor;
+        if (!getFieldDescriptor(fieldId, &descriptor)) {
+            return CONFIGURATION_UNKNOWN_FIELD;
+        }
+        if (isFieldFixedAtCompileTime(fieldId)) {
+            return CONFIGURATION_FIXED_AT_COMPILE_TIME;
+        }
+        if (!isValueInRange(descriptor, value)) {
+            return CONFIGURATION_VALUE_OUT_OF_RANGE;
+        }
+
+        SystemConfiguration candidateConfiguration = *systemConfiguration;
+        writeFieldTo(&candidateConfiguration, descriptor, value);
+        if (!areLimitsConsistent(candidateConfiguration)) {
+            return CONFIGURATION_INCONSISTENT_LIMITS;
+        }
+
+        if (!isStorageOpen || !writeStoredRecord(descriptor, value)) {
+            return CONFIGURATION_STORAGE_FAILED;
+        }
+
+        *systemConfiguration = candidateConfiguration;
+        return CONFIGURATION_UPDATE_OK;
+    }
+
+    /**
+     * Erase every stored field and restore the compiled-in defaults
+     */
+    bool resetToDefaults() {
+        *systemConfiguration = SystemConfiguration();
+        return isStorageOpen && preferences.clear();
+    }
+
+    /**
+     * Print every field as "id name = value [min..max]"
+     */
+    template <typename Output>
+    void printConfigurationFields(Output& out) {
+        out.println("CONFIGURATION FIELDS:");
+        for (int i = 0; i < getNumberOfFields(); i++) {
+            int fieldId = getFieldIdAt(i);
+            ConfigurationFieldDescriptor descriptor;
+            getFieldDescriptor(fieldId, &descriptor);
+
+            out.print(fieldId);
+            out.print(" ");
+            out.print(descriptor.fieldName);
+            if (fieldId >= CONFIGURATION_POSITION_FIELD_ID_BASE) {
+                out.print("[");
+                out.print(fieldId - CONFIGURATION_POSITION_FIELD_ID_BASE);
+                out.print("]");
+            }
+            out.print(" = ");
+            out.print(formatFieldValue(fieldId));
+            out.print(" [");
+            out.print(descriptor.minimumValue);
+            out.print("..");
+            out.print(descriptor.maximumValue);
+            out.println(isFieldFixedAtCompileTime(fieldId) ? "] fixed" : "]");
+        }
+    }
+};
+
+#endif // CONFIGURATION_STORE_H
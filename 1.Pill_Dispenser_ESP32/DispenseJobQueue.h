@@ -0,0 +1,257 @@
+#ifndef DISPENSE_JOB_QUEUE_H
+#define DISPENSE_JOB_QUEUE_H
+
+#include <Arduino.h>
+#include "DoseScheduler.h"
+
+// ============================================================================
+// Job Queue Limits
+// ============================================================================
+#define DISPENSE_JOB_QUEUE_CAPACITY     8
+
+/**
+ * Work that moves the mechanism. Everything else (STATUS, CONFIG, ...) is
+ * answered immediately and never queued.
+ */
+enum DispenseJobType {
+    JOB_BLE_DISPENSE,
+    JOB_MANUAL_DISPENSE,
+    JOB_SCHEDULED_DOSE,
+    JOB_BLE_HOME,
+    JOB_MANUAL_HOME,
+    JOB_CALIBRATE,
+    JOB_RESET_STATISTICS
+};
+
+/**
+ * Lower value runs first. Patient jobs are never preempted; the others stop
+ * at safe points when a patient job is waiting and are queued again.
+ */
+enum DispenseJobPriority {
+    JOB_PRIORITY_PATIENT,
+    JOB_PRIORITY_HOMING,
+    JOB_PRIORITY_MAINTENANCE,
+    NUMBER_OF_JOB_PRIORITIES
+};
+
+inline DispenseJobPriority getDispenseJobPriority(DispenseJobType type) {
+    switch (type) {
+        case JOB_BLE_DISPENSE:
+        case JOB_MANUAL_DISPENSE:
+        case JOB_SCHEDULED_DOSE:    return JOB_PRIORITY_PATIENT;
+        case JOB_BLE_HOME:
+        case JOB_MANUAL_HOME:       return JOB_PRIORITY_HOMING;
+        default:                    return JOB_PRIORITY_MAINTENANCE;
+    }
+}
+
+struct DispenseJob {
+    DispenseJobType type;
+    uint32_t sequenceNumber;            // FIFO order within a priority
+    unsigned long enqueuedMilliseconds;
+    int compartmentNumber;              // Dispense jobs
+    int pillCount;
+    DoseDecision doseDecision;          // JOB_SCHEDULED_DOSE
+    int numberOfPreemptions;
+    bool isFromSerialConsole;           // Reply on the console, not over BLE
+};
+
+/**
+ * DispenseJobQueue Class
+ *
+ * Orders the work in front of DispenserController:
+ * - Highest priority first, then arrival order
+ * - A preempted job goes back with its original sequence number, so it
+ *   resumes before anything queued after it
+ * - A HOME or calibration already waiting absorbs duplicates
+ * - Records how long patient jobs waited before they started
+ */
+class DispenseJobQueue {
+private:
+    DispenseJob jobs[DISPENSE_JOB_QUEUE_CAPACITY];
+    int numberOfJobs;
+    uint32_t nextSequenceNumber;
+
+    unsigned long numberOfJobsRun[NUMBER_OF_JOB_PRIORITIES];
+    unsigned long numberOfPreemptions;
+    unsigned long numberOfRejectedJobs;
+    unsigned long longestPatientWaitMilliseconds;
+
+    bool isJobTypeQueued(DispenseJobType type) {
+        for (int i = 0; i < numberOfJobs; i++) {
+            if (jobs[i].type == type) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * @return Index of the job to run next, or -1 if empty
+     */
+    int findNextJobIndex() {
+        int best = -1;
+        for (int i = 0; i < numberOfJobs; i++) {
+            if (best < 0) {
+                best = i;
+                continue;
+            }
+            DispenseJobPriority priority = getDispenseJobPriority(jobs[i].type);
+            DispenseJobPriority bestPriority = getDispenseJobPriority(jobs[best].type);
+            if (priority < bestPriority ||
+                (priority == bestPriority && jobs[i].sequenceNumber < jobs[best].sequenceNumber)) {
+                best = i;
+            }
+        }
+        return best;
+    }
+
+    bool insertJob(const DispenseJob& job) {
+        if (numberOfJobs >= DISPENSE_JOB_QUEUE_CAPACITY) {
+            numberOfRejectedJobs++;
+            return false;
+        }
+        jobs[numberOfJobs++] = job;
+        return true;
+    }
+
+public:
+    DispenseJobQueue() {
+        numberOfJobs = 0;
+        nextSequenceNumber = 0;
+        memset(numberOfJobsRun, 0, sizeof(numberOfJobsRun));
+        numberOfPreemptions = 0;
+        numberOfRejectedJobs = 0;
+        longestPatientWaitMilliseconds = 0;
+    }
+
+    /**
+     * Add a job
+     * @param isFromSerialConsole Requested on the Serial console (replies go there)
+     * @return false if the queue is full
+     */
+    bool enqueueJob(DispenseJobType type, int compartmentNumber = 0, int pillCount = 0,
+                    bool isFromSerialConsole = false) {
+        if (getDispenseJobPriority(type) != JOB_PRIORITY_PATIENT && isJobTypeQueued(type)) {
+            return true;
+        }
+        DispenseJob job;
+        memset(&job, 0, sizeof(job));
+        job.type = type;
+        job.sequenceNumber = nextSequenceNumber++;
+        job.enqueuedMilliseconds = millis();
+        job.compartmentNumber = compartmentNumber;
+        job.pillCount = pillCount;
+        job.isFromSerialConsole = isFromSerialConsole;
+        return insertJob(job);
+    }
+
+    bool enqueueScheduledDose(const DoseDecision& decision) {
+        DispenseJob job;
+        memset(&job, 0, sizeof(job));
+        job.type = JOB_SCHEDULED_DOSE;
+        job.sequenceNumber = nextSequenceNumber++;
+        job.enqueuedMilliseconds = millis();
+        job.compartmentNumber = decision.compartmentNumber;
+        job.pillCount = decision.pillCount;
+        job.doseDecision = decision;
+        return insertJob(job);
+    }
+
+    /**
+     * Remove and return the job to run next
+     * @return false if the queue is empty
+     */
+    bool takeNextJob(DispenseJob* job) {
+        int index = findNextJobIndex();
+        if (index < 0) {
+            return false;
+        }
+        *job = jobs[index];
+        jobs[index] = jobs[--numberOfJobs];
+
+        DispenseJobPriority priority = getDispenseJobPriority(job->type);
+        numberOfJobsRun[priority]++;
+        if (priority == JOB_PRIORITY_PATIENT) {
+            unsigned long waitMilliseconds = millis() - job->enqueuedMilliseconds;
+            if (waitMilliseconds > longestPatientWaitMilliseconds) {
+                longestPatientWaitMilliseconds = waitMilliseconds;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Put a preempted job back in its original place
+     * @return false if the queue filled up meanwhile and the job was dropped
+     */
+    bool requeuePreemptedJob(DispenseJob job) {
+        job.numberOfPreemptions++;
+        numberOfPreemptions++;
+        numberOfJobsRun[getDispenseJobPriority(job.type)]--;
+        return insertJob(job);
+    }
+
+    /**
+     * Drop every queued job (abort)
+     * The scheduler already popped a queued dose's occurrence and only queues
+     * the next one when the dose is completed, so each dropped dose is
+     * recorded as failed; otherwise its slot would never fire again.
+     * @param doseScheduler Scheduler the queued doses came from
+     * @param now Current UTC seconds
+     * @return Number of jobs dropped
+     */
+    int clearAllJobs(DoseScheduler* doseScheduler, uint32_t now) {
+        for (int i = 0; i < numberOfJobs; i++) {
+            if (jobs[i].type == JOB_SCHEDULED_DOSE) {
+                doseScheduler->completeScheduledDose(jobs[i].doseDecision, 0, now);
+            }
+        }
+        int numberOfDroppedJobs = numberOfJobs;
+        numberOfJobs = 0;
+        return numberOfDroppedJobs;
+    }
+
+    bool isEmpty() {
+        return numberOfJobs == 0;
+    }
+
+    bool hasPatientJobQueued() {
+        for (int i = 0; i < numberOfJobs; i++) {
+            if (getDispenseJobPriority(jobs[i].type) == JOB_PRIORITY_PATIENT) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    int getNumberOfQueuedJobs() {
+        return numberOfJobs;
+    }
+
+    unsigned long getLongestPatientWaitMilliseconds() {
+        return longestPatientWaitMilliseconds;
+    }
+
+    template <typename Output>
+    void printJobQueueReport(Output& out) {
+        out.println("JOB QUEUE:");
+        out.print("Queued: ");
+        out.println(numberOfJobs);
+        out.print("Run (patient/homing/maintenance): ");
+        out.print(numberOfJobsRun[JOB_PRIORITY_PATIENT]);
+        out.print(" / ");
+        out.print(numberOfJobsRun[JOB_PRIORITY_HOMING]);
+        out.print(" / ");
+        out.println(numberOfJobsRun[JOB_PRIORITY_MAINTENANCE]);
+        out.print("Preemptions: ");
+        out.print(numberOfPreemptions);
+        out.print(", rejected (queue full): ");
+        out.println(numberOfRejectedJobs);
+        out.print("Longest patient wait: ");
+        out.print(longestPatientWaitMilliseconds);
+        out.println(" ms");
+    }
+};
+
+#endif // DISPENSE_JOB_QUEUE_H
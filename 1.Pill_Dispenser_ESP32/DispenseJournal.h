@@ -0,0 +1,474 @@
+#ifndef DISPENSE_JOURNAL_H
+#define DISPENSE_JOURNAL_H
+
+#include <Arduino.h>
+#include <esp_partition.h>
+#include <esp_timer.h>
+#include <string.h>
+#include "Config.h"
+#include "ConfigurationSettings.h"
+#include "StoredRecordChecksum.h"
+
+// ============================================================================
+// Journal Format
+// ============================================================================
+// A ring of flash sectors in a raw data partition. Each sector starts with a
+// checkpoint header (sequence number + every compartment count) followed by
+// 8-byte dispense records appended in order. Only the newest sector is replayed
+// at boot. Sectors are reused round-robin, so erases are spread evenly.
+//
+// Add a "journal" data partition (e.g. 16 KB) to the partition table; without
+// one the unused "spiffs" partition of the default Arduino layout is used.
+#define DISPENSE_JOURNAL_PARTITION_LABEL            "journal"
+#define DISPENSE_JOURNAL_FALLBACK_PARTITION_LABEL   "spiffs"
+#define DISPENSE_JOURNAL_SECTOR_SIZE_BYTES          4096
+#define DISPENSE_JOURNAL_MAXIMUM_SECTORS            8
+#define DISPENSE_JOURNAL_MAGIC                      0x4C4E524A  // "JRNL"
+#define DISPENSE_JOURNAL_FORMAT_VERSION             1
+
+// Records wait in RAM and are written in one batch
+#define DISPENSE_JOURNAL_PENDING_RECORDS            16
+#define DISPENSE_JOURNAL_FLUSH_INTERVAL_MILLISECONDS 2000
+
+#define DISPENSE_JOURNAL_RECORD_DISPENSE            0x01
+#define DISPENSE_JOURNAL_RECORD_RESET               0x02
+#define DISPENSE_JOURNAL_RECORD_ERASED              0xFF
+
+struct DispenseJournalSectorHeader {
+    uint32_t magic;
+    uint16_t formatVersion;
+    uint16_t numberOfCompartments;
+    uint32_t sectorSequenceNumber;
+    uint32_t checkpointCounts[NUMBER_OF_COMPARTMENTS_IN_DISPENSER];
+    uint32_t checksum;                  // CRC-32 of the header with checksum = 0
+};
+
+struct DispenseJournalRecord {
+    uint8_t recordType;
+    uint8_t compartmentNumber;
+    uint8_t pillsRequested;
+    uint8_t pillsDispensed;
+    uint16_t recordSequence;            // Running number, for dumps and gap detection
+    uint16_t checksum;                  // Low 16 bits of CRC-32 over the first 6 bytes
+};
+
+/**
+ * DispenseJournal Class
+ *
+ * Crash-safe, append-only log of dispense outcomes so the per-compartment
+ * counts survive reboots and brownouts:
+ * - appendDispenseRecord() only queues into RAM (safe on the dispense path)
+ * - serviceJournal() in the main loop writes the queue in one batch and
+ *   pre-erases the next sector, so rotation never waits for an erase
+ * - beginAndRecoverCounts() rebuilds the counts from the newest checkpoint
+ *   plus the records after it
+ *
+ * A torn record (power lost mid-write) fails its checksum and is skipped.
+ * Records still queued in RAM at power loss (at most the flush interval) are lost.
+ */
+class DispenseJournal {
+private:
+    const esp_partition_t* journalPartition;
+    int numberOfSectors;
+    int currentSectorIndex;
+    uint32_t currentSectorSequence;
+    size_t writeOffset;                 // Within the current sector
+    bool isNextSectorErased;
+    uint32_t committedCounts[NUMBER_OF_COMPARTMENTS_IN_DISPENSER];
+
+    DispenseJournalRecord pendingRecords[DISPENSE_JOURNAL_PENDING_RECORDS];
+    int numberOfPendingRecords;
+    unsigned long timeOfOldestPendingRecordMilliseconds;
+    uint16_t nextRecordSequence;
+
+    // Statistics
+    int numberOfRecoveredRecords;
+    int numberOfSkippedRecords;
+    unsigned long recoveryDurationMicroseconds;
+    unsigned long numberOfBatchWrites;
+    unsigned long numberOfSectorErases;
+    unsigned long numberOfFailedWrites;
+    unsigned long maximumFlushDurationMicroseconds;
+
+    static const size_t HEADER_SIZE_BYTES =
+        (sizeof(DispenseJournalSectorHeader) + sizeof(DispenseJournalRecord) - 1) /
+        sizeof(DispenseJournalRecord) * sizeof(DispenseJournalRecord);
+
+    static uint32_t calculateHeaderChecksum(DispenseJournalSectorHeader header) {
+        header.checksum = 0;
+        return calculateStoredRecordCrc32(&header, sizeof(header));
+    }
+
+    static uint16_t calculateRecordChecksum(const DispenseJournalRecord& record) {
+        return calculateStoredRecordChecksum(&record, offsetof(DispenseJournalRecord, checksum));
+    }
+
+    static bool isRecordErased(const DispenseJournalRecord& record) {
+        const uint8_t* bytes = (const uint8_t*)&record;
+        for (size_t i = 0; i < sizeof(record); i++) {
+            if (bytes[i] != 0xFF) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    size_t getSectorAddress(int sectorIndex) {
+        return (size_t)sectorIndex * DISPENSE_JOURNAL_SECTOR_SIZE_BYTES;
+    }
+
+    bool readSectorHeader(int sectorIndex, DispenseJournalSectorHeader* header) {
+        if (esp_partition_read(journalPartition, getSectorAddress(sectorIndex), header, sizeof(*header)) != ESP_OK) {
+            return false;
+        }
+        return header->magic == DISPENSE_JOURNAL_MAGIC &&
+               header->formatVersion == DISPENSE_JOURNAL_FORMAT_VERSION &&
+               header->numberOfCompartments == NUMBER_OF_COMPARTMENTS_IN_DISPENSER &&
+               header->checksum == calculateHeaderChecksum(*header);
+    }
+
+    static void applyRecord(const DispenseJournalRecord& record, uint32_t* counts) {
+        if (record.recordType == DISPENSE_JOURNAL_RECORD_RESET) {
+            for (int i = 0; i < NUMBER_OF_COMPARTMENTS_IN_DISPENSER; i++) {
+                counts[i] = 0;
+            }
+        } else if (record.recordType == DISPENSE_JOURNAL_RECORD_DISPENSE &&
+                   record.compartmentNumber >= 1 &&
+                   record.compartmentNumber <= NUMBER_OF_COMPARTMENTS_IN_DISPENSER) {
+            counts[record.compartmentNumber - 1] += record.pillsDispensed;
+        }
+    }
+
+    bool eraseSector(int sectorIndex) {
+        numberOfSectorErases++;
+        return esp_partition_erase_range(journalPartition, getSectorAddress(sectorIndex),
+                                         DISPENSE_JOURNAL_SECTOR_SIZE_BYTES) == ESP_OK;
+    }
+
+    /**
+     * Start a new sector whose header checkpoints the committed counts
+     * @param sectorIndex Sector to use (erased here unless already erased)
+     */
+    bool startSectorWithCheckpoint(int sectorIndex, bool isAlreadyErased) {
+        if (!isAlreadyErased && !eraseSector(sectorIndex)) {
+            return false;
+        }
+
+        DispenseJournalSectorHeader header;
+        memset(&header, 0xFF, sizeof(header));
+        header.magic = DISPENSE_JOURNAL_MAGIC;
+        header.formatVersion = DISPENSE_JOURNAL_FORMAT_VERSION;
+        header.numberOfCompartments = NUMBER_OF_COMPARTMENTS_IN_DISPENSER;
+        header.sectorSequenceNumber = currentSectorSequence + 1;
+        memcpy(header.checkpointCounts, committedCounts, sizeof(committedCounts));
+        header.checksum = calculateHeaderChecksum(header);
+
+        if (esp_partition_write(journalPartition, getSectorAddress(sectorIndex), &header, sizeof(header)) != ESP_OK) {
+            return false;
+        }
+
+        currentSectorIndex = sectorIndex;
+        currentSectorSequence = header.sectorSequenceNumber;
+        writeOffset = HEADER_SIZE_BYTES;
+        isNextSectorErased = false;
+        return true;
+    }
+
+    /**
+     * Replay the records of one sector on top of its checkpoint
+     * Sets writeOffset to the first erased slot (or the sector end if full)
+     */
+    void replaySectorRecords(int sectorIndex) {
+        const int RECORDS_PER_READ = 32;
+        DispenseJournalRecord records[RECORDS_PER_READ];
+
+        writeOffset = DISPENSE_JOURNAL_SECTOR_SIZE_BYTES;
+        for (size_t offset = HEADER_SIZE_BYTES; offset < DISPENSE_JOURNAL_SECTOR_SIZE_BYTES; ) {
+            size_t remainingRecords = (DISPENSE_JOURNAL_SECTOR_SIZE_BYTES - offset) / sizeof(DispenseJournalRecord);
+            int recordsToRead = remainingRecords < RECORDS_PER_READ ? (int)remainingRecords : RECORDS_PER_READ;
+            if (recordsToRead == 0 ||
+                esp_partition_read(journalPartition, getSectorAddress(sectorIndex) + offset,
+                                   records, recordsToRead * sizeof(DispenseJournalRecord)) != ESP_OK) {
+                return;
+            }
+
+            for (int i = 0; i < recordsToRead; i++, offset += sizeof(DispenseJournalRecord)) {
+                if (isRecordErased(records[i])) {
+                    writeOffset = offset;
+                    return;
+                }
+                if (records[i].checksum != calculateRecordChecksum(records[i])) {
+                    numberOfSkippedRecords++;
+                    continue;
+                }
+                applyRecord(records[i], committedCounts);
+                nextRecordSequence = records[i].recordSequence + 1;
+                numberOfRecoveredRecords++;
+            }
+        }
+    }
+
+    void queueRecord(uint8_t recordType, int compartmentNumber, int pillsRequested, int pillsDispensed) {
+        if (journalPartition == NULL) {
+            return;
+        }
+        if (numberOfPendingRecords >= DISPENSE_JOURNAL_PENDING_RECORDS) {
+            // Only reached if the loop has not run for a whole batch
+            flushPendingRecords();
+        }
+        if (numberOfPendingRecords == 0) {
+            timeOfOldestPendingRecordMilliseconds = millis();
+        }
+
+        DispenseJournalRecord& record = pendingRecords[numberOfPendingRecords++];
+        record.recordType = recordType;
+        record.compartmentNumber = (uint8_t)compartmentNumber;
+        record.pillsRequested = (uint8_t)constrain(pillsRequested, 0, 255);
+        record.pillsDispensed = (uint8_t)constrain(pillsDispensed, 0, 255);
+        record.recordSequence = nextRecordSequence++;
+        record.checksum = calculateRecordChecksum(record);
+    }
+
+public:
+    DispenseJournal() {
+        journalPartition = NULL;
+        numberOfSectors = 0;
+        currentSectorIndex = 0;
+        currentSectorSequence = 0;
+        writeOffset = 0;
+        isNextSectorErased = false;
+        memset(committedCounts, 0, sizeof(committedCounts));
+        numberOfPendingRecords = 0;
+        timeOfOldestPendingRecordMilliseconds = 0;
+        nextRecordSequence = 0;
+        numberOfRecoveredRecords = 0;
+        numberOfSkippedRecords = 0;
+        recoveryDurationMicroseconds = 0;
+        numberOfBatchWrites = 0;
+        numberOfSectorErases = 0;
+        numberOfFailedWrites = 0;
+        maximumFlushDurationMicroseconds = 0;
+    }
+
+    /**
+     * Open the journal partition and rebuild the counts
+     * @return true if the journal is usable (counts persist across reboots)
+     */
+    bool beginAndRecoverCounts() {
+        int64_t startMicroseconds = esp_timer_get_time();
+
+        journalPartition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+                                                    DISPENSE_JOURNAL_PARTITION_LABEL);
+        if (journalPartition == NULL) {
+            journalPartition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+                                                        DISPENSE_JOURNAL_FALLBACK_PARTITION_LABEL);
+        }
+        if (journalPartition == NULL) {
+            return false;
+        }
+
+        numberOfSectors = journalPartition->size / DISPENSE_JOURNAL_SECTOR_SIZE_BYTES;
+        if (numberOfSectors > DISPENSE_JOURNAL_MAXIMUM_SECTORS) {
+            numberOfSectors = DISPENSE_JOURNAL_MAXIMUM_SECTORS;
+        }
+        if (numberOfSectors < 2) {
+            journalPartition = NULL;
+            return false;
+        }
+
+        // Newest valid checkpoint wins (sequence compared with wrap-around)
+        int newestSectorIndex = -1;
+        DispenseJournalSectorHeader header;
+        DispenseJournalSectorHeader newestHeader;
+        for (int i = 0; i < numberOfSectors; i++) {
+            if (readSectorHeader(i, &header) &&
+                (newestSectorIndex < 0 ||
+                 (int32_t)(header.sectorSequenceNumber - newestHeader.sectorSequenceNumber) > 0)) {
+                newestSectorIndex = i;
+                newestHeader = header;
+            }
+        }
+
+        if (newestSectorIndex < 0) {
+            // Blank or foreign partition: format the first sector
+            if (!startSectorWithCheckpoint(0, false)) {
+                journalPartition = NULL;
+                return false;
+            }
+        } else {
+            currentSectorIndex = newestSectorIndex;
+            currentSectorSequence = newestHeader.sectorSequenceNumber;
+            memcpy(committedCounts, newestHeader.checkpointCounts, sizeof(committedCounts));
+            replaySectorRecords(newestSectorIndex);
+        }
+
+        recoveryDurationMicroseconds = (unsigned long)(esp_timer_get_time() - startMicroseconds);
+        return true;
+    }
+
+    bool isJournalAvailable() {
+        return journalPartition != NULL;
+    }
+
+    /**
+     * @param compartmentNumber Compartment (1-based)
+     * @return Count rebuilt from flash (0 when the journal is unavailable)
+     */
+    uint32_t getRecoveredCountForCompartment(int compartmentNumber) {
+        if (compartmentNumber < 1 || compartmentNumber > NUMBER_OF_COMPARTMENTS_IN_DISPENSER) {
+            return 0;
+        }
+        return committedCounts[compartmentNumber - 1];
+    }
+
+    /**
+     * Queue one dispense outcome (RAM only unless the batch is full)
+     */
+    void appendDispenseRecord(int compartmentNumber, int pillsRequested, int pillsDispensed) {
+        queueRecord(DISPENSE_JOURNAL_RECORD_DISPENSE, compartmentNumber, pillsRequested, pillsDispensed);
+    }
+
+    /**
+     * Queue a statistics reset (replay zeroes every count)
+     */
+    void appendResetRecord() {
+        queueRecord(DISPENSE_JOURNAL_RECORD_RESET, 0, 0, 0);
+    }
+
+    bool hasPendingRecords() {
+        return numberOfPendingRecords > 0;
+    }
+
+    int getNumberOfRecoveredRecords() {
+        return numberOfRecoveredRecords;
+    }
+
+    int getNumberOfSkippedRecords() {
+        return numberOfSkippedRecords;
+    }
+
+    int getCurrentSectorIndex() {
+        return currentSectorIndex;
+    }
+
+    /**
+     * Write all queued records; one flash write per sector touched
+     * @return true if every queued record reached flash
+     */
+    bool flushPendingRecords() {
+        if (journalPartition == NULL || numberOfPendingRecords == 0) {
+            return true;
+        }
+        int64_t startMicroseconds = esp_timer_get_time();
+
+        int firstRecord = 0;
+        bool isFlushSuccessful = true;
+        while (firstRecord < numberOfPendingRecords) {
+            if (writeOffset + sizeof(DispenseJournalRecord) > DISPENSE_JOURNAL_SECTOR_SIZE_BYTES) {
+                int nextSectorIndex = (currentSectorIndex + 1) % numberOfSectors;
+                if (!startSectorWithCheckpoint(nextSectorIndex, isNextSectorErased)) {
+                    isFlushSuccessful = false;
+                    break;
+                }
+            }
+
+            size_t freeRecords = (DISPENSE_JOURNAL_SECTOR_SIZE_BYTES - writeOffset) / sizeof(DispenseJournalRecord);
+            int recordsToWrite = numberOfPendingRecords - firstRecord;
+            if ((size_t)recordsToWrite > freeRecords) {
+                recordsToWrite = (int)freeRecords;
+            }
+
+            // A failed write still consumes the slots: they are skipped at replay
+            esp_err_t writeResult = esp_partition_write(journalPartition,
+                                                        getSectorAddress(currentSectorIndex) + writeOffset,
+                                                        &pendingRecords[firstRecord],
+                                                        recordsToWrite * sizeof(DispenseJournalRecord));
+            writeOffset += recordsToWrite * sizeof(DispenseJournalRecord);
+            numberOfBatchWrites++;
+            if (writeResult != ESP_OK) {
+                numberOfFailedWrites++;
+                isFlushSuccessful = false;
+                break;
+            }
+
+            for (int i = firstRecord; i < firstRecord + recordsToWrite; i++) {
+                applyRecord(pendingRecords[i], committedCounts);
+            }
+            firstRecord += recordsToWrite;
+        }
+
+        // Keep whatever could not be written for the next attempt
+        numberOfPendingRecords -= firstRecord;
+        if (firstRecord > 0 && numberOfPendingRecords > 0) {
+            memmove(pendingRecords, &pendingRecords[firstRecord],
+                    numberOfPendingRecords * sizeof(DispenseJournalRecord));
+        }
+        if (!isFlushSuccessful && numberOfPendingRecords >= DISPENSE_JOURNAL_PENDING_RECORDS) {
+            numberOfPendingRecords = 0;  // Flash is failing: drop rather than block dispensing
+        }
+
+        unsigned long duration = (unsigned long)(esp_timer_get_time() - startMicroseconds);
+        if (duration > maximumFlushDurationMicroseconds) {
+            maximumFlushDurationMicroseconds = duration;
+        }
+        return isFlushSuccessful;
+    }
+
+    /**
+     * Main-loop housekeeping: flush batches that have waited long enough and
+     * pre-erase the next sector once the current one is half full
+     */
+    void serviceJournal() {
+        if (journalPartition == NULL) {
+            return;
+        }
+
+        if (numberOfPendingRecords > 0 &&
+            (millis() - timeOfOldestPendingRecordMilliseconds >= DISPENSE_JOURNAL_FLUSH_INTERVAL_MILLISECONDS ||
+             numberOfPendingRecords >= DISPENSE_JOURNAL_PENDING_RECORDS / 2)) {
+            flushPendingRecords();
+        }
+
+        if (!isNextSectorErased && writeOffset >= DISPENSE_JOURNAL_SECTOR_SIZE_BYTES / 2) {
+            isNextSectorErased = eraseSector((currentSectorIndex + 1) % numberOfSectors);
+        }
+    }
+
+    template <typename Output>
+    void printJournalReport(Output& out) {
+        out.println("DISPENSE JOURNAL:");
+        if (journalPartition == NULL) {
+            out.println("No journal partition - counts are RAM only");
+            return;
+        }
+        out.print("Partition: ");
+        out.print(journalPartition->label);
+        out.print(", ");
+        out.print(numberOfSectors);
+        out.print(" sectors, current ");
+        out.print(currentSectorIndex);
+        out.print(" (seq ");
+        out.print(currentSectorSequence);
+        out.print(", ");
+        out.print((unsigned long)((writeOffset - HEADER_SIZE_BYTES) / sizeof(DispenseJournalRecord)));
+        out.println(" records)");
+        out.print("Recovered ");
+        out.print(numberOfRecoveredRecords);
+        out.print(" records (");
+        out.print(numberOfSkippedRecords);
+        out.print(" torn) in ");
+        out.print(recoveryDurationMicroseconds);
+        out.println(" us");
+        out.print("Batch writes: ");
+        out.print(numberOfBatchWrites);
+        out.print(", erases: ");
+        out.print(numberOfSectorErases);
+        out.print(", failed writes: ");
+        out.print(numberOfFailedWrites);
+        out.print(", max flush: ");
+        out.print(maximumFlushDurationMicroseconds);
+        out.println(" us");
+    }
+};
+
+#endif // DISPENSE_JOURNAL_H
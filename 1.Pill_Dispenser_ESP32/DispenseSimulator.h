@@ -0,0 +1,991 @@
+#ifndef DISPENSE_SIMULATOR_H
+#define DISPENSE_SIMULATOR_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+#include "Config.h"
+#include "ConfigurationSettings.h"
+#include "ServoMotionModel.h"
+
+// ============================================================================
+// Simulator Capacity Limits
+// ============================================================================
+#define SIMULATOR_MAXIMUM_RECORDED_LATENCIES    256   // Reservoir sample of dose latencies for percentiles
+#define SIMULATOR_MAXIMUM_WAITING_DOSES         32    // Doses queued while the unit is busy; later arrivals are dropped
+#define SIMULATOR_MAXIMUM_SYNTHETIC_DOSES       20000 // Larger synthetic runs are clamped
+#define SIMULATOR_EVENTS_PER_SLICE              400   // Events per loop pass when SIMULATE runs in the background
+#define SIMULATOR_EVENT_QUEUE_CAPACITY          8     // Pending events (arrival + phase completion)
+
+/**
+ * Phases of the dispense sequence, in the order DispenserController runs them
+ */
+enum SimulatedDispensePhase {
+    PHASE_HOMING,                       // Homing before a move or after a failed dose
+    PHASE_COMPARTMENT_MOVE,             // Stepper move to the target compartment + settling
+    PHASE_ELECTROMAGNET_ACTIVATION,     // Magnet on + stabilization delay
+    PHASE_SERVO_SWEEP_OUT,              // Servo stepped from rest to max
+    PHASE_SERVO_SETTLE,                 // Modeled servo settle (at most servoMovementDelayMilliseconds) after reaching max
+    PHASE_PILL_DETECTION_WINDOW,        // IR polling window
+    PHASE_SERVO_RETURN,                 // Servo stepped back to rest + settle
+    PHASE_ELECTROMAGNET_RELEASE,        // Magnet off + deactivation delay
+    PHASE_RETRY_WAIT,                   // delayBetweenDispenseAttemptsMilliseconds
+    PHASE_MULTIPLE_PILL_WAIT,           // delayBetweenMultipleDispensesMilliseconds
+    PHASE_AUTO_HOMING,                  // autoHomeAfterDispense pass
+    PHASE_FAILURE_FEEDBACK,             // Error/status messages shown after a failed dose
+    NUMBER_OF_SIMULATED_PHASES
+};
+
+/**
+ * Get a printable name for a simulated phase
+ * @param phase Phase to name
+ * @return Short phase name
+ */
+inline const char* getSimulatedPhaseName(int phase) {
+    switch (phase) {
+        case PHASE_HOMING:                   return "homing";
+        case PHASE_COMPARTMENT_MOVE:         return "move";
+        case PHASE_ELECTROMAGNET_ACTIVATION: return "magnet on";
+        case PHASE_SERVO_SWEEP_OUT:          return "servo out";
+        case PHASE_SERVO_SETTLE:             return "servo settle";
+        case PHASE_PILL_DETECTION_WINDOW:    return "IR window";
+        case PHASE_SERVO_RETURN:             return "servo return";
+        case PHASE_ELECTROMAGNET_RELEASE:    return "magnet off";
+        case PHASE_RETRY_WAIT:               return "retry wait";
+        case PHASE_MULTIPLE_PILL_WAIT:       return "multi-pill wait";
+        case PHASE_AUTO_HOMING:              return "auto-home";
+        case PHASE_FAILURE_FEEDBACK:         return "failure UI";
+        default:                             return "unknown";
+    }
+}
+
+/**
+ * A single dose request fed to the simulator (synthetic or recorded)
+ */
+struct SimulatedDoseRequest {
+    unsigned long arrivalTimeMilliseconds;  // When the dose was requested
+    int compartmentNumber;                  // Target compartment (1-based)
+    int pillCount;                          // Pills requested
+};
+
+/**
+ * DispenserBehaviourModel Structure
+ *
+ * Stochastic description of the mechanism itself. Defaults are rough
+ * bench estimates; fit them to recorded sensor traces for real numbers.
+ * Release delays are measured from the moment the servo reaches max.
+ */
+struct DispenserBehaviourModel {
+    float pillReleaseProbabilityForCompartment[NUMBER_OF_COMPARTMENTS_IN_DISPENSER];  // Chance a sweep frees a pill
+    float pillReleaseDelayMeanMilliseconds = 900.0;               // Sweep end → pill crosses IR beam
+    float pillReleaseDelayStandardDeviationMilliseconds = 200.0;
+    int pillTransitPulseMilliseconds = 15;                        // How long a falling pill breaks the beam
+    
+    // Mechanical limits: shorter settings than these reduce the release probability linearly
+    int electromagnetMinimumStabilizationMilliseconds = 100;      // Magnet not yet holding the pill
+    int compartmentMinimumSettleMilliseconds = 100;               // Plate still oscillating after a move
+    int servoMinimumSweepMilliseconds = 30;                       // Faster sweeps fling pills off the gate
+    
+    DispenserBehaviourModel() {
+        for (int i = 0; i < NUMBER_OF_COMPARTMENTS_IN_DISPENSER; i++) {
+            pillReleaseProbabilityForCompartment[i] = 0.9;
+        }
+    }
+};
+
+/**
+ * DispenseTimingModel Class
+ *
+ * Deterministic durations of each step of the real firmware sequence,
+ * derived from SystemConfiguration exactly the way HardwareController and
+ * DispenserController spend their time (delays, step pulses, servo steps).
+ */
+class DispenseTimingModel {
+private:
+    const SystemConfiguration* systemConfiguration;
+
+public:
+    /**
+     * Constructor
+     * @param config Pointer to system configuration
+     */
+    DispenseTimingModel(const SystemConfiguration* config) {
+        systemConfiguration = config;
+    }
+
+    float getTotalStepsPerRevolution() const {
+        return systemConfiguration->stepperStepsPerRevolution *
+               systemConfiguration->stepperMicrostepping *
+               systemConfiguration->stepperGearRatio;
+    }
+
+    /**
+     * Absolute step position of a compartment (same math as calculateCompartmentStepPositions)
+     * @param compartmentNumber Target compartment (1-based)
+     */
+    long getCompartmentStepPosition(int compartmentNumber) const {
+        float angleInDegrees = systemConfiguration->containerPositionsInDegrees[compartmentNumber - 1];
+        return (long)((angleInDegrees / 360.0) * getTotalStepsPerRevolution());
+    }
+
+    /**
+     * Signed shortest-path steps between two positions (same wrap as moveRotaryDispenserToCompartmentNumber)
+     */
+    long calculateShortestStepsBetween(long fromPositionSteps, long toPositionSteps) const {
+        long stepsToMove = toPositionSteps - fromPositionSteps;
+        float totalStepsPerRevolution = getTotalStepsPerRevolution();
+
+        if (labs(stepsToMove) > (totalStepsPerRevolution / 2)) {
+            if (stepsToMove > 0) {
+                stepsToMove -= (long)totalStepsPerRevolution;
+            } else {
+                stepsToMove += (long)totalStepsPerRevolution;
+            }
+        }
+        return stepsToMove;
+    }
+
+    /**
+     * Time for a stepper move; generateStepPulse() spends two pulse widths per step
+     */
+    unsigned long calculateStepperMoveMilliseconds(long steps) const {
+        unsigned long stepDurationMicroseconds = 2UL * systemConfiguration->stepperStepPulseWidthMicroseconds;
+        return (unsigned long)(labs(steps) * stepDurationMicroseconds / 1000UL);
+    }
+
+    /**
+     * Time for moveServoToMicroseconds(); one step delay per intermediate write plus the final write
+     */
+    unsigned long calculateServoSweepMilliseconds(int fromMicroseconds, int toMicroseconds) const {
+        int distance = abs(toMicroseconds - fromMicroseconds);
+        int stepSize = systemConfiguration->servoStepMicroseconds;
+        long intermediateWrites = (stepSize > 0) ? (distance + stepSize - 1) / stepSize : 0;
+        return (unsigned long)((intermediateWrites + 1) * systemConfiguration->servoStepDelayMilliseconds);
+    }
+
+    /**
+     * Time for waitForServoToSettle() after a sweep; the modeled remaining
+     * time, never more than servoMovementDelayMilliseconds
+     */
+    unsigned long calculateServoSettleMilliseconds(int fromMicroseconds, int toMicroseconds) const {
+        unsigned long fixedDelay = (unsigned long)systemConfiguration->servoMovementDelayMilliseconds;
+        if (fromMicroseconds == toMicroseconds) {
+            return 0;  // Already settled there
+        }
+        long modeled = ServoMotionModel::estimateSettleMillisecondsAfterSweep(
+            toMicroseconds - fromMicroseconds, calculateServoSweepMilliseconds(fromMicroseconds, toMicroseconds),
+            systemConfiguration->servoSlewMicrosecondsPerSecond, systemConfiguration->servoSettleMilliseconds);
+        return (modeled >= 0 && (unsigned long)modeled < fixedDelay) ? (unsigned long)modeled : fixedDelay;
+    }
+
+    int getServoMinSafe() const {
+        return systemConfiguration->servoMinMicroseconds + systemConfiguration->servoEndMarginMicroseconds;
+    }
+
+    int getServoMaxSafe() const {
+        return systemConfiguration->servoMaxMicroseconds - systemConfiguration->servoEndMarginMicroseconds;
+    }
+
+    /**
+     * Forward steps the homing loop needs to reach the switch from a tracked position
+     */
+    long calculateForwardStepsToHome(long fromPositionSteps) const {
+        long totalSteps = (long)getTotalStepsPerRevolution();
+        if (totalSteps <= 0) {
+            return 0;
+        }
+        long remainder = (-fromPositionSteps) % totalSteps;
+        return (remainder < 0) ? remainder + totalSteps : remainder;
+    }
+
+    /**
+     * Time for performHomingWithRetryAndEscalation() from a tracked position
+     * @param fromPositionSteps Position before homing
+     * @param systemAlreadyHomed Whether the early "already on the switch" return applies
+     */
+    unsigned long calculateHomingMilliseconds(long fromPositionSteps, bool systemAlreadyHomed) const {
+        int restPosition = getServoMinSafe();
+        unsigned long total = calculateServoSweepMilliseconds(restPosition, restPosition) +
+                              calculateServoSettleMilliseconds(restPosition, restPosition);
+
+        long stepsToHome = calculateForwardStepsToHome(fromPositionSteps);
+        if (stepsToHome == 0 && systemAlreadyHomed) {
+            return total;
+        }
+
+        if (stepsToHome == 0) {
+            // Back off the switch by 10° and come round to it again
+            long backOffSteps = (long)((10.0 / 360.0) * getTotalStepsPerRevolution());
+            total += calculateStepperMoveMilliseconds(backOffSteps) + 200;
+            stepsToHome = backOffSteps;
+        }
+
+        unsigned long rotationTime = calculateStepperMoveMilliseconds(stepsToHome);
+        if (rotationTime > MAXIMUM_HOMING_TIMEOUT_MILLISECONDS) {
+            rotationTime = MAXIMUM_HOMING_TIMEOUT_MILLISECONDS;
+        }
+        return total + rotationTime + systemConfiguration->delayAfterHomingSwitchActivationMilliseconds;
+    }
+
+    /**
+     * Whether a homing pass from this position finishes before the timeout
+     */
+    bool isHomingWithinTimeout(long fromPositionSteps) const {
+        return calculateStepperMoveMilliseconds(calculateForwardStepsToHome(fromPositionSteps)) <=
+               MAXIMUM_HOMING_TIMEOUT_MILLISECONDS;
+    }
+
+    /**
+     * Length of the IR polling window in attemptToDispenseAndCountPills()
+     */
+    unsigned long getPillDetectionWindowMilliseconds() const {
+        return systemConfiguration->pillDetectionTimeoutMilliseconds;
+    }
+};
+
+/**
+ * DispenseSimulator Class
+ *
+ * Discrete-event simulation of one dispenser unit serving a stream of dose
+ * requests. Each firmware phase is an event; the unit serves doses FIFO and
+ * queues arrivals while busy. Pill release and IR detection are sampled from
+ * DispenserBehaviourModel, so retries and failures appear at realistic rates.
+ *
+ * Has no Arduino dependencies so it can be compiled and run on a host as well
+ * as on the device (see the SIMULATE BLE command).
+ */
+class DispenseSimulator {
+private:
+    enum SimulationEventType {
+        EVENT_DOSE_ARRIVAL,
+        EVENT_PHASE_COMPLETE
+    };
+
+    struct SimulationEvent {
+        unsigned long timeMilliseconds;
+        uint8_t eventType;
+    };
+
+    const SystemConfiguration* systemConfiguration;
+    DispenseTimingModel timingModel;
+    DispenserBehaviourModel behaviourModel;
+    uint32_t randomState;
+
+    // Event queue (binary min-heap on time)
+    SimulationEvent eventQueue[SIMULATOR_EVENT_QUEUE_CAPACITY];
+    int eventQueueSize;
+    unsigned long currentTimeMilliseconds;
+
+    // Dose source: recorded list, or synthetic Poisson arrivals
+    const SimulatedDoseRequest* recordedDoses;
+    int recordedDoseCount;
+    int syntheticDoseCount;
+    float syntheticDosesPerHour;
+    int syntheticMaximumPillsPerDose;
+    int dosesGenerated;
+    SimulatedDoseRequest pendingArrivalDose;
+
+    // Doses waiting for the unit (ring buffer)
+    SimulatedDoseRequest waitingDoses[SIMULATOR_MAXIMUM_WAITING_DOSES];
+    int waitingDoseHead;
+    int waitingDoseCount;
+
+    // State of the dose being served
+    bool isUnitBusy;
+    SimulatedDoseRequest doseInService;
+    int currentPhase;
+    int currentPillIndex;
+    int currentAttemptNumber;
+    int pillsDetectedForCurrentDose;
+    bool currentAttemptDetectedPill;
+    bool isRecoveringFromFailedDose;
+    unsigned long currentPhaseStartMilliseconds;
+    long currentPositionSteps;
+    int currentCompartmentNumber;
+    bool isSystemHomed;
+
+    // Results
+    unsigned long phaseTotalMilliseconds[NUMBER_OF_SIMULATED_PHASES];
+    unsigned long doseLatencyMilliseconds[SIMULATOR_MAXIMUM_RECORDED_LATENCIES];
+    uint32_t latencySampleRandomState;      // Separate from randomState so sampling does not change the run
+    unsigned long maximumLatencyMilliseconds;
+    unsigned long firstArrivalMilliseconds;
+    unsigned long lastCompletionMilliseconds;
+    int completedDoseCount;
+    int failedDoseCount;
+    int droppedDoseCount;
+    long requestedPillCount;
+    long detectedPillCount;
+    long dispenseAttemptCount;
+    long undetectedReleaseCount;
+
+    // ========================================================================
+    // Random Number Generation (deterministic xorshift32)
+    // ========================================================================
+
+    float nextUniformRandom() {
+        randomState ^= randomState << 13;
+        randomState ^= randomState >> 17;
+        randomState ^= randomState << 5;
+        return (randomState >> 8) * (1.0f / 16777216.0f);
+    }
+
+    float nextNormalRandom(float mean, float standardDeviation) {
+        // Irwin-Hall approximation: sum of 12 uniforms has variance 1
+        float sum = 0;
+        for (int i = 0; i < 12; i++) {
+            sum += nextUniformRandom();
+        }
+        return mean + (sum - 6.0f) * standardDeviation;
+    }
+
+    // ========================================================================
+    // Event Queue
+    // ========================================================================
+
+    void scheduleEvent(unsigned long timeMilliseconds, uint8_t eventType) {
+        if (eventQueueSize >= SIMULATOR_EVENT_QUEUE_CAPACITY) {
+            return;
+        }
+        int index = eventQueueSize++;
+        eventQueue[index].timeMilliseconds = timeMilliseconds;
+        eventQueue[index].eventType = eventType;
+
+        while (index > 0) {
+            int parent = (index - 1) / 2;
+            if (eventQueue[parent].timeMilliseconds <= eventQueue[index].timeMilliseconds) {
+                break;
+            }
+            SimulationEvent swap = eventQueue[parent];
+            eventQueue[parent] = eventQueue[index];
+            eventQueue[index] = swap;
+            index = parent;
+        }
+    }
+
+    SimulationEvent popEarliestEvent() {
+        SimulationEvent earliest = eventQueue[0];
+        eventQueue[0] = eventQueue[--eventQueueSize];
+
+        int index = 0;
+        while (true) {
+            int left = index * 2 + 1;
+            int right = left + 1;
+            int smallest = index;
+            if (left < eventQueueSize && eventQueue[left].timeMilliseconds < eventQueue[smallest].timeMilliseconds) {
+                smallest = left;
+            }
+            if (right < eventQueueSize && eventQueue[right].timeMilliseconds < eventQueue[smallest].timeMilliseconds) {
+                smallest = right;
+            }
+            if (smallest == index) {
+                break;
+            }
+            SimulationEvent swap = eventQueue[smallest];
+            eventQueue[smallest] = eventQueue[index];
+            eventQueue[index] = swap;
+            index = smallest;
+        }
+        return earliest;
+    }
+
+    // ========================================================================
+    // Dose Arrivals
+    // ========================================================================
+
+    bool hasMoreDosesToGenerate() {
+        if (recordedDoses != nullptr) {
+            return dosesGenerated < recordedDoseCount;
+        }
+        return dosesGenerated < syntheticDoseCount;
+    }
+
+    SimulatedDoseRequest generateNextDose(unsigned long previousArrivalMilliseconds) {
+        if (recordedDoses != nullptr) {
+            return recordedDoses[dosesGenerated];
+        }
+
+        SimulatedDoseRequest dose;
+        float meanInterArrivalMilliseconds = 3600000.0f / syntheticDosesPerHour;
+        float uniform = nextUniformRandom();
+        if (uniform < 1e-6f) {
+            uniform = 1e-6f;
+        }
+        dose.arrivalTimeMilliseconds = previousArrivalMilliseconds +
+                                       (unsigned long)(-logf(uniform) * meanInterArrivalMilliseconds);
+        dose.compartmentNumber = 1 + (int)(nextUniformRandom() * systemConfiguration->numberOfCompartmentsInDispenser);
+        dose.pillCount = 1 + (int)(nextUniformRandom() * syntheticMaximumPillsPerDose);
+        return dose;
+    }
+
+    void scheduleNextArrival(unsigned long previousArrivalMilliseconds) {
+        if (!hasMoreDosesToGenerate()) {
+            return;
+        }
+        pendingArrivalDose = generateNextDose(previousArrivalMilliseconds);
+        scheduleEvent(pendingArrivalDose.arrivalTimeMilliseconds, EVENT_DOSE_ARRIVAL);
+    }
+
+    void handleDoseArrival() {
+        SimulatedDoseRequest dose = pendingArrivalDose;
+        dosesGenerated++;
+
+        if (dosesGenerated == 1) {
+            firstArrivalMilliseconds = dose.arrivalTimeMilliseconds;
+        }
+
+        if (waitingDoseCount < SIMULATOR_MAXIMUM_WAITING_DOSES) {
+            int tail = (waitingDoseHead + waitingDoseCount) % SIMULATOR_MAXIMUM_WAITING_DOSES;
+            waitingDoses[tail] = dose;
+            waitingDoseCount++;
+        } else {
+            droppedDoseCount++;
+        }
+
+        scheduleNextArrival(dose.arrivalTimeMilliseconds);
+
+        if (!isUnitBusy) {
+            startNextWaitingDose();
+        }
+    }
+
+    // ========================================================================
+    // Dispense Sequence State Machine
+    // ========================================================================
+
+    void startPhase(int phase, unsigned long durationMilliseconds) {
+        currentPhase = phase;
+        currentPhaseStartMilliseconds = currentTimeMilliseconds;
+        scheduleEvent(currentTimeMilliseconds + durationMilliseconds, EVENT_PHASE_COMPLETE);
+    }
+
+    void startNextWaitingDose() {
+        if (waitingDoseCount == 0) {
+            isUnitBusy = false;
+            return;
+        }
+
+        doseInService = waitingDoses[waitingDoseHead];
+        waitingDoseHead = (waitingDoseHead + 1) % SIMULATOR_MAXIMUM_WAITING_DOSES;
+        waitingDoseCount--;
+
+        isUnitBusy = true;
+        currentPillIndex = 0;
+        currentAttemptNumber = 1;
+        pillsDetectedForCurrentDose = 0;
+        isRecoveringFromFailedDose = false;
+        requestedPillCount += doseInService.pillCount;
+
+        if (!isSystemHomed) {
+            startPhase(PHASE_HOMING, timingModel.calculateHomingMilliseconds(currentPositionSteps, false));
+        } else {
+            startCompartmentMove();
+        }
+    }
+
+    void startCompartmentMove() {
+        unsigned long duration = 0;
+        if (currentCompartmentNumber != doseInService.compartmentNumber) {
+            long target = timingModel.getCompartmentStepPosition(doseInService.compartmentNumber);
+            long stepsToMove = timingModel.calculateShortestStepsBetween(currentPositionSteps, target);
+            if (labs(stepsToMove) >= 5) {
+                duration = timingModel.calculateStepperMoveMilliseconds(stepsToMove) +
+                           systemConfiguration->delayAfterCompartmentMoveMilliseconds;
+                currentPositionSteps += stepsToMove;
+            }
+            currentCompartmentNumber = doseInService.compartmentNumber;
+        }
+        startPhase(PHASE_COMPARTMENT_MOVE, duration);
+    }
+
+    void startDetectionWindow() {
+        dispenseAttemptCount++;
+        currentAttemptDetectedPill = false;
+
+        float releaseProbability = calculateReleaseProbability(doseInService.compartmentNumber);
+        if (nextUniformRandom() < releaseProbability) {
+            // The IR is watched through the servo settle wait, then again after the
+            // 50 ms pre-read until the window closes, relative to sweep end
+            float releaseDelay = nextNormalRandom(behaviourModel.pillReleaseDelayMeanMilliseconds,
+                                                  behaviourModel.pillReleaseDelayStandardDeviationMilliseconds);
+            float settleMilliseconds = timingModel.calculateServoSettleMilliseconds(timingModel.getServoMinSafe(),
+                                                                                    timingModel.getServoMaxSafe());
+            float windowOpens = settleMilliseconds + 50;
+            float windowCloses = settleMilliseconds + timingModel.getPillDetectionWindowMilliseconds();
+            bool isWatched = (releaseDelay > 0 && releaseDelay < settleMilliseconds) ||
+                             (releaseDelay > windowOpens && releaseDelay < windowCloses);
+
+            float sampleProbability = 1.0f;
+            int pollInterval = systemConfiguration->pillDetectionCheckIntervalMilliseconds;
+            if (pollInterval > behaviourModel.pillTransitPulseMilliseconds) {
+                sampleProbability = (float)behaviourModel.pillTransitPulseMilliseconds / pollInterval;
+            }
+
+            if (isWatched && nextUniformRandom() < sampleProbability) {
+                currentAttemptDetectedPill = true;
+            } else {
+                undetectedReleaseCount++;
+            }
+        }
+
+        startPhase(PHASE_PILL_DETECTION_WINDOW, timingModel.getPillDetectionWindowMilliseconds());
+    }
+
+    /**
+     * Release probability for one attempt, degraded by settings below the mechanical limits
+     */
+    float calculateReleaseProbability(int compartmentNumber) {
+        float probability = behaviourModel.pillReleaseProbabilityForCompartment[compartmentNumber - 1];
+        
+        probability *= calculateLimitFactor(systemConfiguration->electromagnetActivationDelayMilliseconds,
+                                            behaviourModel.electromagnetMinimumStabilizationMilliseconds);
+        probability *= calculateLimitFactor(systemConfiguration->delayAfterCompartmentMoveMilliseconds,
+                                            behaviourModel.compartmentMinimumSettleMilliseconds);
+        probability *= calculateLimitFactor(
+            timingModel.calculateServoSweepMilliseconds(timingModel.getServoMinSafe(), timingModel.getServoMaxSafe()),
+            behaviourModel.servoMinimumSweepMilliseconds);
+        return probability;
+    }
+    
+    static float calculateLimitFactor(long actualValue, long minimumValue) {
+        if (minimumValue <= 0 || actualValue >= minimumValue) {
+            return 1.0f;
+        }
+        return (actualValue > 0) ? (float)actualValue / minimumValue : 0.0f;
+    }
+
+    void finishCurrentPill() {
+        if (currentPillIndex < doseInService.pillCount - 1) {
+            currentPillIndex++;
+            currentAttemptNumber = 1;
+            startPhase(PHASE_MULTIPLE_PILL_WAIT, systemConfiguration->delayBetweenMultipleDispensesMilliseconds);
+            return;
+        }
+
+        if (pillsDetectedForCurrentDose == 0) {
+            // Main loop shows the failure, then the override/check message, then re-homes
+            startPhase(PHASE_FAILURE_FEEDBACK,
+                       systemConfiguration->errorMessageDisplayTimeMilliseconds +
+                       2 * systemConfiguration->statusMessageDisplayTimeMilliseconds);
+            return;
+        }
+
+        if (systemConfiguration->autoHomeAfterDispense) {
+            startPhase(PHASE_AUTO_HOMING, timingModel.calculateHomingMilliseconds(currentPositionSteps, true));
+            return;
+        }
+
+        completeDoseInService();
+    }
+
+    /**
+     * Keep a uniform sample of all dose latencies (reservoir sampling)
+     */
+    void recordDoseLatency(unsigned long latency) {
+        if (latency > maximumLatencyMilliseconds) {
+            maximumLatencyMilliseconds = latency;
+        }
+        if (completedDoseCount < SIMULATOR_MAXIMUM_RECORDED_LATENCIES) {
+            doseLatencyMilliseconds[completedDoseCount] = latency;
+            return;
+        }
+        latencySampleRandomState ^= latencySampleRandomState << 13;
+        latencySampleRandomState ^= latencySampleRandomState >> 17;
+        latencySampleRandomState ^= latencySampleRandomState << 5;
+        uint32_t slot = latencySampleRandomState % (uint32_t)(completedDoseCount + 1);
+        if (slot < SIMULATOR_MAXIMUM_RECORDED_LATENCIES) {
+            doseLatencyMilliseconds[slot] = latency;
+        }
+    }
+
+    void completeDoseInService() {
+        recordDoseLatency(currentTimeMilliseconds - doseInService.arrivalTimeMilliseconds);
+        completedDoseCount++;
+        if (pillsDetectedForCurrentDose == 0) {
+            failedDoseCount++;
+        }
+        detectedPillCount += pillsDetectedForCurrentDose;
+        lastCompletionMilliseconds = currentTimeMilliseconds;
+
+        startNextWaitingDose();
+    }
+
+    void markHomed() {
+        if (timingModel.isHomingWithinTimeout(currentPositionSteps)) {
+            currentPositionSteps = 0;
+            currentCompartmentNumber = 0;
+            isSystemHomed = true;
+        } else {
+            isSystemHomed = false;
+        }
+    }
+
+    void handlePhaseComplete() {
+        phaseTotalMilliseconds[currentPhase] += currentTimeMilliseconds - currentPhaseStartMilliseconds;
+        int restPosition = timingModel.getServoMinSafe();
+        int maxPosition = timingModel.getServoMaxSafe();
+
+        switch (currentPhase) {
+            case PHASE_HOMING:
+                markHomed();
+                if (isRecoveringFromFailedDose) {
+                    completeDoseInService();
+                } else {
+                    startCompartmentMove();
+                }
+                break;
+
+            case PHASE_COMPARTMENT_MOVE:
+            case PHASE_RETRY_WAIT:
+            case PHASE_MULTIPLE_PILL_WAIT:
+                startPhase(PHASE_ELECTROMAGNET_ACTIVATION, systemConfiguration->electromagnetActivationDelayMilliseconds);
+                break;
+
+            case PHASE_ELECTROMAGNET_ACTIVATION:
+                startPhase(PHASE_SERVO_SWEEP_OUT, timingModel.calculateServoSweepMilliseconds(restPosition, maxPosition));
+                break;
+
+            case PHASE_SERVO_SWEEP_OUT:
+                startPhase(PHASE_SERVO_SETTLE, timingModel.calculateServoSettleMilliseconds(restPosition, maxPosition));
+                break;
+
+            case PHASE_SERVO_SETTLE:
+                startDetectionWindow();
+                break;
+
+            case PHASE_PILL_DETECTION_WINDOW:
+                startPhase(PHASE_SERVO_RETURN,
+                           timingModel.calculateServoSweepMilliseconds(maxPosition, restPosition) +
+                           timingModel.calculateServoSettleMilliseconds(maxPosition, restPosition));
+                break;
+
+            case PHASE_SERVO_RETURN:
+                startPhase(PHASE_ELECTROMAGNET_RELEASE, systemConfiguration->electromagnetDeactivationDelayMilliseconds);
+                break;
+
+            case PHASE_ELECTROMAGNET_RELEASE:
+                if (currentAttemptDetectedPill) {
+                    pillsDetectedForCurrentDose++;
+                    finishCurrentPill();
+                } else if (currentAttemptNumber < systemConfiguration->maximumDispenseAttempts) {
+                    currentAttemptNumber++;
+                    startPhase(PHASE_RETRY_WAIT, systemConfiguration->delayBetweenDispenseAttemptsMilliseconds);
+                } else {
+                    finishCurrentPill();
+                }
+                break;
+
+            case PHASE_AUTO_HOMING:
+                markHomed();
+                completeDoseInService();
+                break;
+
+            case PHASE_FAILURE_FEEDBACK:
+                isRecoveringFromFailedDose = true;
+                startPhase(PHASE_HOMING, timingModel.calculateHomingMilliseconds(currentPositionSteps, false));
+                break;
+
+            default:
+                completeDoseInService();
+                break;
+        }
+    }
+
+    static int compareUnsignedLong(const void* first, const void* second) {
+        unsigned long a = *(const unsigned long*)first;
+        unsigned long b = *(const unsigned long*)second;
+        return (a > b) - (a < b);
+    }
+
+public:
+    /**
+     * Constructor
+     * @param config Pointer to system configuration to simulate
+     */
+    DispenseSimulator(const SystemConfiguration* config)
+        : systemConfiguration(config),
+          timingModel(config) {
+        randomState = 0x2545F491;
+        recordedDoses = nullptr;
+        recordedDoseCount = 0;
+        syntheticDoseCount = 0;
+        syntheticDosesPerHour = 30.0;
+        syntheticMaximumPillsPerDose = 1;
+        resetSimulationState();
+    }
+
+    /**
+     * Replace the stochastic mechanism model
+     */
+    void setBehaviourModel(const DispenserBehaviourModel& model) {
+        behaviourModel = model;
+    }
+
+    DispenserBehaviourModel& getBehaviourModel() {
+        return behaviourModel;
+    }
+
+    /**
+     * Seed the random generator (same seed + inputs = same results)
+     */
+    void setRandomSeed(uint32_t seed) {
+        randomState = (seed == 0) ? 0x2545F491 : seed;
+    }
+
+    /**
+     * Drive the simulation with Poisson dose arrivals over uniformly chosen compartments
+     * @param numberOfDoses Doses to simulate (clamped to SIMULATOR_MAXIMUM_SYNTHETIC_DOSES)
+     * @param dosesPerHour Mean arrival rate (set above capacity to measure saturation)
+     * @param maximumPillsPerDose Pills per dose are uniform in 1..maximumPillsPerDose
+     */
+    void configureSyntheticDoseSchedule(int numberOfDoses, float dosesPerHour, int maximumPillsPerDose) {
+        recordedDoses = nullptr;
+        syntheticDoseCount = (numberOfDoses < 0) ? 0 : numberOfDoses;
+        if (syntheticDoseCount > SIMULATOR_MAXIMUM_SYNTHETIC_DOSES) {
+            syntheticDoseCount = SIMULATOR_MAXIMUM_SYNTHETIC_DOSES;
+        }
+        syntheticDosesPerHour = (dosesPerHour > 0) ? dosesPerHour : 1.0;
+        syntheticMaximumPillsPerDose = (maximumPillsPerDose > 0) ? maximumPillsPerDose : 1;
+    }
+
+    /**
+     * Drive the simulation with a recorded schedule (must be sorted by arrival time)
+     */
+    void configureRecordedDoseSchedule(const SimulatedDoseRequest* doses, int numberOfDoses) {
+        recordedDoses = doses;
+        recordedDoseCount = numberOfDoses;
+    }
+
+    void resetSimulationState() {
+        eventQueueSize = 0;
+        currentTimeMilliseconds = 0;
+        dosesGenerated = 0;
+        waitingDoseHead = 0;
+        waitingDoseCount = 0;
+        isUnitBusy = false;
+        currentPhase = PHASE_HOMING;
+        currentPillIndex = 0;
+        currentAttemptNumber = 1;
+        pillsDetectedForCurrentDose = 0;
+        currentAttemptDetectedPill = false;
+        isRecoveringFromFailedDose = false;
+        currentPhaseStartMilliseconds = 0;
+        currentPositionSteps = 0;
+        currentCompartmentNumber = 0;
+        isSystemHomed = true;   // setup() homes before the first dose
+        firstArrivalMilliseconds = 0;
+        lastCompletionMilliseconds = 0;
+        completedDoseCount = 0;
+        latencySampleRandomState = 0x9E3779B9;
+        maximumLatencyMilliseconds = 0;
+        failedDoseCount = 0;
+        droppedDoseCount = 0;
+        requestedPillCount = 0;
+        detectedPillCount = 0;
+        dispenseAttemptCount = 0;
+        undetectedReleaseCount = 0;
+        for (int i = 0; i < NUMBER_OF_SIMULATED_PHASES; i++) {
+            phaseTotalMilliseconds[i] = 0;
+        }
+    }
+
+    /**
+     * Start the configured schedule; advance it with runSimulationSlice()
+     */
+    void beginSimulation() {
+        resetSimulationState();
+        scheduleNextArrival(0);
+    }
+
+    /**
+     * Process up to maximumEvents events of a run started with beginSimulation()
+     * @return true while events remain
+     */
+    bool runSimulationSlice(int maximumEvents) {
+        for (int i = 0; i < maximumEvents && eventQueueSize > 0; i++) {
+            SimulationEvent event = popEarliestEvent();
+            currentTimeMilliseconds = event.timeMilliseconds;
+
+            if (event.eventType == EVENT_DOSE_ARRIVAL) {
+                handleDoseArrival();
+            } else {
+                handlePhaseComplete();
+            }
+        }
+        return eventQueueSize > 0;
+    }
+
+    bool isSimulationRunning() {
+        return eventQueueSize > 0;
+    }
+
+    /**
+     * Run the configured schedule to completion
+     * @return Number of doses completed
+     */
+    int runSimulation() {
+        beginSimulation();
+        while (isSimulationRunning()) {
+            runSimulationSlice(SIMULATOR_EVENTS_PER_SLICE);
+        }
+        return completedDoseCount;
+    }
+
+    // ========================================================================
+    // Results
+    // ========================================================================
+
+    unsigned long getTotalBusyMilliseconds() {
+        unsigned long total = 0;
+        for (int i = 0; i < NUMBER_OF_SIMULATED_PHASES; i++) {
+            total += phaseTotalMilliseconds[i];
+        }
+        return total;
+    }
+
+    unsigned long getPhaseTotalMilliseconds(int phase) {
+        return phaseTotalMilliseconds[phase];
+    }
+
+    /**
+     * Doses per hour the unit can sustain back-to-back (capacity)
+     */
+    float getSustainedDosesPerHour() {
+        unsigned long busy = getTotalBusyMilliseconds();
+        return (busy > 0) ? completedDoseCount * 3600000.0f / busy : 0;
+    }
+
+    /**
+     * Doses per hour actually served over the simulated span
+     */
+    float getObservedDosesPerHour() {
+        unsigned long span = lastCompletionMilliseconds - firstArrivalMilliseconds;
+        return (span > 0) ? completedDoseCount * 3600000.0f / span : 0;
+    }
+
+    float getMeanServiceMilliseconds() {
+        return (completedDoseCount > 0) ? (float)getTotalBusyMilliseconds() / completedDoseCount : 0;
+    }
+
+    /**
+     * Fraction of requested pills the IR sensor confirmed
+     */
+    float getPillSuccessRate() {
+        return (requestedPillCount > 0) ? (float)detectedPillCount / requestedPillCount : 0;
+    }
+
+    int getCompletedDoseCount() { return completedDoseCount; }
+    int getFailedDoseCount() { return failedDoseCount; }
+    int getDroppedDoseCount() { return droppedDoseCount; }
+    int getSyntheticDoseCount() { return syntheticDoseCount; }
+    long getDispenseAttemptCount() { return dispenseAttemptCount; }
+    long getUndetectedReleaseCount() { return undetectedReleaseCount; }
+
+    /**
+     * Dose latency percentile (queueing + service)
+     * Estimated from a uniform sample once more than
+     * SIMULATOR_MAXIMUM_RECORDED_LATENCIES doses completed; 100 is the exact maximum.
+     * Dropped doses have no latency and are not included.
+     * @param percentile 0-100
+     */
+    unsigned long getLatencyPercentileMilliseconds(int percentile) {
+        if (percentile >= 100) {
+            return maximumLatencyMilliseconds;
+        }
+        int count = completedDoseCount;
+        if (count > SIMULATOR_MAXIMUM_RECORDED_LATENCIES) {
+            count = SIMULATOR_MAXIMUM_RECORDED_LATENCIES;
+        }
+        if (count == 0) {
+            return 0;
+        }
+
+        static unsigned long sortedLatencies[SIMULATOR_MAXIMUM_RECORDED_LATENCIES];
+        for (int i = 0; i < count; i++) {
+            sortedLatencies[i] = doseLatencyMilliseconds[i];
+        }
+        qsort(sortedLatencies, count, sizeof(unsigned long), compareUnsignedLong);
+
+        int index = (percentile * (count - 1) + 50) / 100;
+        return sortedLatencies[index];
+    }
+
+    /**
+     * Phase that consumed the most unit time
+     */
+    int getBottleneckPhase() {
+        int bottleneck = 0;
+        for (int i = 1; i < NUMBER_OF_SIMULATED_PHASES; i++) {
+            if (phaseTotalMilliseconds[i] > phaseTotalMilliseconds[bottleneck]) {
+                bottleneck = i;
+            }
+        }
+        return bottleneck;
+    }
+
+    /**
+     * Print a full report (works with Serial or any print/println sink)
+     */
+    template <typename Output>
+    void printSimulationReport(Output& out) {
+        unsigned long busy = getTotalBusyMilliseconds();
+
+        out.println("SIMULATION RESULTS:");
+        if (droppedDoseCount > 0) {
+            out.print("WARNING: ");
+            out.print(droppedDoseCount);
+            out.print(" of ");
+            out.print(dosesGenerated);
+            out.print(" doses dropped (more than ");
+            out.print(SIMULATOR_MAXIMUM_WAITING_DOSES);
+            out.println(" waiting); latencies cover served doses only");
+        }
+        out.print("Doses completed: ");
+        out.print(completedDoseCount);
+        out.print(" (failed ");
+        out.print(failedDoseCount);
+        out.print(", dropped ");
+        out.print(droppedDoseCount);
+        out.println(")");
+        out.print("Pill success rate: ");
+        out.print(getPillSuccessRate() * 100.0);
+        out.print(" % over ");
+        out.print(dispenseAttemptCount);
+        out.println(" attempts");
+        out.print("Undetected releases: ");
+        out.println(undetectedReleaseCount);
+        out.print("Sustained capacity: ");
+        out.print(getSustainedDosesPerHour());
+        out.println(" doses/hour");
+        out.print("Observed throughput: ");
+        out.print(getObservedDosesPerHour());
+        out.println(" doses/hour");
+        out.print("Mean service time: ");
+        out.print(getMeanServiceMilliseconds());
+        out.println(" ms");
+        out.print("Latency p50/p90/p99/max: ");
+        out.print(getLatencyPercentileMilliseconds(50));
+        out.print(" / ");
+        out.print(getLatencyPercentileMilliseconds(90));
+        out.print(" / ");
+        out.print(getLatencyPercentileMilliseconds(99));
+        out.print(" / ");
+        out.print(getLatencyPercentileMilliseconds(100));
+        out.println(" ms");
+
+        out.println("Time per phase:");
+        for (int i = 0; i < NUMBER_OF_SIMULATED_PHASES; i++) {
+            out.print("  ");
+            out.print(getSimulatedPhaseName(i));
+            out.print(": ");
+            out.print(phaseTotalMilliseconds[i]);
+            out.print(" ms (");
+            out.print(busy > 0 ? phaseTotalMilliseconds[i] * 100.0 / busy : 0.0);
+            out.println(" %)");
+        }
+        out.print("Bottleneck: ");
+        out.println(getSimulatedPhaseName(getBottleneckPhase()));
+    }
+};
+
+#endif // DISPENSE_SIMULATOR_H
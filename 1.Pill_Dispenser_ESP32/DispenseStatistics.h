@@ -0,0 +1,353 @@
+#ifndef DISPENSE_STATISTICS_H
+#define DISPENSE_STATISTICS_H
+
+#include <Arduino.h>
+#include "Config.h"
+#include "ConfigurationSettings.h"
+#include "DoseScheduler.h"
+
+#define DISPENSE_STATISTICS_HOURLY_BUCKETS      24      // Rolling last 24 hours
+#define DISPENSE_STATISTICS_DAILY_BUCKETS       14      // Rolling last 14 days
+#define DISPENSE_STATISTICS_SECONDS_PER_HOUR    3600UL
+
+/**
+ * Outcomes within one hour or one day, tagged with the period they belong to
+ * (local hours/days since the epoch); a bucket from an older period reads as 0
+ */
+struct DispenseStatisticsBucket {
+    uint32_t periodIndex;
+    uint16_t pillsDispensed;
+    uint16_t numberOfRequests;
+    uint16_t numberOfFailedRequests;
+    uint16_t numberOfRetries;
+};
+
+/**
+ * DispenseStatistics Class
+ *
+ * Dispense outcomes kept up to date as they happen, in fixed memory:
+ * - 64-bit totals: pills, requests, fully served / partial / failed
+ *   requests, actuation attempts and retries
+ * - Pills and failed requests per compartment
+ * - Rolling per-hour and per-day buckets (local time)
+ *
+ * Every total is a stored counter, so reads are constant time. Lifetime
+ * pill counts per compartment start from the journal's recovered counts;
+ * everything else counts since boot or the last RESET.
+ */
+class DispenseStatistics {
+private:
+    DoseScheduler* doseScheduler;       // UTC offset for local hour/day boundaries
+
+    uint64_t totalPillsDispensed;
+    uint64_t totalRequests;
+    uint64_t totalFullyServedRequests;
+    uint64_t totalPartialRequests;
+    uint64_t totalFailedRequests;
+    uint64_t totalAttempts;
+    uint64_t totalRetries;
+    uint64_t pillsDispensedPerCompartment[NUMBER_OF_COMPARTMENTS_IN_DISPENSER];
+    uint64_t failedRequestsPerCompartment[NUMBER_OF_COMPARTMENTS_IN_DISPENSER];
+    uint32_t timeOfLastRecord;
+
+    DispenseStatisticsBucket hourlyBuckets[DISPENSE_STATISTICS_HOURLY_BUCKETS];
+    DispenseStatisticsBucket dailyBuckets[DISPENSE_STATISTICS_DAILY_BUCKETS];
+
+    uint32_t getLocalSeconds(uint32_t now) {
+        return now + (long)doseScheduler->getUtcOffsetMinutes() * 60;
+    }
+
+    uint32_t getHourIndex(uint32_t now) {
+        return getLocalSeconds(now) / DISPENSE_STATISTICS_SECONDS_PER_HOUR;
+    }
+
+    uint32_t getDayIndex(uint32_t now) {
+        return getLocalSeconds(now) / DOSE_SCHEDULER_SECONDS_PER_DAY;
+    }
+
+    static uint16_t addSaturated(uint16_t value, int increment) {
+        long sum = (long)value + increment;
+        return (sum > 0xFFFF) ? 0xFFFF : (uint16_t)sum;
+    }
+
+    static void addToBucket(DispenseStatisticsBucket& bucket, uint32_t periodIndex,
+                            int pillsDispensed, bool isFailed, int retries) {
+        if (bucket.periodIndex != periodIndex) {
+            bucket = DispenseStatisticsBucket();
+            bucket.periodIndex = periodIndex;
+        }
+        bucket.pillsDispensed = addSaturated(bucket.pillsDispensed, pillsDispensed);
+        bucket.numberOfRequests = addSaturated(bucket.numberOfRequests, 1);
+        bucket.numberOfFailedRequests = addSaturated(bucket.numberOfFailedRequests, isFailed ? 1 : 0);
+        bucket.numberOfRetries = addSaturated(bucket.numberOfRetries, retries);
+    }
+
+    /**
+     * @return The bucket for the period, or an empty one if it has rolled over
+     */
+    static DispenseStatisticsBucket getBucketForPeriod(const DispenseStatisticsBucket* buckets,
+                                                       int numberOfBuckets, uint32_t periodIndex) {
+        const DispenseStatisticsBucket& bucket = buckets[periodIndex % numberOfBuckets];
+        if (bucket.periodIndex != periodIndex) {
+            return DispenseStatisticsBucket();
+        }
+        return bucket;
+    }
+
+public:
+    /**
+     * Constructor
+     * @param scheduler Source of the local UTC offset
+     */
+    DispenseStatistics(DoseScheduler* scheduler) {
+        doseScheduler = scheduler;
+        resetStatistics();
+    }
+
+    /**
+     * Zero every counter and bucket (RESET command)
+     */
+    void resetStatistics() {
+        totalPillsDispensed = 0;
+        totalRequests = 0;
+        totalFullyServedRequests = 0;
+        totalPartialRequests = 0;
+        totalFailedRequests = 0;
+        totalAttempts = 0;
+        totalRetries = 0;
+        for (int i = 0; i < NUMBER_OF_COMPARTMENTS_IN_DISPENSER; i++) {
+            pillsDispensedPerCompartment[i] = 0;
+            failedRequestsPerCompartment[i] = 0;
+        }
+        for (int i = 0; i < DISPENSE_STATISTICS_HOURLY_BUCKETS; i++) {
+            hourlyBuckets[i] = DispenseStatisticsBucket();
+        }
+        for (int i = 0; i < DISPENSE_STATISTICS_DAILY_BUCKETS; i++) {
+            dailyBuckets[i] = DispenseStatisticsBucket();
+        }
+        timeOfLastRecord = 0;
+    }
+
+    /**
+     * Start a compartment's lifetime pill count from the journal
+     * @param compartmentNumber Compartment (1-based)
+     * @param recoveredCount Count recovered from the dispense journal
+     */
+    void seedCompartmentPillCount(int compartmentNumber, uint32_t recoveredCount) {
+        if (compartmentNumber < 1 || compartmentNumber > NUMBER_OF_COMPARTMENTS_IN_DISPENSER) {
+            return;
+        }
+        uint64_t& count = pillsDispensedPerCompartment[compartmentNumber - 1];
+        totalPillsDispensed += (uint64_t)recoveredCount - count;
+        count = recoveredCount;
+    }
+
+    /**
+     * Add one dispense request's outcome
+     * @param compartmentNumber Compartment (1-based)
+     * @param pillsRequested Pills asked for
+     * @param pillsDispensed Pills detected
+     * @param numberOfAttempts Actuation attempts made
+     * @param now UTC seconds
+     */
+    void recordDispenseOutcome(int compartmentNumber, int pillsRequested, int pillsDispensed,
+                               int numberOfAttempts, uint32_t now) {
+        bool isFailed = pillsRequested > 0 && pillsDispensed == 0;
+        // The first attempt per requested pill is not a retry
+        int retries = max(0, numberOfAttempts - pillsRequested);
+
+        totalPillsDispensed += pillsDispensed;
+        totalRequests++;
+        if (isFailed) {
+            totalFailedRequests++;
+        } else if (pillsDispensed < pillsRequested) {
+            totalPartialRequests++;
+        } else {
+            totalFullyServedRequests++;
+        }
+        totalAttempts += numberOfAttempts;
+        totalRetries += retries;
+
+        if (compartmentNumber >= 1 && compartmentNumber <= NUMBER_OF_COMPARTMENTS_IN_DISPENSER) {
+            pillsDispensedPerCompartment[compartmentNumber - 1] += pillsDispensed;
+            if (isFailed) {
+                failedRequestsPerCompartment[compartmentNumber - 1]++;
+            }
+        }
+
+        uint32_t hourIndex = getHourIndex(now);
+        uint32_t dayIndex = getDayIndex(now);
+        addToBucket(hourlyBuckets[hourIndex % DISPENSE_STATISTICS_HOURLY_BUCKETS], hourIndex,
+                    pillsDispensed, isFailed, retries);
+        addToBucket(dailyBuckets[dayIndex % DISPENSE_STATISTICS_DAILY_BUCKETS], dayIndex,
+                    pillsDispensed, isFailed, retries);
+        timeOfLastRecord = now;
+    }
+
+    // ========================================================================
+    // Constant-time reads
+    // ========================================================================
+
+    uint64_t getTotalPillsDispensed() {
+        return totalPillsDispensed;
+    }
+
+    uint64_t getTotalRequests() {
+        return totalRequests;
+    }
+
+    uint64_t getTotalFullyServedRequests() {
+        return totalFullyServedRequests;
+    }
+
+    uint64_t getTotalPartialRequests() {
+        return totalPartialRequests;
+    }
+
+    uint64_t getTotalFailedRequests() {
+        return totalFailedRequests;
+    }
+
+    uint64_t getTotalAttempts() {
+        return totalAttempts;
+    }
+
+    uint64_t getTotalRetries() {
+        return totalRetries;
+    }
+
+    uint64_t getPillsDispensedForCompartment(int compartmentNumber) {
+        if (compartmentNumber < 1 || compartmentNumber > NUMBER_OF_COMPARTMENTS_IN_DISPENSER) {
+            return 0;
+        }
+        return pillsDispensedPerCompartment[compartmentNumber - 1];
+    }
+
+    uint64_t getFailedRequestsForCompartment(int compartmentNumber) {
+        if (compartmentNumber < 1 || compartmentNumber > NUMBER_OF_COMPARTMENTS_IN_DISPENSER) {
+            return 0;
+        }
+        return failedRequestsPerCompartment[compartmentNumber - 1];
+    }
+
+    /**
+     * @return Requests served in full, as a percentage (100 if none yet)
+     */
+    float getSuccessRatePercent() {
+        if (totalRequests == 0) {
+            return 100.0;
+        }
+        return 100.0 * (double)totalFullyServedRequests / (double)totalRequests;
+    }
+
+    uint32_t getTimeOfLastRecord() {
+        return timeOfLastRecord;
+    }
+
+    /**
+     * @param age 0 = current hour, 1 = previous hour, ...
+     */
+    DispenseStatisticsBucket getHourlyBucket(uint32_t now, int age) {
+        return getBucketForPeriod(hourlyBuckets, DISPENSE_STATISTICS_HOURLY_BUCKETS, getHourIndex(now) - age);
+    }
+
+    /**
+     * @param age 0 = today, 1 = yesterday, ...
+     */
+    DispenseStatisticsBucket getDailyBucket(uint32_t now, int age) {
+        return getBucketForPeriod(dailyBuckets, DISPENSE_STATISTICS_DAILY_BUCKETS, getDayIndex(now) - age);
+    }
+
+    /**
+     * Pills per hour for the last DISPENSE_STATISTICS_HOURLY_BUCKETS hours
+     * @param pillCounts Receives the counts, current hour first
+     */
+    void getHourlyPillCounts(uint32_t now, uint32_t* pillCounts) {
+        for (int age = 0; age < DISPENSE_STATISTICS_HOURLY_BUCKETS; age++) {
+            pillCounts[age] = getHourlyBucket(now, age).pillsDispensed;
+        }
+    }
+
+    /**
+     * Pills per day for the last DISPENSE_STATISTICS_DAILY_BUCKETS days
+     * @param pillCounts Receives the counts, today first
+     */
+    void getDailyPillCounts(uint32_t now, uint32_t* pillCounts) {
+        for (int age = 0; age < DISPENSE_STATISTICS_DAILY_BUCKETS; age++) {
+            pillCounts[age] = getDailyBucket(now, age).pillsDispensed;
+        }
+    }
+
+    /**
+     * Print totals, per-compartment counts and the rolling buckets
+     * @param out Serial or any Print-like output
+     */
+    template <typename Output>
+    void printStatistics(Output& out, uint32_t now) {
+        out.println("=== Dispense Statistics ===");
+        out.print("Pills: ");
+        out.println((unsigned long long)totalPillsDispensed);
+        out.print("Requests: ");
+        out.print((unsigned long long)totalRequests);
+        out.print(" (full ");
+        out.print((unsigned long long)totalFullyServedRequests);
+        out.print(", partial ");
+        out.print((unsigned long long)totalPartialRequests);
+        out.print(", failed ");
+        out.print((unsigned long long)totalFailedRequests);
+        out.println(")");
+        out.print("Attempts: ");
+        out.print((unsigned long long)totalAttempts);
+        out.print(", retries: ");
+        out.println((unsigned long long)totalRetries);
+        out.print("Success rate: ");
+        out.print(getSuccessRatePercent(), 1);
+        out.println("%");
+
+        for (int i = 0; i < NUMBER_OF_COMPARTMENTS_IN_DISPENSER; i++) {
+            out.print("Compartment ");
+            out.print(i + 1);
+            out.print(": ");
+            out.print((unsigned long long)pillsDispensedPerCompartment[i]);
+            out.print(" pills, ");
+            out.print((unsigned long long)failedRequestsPerCompartment[i]);
+            out.println(" failed");
+        }
+
+        out.println("Hour ago,pills,requests,failed,retries");
+        for (int age = 0; age < DISPENSE_STATISTICS_HOURLY_BUCKETS; age++) {
+            DispenseStatisticsBucket bucket = getHourlyBucket(now, age);
+            if (bucket.numberOfRequests == 0) {
+                continue;
+            }
+            out.print(age);
+            out.print(',');
+            out.print(bucket.pillsDispensed);
+            out.print(',');
+            out.print(bucket.numberOfRequests);
+            out.print(',');
+            out.print(bucket.numberOfFailedRequests);
+            out.print(',');
+            out.println(bucket.numberOfRetries);
+        }
+        out.println("Day ago,pills,requests,failed,retries");
+        for (int age = 0; age < DISPENSE_STATISTICS_DAILY_BUCKETS; age++) {
+            DispenseStatisticsBucket bucket = getDailyBucket(now, age);
+            if (bucket.numberOfRequests == 0) {
+                continue;
+            }
+            out.print(age);
+            out.print(',');
+            out.print(bucket.pillsDispensed);
+            out.print(',');
+            out.print(bucket.numberOfRequests);
+            out.print(',');
+            out.print(bucket.numberOfFailedRequests);
+            out.print(',');
+            out.println(bucket.numberOfRetries);
+        }
+        out.println("===========================");
+    }
+};
+
+#endif // DISPENSE_STATISTICS_H
@@ -6,6 +6,30 @@
 #include "ConfigurationSettings.h"
 #include "HardwareController.h"
 #include "SensorManager.h"
+#include "DispenseJournal.h"
+#include "PillInventory.h"
+#include "DispenseStatistics.h"
+#include "SweepRangeLearner.h"
+#include "MessageCatalog.h"
+
+/**
+ * Time spent in each phase of the last dispensePillsFromCompartment() call
+ */
+struct DispensePhaseTimings {
+    unsigned long moveMicroseconds;             // Stepper move to the compartment
+    unsigned long actuationMicroseconds;        // Magnet, servo sweeps and waits between attempts
+    unsigned long detectionWindowMicroseconds;  // IR polling windows
+    unsigned long autoHomingMicroseconds;       // autoHomeAfterDispense pass
+    int numberOfAttempts;
+};
+
+// Maintenance loops poll the preemption check every this many steps
+#define PREEMPTION_CHECK_INTERVAL_STEPS     64
+
+/**
+ * Returns true when a patient-facing job is waiting (see DispenseJobQueue)
+ */
+typedef bool (*PreemptionCheck)();
 
 /**
  * DispenserController Class
@@ -15,24 +39,79 @@
  * - Moving to specific compartments
  * - Multi-attempt pill dispensing
  * - Tracking dispense statistics
+ * - Failing known-empty compartments without trying (PillInventory)
+ * - Sweeping each compartment only as far as its pills need (SweepRangeLearner)
+ * - Stopping homing and calibration at safe points when a dispense waits
+ * - Aborting any operation at safe points (CancellationToken)
  * 
  * This class orchestrates hardware and sensors to perform complete operations.
+ * 
+ * ConfigurationType is SystemConfiguration (read at run time) or
+ * FixedSystemConfiguration (constants folded at compile time).
  */
-class DispenserController {
+template <typename ConfigurationType>
+class BasicDispenserController {
 private:
-    SystemConfiguration* systemConfiguration;
-    HardwareController* hardwareController;
-    SensorManager* sensorManager;
+    ConfigurationType* systemConfiguration;
+    BasicHardwareController<ConfigurationType>* hardwareController;
+    BasicSensorManager<ConfigurationType>* sensorManager;
+    DispenseJournal* dispenseJournal;          // NULL = counts are RAM only
+    PillInventory* pillInventory;              // NULL = stock not tracked
+    DispenseStatistics* dispenseStatistics;    // NULL = no rates or history
+    SweepRangeLearner* sweepRangeLearner;      // NULL = always sweep the full arc
+    PreemptionCheck preemptionCheck;           // NULL = run maintenance to completion
+    CancellationToken* cancellationToken;      // NULL = operations cannot be aborted
+    bool wasLastOperationPreemptedFlag;
+    DispensePhaseTimings lastDispensePhaseTimings;
     
     // State tracking
-    int currentCompartmentNumber;              // Current position: 0=home/start, 1-5=compartments
+    int currentCompartmentNumber;              // Current position: 0=home/start, 1-N=compartments
     bool isSystemHomedAndReady;                // True after successful homing
-    int dispensedCountForEachCompartment[5];   // Max 5 compartments, adjust if needed
+    int dispensedCountForEachCompartment[ConfigurationType::numberOfCompartmentsInDispenser];
+    long totalDispensedCount;                  // Sum of the above, kept in step
     
     // Position tracking in steps (absolute position from home)
     long currentPositionSteps;                 // Current absolute position in steps (0 = home position)
-    long compartmentStepPositions[5];          // Absolute step positions for each compartment (calculated from degrees)
+    long compartmentStepPositions[ConfigurationType::numberOfCompartmentsInDispenser];  // Calculated from degrees
+    
+    /**
+     * Safe point: ask whether maintenance should stop for a waiting dispense
+     * Only allowed while the position is known, so the dispense can move
+     * straight to its compartment without homing again.
+     */
+    bool isPreemptionRequestedAtSafePoint() {
+        if (preemptionCheck != NULL && isSystemHomedAndReady && preemptionCheck()) {
+            wasLastOperationPreemptedFlag = true;
+            return true;
+        }
+        return false;
+    }
+    
+    bool isCancellationRequested() {
+        return cancellationToken != NULL && cancellationToken->isCancellationRequested();
+    }
     
+    /**
+     * Queue the outcome for the journal (RAM only, flushed from the main loop)
+     * and add it to the inventory and statistics.
+     * Trace replay moves nothing, so its outcomes are not recorded.
+     */
+    void recordDispenseOutcomeInJournal(int compartmentNumber, int pillsRequested, int pillsDispensed) {
+        if (sensorManager->isSensorTraceReplaying()) {
+            return;
+        }
+        if (dispenseJournal != NULL) {
+            dispenseJournal->appendDispenseRecord(compartmentNumber, pillsRequested, pillsDispensed);
+        }
+        if (pillInventory != NULL) {
+            pillInventory->recordPillsRemoved(compartmentNumber, pillsDispensed);
+        }
+        if (dispenseStatistics != NULL) {
+            dispenseStatistics->recordDispenseOutcome(compartmentNumber, pillsRequested, pillsDispensed,
+                                                      lastDispensePhaseTimings.numberOfAttempts,
+                                                      (uint32_t)time(NULL));
+        }
+    }
     
 public:
     /**
@@ -41,12 +120,20 @@ public:
      * @param hardware Pointer to hardware controller
      * @param sensors Pointer to sensor manager
      */
-    DispenserController(SystemConfiguration* config, 
-                       HardwareController* hardware, 
-                       SensorManager* sensors) {
+    BasicDispenserController(ConfigurationType* config, 
+                             BasicHardwareController<ConfigurationType>* hardware, 
+                             BasicSensorManager<ConfigurationType>* sensors) {
         systemConfiguration = config;
         hardwareController = hardware;
         sensorManager = sensors;
+        dispenseJournal = NULL;
+        pillInventory = NULL;
+        dispenseStatistics = NULL;
+        sweepRangeLearner = NULL;
+        preemptionCheck = NULL;
+        cancellationToken = NULL;
+        wasLastOperationPreemptedFlag = false;
+        lastDispensePhaseTimings = DispensePhaseTimings();
         currentCompartmentNumber = 0;
         isSystemHomedAndReady = false;
         currentPositionSteps = 0;  // Start at unknown position until homed
@@ -55,6 +142,7 @@ public:
         for (int i = 0; i < systemConfiguration->numberOfCompartmentsInDispenser; i++) {
             dispensedCountForEachCompartment[i] = 0;
         }
+        totalDispensedCount = 0;
         
         // Calculate compartment step positions from degrees
         calculateCompartmentStepPositions();
@@ -81,6 +169,29 @@ public:
         }
     }
     
+    /**
+     * Signed step count of the shortest path from the current position
+     * @param targetCompartmentNumber Compartment to move to (1-based, validated by caller)
+     * @return Steps to move (positive = forward)
+     */
+    long calculateShortestStepsToCompartment(int targetCompartmentNumber) {
+        long targetStepPosition = compartmentStepPositions[targetCompartmentNumber - 1];
+        long stepsToMove = targetStepPosition - currentPositionSteps;
+        
+        float totalStepsPerRevolution = systemConfiguration->stepperStepsPerRevolution * 
+                                        systemConfiguration->stepperMicrostepping * 
+                                        systemConfiguration->stepperGearRatio;
+        
+        if (abs(stepsToMove) > (totalStepsPerRevolution / 2)) {
+            if (stepsToMove > 0) {
+                stepsToMove -= (long)totalStepsPerRevolution;
+            } else {
+                stepsToMove += (long)totalStepsPerRevolution;
+            }
+        }
+        return stepsToMove;
+    }
+    
     /**
      * Get current absolute position in steps
      * @return Current position in steps from home (0 = home position)
@@ -129,6 +240,8 @@ public:
      * @return true if homing successful, false if all attempts failed
      */
     bool performHomingWithRetryAndEscalation() {
+        wasLastOperationPreemptedFlag = false;
+        sensorManager->markTraceSynchronizationPoint();
         hardwareController->moveServoToRestPositionAndWait();
         
         int maxAttempts = systemConfiguration->homingRetryAttempts;
@@ -146,6 +259,11 @@ public:
             
             unsigned long attemptTimeout = baseTimeout + ((attempt - 1) * timeoutIncrement);
             
+            if (isCancellationRequested()) {
+                hardwareController->stopMotorCompletely();
+                return false;
+            }
+            
 			if (isSystemHomedAndReady && sensorManager->isHomePositionSwitchActivated()) {
 				sensorManager->resetEncoderPositionToZero();
 				resetPositionToHome();
@@ -165,14 +283,24 @@ public:
             
             unsigned long startTimeMillis = millis();
             bool homeSwitchActivated = false;
+            long stepsRotated = 0;
             
             while (!sensorManager->isHomePositionSwitchActivated()) {
                 if (millis() - startTimeMillis > attemptTimeout) {
-                    Serial.println("ERROR: Homing timeout");
+                    printMessageLine(Serial, MSG_ERROR_HOMING_TIMEOUT);
                     break;
                 }
                 
+                // Re-homing a tracked position can stop anywhere: keep the position
+                if (isCancellationRequested() ||
+                    (stepsRotated % PREEMPTION_CHECK_INTERVAL_STEPS == 0 && isPreemptionRequestedAtSafePoint())) {
+                    hardwareController->stopMotorCompletely();
+                    updatePositionAfterMovement(stepsRotated);
+                    return false;
+                }
+                
                 hardwareController->rotateStepperForwardContinuous(attemptDelay);
+                stepsRotated++;
             }
             
             if (sensorManager->isHomePositionSwitchActivated()) {
@@ -192,7 +320,9 @@ public:
             }
             
             if (attempt < maxAttempts) {
-                delay(500);
+                if (!hardwareController->waitMillisecondsUnlessCancelled(500)) {
+                    continue;  // Returns at the top of the next attempt
+                }
                 
                 long stepsMoved = hardwareController->moveStepperForwardBySteps(
                     hardwareController->calculateStepsForAngle(5.0), 
@@ -203,7 +333,7 @@ public:
             }
         }
         
-        Serial.println("ERROR: All homing attempts failed");
+        printMessageLine(Serial, MSG_ERROR_ALL_HOMING_ATTEMPTS_FAILED);
         isSystemHomedAndReady = false;
         return false;
     }
@@ -227,41 +357,48 @@ public:
     
     bool calibrateFullRotationTiming() {
         if (!performHomingWithRetryAndEscalation()) {
-            Serial.println("ERROR: Failed to home before calibration");
+            if (!wasLastOperationPreemptedFlag) {
+                printMessageLine(Serial, MSG_ERROR_HOME_BEFORE_CALIBRATION);
+            }
             return false;
         }
         
         if (!sensorManager->isHomePositionSwitchActivated()) {
-            Serial.println("ERROR: Switch not activated after homing");
+            printMessageLine(Serial, MSG_ERROR_SWITCH_NOT_ACTIVATED);
             return false;
         }
         
-        delay(500);
+        if (!hardwareController->waitMillisecondsUnlessCancelled(500)) {
+            return false;
+        }
         
         int stepDelay = systemConfiguration->stepperStepPulseWidthMicroseconds * 2;
         long stepsToMoveOff = hardwareController->calculateStepsForAngle(10.0);
         long stepsMoved = hardwareController->moveStepperBackwardBySteps(stepsToMoveOff, stepDelay);
         updatePositionAfterMovement(stepsMoved);
         
-        delay(200);
-        delay(500);
+        if (!hardwareController->waitMillisecondsUnlessCancelled(700)) {
+            return false;
+        }
         
         unsigned long rotationStartTime = millis();
         unsigned long stepCount = 0;
         
-        float totalStepsPerRevolution = systemConfiguration->stepperStepsPerRevolution * 
-                                        systemConfiguration->stepperMicrostepping * 
-                                        systemConfiguration->stepperGearRatio;
-        long stepsForFullRotation = (long)totalStepsPerRevolution;
-        
         hardwareController->enableStepperMotor(true);
         
         while (!sensorManager->isHomePositionSwitchActivated()) {
+            if (isCancellationRequested() ||
+                (stepCount % PREEMPTION_CHECK_INTERVAL_STEPS == 0 && isPreemptionRequestedAtSafePoint())) {
+                hardwareController->stopMotorCompletely();
+                updatePositionAfterMovement((long)stepCount);
+                return false;
+            }
+            
             hardwareController->rotateStepperForwardContinuous(stepDelay);
             stepCount++;
             
             if (millis() - rotationStartTime > 30000) {
-                Serial.println("ERROR: Calibration timeout");
+                printMessageLine(Serial, MSG_ERROR_CALIBRATION_TIMEOUT);
                 hardwareController->stopMotorCompletely();
                 return false;
             }
@@ -312,10 +449,13 @@ public:
      */
     bool moveRotaryDispenserToCompartmentNumber(int targetCompartmentNumber) {
         ensureSystemIsHomed();
+        if (isCancellationRequested()) {
+            return false;
+        }
         
         if (targetCompartmentNumber < 1 || 
             targetCompartmentNumber > systemConfiguration->numberOfCompartmentsInDispenser) {
-            Serial.println("ERROR: Invalid compartment number");
+            printMessageLine(Serial, MSG_ERROR_INVALID_COMPARTMENT);
             return false;
         }
         
@@ -323,21 +463,7 @@ public:
             return true;
         }
         
-        long targetStepPosition = compartmentStepPositions[targetCompartmentNumber - 1];
-        long currentStepPosition = currentPositionSteps;
-        long stepsToMove = targetStepPosition - currentStepPosition;
-        
-        float totalStepsPerRevolution = systemConfiguration->stepperStepsPerRevolution * 
-                                        systemConfiguration->stepperMicrostepping * 
-                                        systemConfiguration->stepperGearRatio;
-        
-        if (abs(stepsToMove) > (totalStepsPerRevolution / 2)) {
-            if (stepsToMove > 0) {
-                stepsToMove -= (long)totalStepsPerRevolution;
-            } else {
-                stepsToMove += (long)totalStepsPerRevolution;
-            }
-        }
+        long stepsToMove = calculateShortestStepsToCompartment(targetCompartmentNumber);
         
         if (abs(stepsToMove) < 5) {
             currentCompartmentNumber = targetCompartmentNumber;
@@ -354,6 +480,10 @@ public:
         }
         
         updatePositionAfterMovement(stepsMoved);
+        if (isCancellationRequested()) {
+            currentCompartmentNumber = 0;  // Between compartments; steps are still tracked
+            return false;
+        }
         delay(systemConfiguration->delayAfterCompartmentMoveMilliseconds);
         
         currentCompartmentNumber = targetCompartmentNumber;
@@ -379,24 +509,56 @@ public:
      */
     int attemptToDispenseAndCountPills() {
         int maxAttempts = systemConfiguration->maximumDispenseAttempts;
+        int compartmentNumber = currentCompartmentNumber;
+        bool isLearning = sweepRangeLearner != NULL && !sensorManager->isSensorTraceReplaying();
         
         for (int attemptNumber = 1; attemptNumber <= maxAttempts; attemptNumber++) {
+            lastDispensePhaseTimings.numberOfAttempts++;
             hardwareController->activateElectromagnetAndWaitForStabilization();
             
             int startPosition = hardwareController->getCurrentServoPosition();
-            hardwareController->moveServoFromCurrentToMax();
+            int maxSafe = hardwareController->getServoMaxSafe();
+            int sweepEnd = isLearning
+                ? sweepRangeLearner->getSweepEndMicroseconds(compartmentNumber, hardwareController->getServoMinSafe(), maxSafe)
+                : maxSafe;
             
-            unsigned long waitStartTime = millis();
-            const unsigned long waitDurationMs = 2000;
             int checkIntervalMs = systemConfiguration->pillDetectionCheckIntervalMilliseconds;
             int pillCount = 0;
-            bool lastSensorState = false;
+            int releasePosition = 0;
+            bool lastSensorState = sensorManager->isPillCurrentlyDetectedByInfraredSensor();
             bool currentSensorState = false;
             
+            hardwareController->moveServoToMicroseconds(sweepEnd);
+            
+            // Settle wait with the IR watched: a pill seen while the horn still
+            // travels tells how far this compartment has to be swept
+            unsigned long settleStartTime = millis();
+            unsigned long settleWaitMs = hardwareController->getServoSettleWaitMilliseconds();
+            while (millis() - settleStartTime < settleWaitMs && !isCancellationRequested()) {
+                currentSensorState = sensorManager->isPillCurrentlyDetectedByInfraredSensor();
+                if (!lastSensorState && currentSensorState) {
+                    if (pillCount == 0) {
+                        releasePosition = hardwareController->getServoPositionWhileTravelling();
+                    }
+                    pillCount++;
+                }
+                lastSensorState = currentSensorState;
+                delay(checkIntervalMs);
+            }
+            if (isCancellationRequested()) {
+                // Pills already seen did drop; the caller's safe state releases the magnet and servo
+                return pillCount;
+            }
+            hardwareController->markServoSettled();
+            
+            unsigned long waitStartTime = millis();
+            const unsigned long waitDurationMs = systemConfiguration->pillDetectionTimeoutMilliseconds;
+            
+            unsigned long detectionStartMicroseconds = micros();
             delay(50);
             lastSensorState = sensorManager->isPillCurrentlyDetectedByInfraredSensor();
             
-            while (millis() - waitStartTime < waitDurationMs) {
+            while (millis() - waitStartTime < waitDurationMs && !isCancellationRequested()) {
                 currentSensorState = sensorManager->isPillCurrentlyDetectedByInfraredSensor();
                 
                 if (!lastSensorState && currentSensorState) {
@@ -406,9 +568,18 @@ public:
                 lastSensorState = currentSensorState;
                 delay(checkIntervalMs);
             }
+            lastDispensePhaseTimings.detectionWindowMicroseconds += micros() - detectionStartMicroseconds;
+            if (isCancellationRequested()) {
+                return pillCount;
+            }
+            
+            if (isLearning) {
+                sweepRangeLearner->recordReleasePosition(compartmentNumber, releasePosition);
+                sweepRangeLearner->recordSweepOutcome(compartmentNumber, sweepEnd < maxSafe, pillCount > 0);
+            }
             
             hardwareController->moveServoToMicroseconds(startPosition);
-            delay(systemConfiguration->servoMovementDelayMilliseconds);
+            hardwareController->waitForServoToSettle();
             
             if (pillCount > 0) {
                 hardwareController->deactivateElectromagnetWithDelay();
@@ -417,8 +588,10 @@ public:
             
             hardwareController->deactivateElectromagnetWithDelay();
             
-            if (attemptNumber < maxAttempts) {
-                delay(systemConfiguration->delayBetweenDispenseAttemptsMilliseconds);
+            if (attemptNumber < maxAttempts &&
+                !hardwareController->waitMillisecondsUnlessCancelled(
+                    systemConfiguration->delayBetweenDispenseAttemptsMilliseconds)) {
+                return 0;
             }
         }
         
@@ -432,11 +605,27 @@ public:
      * @return Number of pills successfully dispensed (counted by IR sensor)
      */
     int dispensePillsFromCompartment(int compartmentNumber, int numberOfPillsToDispense) {
+        sensorManager->markTraceSynchronizationPoint();
+        lastDispensePhaseTimings = DispensePhaseTimings();
+        
+        // An empty compartment would only burn every retry
+        if (pillInventory != NULL && pillInventory->isCompartmentKnownEmpty(compartmentNumber)) {
+            printMessageLineWithNumber(Serial, MSG_COMPARTMENT, compartmentNumber, MSG_IS_EMPTY_SKIPPING);
+            recordDispenseOutcomeInJournal(compartmentNumber, numberOfPillsToDispense, 0);
+            return 0;
+        }
+        
+        unsigned long phaseStartMicroseconds = micros();
+        
         // Move to target compartment
-        if (!moveRotaryDispenserToCompartmentNumber(compartmentNumber)) {
+        bool isMoveSuccessful = moveRotaryDispenserToCompartmentNumber(compartmentNumber);
+        lastDispensePhaseTimings.moveMicroseconds = micros() - phaseStartMicroseconds;
+        if (!isMoveSuccessful) {
+            recordDispenseOutcomeInJournal(compartmentNumber, numberOfPillsToDispense, 0);
             return 0;  // Failed to move to compartment
         }
         
+        phaseStartMicroseconds = micros();
         int totalPillsDetected = 0;
         
         // Attempt to dispense requested number of pills
@@ -446,32 +635,67 @@ public:
             if (pillsDetected > 0) {
                 totalPillsDetected += pillsDetected;
                 
-                // Update statistics for each pill detected
-                for (int i = 0; i < pillsDetected; i++) {
-                    if (compartmentNumber >= 1 && 
-                        compartmentNumber <= systemConfiguration->numberOfCompartmentsInDispenser) {
-                        dispensedCountForEachCompartment[compartmentNumber - 1]++;
-                    }
+                // Update statistics for the pills detected
+                if (compartmentNumber >= 1 && 
+                    compartmentNumber <= systemConfiguration->numberOfCompartmentsInDispenser) {
+                    dispensedCountForEachCompartment[compartmentNumber - 1] += pillsDetected;
+                    totalDispensedCount += pillsDetected;
                 }
             }
             
-            // Delay between multiple pills
-            if (pillNumber < numberOfPillsToDispense - 1) {
-                delay(systemConfiguration->delayBetweenMultipleDispensesMilliseconds);
+            // Delay between multiple pills (pills already out are still counted on abort)
+            if (isCancellationRequested() ||
+                (pillNumber < numberOfPillsToDispense - 1 &&
+                 !hardwareController->waitMillisecondsUnlessCancelled(
+                     systemConfiguration->delayBetweenMultipleDispensesMilliseconds))) {
+                break;
             }
         }
         
-        if (systemConfiguration->autoHomeAfterDispense && totalPillsDetected > 0) {
+        lastDispensePhaseTimings.actuationMicroseconds = 
+            (micros() - phaseStartMicroseconds) - lastDispensePhaseTimings.detectionWindowMicroseconds;
+        recordDispenseOutcomeInJournal(compartmentNumber, numberOfPillsToDispense, totalPillsDetected);
+        
+        if (systemConfiguration->autoHomeAfterDispense && totalPillsDetected > 0 && !isCancellationRequested()) {
+            phaseStartMicroseconds = micros();
             performHomingWithRetryAndEscalation();
+            lastDispensePhaseTimings.autoHomingMicroseconds = micros() - phaseStartMicroseconds;
         }
         
         return totalPillsDetected;
     }
     
+    // ========================================================================
+    // Diagnostics
+    // ========================================================================
+    
+    /**
+     * Move the carousel by a raw number of steps (Serial console JOG)
+     * Position tracking follows; the carousel is no longer at a compartment.
+     * @param steps Steps to move (negative = backward)
+     * @return Steps actually moved (fewer if cancelled)
+     */
+    long jogStepperBySteps(long steps) {
+        int stepDelay = systemConfiguration->stepperStepPulseWidthMicroseconds * 2;
+        long stepsMoved = (steps >= 0)
+            ? hardwareController->moveStepperForwardBySteps(steps, stepDelay)
+            : hardwareController->moveStepperBackwardBySteps(-steps, stepDelay);
+        updatePositionAfterMovement(stepsMoved);
+        currentCompartmentNumber = 0;
+        return stepsMoved;
+    }
+    
     // ========================================================================
     // Statistics and Status Operations
     // ========================================================================
     
+    /**
+     * @return Phase timings of the last dispensePillsFromCompartment() call
+     */
+    DispensePhaseTimings getLastDispensePhaseTimings() {
+        return lastDispensePhaseTimings;
+    }
+    
     /**
      * Get dispense count for a specific compartment
      * @param compartmentNumber Target compartment (1-based)
@@ -487,28 +711,122 @@ public:
     
     /**
      * Reset all dispense statistics to zero
+     * The journal's reset record is written before the stock baselines move to
+     * the zeroed counts, so a power loss in between cannot pair old journal
+     * counts with new baselines (which would read every compartment empty).
+     * @return false if the reset could not be written to the journal; the stock
+     * baselines are then left as they were
      */
-    void resetAllDispenseStatistics() {
+    bool resetAllDispenseStatistics() {
         for (int i = 0; i < systemConfiguration->numberOfCompartmentsInDispenser; i++) {
             dispensedCountForEachCompartment[i] = 0;
         }
+        totalDispensedCount = 0;
+        bool isResetPersisted = true;
+        if (dispenseJournal != NULL) {
+            dispenseJournal->appendResetRecord();
+            isResetPersisted = dispenseJournal->flushPendingRecords();
+        }
+        if (dispenseStatistics != NULL) {
+            dispenseStatistics->resetStatistics();
+        }
+        if (pillInventory != NULL && isResetPersisted) {
+            pillInventory->rebaseAfterDispenseCountReset();
+        }
+        return isResetPersisted;
     }
     
     /**
-     * Get total number of pills dispensed across all compartments
-     * @return Total dispense count
+     * Persist dispense outcomes and restore the counts recovered from it
+     * @param journal Journal already opened with beginAndRecoverCounts()
      */
-    int getTotalDispenseCount() {
-        int total = 0;
+    void attachDispenseJournal(DispenseJournal* journal) {
+        dispenseJournal = journal;
+        totalDispensedCount = 0;
         for (int i = 0; i < systemConfiguration->numberOfCompartmentsInDispenser; i++) {
-            total += dispensedCountForEachCompartment[i];
+            dispensedCountForEachCompartment[i] = (int)journal->getRecoveredCountForCompartment(i + 1);
+            totalDispensedCount += dispensedCountForEachCompartment[i];
         }
-        return total;
+    }
+    
+    /**
+     * Allow homing and calibration to stop at safe points
+     * Set only around maintenance jobs; dispenses always run to completion.
+     * @param check Returns true when a patient-facing job waits (NULL = never)
+     */
+    void setPreemptionCheck(PreemptionCheck check) {
+        preemptionCheck = check;
+    }
+    
+    /**
+     * Let operations stop at safe points when the token is cancelled
+     * (shared with the hardware controller so single moves stop too)
+     * @param token Shared token (NULL = never cancelled)
+     */
+    void attachCancellationToken(CancellationToken* token) {
+        cancellationToken = token;
+        hardwareController->attachCancellationToken(token);
+    }
+    
+    /**
+     * @return true if the current or last operation was aborted
+     */
+    bool wasLastOperationCancelled() {
+        return isCancellationRequested();
+    }
+    
+    /**
+     * @return true if the last homing or calibration stopped for a waiting job
+     */
+    bool wasLastOperationPreempted() {
+        return wasLastOperationPreemptedFlag;
+    }
+    
+    /**
+     * Track stock and fail known-empty compartments fast
+     * Attach after the journal so the inventory starts from the recovered counts.
+     * @param inventory Inventory already loaded with beginAndLoadInventory()
+     */
+    void attachPillInventory(PillInventory* inventory) {
+        pillInventory = inventory;
+        for (int i = 0; i < systemConfiguration->numberOfCompartmentsInDispenser; i++) {
+            inventory->synchronizeDispenseCount(i + 1, (uint32_t)dispensedCountForEachCompartment[i]);
+        }
+    }
+    
+    /**
+     * Keep totals, rates and hourly/daily history of dispense outcomes
+     * Attach after the journal so lifetime pill counts start from the recovered counts.
+     * @param statistics Statistics to update with every outcome
+     */
+    void attachDispenseStatistics(DispenseStatistics* statistics) {
+        dispenseStatistics = statistics;
+        for (int i = 0; i < systemConfiguration->numberOfCompartmentsInDispenser; i++) {
+            statistics->seedCompartmentPillCount(i + 1, (uint32_t)dispensedCountForEachCompartment[i]);
+        }
+    }
+    
+    /**
+     * End each compartment's sweep where its pills are known to release
+     * @param learner Learner to read sweep end points from and teach (NULL = full arc)
+     */
+    void attachSweepRangeLearner(SweepRangeLearner* learner) {
+        sweepRangeLearner = learner;
+    }
+    
+    /**
+     * Get total number of pills dispensed across all compartments
+     * @return Total dispense count (kept up to date, no summing)
+     */
+    long getTotalDispenseCount() {
+        return totalDispensedCount;
     }
     
     void printDispenserStatistics() {
     }
 };
 
+typedef BasicDispenserController<ControllerConfiguration> DispenserController;
+
 #endif // DISPENSER_CONTROLLER_H
 
@@ -0,0 +1,134 @@
+#ifndef DOSE_PREPOSITIONER_H
+#define DOSE_PREPOSITIONER_H
+
+#include <Arduino.h>
+#include "ConfigurationSettings.h"
+#include "HardwareController.h"
+#include "DispenserController.h"
+#include "DoseScheduler.h"
+#include "MessageCatalog.h"
+
+/**
+ * DosePrepositioner Class
+ *
+ * Gets the mechanism ready for the next scheduled dose so that, when it is
+ * due, dispensing starts with the servo sweep:
+ * - dosePrepositionLeadSeconds before the dose: home, move to the dose's
+ *   compartment and attach the servo at rest
+ * - Just before the dose (optional): switch the electromagnet on so its
+ *   stabilization time has already passed
+ *
+ * The stepper is not held energized while waiting (an idle carousel does not
+ * drift, and holding current would heat the motor for the whole lead time).
+ */
+class DosePrepositioner {
+private:
+    SystemConfiguration* systemConfiguration;
+    DispenserController* dispenserController;
+    HardwareController* hardwareController;
+    DoseScheduler* doseScheduler;
+
+    uint32_t preparedDueTime;           // Dose the carousel is parked for (0 = none)
+    int preparedCompartmentNumber;
+    uint32_t failedDueTime;             // Don't retry a failed move every loop
+    bool isElectromagnetPreEnergized;
+    unsigned long numberOfPrepositionMoves;
+
+    void releasePreparation() {
+        if (isElectromagnetPreEnergized && hardwareController->isElectromagnetActive()) {
+            hardwareController->deactivateElectromagnetToReleasePill();
+        }
+        isElectromagnetPreEnergized = false;
+        preparedDueTime = 0;
+        preparedCompartmentNumber = 0;
+    }
+
+public:
+    /**
+     * Constructor
+     * @param config Pointer to system configuration (lead time, magnet option)
+     * @param dispenser Dispenser controller (homing and compartment moves)
+     * @param hardware Hardware controller (servo and electromagnet)
+     * @param scheduler Source of the next dose
+     */
+    DosePrepositioner(SystemConfiguration* config, DispenserController* dispenser,
+                      HardwareController* hardware, DoseScheduler* scheduler) {
+        systemConfiguration = config;
+        dispenserController = dispenser;
+        hardwareController = hardware;
+        doseScheduler = scheduler;
+        preparedDueTime = 0;
+        preparedCompartmentNumber = 0;
+        failedDueTime = 0;
+        isElectromagnetPreEnergized = false;
+        numberOfPrepositionMoves = 0;
+    }
+
+    /**
+     * Call every loop while nothing else is moving the mechanism
+     * @param now Current UTC seconds
+     * @return true while parked for an imminent dose (keep the chip awake)
+     */
+    bool servicePrepositioning(uint32_t now) {
+        long secondsUntilDose = doseScheduler->getSecondsUntilNextDose(now);
+        if (!systemConfiguration->enableDosePrepositioning || secondsUntilDose < 0 ||
+            secondsUntilDose > systemConfiguration->dosePrepositionLeadSeconds) {
+            releasePreparation();
+            return false;
+        }
+
+        uint32_t dueTime = doseScheduler->getNextDoseDueTime();
+        int compartmentNumber = doseScheduler->getNextDoseCompartmentNumber();
+        if (dueTime == failedDueTime) {
+            return false;
+        }
+
+        // Park again if the dose changed or something else moved the carousel
+        if (preparedDueTime != dueTime ||
+            dispenserController->getCurrentCompartmentNumber() != compartmentNumber) {
+            releasePreparation();
+            printMessageLineWithNumber(Serial, MSG_PREPOSITIONING, compartmentNumber);
+
+            if (!dispenserController->performHomingWithRetryAndEscalation() ||
+                !dispenserController->moveRotaryDispenserToCompartmentNumber(compartmentNumber)) {
+                failedDueTime = dueTime;
+                return false;  // The dose itself will retry and report the failure
+            }
+            hardwareController->prepareServoForUpcomingSweep();
+            preparedDueTime = dueTime;
+            preparedCompartmentNumber = compartmentNumber;
+            numberOfPrepositionMoves++;
+        }
+
+        long millisecondsUntilDose = secondsUntilDose * 1000L;
+        if (systemConfiguration->preEnergizeElectromagnetBeforeDose && !isElectromagnetPreEnergized &&
+            millisecondsUntilDose <= systemConfiguration->electromagnetActivationDelayMilliseconds + 1000L) {
+            hardwareController->activateElectromagnetForPillPickup();
+            isElectromagnetPreEnergized = true;
+        }
+        return true;
+    }
+
+    /**
+     * Seconds to sleep before preparation for the next dose must start
+     * @param secondsUntilDose From DoseScheduler::getSecondsUntilNextDose()
+     * @return Seconds until preparation, or -1 if no dose is queued
+     */
+    long getSecondsUntilPreparation(long secondsUntilDose) {
+        if (secondsUntilDose < 0 || !systemConfiguration->enableDosePrepositioning) {
+            return secondsUntilDose;
+        }
+        long secondsUntilPreparation = secondsUntilDose - systemConfiguration->dosePrepositionLeadSeconds;
+        return secondsUntilPreparation > 0 ? secondsUntilPreparation : 0;
+    }
+
+    bool isPreparedForDose() {
+        return preparedDueTime != 0;
+    }
+
+    unsigned long getNumberOfPrepositionMoves() {
+        return numberOfPrepositionMoves;
+    }
+};
+
+#endif // DOSE_PREPOSITIONER_H
@@ -0,0 +1,556 @@
+#ifndef DOSE_SCHEDULER_H
+#define DOSE_SCHEDULER_H
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include <sys/time.h>
+#include <time.h>
+#include "Config.h"
+#include "ConfigurationSettings.h"
+#include "StoredRecordChecksum.h"
+
+// ============================================================================
+// Schedule Storage
+// ============================================================================
+// One NVS key per slot ("e<slot>") plus the UTC offset ("tz"). Each entry is a
+// daily dose at a local minute of day; lastHandledDueTime makes a dose missed
+// while powered off detectable after the next boot.
+#define DOSE_SCHEDULE_NAMESPACE                 "schedule"
+#define DOSE_SCHEDULE_FORMAT_VERSION            1
+#define DOSE_SCHEDULER_MAXIMUM_ENTRIES          16
+#define DOSE_SCHEDULER_SECONDS_PER_DAY          86400UL
+#define DOSE_SCHEDULER_EARLIEST_VALID_TIME      1577836800UL    // 2020-01-01: older clocks were never set
+
+enum MissedDosePolicy {
+    MISSED_DOSE_DISPENSE_WITHIN_GRACE,  // Late doses dispensed up to missedDoseGraceMinutes, then missed
+    MISSED_DOSE_SKIP_IF_LATE,           // Only dispensed within onTimeDoseToleranceMinutes
+    MISSED_DOSE_ALWAYS_DISPENSE,        // Always dispensed at the next chance (latest occurrence only)
+    NUMBER_OF_MISSED_DOSE_POLICIES
+};
+
+enum DoseOutcome {
+    DOSE_TAKEN_ON_TIME,
+    DOSE_TAKEN_LATE,
+    DOSE_MISSED,
+    DOSE_FAILED,
+    NUMBER_OF_DOSE_OUTCOMES
+};
+
+inline const char* getDoseOutcomeName(DoseOutcome outcome) {
+    switch (outcome) {
+        case DOSE_TAKEN_ON_TIME:    return "taken";
+        case DOSE_TAKEN_LATE:       return "late";
+        case DOSE_MISSED:           return "missed";
+        case DOSE_FAILED:           return "failed";
+        default:                    return "unknown";
+    }
+}
+
+struct DoseScheduleEntry {
+    uint8_t isEnabled;
+    uint8_t compartmentNumber;          // 1-based
+    uint8_t pillCount;
+    uint8_t missedDosePolicy;           // MissedDosePolicy
+    uint16_t minuteOfDay;               // Local time, 0-1439
+    uint16_t reserved;
+    uint32_t lastHandledDueTime;        // UTC seconds of the last occurrence dispensed or missed
+};
+
+struct StoredDoseScheduleRecord {
+    uint8_t formatVersion;
+    uint8_t reserved;
+    uint16_t checksum;                  // Low 16 bits of CRC-32 of the record with checksum = 0
+    DoseScheduleEntry entry;
+};
+
+/**
+ * One occurrence of a schedule entry
+ */
+struct ScheduledDose {
+    uint32_t dueTime;                   // UTC seconds
+    int slot;
+};
+
+/**
+ * Result of servicing the scheduler: dispense now, or report a missed dose
+ */
+struct DoseDecision {
+    ScheduledDose dose;
+    int compartmentNumber;
+    int pillCount;
+    bool shouldDispense;                // false = dose was marked missed
+    long secondsLate;
+};
+
+/**
+ * DoseScheduler Class
+ *
+ * Dispenses scheduled doses on time without the phone:
+ * - TIME sync sets the ESP32 clock (kept through light sleep and soft resets)
+ * - Schedule entries are stored in NVS and survive power loss
+ * - Upcoming occurrences sit in a min-heap keyed by due time, so the main
+ *   loop only compares the head against the clock
+ * - Late or missed doses are resolved by each entry's MissedDosePolicy
+ *
+ * The scheduler only decides; the main loop performs the dispense and reports
+ * the result with completeScheduledDose().
+ */
+class DoseScheduler {
+private:
+    SystemConfiguration* systemConfiguration;
+    Preferences preferences;
+    bool isStorageOpen;
+
+    DoseScheduleEntry scheduleEntries[DOSE_SCHEDULER_MAXIMUM_ENTRIES];
+    int utcOffsetMinutes;
+
+    // Min-heap of the next occurrence of each enabled entry
+    ScheduledDose upcomingDoses[DOSE_SCHEDULER_MAXIMUM_ENTRIES];
+    int numberOfUpcomingDoses;
+
+    // Due time of a dose handed out to dispense and not completed yet (0 = none).
+    // A rebuild skips these slots so a waiting dose is never queued twice.
+    uint32_t inFlightDueTimes[DOSE_SCHEDULER_MAXIMUM_ENTRIES];
+
+    unsigned long outcomeCounts[NUMBER_OF_DOSE_OUTCOMES];
+
+    static uint16_t calculateRecordChecksum(StoredDoseScheduleRecord record) {
+        record.checksum = 0;
+        return calculateStoredRecordChecksum(&record, sizeof(record));
+    }
+
+    static void makeStorageKey(int slot, char* key) {
+        snprintf(key, 8, "e%d", slot);
+    }
+
+    // ========================================================================
+    // Min-heap
+    // ========================================================================
+
+    void swapUpcomingDoses(int first, int second) {
+        ScheduledDose temporary = upcomingDoses[first];
+        upcomingDoses[first] = upcomingDoses[second];
+        upcomingDoses[second] = temporary;
+    }
+
+    void pushUpcomingDose(ScheduledDose dose) {
+        if (numberOfUpcomingDoses >= DOSE_SCHEDULER_MAXIMUM_ENTRIES) {
+            return;
+        }
+        int index = numberOfUpcomingDoses++;
+        upcomingDoses[index] = dose;
+        while (index > 0) {
+            int parent = (index - 1) / 2;
+            if (upcomingDoses[parent].dueTime <= upcomingDoses[index].dueTime) {
+                break;
+            }
+            swapUpcomingDoses(parent, index);
+            index = parent;
+        }
+    }
+
+    ScheduledDose popUpcomingDose() {
+        ScheduledDose earliest = upcomingDoses[0];
+        upcomingDoses[0] = upcomingDoses[--numberOfUpcomingDoses];
+        int index = 0;
+        while (true) {
+            int smallest = index;
+            int left = 2 * index + 1;
+            int right = left + 1;
+            if (left < numberOfUpcomingDoses && upcomingDoses[left].dueTime < upcomingDoses[smallest].dueTime) {
+                smallest = left;
+            }
+            if (right < numberOfUpcomingDoses && upcomingDoses[right].dueTime < upcomingDoses[smallest].dueTime) {
+                smallest = right;
+            }
+            if (smallest == index) {
+                break;
+            }
+            swapUpcomingDoses(index, smallest);
+            index = smallest;
+        }
+        return earliest;
+    }
+
+    // ========================================================================
+    // Occurrence math (UTC seconds; minuteOfDay is local)
+    // ========================================================================
+
+    /**
+     * @return Latest occurrence of the entry at or before now
+     */
+    uint32_t getLatestOccurrenceAtOrBefore(const DoseScheduleEntry& entry, uint32_t now) {
+        long offsetSeconds = (long)utcOffsetMinutes * 60;
+        uint32_t localNow = now + offsetSeconds;
+        uint32_t localDayStart = localNow - localNow % DOSE_SCHEDULER_SECONDS_PER_DAY;
+        uint32_t occurrence = localDayStart + (uint32_t)entry.minuteOfDay * 60 - offsetSeconds;
+        if (occurrence > now) {
+            occurrence -= DOSE_SCHEDULER_SECONDS_PER_DAY;
+        }
+        return occurrence;
+    }
+
+    /**
+     * Queue the first occurrence not yet handled. Only the latest past
+     * occurrence is considered, so a long outage never triggers several doses.
+     * Entries created before the clock was set start with the next occurrence.
+     */
+    void queueNextOccurrence(int slot, uint32_t now) {
+        const DoseScheduleEntry& entry = scheduleEntries[slot];
+        if (!entry.isEnabled || inFlightDueTimes[slot] != 0) {
+            return;
+        }
+        ScheduledDose dose;
+        dose.slot = slot;
+        dose.dueTime = getLatestOccurrenceAtOrBefore(entry, now);
+        if (dose.dueTime <= entry.lastHandledDueTime || entry.lastHandledDueTime == 0) {
+            dose.dueTime += DOSE_SCHEDULER_SECONDS_PER_DAY;
+        }
+        pushUpcomingDose(dose);
+    }
+
+    void rebuildUpcomingDoses(uint32_t now) {
+        numberOfUpcomingDoses = 0;
+        for (int slot = 0; slot < DOSE_SCHEDULER_MAXIMUM_ENTRIES; slot++) {
+            queueNextOccurrence(slot, now);
+        }
+    }
+
+    bool writeStoredEntry(int slot) {
+        if (!isStorageOpen) {
+            return false;
+        }
+        char key[8];
+        makeStorageKey(slot, key);
+        if (!scheduleEntries[slot].isEnabled) {
+            preferences.remove(key);
+            return true;
+        }
+
+        StoredDoseScheduleRecord record;
+        memset(&record, 0, sizeof(record));
+        record.formatVersion = DOSE_SCHEDULE_FORMAT_VERSION;
+        record.entry = scheduleEntries[slot];
+        record.checksum = calculateRecordChecksum(record);
+        return preferences.putBytes(key, &record, sizeof(record)) == sizeof(record);
+    }
+
+    void markOccurrenceHandled(const ScheduledDose& dose, DoseOutcome outcome, uint32_t now) {
+        inFlightDueTimes[dose.slot] = 0;
+        // An entry replaced while its dose was in flight keeps its newer mark
+        if (dose.dueTime > scheduleEntries[dose.slot].lastHandledDueTime) {
+            scheduleEntries[dose.slot].lastHandledDueTime = dose.dueTime;
+        }
+        writeStoredEntry(dose.slot);
+        outcomeCounts[outcome]++;
+        queueNextOccurrence(dose.slot, now);
+    }
+
+public:
+    /**
+     * Constructor
+     * @param config Pointer to system configuration (grace/tolerance windows)
+     */
+    DoseScheduler(SystemConfiguration* config) {
+        systemConfiguration = config;
+        isStorageOpen = false;
+        memset(scheduleEntries, 0, sizeof(scheduleEntries));
+        utcOffsetMinutes = 0;
+        numberOfUpcomingDoses = 0;
+        memset(inFlightDueTimes, 0, sizeof(inFlightDueTimes));
+        memset(outcomeCounts, 0, sizeof(outcomeCounts));
+    }
+
+    /**
+     * Load the stored schedule and queue upcoming doses
+     * @return Number of enabled entries
+     */
+    int beginAndLoadSchedule() {
+        isStorageOpen = preferences.begin(DOSE_SCHEDULE_NAMESPACE, false);
+        if (!isStorageOpen) {
+            Serial.println("WARNING: Schedule storage unavailable");
+            return 0;
+        }
+
+        utcOffsetMinutes = preferences.getInt("tz", 0);
+        int numberOfEnabledEntries = 0;
+        for (int slot = 0; slot < DOSE_SCHEDULER_MAXIMUM_ENTRIES; slot++) {
+            char key[8];
+            makeStorageKey(slot, key);
+            if (preferences.getBytesLength(key) != sizeof(StoredDoseScheduleRecord)) {
+                continue;
+            }
+            StoredDoseScheduleRecord record;
+            preferences.getBytes(key, &record, sizeof(record));
+            if (record.formatVersion != DOSE_SCHEDULE_FORMAT_VERSION ||
+                record.checksum != calculateRecordChecksum(record) ||
+                record.entry.minuteOfDay >= 1440 ||
+                record.entry.missedDosePolicy >= NUMBER_OF_MISSED_DOSE_POLICIES) {
+                continue;
+            }
+            scheduleEntries[slot] = record.entry;
+            numberOfEnabledEntries++;
+        }
+
+        if (isClockSynchronized()) {
+            rebuildUpcomingDoses((uint32_t)time(NULL));
+        }
+        return numberOfEnabledEntries;
+    }
+
+    // ========================================================================
+    // Clock
+    // ========================================================================
+
+    /**
+     * Set the clock from the phone
+     * @param epochSeconds UTC seconds since 1970
+     * @param offsetMinutes Local time offset from UTC (minuteOfDay is local)
+     */
+    void synchronizeClock(uint32_t epochSeconds, int offsetMinutes) {
+        struct timeval now;
+        now.tv_sec = epochSeconds;
+        now.tv_usec = 0;
+        settimeofday(&now, NULL);
+
+        if (offsetMinutes != utcOffsetMinutes) {
+            utcOffsetMinutes = offsetMinutes;
+            if (isStorageOpen) {
+                preferences.putInt("tz", utcOffsetMinutes);
+            }
+        }
+        rebuildUpcomingDoses(epochSeconds);
+    }
+
+    static bool isValidTime(uint32_t seconds) {
+        return seconds >= DOSE_SCHEDULER_EARLIEST_VALID_TIME;
+    }
+
+    bool isClockSynchronized() {
+        return isValidTime((uint32_t)time(NULL));
+    }
+
+    int getUtcOffsetMinutes() {
+        return utcOffsetMinutes;
+    }
+
+    // ========================================================================
+    // Schedule editing
+    // ========================================================================
+
+    /**
+     * Add or replace a daily dose. An entry never fires for a time already
+     * past when it is created.
+     * @return false if a parameter is out of range or it could not be stored
+     */
+    bool setScheduleEntry(int slot, int minuteOfDay, int compartmentNumber, int pillCount,
+                          int missedDosePolicy, uint32_t now) {
+        if (slot < 0 || slot >= DOSE_SCHEDULER_MAXIMUM_ENTRIES ||
+            minuteOfDay < 0 || minuteOfDay >= 1440 ||
+            compartmentNumber < 1 || compartmentNumber > systemConfiguration->numberOfCompartmentsInDispenser ||
+            pillCount < 1 || pillCount > 255 ||
+            missedDosePolicy < 0 || missedDosePolicy >= NUMBER_OF_MISSED_DOSE_POLICIES) {
+            return false;
+        }
+
+        DoseScheduleEntry& entry = scheduleEntries[slot];
+        entry.isEnabled = 1;
+        entry.compartmentNumber = (uint8_t)compartmentNumber;
+        entry.pillCount = (uint8_t)pillCount;
+        entry.missedDosePolicy = (uint8_t)missedDosePolicy;
+        entry.minuteOfDay = (uint16_t)minuteOfDay;
+        entry.reserved = 0;
+        entry.lastHandledDueTime = isValidTime(now) ? getLatestOccurrenceAtOrBefore(entry, now) : 0;
+
+        bool isStored = writeStoredEntry(slot);
+        if (isValidTime(now)) {
+            rebuildUpcomingDoses(now);
+        }
+        return isStored;
+    }
+
+    bool deleteScheduleEntry(int slot, uint32_t now) {
+        if (slot < 0 || slot >= DOSE_SCHEDULER_MAXIMUM_ENTRIES) {
+            return false;
+        }
+        scheduleEntries[slot].isEnabled = 0;
+        writeStoredEntry(slot);
+        if (isValidTime(now)) {
+            rebuildUpcomingDoses(now);
+        }
+        return true;
+    }
+
+    void clearSchedule() {
+        memset(scheduleEntries, 0, sizeof(scheduleEntries));
+        numberOfUpcomingDoses = 0;
+        memset(inFlightDueTimes, 0, sizeof(inFlightDueTimes));
+        if (isStorageOpen) {
+            preferences.clear();
+            preferences.putInt("tz", utcOffsetMinutes);
+        }
+    }
+
+    int getNumberOfEnabledEntries() {
+        int count = 0;
+        for (int slot = 0; slot < DOSE_SCHEDULER_MAXIMUM_ENTRIES; slot++) {
+            if (scheduleEntries[slot].isEnabled) {
+                count++;
+            }
+        }
+        return count;
+    }
+
+    // ========================================================================
+    // Firing
+    // ========================================================================
+
+    /**
+     * Pop the next due dose, applying its missed-dose policy
+     * Call every loop. When a dose is returned with shouldDispense, dispense
+     * it and call completeScheduledDose(); a missed dose is already recorded.
+     * Until then the slot is in flight and is not queued again.
+     * @param now Current UTC seconds
+     * @param decision Filled when true is returned
+     * @return true if a dose is due (to dispense or to report as missed)
+     */
+    bool getNextDueDose(uint32_t now, DoseDecision* decision) {
+        if (!isValidTime(now)) {
+            return false;
+        }
+        ScheduledDose dose;
+        while (true) {
+            if (numberOfUpcomingDoses == 0 || upcomingDoses[0].dueTime > now) {
+                return false;
+            }
+            dose = popUpcomingDose();
+            // Stale copies (already handled, in flight or deleted) are dropped
+            const DoseScheduleEntry& candidate = scheduleEntries[dose.slot];
+            if (candidate.isEnabled && inFlightDueTimes[dose.slot] == 0 &&
+                dose.dueTime > candidate.lastHandledDueTime) {
+                break;
+            }
+        }
+        const DoseScheduleEntry& entry = scheduleEntries[dose.slot];
+        long secondsLate = (long)(now - dose.dueTime);
+
+        bool shouldDispense;
+        switch (entry.missedDosePolicy) {
+            case MISSED_DOSE_ALWAYS_DISPENSE:
+                shouldDispense = true;
+                break;
+            case MISSED_DOSE_SKIP_IF_LATE:
+                shouldDispense = secondsLate <= (long)systemConfiguration->onTimeDoseToleranceMinutes * 60;
+                break;
+            case MISSED_DOSE_DISPENSE_WITHIN_GRACE:
+            default:
+                shouldDispense = secondsLate <= (long)systemConfiguration->missedDoseGraceMinutes * 60;
+                break;
+        }
+
+        decision->dose = dose;
+        decision->compartmentNumber = entry.compartmentNumber;
+        decision->pillCount = entry.pillCount;
+        decision->shouldDispense = shouldDispense;
+        decision->secondsLate = secondsLate;
+
+        if (shouldDispense) {
+            inFlightDueTimes[dose.slot] = dose.dueTime;
+        } else {
+            markOccurrenceHandled(dose, DOSE_MISSED, now);
+        }
+        return true;
+    }
+
+    /**
+     * Record the result of a dispensed dose and queue its next occurrence
+     * @return Outcome recorded for the dose
+     */
+    DoseOutcome completeScheduledDose(const DoseDecision& decision, int pillsDispensed, uint32_t now) {
+        DoseOutcome outcome;
+        if (pillsDispensed <= 0) {
+            outcome = DOSE_FAILED;
+        } else if (decision.secondsLate <= (long)systemConfiguration->onTimeDoseToleranceMinutes * 60) {
+            outcome = DOSE_TAKEN_ON_TIME;
+        } else {
+            outcome = DOSE_TAKEN_LATE;
+        }
+        markOccurrenceHandled(decision.dose, outcome, now);
+        return outcome;
+    }
+
+    /**
+     * @return Seconds until the next queued dose, or -1 if none
+     */
+    long getSecondsUntilNextDose(uint32_t now) {
+        if (numberOfUpcomingDoses == 0 || !isValidTime(now)) {
+            return -1;
+        }
+        return upcomingDoses[0].dueTime > now ? (long)(upcomingDoses[0].dueTime - now) : 0;
+    }
+
+    int getNextDoseSlot() {
+        return numberOfUpcomingDoses > 0 ? upcomingDoses[0].slot : -1;
+    }
+    
+    /**
+     * @return Compartment of the next queued dose, or 0 if none
+     */
+    int getNextDoseCompartmentNumber() {
+        return numberOfUpcomingDoses > 0 ? scheduleEntries[upcomingDoses[0].slot].compartmentNumber : 0;
+    }
+    
+    /**
+     * @return Due time (UTC seconds) of the next queued dose, or 0 if none
+     */
+    uint32_t getNextDoseDueTime() {
+        return numberOfUpcomingDoses > 0 ? upcomingDoses[0].dueTime : 0;
+    }
+
+    /**
+     * @return Pills per day the enabled entries take from a compartment
+     */
+    int getScheduledPillsPerDayForCompartment(int compartmentNumber) {
+        int pillsPerDay = 0;
+        for (int slot = 0; slot < DOSE_SCHEDULER_MAXIMUM_ENTRIES; slot++) {
+            if (scheduleEntries[slot].isEnabled && scheduleEntries[slot].compartmentNumber == compartmentNumber) {
+                pillsPerDay += scheduleEntries[slot].pillCount;
+            }
+        }
+        return pillsPerDay;
+    }
+
+    unsigned long getOutcomeCount(DoseOutcome outcome) {
+        return outcomeCounts[outcome];
+    }
+
+    template <typename Output>
+    void printSchedule(Output& out) {
+        out.println("DOSE SCHEDULE:");
+        out.print("Clock: ");
+        out.print(isClockSynchronized() ? "synchronized" : "NOT SET");
+        out.print(", UTC offset ");
+        out.print(utcOffsetMinutes);
+        out.println(" min");
+        for (int slot = 0; slot < DOSE_SCHEDULER_MAXIMUM_ENTRIES; slot++) {
+            const DoseScheduleEntry& entry = scheduleEntries[slot];
+            if (!entry.isEnabled) {
+                continue;
+            }
+            char line[64];
+            snprintf(line, sizeof(line), "  [%d] %02d:%02d  compartment %d x%d  policy %d",
+                     slot, entry.minuteOfDay / 60, entry.minuteOfDay % 60,
+                     entry.compartmentNumber, entry.pillCount, entry.missedDosePolicy);
+            out.println(line);
+        }
+        out.print("Outcomes: ");
+        for (int i = 0; i < NUMBER_OF_DOSE_OUTCOMES; i++) {
+            out.print(getDoseOutcomeName((DoseOutcome)i));
+            out.print("=");
+            out.print(outcomeCounts[i]);
+            out.print(i < NUMBER_OF_DOSE_OUTCOMES - 1 ? " " : "\n");
+        }
+    }
+};
+
+#endif // DOSE_SCHEDULER_H
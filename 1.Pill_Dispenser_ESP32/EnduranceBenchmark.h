@@ -0,0 +1,300 @@
+#ifndef ENDURANCE_BENCHMARK_H
+#define ENDURANCE_BENCHMARK_H
+
+#include <Arduino.h>
+#include "Config.h"
+#include "ConfigurationSettings.h"
+#include "DispenserController.h"
+
+// ============================================================================
+// Endurance Benchmark Limits
+// ============================================================================
+#define ENDURANCE_MAXIMUM_ROUNDS                300     // Results kept for the CSV dump and percentiles
+#define ENDURANCE_DEFAULT_ROUNDS                50
+#define ENDURANCE_DEFAULT_PAUSE_MILLISECONDS    500
+#define ENDURANCE_CSV_HEADER                    "round,compartment,pills,attempts,cycle_ms,move_ms,actuation_ms,ir_window_ms,homing_ms"
+
+/**
+ * One benchmark round (one pill requested), times in milliseconds
+ */
+struct EnduranceRoundResult {
+    uint16_t roundNumber;
+    uint8_t compartmentNumber;
+    uint8_t pillsDispensed;
+    uint8_t numberOfAttempts;
+    uint32_t cycleMilliseconds;
+    uint16_t moveMilliseconds;
+    uint16_t actuationMilliseconds;
+    uint16_t detectionWindowMilliseconds;
+    uint16_t autoHomingMilliseconds;
+};
+
+/**
+ * EnduranceBenchmark Class
+ *
+ * Production replacement for the Test Code endurance sketch. Runs rounds of
+ * single-pill dispenses through the real DispenserController path, cycling
+ * over the chosen compartments:
+ * - One round per runNextRoundIfDue() call, so BLE and STOP still work
+ *   between rounds
+ * - Each round is streamed as a CSV line on Serial as it finishes
+ * - The summary gives success rate, p50/p95/p99 cycle time, pills per minute
+ *   and mean phase times (the phases DispenseSimulator models)
+ */
+class EnduranceBenchmark {
+private:
+    DispenserController* dispenserController;
+
+    EnduranceRoundResult roundResults[ENDURANCE_MAXIMUM_ROUNDS];
+    int numberOfRequestedRounds;
+    int numberOfCompletedRounds;
+    uint32_t compartmentMask;           // Bit i = compartment i + 1
+    int nextCompartmentNumber;
+    int pauseBetweenRoundsMilliseconds;
+    bool isBenchmarkRunning;
+    unsigned long timeOfRunStartMilliseconds;
+    unsigned long timeOfLastRoundEndMilliseconds;
+
+    static uint16_t toSaturatedMilliseconds(unsigned long microseconds) {
+        unsigned long milliseconds = microseconds / 1000;
+        return milliseconds > 0xFFFF ? 0xFFFF : (uint16_t)milliseconds;
+    }
+
+    /**
+     * @return Next selected compartment after the given one (wraps around)
+     */
+    int findNextSelectedCompartment(int afterCompartmentNumber) {
+        for (int offset = 1; offset <= NUMBER_OF_COMPARTMENTS_IN_DISPENSER; offset++) {
+            int candidate = (afterCompartmentNumber - 1 + offset) % NUMBER_OF_COMPARTMENTS_IN_DISPENSER + 1;
+            if (compartmentMask & (1UL << (candidate - 1))) {
+                return candidate;
+            }
+        }
+        return 0;
+    }
+
+    template <typename Output>
+    void printRoundAsCsv(Output& out, const EnduranceRoundResult& result) {
+        char line[80];
+        snprintf(line, sizeof(line), "%u,%u,%u,%u,%lu,%u,%u,%u,%u",
+                 result.roundNumber, result.compartmentNumber, result.pillsDispensed,
+                 result.numberOfAttempts, (unsigned long)result.cycleMilliseconds,
+                 result.moveMilliseconds, result.actuationMilliseconds,
+                 result.detectionWindowMilliseconds, result.autoHomingMilliseconds);
+        out.println(line);
+    }
+
+public:
+    /**
+     * Constructor
+     * @param dispenser The live dispenser controller (rounds really dispense)
+     */
+    EnduranceBenchmark(DispenserController* dispenser) {
+        dispenserController = dispenser;
+        numberOfRequestedRounds = 0;
+        numberOfCompletedRounds = 0;
+        compartmentMask = 0;
+        nextCompartmentNumber = 0;
+        pauseBetweenRoundsMilliseconds = ENDURANCE_DEFAULT_PAUSE_MILLISECONDS;
+        isBenchmarkRunning = false;
+        timeOfRunStartMilliseconds = 0;
+        timeOfLastRoundEndMilliseconds = 0;
+    }
+
+    /**
+     * Start a run; previous results are discarded
+     * @param rounds Rounds to run (capped at ENDURANCE_MAXIMUM_ROUNDS)
+     * @param selectedCompartmentMask Bit i = compartment i + 1 (0 = all)
+     * @param pauseMilliseconds Pause between rounds
+     * @return false if no valid compartment is selected
+     */
+    bool startBenchmark(int rounds, uint32_t selectedCompartmentMask, int pauseMilliseconds) {
+        uint32_t allCompartmentsMask = (NUMBER_OF_COMPARTMENTS_IN_DISPENSER >= 32)
+            ? 0xFFFFFFFFUL : ((1UL << NUMBER_OF_COMPARTMENTS_IN_DISPENSER) - 1);
+        compartmentMask = (selectedCompartmentMask == 0) ? allCompartmentsMask
+                                                         : (selectedCompartmentMask & allCompartmentsMask);
+        if (compartmentMask == 0) {
+            return false;
+        }
+
+        numberOfRequestedRounds = constrain(rounds, 1, ENDURANCE_MAXIMUM_ROUNDS);
+        pauseBetweenRoundsMilliseconds = max(pauseMilliseconds, 0);
+        numberOfCompletedRounds = 0;
+        nextCompartmentNumber = findNextSelectedCompartment(NUMBER_OF_COMPARTMENTS_IN_DISPENSER);
+        isBenchmarkRunning = true;
+        timeOfRunStartMilliseconds = millis();
+        timeOfLastRoundEndMilliseconds = timeOfRunStartMilliseconds - pauseBetweenRoundsMilliseconds;
+
+        Serial.println("ENDURANCE BEGIN");
+        Serial.println(ENDURANCE_CSV_HEADER);
+        return true;
+    }
+
+    void stopBenchmark() {
+        if (isBenchmarkRunning) {
+            isBenchmarkRunning = false;
+            Serial.println("ENDURANCE END");
+        }
+    }
+
+    bool isRunning() {
+        return isBenchmarkRunning;
+    }
+
+    int getNumberOfCompletedRounds() {
+        return numberOfCompletedRounds;
+    }
+
+    int getNumberOfRequestedRounds() {
+        return numberOfRequestedRounds;
+    }
+
+    /**
+     * Run one round once the pause since the previous round has passed
+     * @return true when a round ran
+     */
+    bool runNextRoundIfDue() {
+        if (!isBenchmarkRunning ||
+            millis() - timeOfLastRoundEndMilliseconds < (unsigned long)pauseBetweenRoundsMilliseconds) {
+            return false;
+        }
+
+        int compartmentNumber = nextCompartmentNumber;
+        unsigned long cycleStartMicroseconds = micros();
+        int pillsDispensed = dispenserController->dispensePillsFromCompartment(compartmentNumber, 1);
+        unsigned long cycleMicroseconds = micros() - cycleStartMicroseconds;
+        DispensePhaseTimings timings = dispenserController->getLastDispensePhaseTimings();
+
+        EnduranceRoundResult& result = roundResults[numberOfCompletedRounds];
+        result.roundNumber = (uint16_t)(numberOfCompletedRounds + 1);
+        result.compartmentNumber = (uint8_t)compartmentNumber;
+        result.pillsDispensed = (uint8_t)constrain(pillsDispensed, 0, 255);
+        result.numberOfAttempts = (uint8_t)constrain(timings.numberOfAttempts, 0, 255);
+        result.cycleMilliseconds = cycleMicroseconds / 1000;
+        result.moveMilliseconds = toSaturatedMilliseconds(timings.moveMicroseconds);
+        result.actuationMilliseconds = toSaturatedMilliseconds(timings.actuationMicroseconds);
+        result.detectionWindowMilliseconds = toSaturatedMilliseconds(timings.detectionWindowMicroseconds);
+        result.autoHomingMilliseconds = toSaturatedMilliseconds(timings.autoHomingMicroseconds);
+        printRoundAsCsv(Serial, result);
+
+        numberOfCompletedRounds++;
+        nextCompartmentNumber = findNextSelectedCompartment(compartmentNumber);
+        timeOfLastRoundEndMilliseconds = millis();
+
+        if (numberOfCompletedRounds >= numberOfRequestedRounds) {
+            stopBenchmark();
+            printSummary(Serial);
+        }
+        return true;
+    }
+
+    // ========================================================================
+    // Results
+    // ========================================================================
+
+    float getSuccessRatePercent() {
+        if (numberOfCompletedRounds == 0) {
+            return 0;
+        }
+        int successfulRounds = 0;
+        for (int i = 0; i < numberOfCompletedRounds; i++) {
+            if (roundResults[i].pillsDispensed > 0) {
+                successfulRounds++;
+            }
+        }
+        return 100.0 * successfulRounds / numberOfCompletedRounds;
+    }
+
+    /**
+     * @param percentile 0-100
+     * @return Cycle time at that percentile (nearest rank), in milliseconds
+     */
+    unsigned long getCycleTimePercentileMilliseconds(int percentile) {
+        if (numberOfCompletedRounds == 0) {
+            return 0;
+        }
+        static uint32_t sortedCycleTimes[ENDURANCE_MAXIMUM_ROUNDS];
+        for (int i = 0; i < numberOfCompletedRounds; i++) {
+            uint32_t value = roundResults[i].cycleMilliseconds;
+            int j = i;
+            while (j > 0 && sortedCycleTimes[j - 1] > value) {
+                sortedCycleTimes[j] = sortedCycleTimes[j - 1];
+                j--;
+            }
+            sortedCycleTimes[j] = value;
+        }
+        int rank = (percentile * numberOfCompletedRounds + 99) / 100;
+        return sortedCycleTimes[constrain(rank, 1, numberOfCompletedRounds) - 1];
+    }
+
+    /**
+     * @return Pills dispensed per minute of wall time (pauses included)
+     */
+    float getPillsPerMinute() {
+        unsigned long elapsed = timeOfLastRoundEndMilliseconds - timeOfRunStartMilliseconds;
+        if (numberOfCompletedRounds == 0 || elapsed == 0) {
+            return 0;
+        }
+        unsigned long totalPills = 0;
+        for (int i = 0; i < numberOfCompletedRounds; i++) {
+            totalPills += roundResults[i].pillsDispensed;
+        }
+        return totalPills * 60000.0 / elapsed;
+    }
+
+    template <typename Output>
+    void printSummary(Output& out) {
+        out.println("ENDURANCE SUMMARY:");
+        out.print("Rounds: ");
+        out.print(numberOfCompletedRounds);
+        out.print(" / ");
+        out.println(numberOfRequestedRounds);
+        out.print("Success rate: ");
+        out.print(getSuccessRatePercent());
+        out.println(" %");
+        out.print("Cycle time p50/p95/p99: ");
+        out.print(getCycleTimePercentileMilliseconds(50));
+        out.print(" / ");
+        out.print(getCycleTimePercentileMilliseconds(95));
+        out.print(" / ");
+        out.print(getCycleTimePercentileMilliseconds(99));
+        out.println(" ms");
+        out.print("Pills per minute: ");
+        out.println(getPillsPerMinute());
+
+        if (numberOfCompletedRounds > 0) {
+            unsigned long totalMove = 0, totalActuation = 0, totalDetection = 0, totalHoming = 0;
+            for (int i = 0; i < numberOfCompletedRounds; i++) {
+                totalMove += roundResults[i].moveMilliseconds;
+                totalActuation += roundResults[i].actuationMilliseconds;
+                totalDetection += roundResults[i].detectionWindowMilliseconds;
+                totalHoming += roundResults[i].autoHomingMilliseconds;
+            }
+            out.print("Mean phases (move/actuation/IR window/homing): ");
+            out.print(totalMove / numberOfCompletedRounds);
+            out.print(" / ");
+            out.print(totalActuation / numberOfCompletedRounds);
+            out.print(" / ");
+            out.print(totalDetection / numberOfCompletedRounds);
+            out.print(" / ");
+            out.print(totalHoming / numberOfCompletedRounds);
+            out.println(" ms");
+        }
+    }
+
+    /**
+     * Print every stored round as CSV followed by the summary
+     */
+    template <typename Output>
+    void printResultsAsCsv(Output& out) {
+        out.println("ENDURANCE BEGIN");
+        out.println(ENDURANCE_CSV_HEADER);
+        for (int i = 0; i < numberOfCompletedRounds; i++) {
+            printRoundAsCsv(out, roundResults[i]);
+        }
+        out.println("ENDURANCE END");
+        printSummary(out);
+    }
+};
+
+#endif // ENDURANCE_BENCHMARK_H
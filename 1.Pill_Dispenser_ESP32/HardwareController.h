@@ -5,32 +5,157 @@
 #include <ESP32Servo.h>
 #include "Config.h"
 #include "ConfigurationSettings.h"
+#include "CancellationToken.h"
+#include "ServoMotionModel.h"
+
+// ============================================================================
+// Servo Attach
+// ============================================================================
+// The bundled ESP32Servo (Test Code/Test_Code_ESP32/libraries/ESP32Servo) can
+// attach with the first pulse already at a given width. Releases from the
+// Library Manager only have attach(pin, min, max): the servo then gets its
+// default 1500 us pulse until the caller writes the width, so it may twitch.
+// Overload resolution prefers the first form (int tag) when it compiles.
+
+template <typename ServoType>
+auto attachServoWithInitialPulse(ServoType& servo, int pin, int minimum, int maximum, int initialMicroseconds, int)
+    -> decltype(servo.attach(pin, minimum, maximum, initialMicroseconds)) {
+    return servo.attach(pin, minimum, maximum, initialMicroseconds);
+}
+
+template <typename ServoType>
+int attachServoWithInitialPulse(ServoType& servo, int pin, int minimum, int maximum, int, long) {
+    return servo.attach(pin, minimum, maximum);
+}
 
 /**
  * HardwareController Class
  * 
  * Responsible for all hardware actuation including:
  * - Stepper motor control (precise positioning and continuous rotation)
- * - Servo motor positioning
+ * - Servo motor positioning (trajectory tracked in ServoMotionModel, so
+ *   positions are never read back from the PWM)
  * - Electromagnet activation
+ * - Safe state after an abort (moves stop at the next step or servo write)
  * 
  * This class provides low-level hardware control without knowledge of
  * higher-level operations like "dispensing" or "homing" (low coupling).
+ * 
+ * ConfigurationType is SystemConfiguration (read at run time) or
+ * FixedSystemConfiguration (constants folded at compile time).
  */
-class HardwareController {
+template <typename ConfigurationType>
+class BasicHardwareController {
 private:
-    SystemConfiguration* systemConfiguration;
+    ConfigurationType* systemConfiguration;
     Servo dispenserServoMotor;
     bool isElectromagnetCurrentlyActivated;
+    bool areActuatorOutputsSuppressed;         // Sensor trace replay: keep timing, drive nothing
+    int parkedServoMicroseconds;               // Position held when the servo was detached for idle (0 = none)
+    ServoMotionModel servoMotion;              // Commanded target, setpoint and modeled horn position
+    unsigned long timeOfLastServoCommandMilliseconds;
+    unsigned long numberOfServoIdleDetaches;
+    unsigned long timeOfElectromagnetActivationMilliseconds;
+    CancellationToken* cancellationToken;      // NULL = moves always run to completion
+    
+    /**
+     * Attach the servo, resuming from the position it was parked at
+     */
+    void attachServoAtParkedPosition() {
+        // With the bundled library the first pulse already has the parked width,
+        // so the horn does not jump
+        attachServoWithInitialPulse(dispenserServoMotor, PIN_FOR_SERVO_MOTOR_SIGNAL, getServoMinSafe(),
+                                    getServoMaxSafe(), parkedServoMicroseconds > 0 ? parkedServoMicroseconds : -1, 0);
+        timeOfLastServoCommandMilliseconds = millis();
+        if (parkedServoMicroseconds > 0) {
+            commandServoMicroseconds(parkedServoMicroseconds);
+        }
+    }
+    
+    /**
+     * Stop pulsing the servo; the next attach resumes at the same pulse width
+     */
+    void detachServoAtSetpoint() {
+        parkedServoMicroseconds = servoMotion.getSetpointMicroseconds();
+        servoMotion.recordDetach(millis(), systemConfiguration->servoSlewMicrosecondsPerSecond);
+        dispenserServoMotor.detach();
+    }
+    
+    /**
+     * Write a pulse width (unless outputs are suppressed) and record it as the setpoint
+     */
+    void commandServoMicroseconds(int microseconds) {
+        timeOfLastServoCommandMilliseconds = millis();
+        servoMotion.recordSetpoint(microseconds, timeOfLastServoCommandMilliseconds,
+                                   systemConfiguration->servoSlewMicrosecondsPerSecond);
+        if (!areActuatorOutputsSuppressed) {
+            dispenserServoMotor.writeMicroseconds(microseconds);
+        }
+    }
     
 public:
     /**
      * Constructor
      * @param config Pointer to system configuration
      */
-    HardwareController(SystemConfiguration* config) {
+    BasicHardwareController(ConfigurationType* config) {
         systemConfiguration = config;
         isElectromagnetCurrentlyActivated = false;
+        areActuatorOutputsSuppressed = false;
+        parkedServoMicroseconds = 0;
+        timeOfLastServoCommandMilliseconds = 0;
+        numberOfServoIdleDetaches = 0;
+        timeOfElectromagnetActivationMilliseconds = 0;
+        cancellationToken = NULL;
+    }
+    
+    // ========================================================================
+    // Cancellation
+    // ========================================================================
+    
+    /**
+     * Poll an abort token at every step, servo write and wait slice
+     * @param token Shared token (NULL = never cancelled)
+     */
+    void attachCancellationToken(CancellationToken* token) {
+        cancellationToken = token;
+    }
+    
+    bool isCancellationRequested() {
+        return cancellationToken != NULL && cancellationToken->isCancellationRequested();
+    }
+    
+    /**
+     * delay() that returns early on an abort
+     * @return false if cancelled before the time passed
+     */
+    bool waitMillisecondsUnlessCancelled(unsigned long milliseconds) {
+        unsigned long start = millis();
+        while (millis() - start < milliseconds) {
+            if (isCancellationRequested()) {
+                return false;
+            }
+            unsigned long remaining = milliseconds - (millis() - start);
+            delay(remaining < 5 ? remaining : 5);
+        }
+        return !isCancellationRequested();
+    }
+    
+    /**
+     * Abort: electromagnet off, stepper driver disabled, servo sent straight to
+     * rest (a single write, no stepped sweep)
+     */
+    void enterSafeState() {
+        deactivateElectromagnetToReleasePill();
+        digitalWrite(PIN_FOR_STEPPER_EN, HIGH);
+        digitalWrite(PIN_FOR_STEPPER_STEP, LOW);
+        if (!areActuatorOutputsSuppressed) {
+            if (!dispenserServoMotor.attached()) {
+                attachServoAtParkedPosition();
+            }
+        }
+        servoMotion.beginMove(getServoMinSafe());
+        commandServoMicroseconds(getServoMinSafe());
     }
     
     void initializeAllHardwareActuators() {
@@ -96,7 +221,9 @@ public:
         stepPulseCount++;
         int stepPulseWidth = systemConfiguration->stepperStepPulseWidthMicroseconds;
         
-        digitalWrite(PIN_FOR_STEPPER_STEP, HIGH);
+        if (!areActuatorOutputsSuppressed) {
+            digitalWrite(PIN_FOR_STEPPER_STEP, HIGH);
+        }
         delayMicroseconds(stepPulseWidth);
         digitalWrite(PIN_FOR_STEPPER_STEP, LOW);
         delayMicroseconds(stepPulseWidth);
@@ -111,7 +238,9 @@ public:
         digitalWrite(PIN_FOR_STEPPER_DIR, dirPinState);
         delayMicroseconds(5);
         
-        digitalWrite(PIN_FOR_STEPPER_EN, LOW);
+        if (!areActuatorOutputsSuppressed) {
+            digitalWrite(PIN_FOR_STEPPER_EN, LOW);
+        }
         delayMicroseconds(10);
     }
     
@@ -140,12 +269,14 @@ public:
         resetStepCounter();
         enableStepperMotor(true);
         
-        for (long i = 0; i < steps; i++) {
+        long stepsMoved = 0;
+        while (stepsMoved < steps && !isCancellationRequested()) {
             generateStepPulse();
+            stepsMoved++;
         }
         
         delayMicroseconds(100);
-        return steps;
+        return stepsMoved;
     }
     
     long moveStepperBackwardBySteps(long steps, int stepDelayMicroseconds) {
@@ -156,12 +287,14 @@ public:
         resetStepCounter();
         enableStepperMotor(false);
         
-        for (long i = 0; i < steps; i++) {
+        long stepsMoved = 0;
+        while (stepsMoved < steps && !isCancellationRequested()) {
             generateStepPulse();
+            stepsMoved++;
         }
         
         delayMicroseconds(100);
-        return -steps;
+        return -stepsMoved;
     }
     
     void rotateStepperBackwardByAngle(float angleInDegrees, int stepDelayMicroseconds) {
@@ -238,18 +371,22 @@ public:
         
         // Constrain to safe range
         targetMicroseconds = constrain(targetMicroseconds, minSafe, maxSafe);
+        servoMotion.beginMove(targetMicroseconds);
         
-        // Ensure servo is attached
-        if (!dispenserServoMotor.attached()) {
-            dispenserServoMotor.attach(PIN_FOR_SERVO_MOTOR_SIGNAL, minSafe, maxSafe);
+        // Ensure servo is attached (suppressed outputs run the same steps and
+        // delays without driving the servo)
+        if (!dispenserServoMotor.attached() && !areActuatorOutputsSuppressed) {
+            attachServoAtParkedPosition();
         }
         
         // Get current position
-        int current = dispenserServoMotor.readMicroseconds();
+        int current = servoMotion.getSetpointMicroseconds();
         if (current < minSafe || current > maxSafe) {
             current = minSafe;  // Clamp to known good start
-            dispenserServoMotor.writeMicroseconds(current);
-            delay(5);
+            commandServoMicroseconds(current);
+            if (!areActuatorOutputsSuppressed) {
+                delay(5);
+            }
         }
         
         // Determine step direction and size
@@ -258,7 +395,10 @@ public:
         // Move in steps to target position
         int us = current;
         while ((step > 0 && us < targetMicroseconds) || (step < 0 && us > targetMicroseconds)) {
-            dispenserServoMotor.writeMicroseconds(us);
+            if (isCancellationRequested()) {
+                return;  // Hold where it is; enterSafeState() sends it to rest
+            }
+            commandServoMicroseconds(us);
             delay(systemConfiguration->servoStepDelayMilliseconds);
             
             // Check if next step would overshoot
@@ -270,7 +410,7 @@ public:
         }
         
         // Ensure we end exactly at target position (in case step size didn't divide evenly)
-        dispenserServoMotor.writeMicroseconds(targetMicroseconds);
+        commandServoMicroseconds(targetMicroseconds);
         delay(systemConfiguration->servoStepDelayMilliseconds);
         
     }
@@ -290,7 +430,46 @@ public:
         
         const int naturalMinimumMicroseconds = 150;
         moveServoToMicroseconds(naturalMinimumMicroseconds);
-        delay(systemConfiguration->servoMovementDelayMilliseconds);
+        waitForServoToSettle();
+    }
+    
+    /**
+     * Wait after a move until the servo is modeled to be at rest
+     * Never longer than servoMovementDelayMilliseconds; the full delay when the
+     * model has no estimate (after boot, after a detach mid-move, 0 slew).
+     * @return false if cancelled
+     */
+    bool waitForServoToSettle() {
+        if (!waitMillisecondsUnlessCancelled(getServoSettleWaitMilliseconds())) {
+            return false;
+        }
+        markServoSettled();
+        return true;
+    }
+    
+    /**
+     * The wait waitForServoToSettle() would do now, for callers that poll
+     * something else meanwhile (call markServoSettled() once it has passed)
+     */
+    unsigned long getServoSettleWaitMilliseconds() {
+        unsigned long fixedDelay = (unsigned long)systemConfiguration->servoMovementDelayMilliseconds;
+        long remaining = servoMotion.getRemainingSettleMilliseconds(millis(),
+                                                                    systemConfiguration->servoSlewMicrosecondsPerSecond,
+                                                                    systemConfiguration->servoSettleMilliseconds);
+        return (remaining >= 0 && (unsigned long)remaining < fixedDelay) ? (unsigned long)remaining : fixedDelay;
+    }
+    
+    void markServoSettled() {
+        servoMotion.markSettled(millis());
+    }
+    
+    /**
+     * Modeled horn position while it is still on its way to the setpoint
+     * @return Microseconds, or 0 once it arrived or when the model cannot tell
+     */
+    int getServoPositionWhileTravelling() {
+        return servoMotion.getTravellingEstimateMicroseconds(millis(),
+                                                             systemConfiguration->servoSlewMicrosecondsPerSecond);
     }
     
     /**
@@ -306,7 +485,7 @@ public:
      */
     void moveServoToMaxPositionAndWait() {
         moveServoToMaxPosition();
-        delay(systemConfiguration->servoMovementDelayMilliseconds);
+        waitForServoToSettle();
     }
     
     /**
@@ -343,7 +522,7 @@ public:
      */
     void moveServoToDispensingPositionAndWait() {
         moveServoToDispensingPosition();
-        delay(systemConfiguration->servoMovementDelayMilliseconds);
+        waitForServoToSettle();
     }
     
     /**
@@ -351,20 +530,15 @@ public:
      */
     void moveServoToRestPositionAndWait() {
         moveServoToRestPosition();
-        delay(systemConfiguration->servoMovementDelayMilliseconds);
+        waitForServoToSettle();
     }
     
     /**
      * Get current servo position in microseconds
-     * @return Current servo position in microseconds
+     * @return Last commanded setpoint (the parked position while detached)
      */
     int getCurrentServoPosition() {
-        if (!dispenserServoMotor.attached()) {
-            int minSafe = getServoMinSafe();
-            int maxSafe = getServoMaxSafe();
-            dispenserServoMotor.attach(PIN_FOR_SERVO_MOTOR_SIGNAL, minSafe, maxSafe);
-        }
-        int current = dispenserServoMotor.readMicroseconds();
+        int current = servoMotion.getSetpointMicroseconds();
         int minSafe = getServoMinSafe();
         int maxSafe = getServoMaxSafe();
         
@@ -380,7 +554,7 @@ public:
         int targetPosition = maxSafe;
         
         moveServoToMicroseconds(targetPosition);
-        delay(systemConfiguration->servoMovementDelayMilliseconds);
+        waitForServoToSettle();
         
         return targetPosition;
     }
@@ -391,18 +565,23 @@ public:
         moveServoFromCurrentToMax();
         
         moveServoToMicroseconds(startPosition);
-        delay(systemConfiguration->servoMovementDelayMilliseconds);
+        waitForServoToSettle();
         
         return startPosition;
     }
     
     void moveServoFromCurrentToMaxAndReturnAndWait() {
         moveServoFromCurrentToMaxAndReturn();
-        delay(systemConfiguration->servoMovementDelayMilliseconds);
+        waitForServoToSettle();
     }
     
     void activateElectromagnetForPillPickup() {
-        digitalWrite(PIN_FOR_ELECTROMAGNET_CONTROL, HIGH);
+        if (!areActuatorOutputsSuppressed) {
+            digitalWrite(PIN_FOR_ELECTROMAGNET_CONTROL, HIGH);
+        }
+        if (!isElectromagnetCurrentlyActivated) {
+            timeOfElectromagnetActivationMilliseconds = millis();
+        }
         isElectromagnetCurrentlyActivated = true;
     }
     
@@ -411,9 +590,17 @@ public:
         isElectromagnetCurrentlyActivated = false;
     }
     
+    /**
+     * Energize the magnet and wait until it has been on for the stabilization
+     * time; a magnet pre-energized before a scheduled dose only waits the rest
+     */
     void activateElectromagnetAndWaitForStabilization() {
         activateElectromagnetForPillPickup();
-        delay(systemConfiguration->electromagnetActivationDelayMilliseconds);
+        unsigned long elapsed = millis() - timeOfElectromagnetActivationMilliseconds;
+        unsigned long required = systemConfiguration->electromagnetActivationDelayMilliseconds;
+        if (elapsed < required) {
+            waitMillisecondsUnlessCancelled(required - elapsed);
+        }
     }
     
     void deactivateElectromagnetWithDelay() {
@@ -425,6 +612,93 @@ public:
         return isElectromagnetCurrentlyActivated;
     }
     
+    /**
+     * Suppress stepper, servo and electromagnet outputs while keeping all timing
+     * Used when replaying a sensor trace on the device with motors disabled
+     * @param suppressed true to stop driving actuators
+     */
+    void setActuatorOutputsSuppressed(bool suppressed) {
+        areActuatorOutputsSuppressed = suppressed;
+        if (suppressed) {
+            digitalWrite(PIN_FOR_STEPPER_EN, HIGH);
+            digitalWrite(PIN_FOR_ELECTROMAGNET_CONTROL, LOW);
+        }
+    }
+    
+    /**
+     * Release actuators that draw current while holding still
+     * Disables the stepper driver and detaches the servo (re-attached at the
+     * same position on the next move) and switches the electromagnet off.
+     */
+    void parkActuatorsForIdle() {
+        digitalWrite(PIN_FOR_STEPPER_EN, HIGH);
+        digitalWrite(PIN_FOR_STEPPER_STEP, LOW);
+        deactivateElectromagnetToReleasePill();
+        if (dispenserServoMotor.attached()) {
+            detachServoAtSetpoint();
+        }
+    }
+    
+    /**
+     * Detach the servo once it has been still for servoIdleDetachMilliseconds
+     * (no pulses = no hum and less current). Call every loop while nothing is
+     * moving the mechanism; the next move re-attaches at the same position.
+     * @param now millis()
+     * @return true if the servo was detached by this call
+     */
+    bool serviceServoIdleDetach(unsigned long now) {
+        if (!dispenserServoMotor.attached() || systemConfiguration->servoIdleDetachMilliseconds <= 0) {
+            return false;
+        }
+        unsigned long sinceLastCommand = now - timeOfLastServoCommandMilliseconds;
+        if (sinceLastCommand < (unsigned long)systemConfiguration->servoIdleDetachMilliseconds) {
+            return false;
+        }
+        // Never drop the horn while it is modeled to be travelling
+        long remaining = servoMotion.getRemainingSettleMilliseconds(now,
+                                                                    systemConfiguration->servoSlewMicrosecondsPerSecond,
+                                                                    systemConfiguration->servoSettleMilliseconds);
+        if (remaining > 0 ||
+            (remaining < 0 && sinceLastCommand < (unsigned long)systemConfiguration->servoMovementDelayMilliseconds)) {
+            return false;
+        }
+        detachServoAtSetpoint();
+        numberOfServoIdleDetaches++;
+        return true;
+    }
+    
+    bool isServoAttached() {
+        return dispenserServoMotor.attached();
+    }
+    
+    unsigned long getNumberOfServoIdleDetaches() {
+        return numberOfServoIdleDetaches;
+    }
+    
+    /**
+     * Attach the servo (at its parked position) ahead of a sweep so the sweep
+     * starts without the attach settling time (prepositioning, queued dispenses)
+     */
+    void prepareServoForUpcomingSweep() {
+        if (!dispenserServoMotor.attached() && !areActuatorOutputsSuppressed) {
+            attachServoAtParkedPosition();
+        }
+    }
+    
+    /**
+     * Re-attach the servo so new servoMin/MaxMicroseconds limits take effect
+     * (the library clamps every write to the range given at attach). A detached
+     * servo picks them up on its next attach anyway.
+     */
+    void reattachServoWithCurrentLimits() {
+        if (!dispenserServoMotor.attached() || areActuatorOutputsSuppressed) {
+            return;
+        }
+        detachServoAtSetpoint();
+        parkedServoMicroseconds = constrain(parkedServoMicroseconds, getServoMinSafe(), getServoMaxSafe());
+        attachServoAtParkedPosition();
+    }
+    
     void turnOnReadyStatusLED() {
         digitalWrite(PIN_FOR_GREEN_STATUS_LED, HIGH);
     }
@@ -439,7 +713,10 @@ public:
 };
 
 // Static member definition (required for C++)
-unsigned long HardwareController::stepPulseCount = 0;
+template <typename ConfigurationType>
+unsigned long BasicHardwareController<ConfigurationType>::stepPulseCount = 0;
+
+typedef BasicHardwareController<ControllerConfiguration> HardwareController;
 
 #endif // HARDWARE_CONTROLLER_H
 
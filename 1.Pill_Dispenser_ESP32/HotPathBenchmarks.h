@@ -0,0 +1,333 @@
+#ifndef HOT_PATH_BENCHMARKS_H
+#define HOT_PATH_BENCHMARKS_H
+
+#include <Arduino.h>
+#include "ConfigurationSettings.h"
+#include "BLEManager.h"
+#include "SensorManager.h"
+#include "DispenserController.h"
+#include "UIManager.h"
+#include "DispenseSimulator.h"
+
+// ============================================================================
+// Benchmark Settings
+// ============================================================================
+#define HOT_PATH_BENCHMARK_MAXIMUM_CASES        16
+#define HOT_PATH_BENCHMARK_FAST_ITERATIONS      2000    // Pure computation cases
+#define HOT_PATH_BENCHMARK_SIMULATED_ITERATIONS 50      // Full simulated dispense cycles
+
+// Identifies the firmware in the JSON; override with -DBENCHMARK_BUILD_LABEL="\"<git sha>\""
+#ifndef BENCHMARK_BUILD_LABEL
+#define BENCHMARK_BUILD_LABEL __DATE__ " " __TIME__
+#endif
+
+/**
+ * Timing of one benchmark case
+ */
+struct HotPathBenchmarkResult {
+    const char* caseName;
+    unsigned long iterations;
+    uint64_t totalCycles;
+    unsigned long totalMicroseconds;
+};
+
+/**
+ * HotPathBenchmarks Class
+ *
+ * Microbenchmarks for the firmware's hot paths, run on the ESP32 itself:
+ * - BLE command parsing and response formatting (BLEManager)
+ * - Step-position math (DispenserController)
+ * - Quadrature decoding (SensorManager)
+ * - LCD row formatting (UIManager)
+ * - Full simulated dispense cycles (DispenseSimulator)
+ *
+ * Every case runs on private instances that are never connected to hardware,
+ * so running the suite does not move motors or touch BLE state. Results are
+ * printed as JSON so they can be captured from Serial and tracked per commit.
+ */
+class HotPathBenchmarks {
+private:
+    SystemConfiguration* systemConfiguration;
+    BLEManager benchmarkBLEManager;                 // Never started; parsed commands are consumed here
+    BasicSensorManager<SystemConfiguration> benchmarkSensorManager;
+    BasicDispenserController<SystemConfiguration> benchmarkDispenserController;
+    DispenseSimulator benchmarkSimulator;
+    
+    // Same paths specialized on the compile-time configuration, for comparison
+    FixedSystemConfiguration fixedConfiguration;
+    BasicSensorManager<FixedSystemConfiguration> fixedSensorManager;
+    BasicDispenserController<FixedSystemConfiguration> fixedDispenserController;
+
+    HotPathBenchmarkResult results[HOT_PATH_BENCHMARK_MAXIMUM_CASES];
+    int numberOfResults;
+    volatile long benchmarkSink;                    // Keeps results live so the compiler cannot drop the work
+
+    typedef void (HotPathBenchmarks::*BenchmarkBody)(unsigned long iteration);
+
+    struct BenchmarkCase {
+        const char* caseName;
+        unsigned long iterations;       // On the ESP32; the host runner picks its own count
+        BenchmarkBody body;
+    };
+
+    static const BenchmarkCase* getBenchmarkCases(int& numberOfCases) {
+        static const BenchmarkCase benchmarkCases[] = {
+            {"BLEManager/ParseDispenseCommand", HOT_PATH_BENCHMARK_FAST_ITERATIONS,
+             &HotPathBenchmarks::benchmarkParseDispenseCommand},
+            {"BLEManager/ParseStatusCommand", HOT_PATH_BENCHMARK_FAST_ITERATIONS,
+             &HotPathBenchmarks::benchmarkParseStatusCommand},
+            {"BLEManager/ParseSimulateCommand", HOT_PATH_BENCHMARK_FAST_ITERATIONS,
+             &HotPathBenchmarks::benchmarkParseSimulateCommand},
+            {"BLEManager/FormatDispenseResponse", HOT_PATH_BENCHMARK_FAST_ITERATIONS,
+             &HotPathBenchmarks::benchmarkFormatDispenseResponse},
+            {"DispenserController/CalculateCompartmentStepPositions", HOT_PATH_BENCHMARK_FAST_ITERATIONS,
+             &HotPathBenchmarks::benchmarkCalculateCompartmentStepPositions},
+            {"DispenserController/CalculateShortestSteps", HOT_PATH_BENCHMARK_FAST_ITERATIONS,
+             &HotPathBenchmarks::benchmarkCalculateShortestSteps},
+            {"DispenserController/CalculateCompartmentStepPositionsFixed", HOT_PATH_BENCHMARK_FAST_ITERATIONS,
+             &HotPathBenchmarks::benchmarkCalculateCompartmentStepPositionsFixed},
+            {"DispenserController/CalculateShortestStepsFixed", HOT_PATH_BENCHMARK_FAST_ITERATIONS,
+             &HotPathBenchmarks::benchmarkCalculateShortestStepsFixed},
+            {"SensorManager/DecodeEncoderChannels", HOT_PATH_BENCHMARK_FAST_ITERATIONS,
+             &HotPathBenchmarks::benchmarkDecodeEncoderChannels},
+            {"UIManager/FormatLCDRowPadded", HOT_PATH_BENCHMARK_FAST_ITERATIONS,
+             &HotPathBenchmarks::benchmarkFormatLCDRowPadded},
+            {"UIManager/FormatLCDRowTruncated", HOT_PATH_BENCHMARK_FAST_ITERATIONS,
+             &HotPathBenchmarks::benchmarkFormatLCDRowTruncated},
+            {"DispenseSimulator/DispenseCycle", HOT_PATH_BENCHMARK_SIMULATED_ITERATIONS,
+             &HotPathBenchmarks::benchmarkSimulatedDispenseCycle},
+        };
+        numberOfCases = sizeof(benchmarkCases) / sizeof(benchmarkCases[0]);
+        return benchmarkCases;
+    }
+
+    /**
+     * Time a case and store the result
+     * @param caseName Name reported in the JSON
+     * @param iterations Times to run the body
+     * @param body Case body
+     */
+    void measureCase(const char* caseName, unsigned long iterations, BenchmarkBody body) {
+        if (numberOfResults >= HOT_PATH_BENCHMARK_MAXIMUM_CASES) {
+            return;
+        }
+
+        // Warm-up pass fills caches and performs any first-use allocation
+        (this->*body)(0);
+
+        // Cycle counter wraps every ~18 s at 240 MHz, so accumulate per iteration
+        uint64_t totalCycles = 0;
+        unsigned long startMicroseconds = micros();
+        for (unsigned long i = 0; i < iterations; i++) {
+            uint32_t startCycles = ESP.getCycleCount();
+            (this->*body)(i);
+            totalCycles += (uint32_t)(ESP.getCycleCount() - startCycles);
+        }
+        unsigned long elapsedMicroseconds = micros() - startMicroseconds;
+
+        HotPathBenchmarkResult& result = results[numberOfResults++];
+        result.caseName = caseName;
+        result.iterations = iterations;
+        result.totalCycles = totalCycles;
+        result.totalMicroseconds = elapsedMicroseconds;
+    }
+
+    // ========================================================================
+    // Benchmark Cases
+    // ========================================================================
+
+    void benchmarkParseDispenseCommand(unsigned long iteration) {
+        BLECommand command;
+        benchmarkBLEManager.parseCommandString("DISPENSE:3:2", &command);
+        benchmarkSink += command.compartmentNumber;
+    }
+
+    void benchmarkParseStatusCommand(unsigned long iteration) {
+        BLECommand command;
+        benchmarkBLEManager.parseCommandString("STATUS", &command);
+        benchmarkSink += command.commandType;
+    }
+
+    void benchmarkParseSimulateCommand(unsigned long iteration) {
+        BLECommand command;
+        benchmarkBLEManager.parseCommandString("SIMULATE:100:1000", &command);
+        benchmarkSink += command.simulatedDoseCount;
+    }
+
+    void benchmarkFormatDispenseResponse(unsigned long iteration) {
+        benchmarkSink += BLEManager::formatDispenseResultResponse(iteration & 7, 8).length();
+    }
+
+    void benchmarkCalculateCompartmentStepPositions(unsigned long iteration) {
+        benchmarkDispenserController.calculateCompartmentStepPositions();
+        benchmarkSink += benchmarkDispenserController.calculateShortestStepsToCompartment(1);
+    }
+
+    void benchmarkCalculateShortestSteps(unsigned long iteration) {
+        benchmarkDispenserController.resetPositionToHome();
+        long stepsPerRevolution = (long)(systemConfiguration->stepperStepsPerRevolution *
+                                         systemConfiguration->stepperMicrostepping *
+                                         systemConfiguration->stepperGearRatio);
+        // Start from positions spread around the revolution so both wrap directions are hit
+        benchmarkDispenserController.updatePositionAfterMovement((long)((iteration * 37) % stepsPerRevolution));
+        int compartment = (int)(iteration % systemConfiguration->numberOfCompartmentsInDispenser) + 1;
+        benchmarkSink += benchmarkDispenserController.calculateShortestStepsToCompartment(compartment);
+    }
+
+    void benchmarkCalculateCompartmentStepPositionsFixed(unsigned long iteration) {
+        fixedDispenserController.calculateCompartmentStepPositions();
+        benchmarkSink += fixedDispenserController.calculateShortestStepsToCompartment(1);
+    }
+
+    void benchmarkCalculateShortestStepsFixed(unsigned long iteration) {
+        long stepsPerRevolution = (long)(FixedSystemConfiguration::stepperStepsPerRevolution *
+                                         FixedSystemConfiguration::stepperMicrostepping *
+                                         FixedSystemConfiguration::stepperGearRatio);
+        fixedDispenserController.resetPositionToHome();
+        fixedDispenserController.updatePositionAfterMovement((long)((iteration * 37) % stepsPerRevolution));
+        int compartment = (int)(iteration % FixedSystemConfiguration::numberOfCompartmentsInDispenser) + 1;
+        benchmarkSink += fixedDispenserController.calculateShortestStepsToCompartment(compartment);
+    }
+
+    void benchmarkDecodeEncoderChannels(unsigned long iteration) {
+        // One full forward quadrature cycle every four iterations
+        static const uint8_t quadratureSequence[4][2] = {{HIGH, LOW}, {HIGH, HIGH}, {LOW, HIGH}, {LOW, LOW}};
+        const uint8_t* levels = quadratureSequence[iteration & 3];
+        benchmarkSensorManager.decodeEncoderChannels(levels[0], levels[1]);
+        benchmarkSink += benchmarkSensorManager.getCurrentEncoderPosition();
+    }
+
+    void benchmarkFormatLCDRowPadded(unsigned long iteration) {
+        LCDRowText rowText;
+        rowText.appendMessage(MSG_READY);
+        benchmarkSink += rowText.getPaddedText()[0];
+    }
+
+    void benchmarkFormatLCDRowTruncated(unsigned long iteration) {
+        LCDRowText rowText;
+        rowText.appendMessage(MSG_PREPOSITIONING).appendNumber(3);
+        benchmarkSink += rowText.getPaddedText()[0];
+    }
+
+    void benchmarkSimulatedDispenseCycle(unsigned long iteration) {
+        benchmarkSimulator.setRandomSeed(iteration + 1);
+        benchmarkSimulator.configureSyntheticDoseSchedule(1, 1, 1);
+        benchmarkSink += benchmarkSimulator.runSimulation();
+    }
+
+public:
+    /**
+     * Constructor
+     * @param config Pointer to system configuration (read only)
+     */
+    HotPathBenchmarks(SystemConfiguration* config)
+        : systemConfiguration(config),
+          benchmarkBLEManager(config),
+          benchmarkSensorManager(config),
+          benchmarkDispenserController(config, nullptr, &benchmarkSensorManager),
+          benchmarkSimulator(config),
+          fixedSensorManager(&fixedConfiguration),
+          fixedDispenserController(&fixedConfiguration, nullptr, &fixedSensorManager) {
+        numberOfResults = 0;
+        benchmarkSink = 0;
+    }
+
+    /**
+     * Run every case (blocks for a few seconds)
+     * @return Number of cases measured
+     */
+    int runAllBenchmarks() {
+        numberOfResults = 0;
+
+        int numberOfCases;
+        const BenchmarkCase* benchmarkCases = getBenchmarkCases(numberOfCases);
+        for (int i = 0; i < numberOfCases; i++) {
+            measureCase(benchmarkCases[i].caseName, benchmarkCases[i].iterations, benchmarkCases[i].body);
+        }
+
+        return numberOfResults;
+    }
+
+    /**
+     * Case list for an external runner (the host Google Benchmark build)
+     */
+    static int getNumberOfCases() {
+        int numberOfCases;
+        getBenchmarkCases(numberOfCases);
+        return numberOfCases;
+    }
+
+    static const char* getCaseName(int caseIndex) {
+        int numberOfCases;
+        return getBenchmarkCases(numberOfCases)[caseIndex].caseName;
+    }
+
+    /**
+     * Run one iteration of a case without timing it
+     * @param caseIndex Index into the case list
+     * @param iteration Iteration number passed to the body
+     */
+    void runCaseIteration(int caseIndex, unsigned long iteration) {
+        int numberOfCases;
+        BenchmarkBody body = getBenchmarkCases(numberOfCases)[caseIndex].body;
+        (this->*body)(iteration);
+    }
+
+    long getBenchmarkSink() {
+        return benchmarkSink;
+    }
+
+    int getNumberOfResults() {
+        return numberOfResults;
+    }
+
+    const HotPathBenchmarkResult& getResult(int index) {
+        return results[index];
+    }
+
+    /**
+     * Print results as JSON between BENCH BEGIN / BENCH END lines
+     * Layout follows Google Benchmark's JSON (context + benchmarks array)
+     */
+    template <typename Output>
+    void printResultsAsJson(Output& out) {
+        out.println("BENCH BEGIN");
+        out.println("{");
+        out.println("  \"context\": {");
+        out.print("    \"build\": \"");
+        out.print(BENCHMARK_BUILD_LABEL);
+        out.println("\",");
+        out.print("    \"cpu_mhz\": ");
+        out.print(ESP.getCpuFreqMHz());
+        out.println(",");
+        out.print("    \"sketch_bytes\": ");
+        out.print(ESP.getSketchSize());
+        out.println(",");
+        out.print("    \"controller_configuration\": \"");
+        out.print(USE_COMPILE_TIME_CONFIGURATION ? "fixed" : "runtime");
+        out.println("\"");
+        out.println("  },");
+        out.println("  \"benchmarks\": [");
+        for (int i = 0; i < numberOfResults; i++) {
+            const HotPathBenchmarkResult& result = results[i];
+            double cyclesPerIteration = (double)result.totalCycles / result.iterations;
+            double nanosecondsPerIteration = (result.totalMicroseconds * 1000.0) / result.iterations;
+
+            out.print("    {\"name\": \"");
+            out.print(result.caseName);
+            out.print("\", \"iterations\": ");
+            out.print(result.iterations);
+            out.print(", \"cycles_per_iteration\": ");
+            out.print(cyclesPerIteration, 1);
+            out.print(", \"real_time\": ");
+            out.print(nanosecondsPerIteration, 1);
+            out.print(", \"time_unit\": \"ns\"}");
+            out.println((i + 1 < numberOfResults) ? "," : "");
+        }
+        out.println("  ]");
+        out.println("}");
+        out.println("BENCH END");
+    }
+};
+
+#endif // HOT_PATH_BENCHMARKS_H
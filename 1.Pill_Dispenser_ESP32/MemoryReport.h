@@ -0,0 +1,109 @@
+#ifndef MEMORY_REPORT_H
+#define MEMORY_REPORT_H
+
+#include <Arduino.h>
+
+/**
+ * Size of one statically allocated object, listed in the memory report
+ * Build the table with STATIC_OBJECT_SIZE(object) so names stay in sync
+ */
+struct StaticObjectSize {
+    const char* name;
+    size_t bytes;
+};
+
+#define STATIC_OBJECT_SIZE(object) { #object, sizeof(object) }
+
+/**
+ * MemoryReport Class
+ *
+ * Heap figures for checking that the firmware's footprint is fixed after boot:
+ * - Free heap right after setup() (everything the sketch allocates is static,
+ *   so later drops come from the BLE stack or String temporaries)
+ * - Current and lowest-ever free heap
+ * - Largest allocatable block, and fragmentation derived from it
+ */
+class MemoryReport {
+private:
+    uint32_t freeHeapAfterBoot;
+    uint32_t largestFreeBlockAfterBoot;
+
+public:
+    MemoryReport() {
+        freeHeapAfterBoot = 0;
+        largestFreeBlockAfterBoot = 0;
+    }
+
+    /**
+     * Take the baseline; call once at the end of setup()
+     */
+    void recordHeapAfterBoot() {
+        freeHeapAfterBoot = ESP.getFreeHeap();
+        largestFreeBlockAfterBoot = ESP.getMaxAllocHeap();
+    }
+
+    uint32_t getFreeHeapAfterBoot() {
+        return freeHeapAfterBoot;
+    }
+
+    uint32_t getFreeHeap() {
+        return ESP.getFreeHeap();
+    }
+
+    uint32_t getMinimumFreeHeap() {
+        return ESP.getMinFreeHeap();
+    }
+
+    uint32_t getLargestFreeBlock() {
+        return ESP.getMaxAllocHeap();
+    }
+
+    /**
+     * Share of free heap that cannot be handed out as one block
+     * @return 0 (one contiguous region) to 100
+     */
+    float getFragmentationPercent() {
+        uint32_t freeHeap = ESP.getFreeHeap();
+        if (freeHeap == 0) {
+            return 0.0;
+        }
+        return 100.0 * (1.0 - (float)ESP.getMaxAllocHeap() / freeHeap);
+    }
+
+    /**
+     * Bytes of free heap lost since boot (negative if more is free now)
+     */
+    long getFreeHeapDropSinceBoot() {
+        return (long)freeHeapAfterBoot - (long)ESP.getFreeHeap();
+    }
+
+    /**
+     * Print heap figures and the static object table
+     * @param out Serial or any Print-like output
+     * @param objects Table built with STATIC_OBJECT_SIZE()
+     * @param numberOfObjects Entries in the table
+     */
+    template <typename Output>
+    void printMemoryReport(Output& out, const StaticObjectSize* objects, int numberOfObjects) {
+        out.println("=== Memory ===");
+        out.println("Heap size: " + String(ESP.getHeapSize()) + " bytes");
+        out.println("Free heap after boot: " + String(freeHeapAfterBoot) + " bytes");
+        out.println("Free heap now: " + String(getFreeHeap()) +
+                    " bytes (drop since boot " + String(getFreeHeapDropSinceBoot()) + ")");
+        out.println("Minimum free heap: " + String(getMinimumFreeHeap()) + " bytes");
+        out.println("Largest free block: " + String(getLargestFreeBlock()) +
+                    " bytes (boot " + String(largestFreeBlockAfterBoot) + ")");
+        out.println("Fragmentation: " + String(getFragmentationPercent(), 1) + "%");
+
+        size_t totalStaticBytes = 0;
+        out.println("Static objects:");
+        for (int i = 0; i < numberOfObjects; i++) {
+            out.println("  " + String(objects[i].name) + ": " + String((unsigned long)objects[i].bytes) + " bytes");
+            totalStaticBytes += objects[i].bytes;
+        }
+        out.println("  total: " + String((unsigned long)totalStaticBytes) + " bytes");
+        out.println("==============");
+    }
+};
+
+#endif // MEMORY_REPORT_H
@@ -0,0 +1,283 @@
+#ifndef MEMORY_TELEMETRY_H
+#define MEMORY_TELEMETRY_H
+
+#include <Arduino.h>
+#include "ConfigurationSettings.h"
+
+#define MEMORY_TELEMETRY_SNAPSHOT_CAPACITY   48      // 4 hours at the default 5 minute interval
+#define MEMORY_TELEMETRY_STACK_UNKNOWN       0xFFFF  // Task not running (yet)
+
+// Debug builds: count allocations by wrapping malloc (needs -Wl,--wrap=... at link time, see README)
+#ifndef MEMORY_TELEMETRY_COUNT_ALLOCATIONS
+#define MEMORY_TELEMETRY_COUNT_ALLOCATIONS   0
+#endif
+
+/**
+ * Tasks whose stack headroom is sampled: the Arduino loop and the Bluedroid
+ * BLE tasks. Names are looked up at each snapshot, so tasks started later
+ * are picked up once they exist.
+ */
+static const char* const MEMORY_TELEMETRY_WATCHED_TASKS[] = {
+    "loopTask",
+    "btController",
+    "BTC_TASK",
+    "BTU_TASK"
+};
+
+#define NUMBER_OF_WATCHED_TASKS \
+    (int)(sizeof(MEMORY_TELEMETRY_WATCHED_TASKS) / sizeof(MEMORY_TELEMETRY_WATCHED_TASKS[0]))
+
+/**
+ * Alert bits (several can be set at once)
+ */
+enum MemoryAlertFlag {
+    MEMORY_ALERT_LOW_FREE_HEAP = 0x01,
+    MEMORY_ALERT_LOW_LARGEST_BLOCK = 0x02,
+    MEMORY_ALERT_LOW_STACK = 0x04
+};
+
+/**
+ * One periodic sample, sizes in bytes
+ */
+struct MemorySnapshot {
+    uint32_t uptimeSeconds;
+    uint32_t freeHeap;
+    uint32_t minimumFreeHeap;
+    uint32_t largestFreeBlock;
+    uint32_t allocationCount;                           // Since boot, 0 unless counting is built in
+    uint32_t failedAllocationCount;
+    uint16_t stackHighWaterBytes[NUMBER_OF_WATCHED_TASKS];
+};
+
+#if MEMORY_TELEMETRY_COUNT_ALLOCATIONS
+volatile uint32_t memoryTelemetryAllocationCount = 0;
+volatile uint32_t memoryTelemetryFailedAllocationCount = 0;
+
+extern "C" {
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* pointer, size_t size);
+
+static inline void* countAllocation(void* pointer) {
+    __atomic_add_fetch(&memoryTelemetryAllocationCount, 1, __ATOMIC_RELAXED);
+    if (pointer == NULL) {
+        __atomic_add_fetch(&memoryTelemetryFailedAllocationCount, 1, __ATOMIC_RELAXED);
+    }
+    return pointer;
+}
+
+void* __wrap_malloc(size_t size) {
+    return countAllocation(__real_malloc(size));
+}
+
+void* __wrap_calloc(size_t count, size_t size) {
+    return countAllocation(__real_calloc(count, size));
+}
+
+void* __wrap_realloc(void* pointer, size_t size) {
+    return countAllocation(__real_realloc(pointer, size));
+}
+}
+#endif
+
+/**
+ * MemoryTelemetry Class
+ *
+ * Periodic heap and stack sampling for chasing field resets:
+ * - Free and lowest-ever free heap, largest free block (fragmentation)
+ * - Stack high-water mark of each watched task
+ * - Allocation counts when built with MEMORY_TELEMETRY_COUNT_ALLOCATIONS
+ *
+ * Snapshots go into a ring buffer (oldest overwritten). A sample below one
+ * of the configured thresholds raises an alert once; it is raised again only
+ * after the value has recovered.
+ */
+class MemoryTelemetry {
+private:
+    SystemConfiguration* systemConfiguration;
+
+    MemorySnapshot snapshots[MEMORY_TELEMETRY_SNAPSHOT_CAPACITY];
+    int nextSnapshotIndex;
+    int numberOfSnapshots;
+    unsigned long timeOfLastSnapshotMilliseconds;
+    bool hasTakenSnapshot;
+
+    uint8_t activeAlertFlags;           // Conditions currently below threshold
+    uint8_t pendingAlertFlags;          // Raised but not yet reported over BLE
+
+    static bool isBelowThreshold(uint32_t value, int threshold) {
+        return threshold > 0 && value < (uint32_t)threshold;
+    }
+
+    uint8_t evaluateAlertConditions(const MemorySnapshot& snapshot) {
+        uint8_t flags = 0;
+        if (isBelowThreshold(snapshot.freeHeap, systemConfiguration->lowFreeHeapAlertBytes)) {
+            flags |= MEMORY_ALERT_LOW_FREE_HEAP;
+        }
+        if (isBelowThreshold(snapshot.largestFreeBlock, systemConfiguration->lowLargestFreeBlockAlertBytes)) {
+            flags |= MEMORY_ALERT_LOW_LARGEST_BLOCK;
+        }
+        if (isBelowThreshold(getLowestStackHighWaterBytes(snapshot, nullptr), systemConfiguration->lowStackAlertBytes)) {
+            flags |= MEMORY_ALERT_LOW_STACK;
+        }
+        return flags;
+    }
+
+public:
+    /**
+     * Constructor
+     * @param config Pointer to system configuration (interval and thresholds)
+     */
+    MemoryTelemetry(SystemConfiguration* config) {
+        systemConfiguration = config;
+        nextSnapshotIndex = 0;
+        numberOfSnapshots = 0;
+        timeOfLastSnapshotMilliseconds = 0;
+        hasTakenSnapshot = false;
+        activeAlertFlags = 0;
+        pendingAlertFlags = 0;
+    }
+
+    /**
+     * Call every loop; samples once per memoryTelemetryIntervalSeconds
+     * @return true if a snapshot was taken
+     */
+    bool serviceTelemetry(unsigned long nowMilliseconds) {
+        if (hasTakenSnapshot &&
+            nowMilliseconds - timeOfLastSnapshotMilliseconds <
+                (unsigned long)systemConfiguration->memoryTelemetryIntervalSeconds * 1000UL) {
+            return false;
+        }
+        takeSnapshot(nowMilliseconds);
+        return true;
+    }
+
+    /**
+     * Sample now, store the result and update alerts
+     * @return The stored snapshot
+     */
+    const MemorySnapshot& takeSnapshot(unsigned long nowMilliseconds) {
+        MemorySnapshot& snapshot = snapshots[nextSnapshotIndex];
+        snapshot.uptimeSeconds = nowMilliseconds / 1000;
+        snapshot.freeHeap = ESP.getFreeHeap();
+        snapshot.minimumFreeHeap = ESP.getMinFreeHeap();
+        snapshot.largestFreeBlock = ESP.getMaxAllocHeap();
+#if MEMORY_TELEMETRY_COUNT_ALLOCATIONS
+        snapshot.allocationCount = memoryTelemetryAllocationCount;
+        snapshot.failedAllocationCount = memoryTelemetryFailedAllocationCount;
+#else
+        snapshot.allocationCount = 0;
+        snapshot.failedAllocationCount = 0;
+#endif
+        for (int i = 0; i < NUMBER_OF_WATCHED_TASKS; i++) {
+            TaskHandle_t task = xTaskGetHandle(MEMORY_TELEMETRY_WATCHED_TASKS[i]);
+            // ESP-IDF reports the high-water mark in bytes
+            snapshot.stackHighWaterBytes[i] = (task != NULL)
+                ? (uint16_t)min((UBaseType_t)(MEMORY_TELEMETRY_STACK_UNKNOWN - 1), uxTaskGetStackHighWaterMark(task))
+                : MEMORY_TELEMETRY_STACK_UNKNOWN;
+        }
+
+        nextSnapshotIndex = (nextSnapshotIndex + 1) % MEMORY_TELEMETRY_SNAPSHOT_CAPACITY;
+        if (numberOfSnapshots < MEMORY_TELEMETRY_SNAPSHOT_CAPACITY) {
+            numberOfSnapshots++;
+        }
+        timeOfLastSnapshotMilliseconds = nowMilliseconds;
+        hasTakenSnapshot = true;
+
+        uint8_t flags = evaluateAlertConditions(snapshot);
+        uint8_t newlyRaisedFlags = flags & ~activeAlertFlags;
+        activeAlertFlags = flags;
+        if (newlyRaisedFlags != 0) {
+            pendingAlertFlags |= newlyRaisedFlags;
+            Serial.println("Memory alert: free " + String(snapshot.freeHeap) +
+                           ", largest " + String(snapshot.largestFreeBlock) +
+                           ", stack min " + String(getLowestStackHighWaterBytes(snapshot, nullptr)));
+        }
+        return snapshot;
+    }
+
+    /**
+     * Lowest stack headroom among the watched tasks that are running
+     * @param taskIndex Receives the task's index in MEMORY_TELEMETRY_WATCHED_TASKS (may be NULL)
+     * @return Bytes, or MEMORY_TELEMETRY_STACK_UNKNOWN if none was found
+     */
+    static uint16_t getLowestStackHighWaterBytes(const MemorySnapshot& snapshot, int* taskIndex) {
+        uint16_t lowest = MEMORY_TELEMETRY_STACK_UNKNOWN;
+        for (int i = 0; i < NUMBER_OF_WATCHED_TASKS; i++) {
+            if (snapshot.stackHighWaterBytes[i] < lowest) {
+                lowest = snapshot.stackHighWaterBytes[i];
+                if (taskIndex != nullptr) {
+                    *taskIndex = i;
+                }
+            }
+        }
+        return lowest;
+    }
+
+    int getNumberOfSnapshots() {
+        return numberOfSnapshots;
+    }
+
+    /**
+     * @param age 0 = latest, 1 = the one before, ...
+     */
+    const MemorySnapshot& getSnapshot(int age) {
+        int index = (nextSnapshotIndex - 1 - age + 2 * MEMORY_TELEMETRY_SNAPSHOT_CAPACITY) %
+                    MEMORY_TELEMETRY_SNAPSHOT_CAPACITY;
+        return snapshots[index];
+    }
+
+    uint8_t getActiveAlertFlags() {
+        return activeAlertFlags;
+    }
+
+    /**
+     * Take the alerts raised since the last call (for the BLE notification)
+     * @return MemoryAlertFlag bits, 0 if none
+     */
+    uint8_t takeMemoryAlert() {
+        uint8_t flags = pendingAlertFlags;
+        pendingAlertFlags = 0;
+        return flags;
+    }
+
+    /**
+     * Print every stored snapshot, oldest first, as CSV between MEMORY BEGIN / MEMORY END
+     * @param out Serial or any Print-like output
+     */
+    template <typename Output>
+    void printSnapshotsAsCsv(Output& out) {
+        out.println("MEMORY BEGIN");
+        out.print("uptime_s,free,min_free,largest_block,allocations,failed_allocations");
+        for (int i = 0; i < NUMBER_OF_WATCHED_TASKS; i++) {
+            out.print(",stack_");
+            out.print(MEMORY_TELEMETRY_WATCHED_TASKS[i]);
+        }
+        out.println();
+
+        for (int age = numberOfSnapshots - 1; age >= 0; age--) {
+            const MemorySnapshot& snapshot = getSnapshot(age);
+            out.print(snapshot.uptimeSeconds);
+            out.print(',');
+            out.print(snapshot.freeHeap);
+            out.print(',');
+            out.print(snapshot.minimumFreeHeap);
+            out.print(',');
+            out.print(snapshot.largestFreeBlock);
+            out.print(',');
+            out.print(snapshot.allocationCount);
+            out.print(',');
+            out.print(snapshot.failedAllocationCount);
+            for (int i = 0; i < NUMBER_OF_WATCHED_TASKS; i++) {
+                out.print(',');
+                if (snapshot.stackHighWaterBytes[i] != MEMORY_TELEMETRY_STACK_UNKNOWN) {
+                    out.print(snapshot.stackHighWaterBytes[i]);
+                }
+            }
+            out.println();
+        }
+        out.println("MEMORY END");
+    }
+};
+
+#endif // MEMORY_TELEMETRY_H
@@ -0,0 +1,236 @@
+#ifndef MESSAGE_CATALOG_H
+#define MESSAGE_CATALOG_H
+
+#include <Arduino.h>
+#include "Config.h"
+
+/**
+ * Message identifiers for LCD and Serial text
+ * Order must match MESSAGE_CATALOG_TEXT below
+ */
+enum MessageId {
+    MSG_NONE,
+
+    // LCD
+    MSG_PILL_DISPENSER,
+    MSG_INITIALIZING,
+    MSG_HOMING,
+    MSG_HOME_OK,
+    MSG_HOMING_FAILED,
+    MSG_SLOT_LABEL,
+    MSG_SLOT,
+    MSG_READY,
+    MSG_EMPTY,
+    MSG_BLE_CONNECTED,
+    MSG_BLE_WAITING,
+    MSG_DISPENSING,
+    MSG_SUCCESS,
+    MSG_FAILED,
+    MSG_FAILED_UPPERCASE,
+    MSG_SCHEDULED_DOSE,
+    MSG_PLEASE_REFILL,
+    MSG_CHECK_PILL_LEVELS,
+    MSG_OVERRIDE_SLOT,
+    MSG_ENDURANCE_TEST,
+    MSG_RELEASE_BUTTONS,
+    MSG_BENCHMARKING,
+    MSG_OPTIMIZING,
+    MSG_CALIBRATION,
+    MSG_CALIBRATION_IN_PROGRESS,
+    MSG_MEASURING,
+    MSG_CALIBRATION_OK,
+    MSG_CHECK_SERIAL,
+    MSG_ABORTED,
+    MSG_SAFE_STATE,
+    MSG_HOME_NEEDED,
+
+    // Serial
+    MSG_ERROR_HOMING_TIMEOUT,
+    MSG_ERROR_ALL_HOMING_ATTEMPTS_FAILED,
+    MSG_ERROR_HOME_BEFORE_CALIBRATION,
+    MSG_ERROR_SWITCH_NOT_ACTIVATED,
+    MSG_ERROR_CALIBRATION_TIMEOUT,
+    MSG_ERROR_INVALID_COMPARTMENT,
+    MSG_ERROR_DISPENSE_FAILED,
+    MSG_ERROR_SCHEDULED_DOSE_FAILED,
+    MSG_COMPARTMENT,
+    MSG_IS_EMPTY_SKIPPING,
+    MSG_LOW_STOCK,
+    MSG_PREPOSITIONING,
+
+    NUMBER_OF_MESSAGE_IDS
+};
+
+/**
+ * English texts, indexed by MessageId
+ * The literals and this const table are linked into flash (.rodata), so
+ * they cost no RAM; a translated build only replaces this table.
+ * LCD texts longer than LCD_NUMBER_OF_COLUMNS are cut at the row end.
+ */
+static const char* const MESSAGE_CATALOG_TEXT[] = {
+    "",
+
+    "Pill Dispenser",
+    "Initializing...",
+    "Homing...",
+    "Home: OK",
+    "Homing FAILED!",
+    "Slot: ",
+    "Slot ",
+    " Ready",
+    " empty",
+    "BLE: Connected",
+    "BLE: Waiting...",
+    "Dispensing...",
+    "Success!",
+    "Failed!",
+    "FAILED!",
+    "Scheduled dose",
+    "Please refill",
+    "Check pill levels",
+    "Override slot ",
+    "Endurance test",
+    "Release buttons",
+    "Benchmarking...",
+    "Optimizing...",
+    "Calibration",
+    "Calibration...",
+    "Measuring...",
+    "Calibration OK",
+    "Check Serial",
+    "Aborted",
+    "Safe state",
+    "Home needed",
+
+    "ERROR: Homing timeout",
+    "ERROR: All homing attempts failed",
+    "ERROR: Failed to home before calibration",
+    "ERROR: Switch not activated after homing",
+    "ERROR: Calibration timeout",
+    "ERROR: Invalid compartment number",
+    "ERROR: Failed to dispense from compartment ",
+    "ERROR: Scheduled dose failed from compartment ",
+    "Compartment ",
+    " is empty - skipping dispense",
+    "Low stock: compartment ",
+    "Pre-positioning for scheduled dose: compartment "
+};
+
+static_assert(sizeof(MESSAGE_CATALOG_TEXT) / sizeof(MESSAGE_CATALOG_TEXT[0]) == NUMBER_OF_MESSAGE_IDS,
+              "MESSAGE_CATALOG_TEXT must have one entry per MessageId");
+
+inline const char* getMessageText(MessageId id) {
+    return (id >= 0 && id < NUMBER_OF_MESSAGE_IDS) ? MESSAGE_CATALOG_TEXT[id] : "";
+}
+
+/**
+ * FixedWidthText Class
+ *
+ * Builds one line of at most WIDTH characters in a fixed buffer (no heap).
+ * Anything past WIDTH is dropped; getPaddedText() fills the rest with
+ * spaces, which is what an LCD row needs to overwrite older text.
+ */
+template <int WIDTH>
+class FixedWidthText {
+private:
+    char characters[WIDTH + 1];
+    int length;
+
+public:
+    FixedWidthText() {
+        clear();
+    }
+
+    void clear() {
+        length = 0;
+        characters[0] = '\0';
+    }
+
+    FixedWidthText& appendCharacter(char character) {
+        if (length < WIDTH) {
+            characters[length++] = character;
+            characters[length] = '\0';
+        }
+        return *this;
+    }
+
+    FixedWidthText& appendText(const char* text) {
+        while (*text != '\0' && length < WIDTH) {
+            characters[length++] = *text++;
+        }
+        characters[length] = '\0';
+        return *this;
+    }
+
+    FixedWidthText& appendMessage(MessageId id) {
+        return appendText(getMessageText(id));
+    }
+
+    /**
+     * Append a decimal integer (digits that do not fit are dropped)
+     */
+    FixedWidthText& appendNumber(long number) {
+        char digits[12];
+        int numberOfDigits = 0;
+        unsigned long magnitude = (number < 0) ? 0UL - (unsigned long)number : (unsigned long)number;
+        do {
+            digits[numberOfDigits++] = '0' + (magnitude % 10);
+            magnitude /= 10;
+        } while (magnitude > 0);
+
+        if (number < 0) {
+            appendCharacter('-');
+        }
+        while (numberOfDigits > 0) {
+            appendCharacter(digits[--numberOfDigits]);
+        }
+        return *this;
+    }
+
+    int getLength() const {
+        return length;
+    }
+
+    /**
+     * @return Text as built so far (not padded)
+     */
+    const char* getText() const {
+        return characters;
+    }
+
+    /**
+     * Pad with spaces to exactly WIDTH characters
+     * @return The padded text
+     */
+    const char* getPaddedText() {
+        while (length < WIDTH) {
+            characters[length++] = ' ';
+        }
+        characters[length] = '\0';
+        return characters;
+    }
+};
+
+typedef FixedWidthText<LCD_NUMBER_OF_COLUMNS> LCDRowText;
+
+/**
+ * Print a catalog message and end the line
+ * @param out Serial or any Print-like output
+ */
+template <typename Output>
+void printMessageLine(Output& out, MessageId id) {
+    out.println(getMessageText(id));
+}
+
+/**
+ * Print "<message><number><suffix>" and end the line, without building a String
+ * @param out Serial or any Print-like output
+ */
+template <typename Output>
+void printMessageLineWithNumber(Output& out, MessageId id, long number, MessageId suffix = MSG_NONE) {
+    out.print(getMessageText(id));
+    out.print(number);
+    out.println(getMessageText(suffix));
+}
+
+#endif // MESSAGE_CATALOG_H
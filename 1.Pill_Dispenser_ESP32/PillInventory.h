@@ -0,0 +1,336 @@
+#ifndef PILL_INVENTORY_H
+#define PILL_INVENTORY_H
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include <time.h>
+#include "Config.h"
+#include "ConfigurationSettings.h"
+#include "DoseScheduler.h"
+#include "StoredRecordChecksum.h"
+
+// ============================================================================
+// Inventory Storage
+// ============================================================================
+// One NVS key per compartment ("c<n>"). A refill stores the pill count and the
+// dispense counter at that moment; the stock left is derived from the counter,
+// which the dispense journal already persists, so dispensing never writes NVS.
+#define PILL_INVENTORY_NAMESPACE                "inventory"
+#define PILL_INVENTORY_FORMAT_VERSION           1
+#define PILL_INVENTORY_UNTRACKED                -1
+#define PILL_INVENTORY_MINIMUM_OBSERVATION_SECONDS  21600UL    // Observed rate needs 6 h of history
+
+// reportedLowStockMask keeps one bit per compartment
+static_assert(NUMBER_OF_COMPARTMENTS_IN_DISPENSER <= 32, "Low-stock alert mask holds at most 32 compartments");
+
+struct CompartmentStock {
+    int16_t pillsAtRefill;              // PILL_INVENTORY_UNTRACKED = fill level unknown
+    uint16_t reserved;
+    uint32_t dispenseCountAtRefill;     // Dispense counter when the fill level was set
+    uint32_t refillTime;                // UTC seconds (0 = clock was not set)
+};
+
+struct StoredCompartmentStockRecord {
+    uint8_t formatVersion;
+    uint8_t reserved;
+    uint16_t checksum;                  // Low 16 bits of CRC-32 of the record with checksum = 0
+    CompartmentStock stock;
+};
+
+/**
+ * PillInventory Class
+ *
+ * Tracks how many pills are left in each compartment:
+ * - Fill levels are set over BLE when a compartment is refilled
+ * - Every detected pill lowers the stock; a compartment at zero is known
+ *   empty and DispenserController fails it without trying
+ * - Depletion is predicted from the schedule (pills per day), or from the
+ *   observed consumption since the refill for unscheduled compartments
+ * - A compartment turning low is reported once per refill over BLE
+ */
+class PillInventory {
+private:
+    SystemConfiguration* systemConfiguration;
+    DoseScheduler* doseScheduler;
+    Preferences preferences;
+    bool isStorageOpen;
+
+    CompartmentStock compartmentStocks[NUMBER_OF_COMPARTMENTS_IN_DISPENSER];
+    uint32_t dispenseCounts[NUMBER_OF_COMPARTMENTS_IN_DISPENSER];   // Same counter as the journal
+    uint32_t reportedLowStockMask;      // Bit i = compartment i + 1 already reported
+
+    static uint16_t calculateRecordChecksum(StoredCompartmentStockRecord record) {
+        record.checksum = 0;
+        return calculateStoredRecordChecksum(&record, sizeof(record));
+    }
+
+    static void makeStorageKey(int compartmentNumber, char* key) {
+        snprintf(key, 8, "c%d", compartmentNumber);
+    }
+
+    bool isValidCompartment(int compartmentNumber) {
+        return compartmentNumber >= 1 && compartmentNumber <= systemConfiguration->numberOfCompartmentsInDispenser;
+    }
+
+    bool writeStoredStock(int compartmentNumber) {
+        if (!isStorageOpen) {
+            return false;
+        }
+        char key[8];
+        makeStorageKey(compartmentNumber, key);
+        const CompartmentStock& stock = compartmentStocks[compartmentNumber - 1];
+        if (stock.pillsAtRefill == PILL_INVENTORY_UNTRACKED) {
+            preferences.remove(key);
+            return true;
+        }
+
+        StoredCompartmentStockRecord record;
+        memset(&record, 0, sizeof(record));
+        record.formatVersion = PILL_INVENTORY_FORMAT_VERSION;
+        record.stock = stock;
+        record.checksum = calculateRecordChecksum(record);
+        return preferences.putBytes(key, &record, sizeof(record)) == sizeof(record);
+    }
+
+    void markUntracked(int index) {
+        compartmentStocks[index].pillsAtRefill = PILL_INVENTORY_UNTRACKED;
+        compartmentStocks[index].reserved = 0;
+        compartmentStocks[index].dispenseCountAtRefill = 0;
+        compartmentStocks[index].refillTime = 0;
+    }
+
+public:
+    /**
+     * Constructor
+     * @param config Pointer to system configuration (low-stock thresholds)
+     * @param scheduler Schedule used to predict consumption
+     */
+    PillInventory(SystemConfiguration* config, DoseScheduler* scheduler) {
+        systemConfiguration = config;
+        doseScheduler = scheduler;
+        isStorageOpen = false;
+        reportedLowStockMask = 0;
+        for (int i = 0; i < NUMBER_OF_COMPARTMENTS_IN_DISPENSER; i++) {
+            markUntracked(i);
+            dispenseCounts[i] = 0;
+        }
+    }
+
+    /**
+     * Load stored fill levels
+     * @return Number of tracked compartments
+     */
+    int beginAndLoadInventory() {
+        isStorageOpen = preferences.begin(PILL_INVENTORY_NAMESPACE, false);
+        if (!isStorageOpen) {
+            Serial.println("WARNING: Inventory storage unavailable");
+            return 0;
+        }
+
+        int numberOfTrackedCompartments = 0;
+        for (int compartmentNumber = 1; compartmentNumber <= systemConfiguration->numberOfCompartmentsInDispenser;
+             compartmentNumber++) {
+            char key[8];
+            makeStorageKey(compartmentNumber, key);
+            if (preferences.getBytesLength(key) != sizeof(StoredCompartmentStockRecord)) {
+                continue;
+            }
+            StoredCompartmentStockRecord record;
+            preferences.getBytes(key, &record, sizeof(record));
+            if (record.formatVersion != PILL_INVENTORY_FORMAT_VERSION ||
+                record.checksum != calculateRecordChecksum(record) ||
+                record.stock.pillsAtRefill < 0) {
+                continue;
+            }
+            compartmentStocks[compartmentNumber - 1] = record.stock;
+            numberOfTrackedCompartments++;
+        }
+        return numberOfTrackedCompartments;
+    }
+
+    // ========================================================================
+    // Stock updates (called by DispenserController)
+    // ========================================================================
+
+    /**
+     * Set the dispense counter recovered at boot (journal counts)
+     * Without a journal the counter restarts at 0 and the stock shows the
+     * last refill level again.
+     */
+    void synchronizeDispenseCount(int compartmentNumber, uint32_t dispenseCount) {
+        if (isValidCompartment(compartmentNumber)) {
+            dispenseCounts[compartmentNumber - 1] = dispenseCount;
+        }
+    }
+
+    void recordPillsRemoved(int compartmentNumber, int pillsRemoved) {
+        if (isValidCompartment(compartmentNumber) && pillsRemoved > 0) {
+            dispenseCounts[compartmentNumber - 1] += pillsRemoved;
+        }
+    }
+
+    /**
+     * The dispense counters were reset: keep each stock level by making it the
+     * new refill baseline
+     */
+    void rebaseAfterDispenseCountReset() {
+        for (int compartmentNumber = 1; compartmentNumber <= systemConfiguration->numberOfCompartmentsInDispenser;
+             compartmentNumber++) {
+            CompartmentStock& stock = compartmentStocks[compartmentNumber - 1];
+            if (stock.pillsAtRefill != PILL_INVENTORY_UNTRACKED) {
+                stock.pillsAtRefill = (int16_t)getRemainingPills(compartmentNumber);
+                stock.dispenseCountAtRefill = 0;
+                writeStoredStock(compartmentNumber);
+            }
+            dispenseCounts[compartmentNumber - 1] = 0;
+        }
+    }
+
+    // ========================================================================
+    // Fill levels
+    // ========================================================================
+
+    /**
+     * Record a refill (or a correction)
+     * @param pills Pills now in the compartment, or PILL_INVENTORY_UNTRACKED
+     * @param now Current UTC seconds (may be unset; only the observed rate needs it)
+     * @return false if a parameter is out of range or it could not be stored
+     */
+    bool setFillLevel(int compartmentNumber, int pills, uint32_t now) {
+        if (!isValidCompartment(compartmentNumber) || pills < PILL_INVENTORY_UNTRACKED || pills > 32767) {
+            return false;
+        }
+        int index = compartmentNumber - 1;
+        if (pills == PILL_INVENTORY_UNTRACKED) {
+            markUntracked(index);
+        } else {
+            compartmentStocks[index].pillsAtRefill = (int16_t)pills;
+            compartmentStocks[index].reserved = 0;
+            compartmentStocks[index].dispenseCountAtRefill = dispenseCounts[index];
+            compartmentStocks[index].refillTime = DoseScheduler::isValidTime(now) ? now : 0;
+        }
+        reportedLowStockMask &= ~(1UL << index);
+        return writeStoredStock(compartmentNumber);
+    }
+
+    bool isCompartmentTracked(int compartmentNumber) {
+        return isValidCompartment(compartmentNumber) &&
+               compartmentStocks[compartmentNumber - 1].pillsAtRefill != PILL_INVENTORY_UNTRACKED;
+    }
+
+    /**
+     * @return Pills left, or PILL_INVENTORY_UNTRACKED
+     */
+    int getRemainingPills(int compartmentNumber) {
+        if (!isCompartmentTracked(compartmentNumber)) {
+            return PILL_INVENTORY_UNTRACKED;
+        }
+        const CompartmentStock& stock = compartmentStocks[compartmentNumber - 1];
+        uint32_t dispenseCount = dispenseCounts[compartmentNumber - 1];
+        long pillsRemoved = dispenseCount > stock.dispenseCountAtRefill
+                          ? (long)(dispenseCount - stock.dispenseCountAtRefill) : 0;
+        return pillsRemoved >= stock.pillsAtRefill ? 0 : (int)(stock.pillsAtRefill - pillsRemoved);
+    }
+
+    /**
+     * @return true if the compartment is tracked and has no pills left
+     */
+    bool isCompartmentKnownEmpty(int compartmentNumber) {
+        return getRemainingPills(compartmentNumber) == 0;
+    }
+
+    // ========================================================================
+    // Prediction
+    // ========================================================================
+
+    /**
+     * Expected consumption: the schedule when the compartment has entries,
+     * otherwise the rate observed since the refill
+     * @return Pills per day, or 0 if unknown
+     */
+    float getPillsPerDay(int compartmentNumber, uint32_t now) {
+        int scheduledPillsPerDay = doseScheduler->getScheduledPillsPerDayForCompartment(compartmentNumber);
+        if (scheduledPillsPerDay > 0) {
+            return scheduledPillsPerDay;
+        }
+        if (!isCompartmentTracked(compartmentNumber)) {
+            return 0;
+        }
+        const CompartmentStock& stock = compartmentStocks[compartmentNumber - 1];
+        if (stock.refillTime == 0 || !DoseScheduler::isValidTime(now) ||
+            now - stock.refillTime < PILL_INVENTORY_MINIMUM_OBSERVATION_SECONDS) {
+            return 0;
+        }
+        int pillsRemoved = stock.pillsAtRefill - getRemainingPills(compartmentNumber);
+        return pillsRemoved * (float)DOSE_SCHEDULER_SECONDS_PER_DAY / (now - stock.refillTime);
+    }
+
+    /**
+     * @return Days until the compartment runs out, or -1 if unknown
+     */
+    float getPredictedDaysUntilEmpty(int compartmentNumber, uint32_t now) {
+        int remainingPills = getRemainingPills(compartmentNumber);
+        float pillsPerDay = getPillsPerDay(compartmentNumber, now);
+        if (remainingPills == PILL_INVENTORY_UNTRACKED || pillsPerDay <= 0) {
+            return -1;
+        }
+        return remainingPills / pillsPerDay;
+    }
+
+    bool isLowStock(int compartmentNumber, uint32_t now) {
+        int remainingPills = getRemainingPills(compartmentNumber);
+        if (remainingPills == PILL_INVENTORY_UNTRACKED) {
+            return false;
+        }
+        if (remainingPills <= systemConfiguration->lowStockPillThreshold) {
+            return true;
+        }
+        float daysUntilEmpty = getPredictedDaysUntilEmpty(compartmentNumber, now);
+        return daysUntilEmpty >= 0 && daysUntilEmpty <= systemConfiguration->lowStockWarningDays;
+    }
+
+    /**
+     * Take the next low-stock alert not yet reported since its refill
+     * Call while a device is connected so the alert is not lost.
+     * @return Compartment number, or 0 if none
+     */
+    int takeLowStockAlert(uint32_t now) {
+        for (int compartmentNumber = 1; compartmentNumber <= systemConfiguration->numberOfCompartmentsInDispenser;
+             compartmentNumber++) {
+            uint32_t bit = 1UL << (compartmentNumber - 1);
+            if (!(reportedLowStockMask & bit) && isLowStock(compartmentNumber, now)) {
+                reportedLowStockMask |= bit;
+                return compartmentNumber;
+            }
+        }
+        return 0;
+    }
+
+    template <typename Output>
+    void printInventory(Output& out) {
+        uint32_t now = (uint32_t)time(NULL);
+        out.println("PILL INVENTORY:");
+        for (int compartmentNumber = 1; compartmentNumber <= systemConfiguration->numberOfCompartmentsInDispenser;
+             compartmentNumber++) {
+            out.print("  Compartment ");
+            out.print(compartmentNumber);
+            out.print(": ");
+            int remainingPills = getRemainingPills(compartmentNumber);
+            if (remainingPills == PILL_INVENTORY_UNTRACKED) {
+                out.println("not tracked");
+                continue;
+            }
+            out.print(remainingPills);
+            out.print(" left");
+            float daysUntilEmpty = getPredictedDaysUntilEmpty(compartmentNumber, now);
+            if (daysUntilEmpty >= 0) {
+                out.print(", ~");
+                out.print(daysUntilEmpty, 1);
+                out.print(" days");
+            }
+            out.println(isLowStock(compartmentNumber, now) ? "  LOW" : "");
+        }
+    }
+};
+
+#endif // PILL_INVENTORY_H
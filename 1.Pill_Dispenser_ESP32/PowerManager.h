@@ -0,0 +1,303 @@
+#ifndef POWER_MANAGER_H
+#define POWER_MANAGER_H
+
+#include <Arduino.h>
+#include <esp_sleep.h>
+#include <esp_timer.h>
+#include <driver/gpio.h>
+#include <driver/uart.h>
+#include "Config.h"
+#include "ConfigurationSettings.h"
+#include "HardwareController.h"
+#include "UIManager.h"
+
+// ============================================================================
+// Current Estimates (ESP32 datasheet typicals, chip only)
+// ============================================================================
+// Replace with bench measurements of your board to get real savings figures.
+#define POWER_ESTIMATED_ACTIVE_CURRENT_MILLIAMPS        45.0    // CPU 240 MHz, radio idle between BLE events
+#define POWER_ESTIMATED_LIGHT_SLEEP_CURRENT_MILLIAMPS   0.8
+
+// Serial (UART0) RX edges that wake the chip. 3 is the hardware minimum; the
+// character that carries them is lost, the ones after it are received.
+#define POWER_UART_WAKE_THRESHOLD_EDGES                 3
+
+/**
+ * PowerManager Class
+ *
+ * Puts the ESP32 into light sleep between events:
+ * - Sleeps only when the caller reports nothing pending (no BLE central
+ *   connected, no command queued, no trace running) and no activity has been
+ *   noted for idleTimeBeforeSleepMilliseconds
+ * - Wakes when any button, the home switch or the IR sensor changes level,
+ *   when Serial input arrives, when a timed wake (scheduled dose) is due, or after
+ *   maximumLightSleepMilliseconds so BLE advertising gets an awake window
+ * - Disables the stepper driver and detaches the servo before sleeping
+ *
+ * Tracks sleep time and wake-to-action latency to report the estimated
+ * current reduction.
+ */
+class PowerManager {
+private:
+    SystemConfiguration* systemConfiguration;
+    HardwareController* hardwareController;
+
+    unsigned long timeOfLastActivityMilliseconds;
+    unsigned long timeOfLastWakeMilliseconds;
+    bool hasTimedWake;
+    unsigned long timedWakeMilliseconds;
+
+    // Wake-to-action latency
+    bool isWakeActionPending;
+    int64_t wakeTimestampMicroseconds;
+    unsigned long numberOfLatencySamples;
+    uint64_t totalWakeToActionMicroseconds;
+    unsigned long maximumWakeToActionMicroseconds;
+
+    // Sleep accounting
+    int64_t statisticsStartMicroseconds;
+    uint64_t totalSleepMicroseconds;
+    unsigned long numberOfSleeps;
+    unsigned long numberOfGpioWakes;
+    unsigned long numberOfTimerWakes;
+    unsigned long numberOfUartWakes;
+    unsigned long numberOfRejectedSleeps;   // esp_light_sleep_start() refused (e.g. wake already pending)
+
+    /**
+     * Arm a GPIO wake for the opposite of the pin's current level
+     * (level wakeup emulating an edge, so a held switch does not re-wake)
+     */
+    void enableWakeOnLevelChange(int pin) {
+        gpio_int_type_t wakeLevel = (digitalRead(pin) == HIGH) ? GPIO_INTR_LOW_LEVEL : GPIO_INTR_HIGH_LEVEL;
+        gpio_wakeup_enable((gpio_num_t)pin, wakeLevel);
+    }
+
+    void configureWakeSources(unsigned long sleepMilliseconds) {
+        for (int i = 0; i < NUMBER_OF_COMPARTMENT_BUTTONS; i++) {
+            enableWakeOnLevelChange(COMPARTMENT_BUTTON_MAPPINGS[i].pin);
+        }
+        enableWakeOnLevelChange(PIN_FOR_NAVIGATION_BACK_BUTTON);
+        enableWakeOnLevelChange(PIN_FOR_NAVIGATION_SELECT_BUTTON);
+        enableWakeOnLevelChange(PIN_FOR_HOME_POSITION_SWITCH);
+        enableWakeOnLevelChange(PIN_FOR_INFRARED_PILL_DETECTOR);
+        esp_sleep_enable_gpio_wakeup();
+        uart_set_wakeup_threshold(UART_NUM_0, POWER_UART_WAKE_THRESHOLD_EDGES);
+        esp_sleep_enable_uart_wakeup(UART_NUM_0);
+        esp_sleep_enable_timer_wakeup((uint64_t)sleepMilliseconds * 1000ULL);
+    }
+
+    void disableWakeSources() {
+        for (int i = 0; i < NUMBER_OF_COMPARTMENT_BUTTONS; i++) {
+            gpio_wakeup_disable((gpio_num_t)COMPARTMENT_BUTTON_MAPPINGS[i].pin);
+        }
+        gpio_wakeup_disable((gpio_num_t)PIN_FOR_NAVIGATION_BACK_BUTTON);
+        gpio_wakeup_disable((gpio_num_t)PIN_FOR_NAVIGATION_SELECT_BUTTON);
+        gpio_wakeup_disable((gpio_num_t)PIN_FOR_HOME_POSITION_SWITCH);
+        gpio_wakeup_disable((gpio_num_t)PIN_FOR_INFRARED_PILL_DETECTOR);
+    }
+
+public:
+    /**
+     * Constructor
+     * @param config Pointer to system configuration
+     * @param hardware Pointer to hardware controller (parked before sleeping)
+     */
+    PowerManager(SystemConfiguration* config, HardwareController* hardware) {
+        systemConfiguration = config;
+        hardwareController = hardware;
+        timeOfLastActivityMilliseconds = 0;
+        timeOfLastWakeMilliseconds = 0;
+        hasTimedWake = false;
+        timedWakeMilliseconds = 0;
+        resetPowerStatistics();
+    }
+
+    /**
+     * Record user, BLE or motion activity (postpones sleep)
+     */
+    void noteActivity() {
+        timeOfLastActivityMilliseconds = millis();
+    }
+
+    /**
+     * Wake by this time even without a GPIO event (e.g. next scheduled dose)
+     * @param wakeTimeMilliseconds Absolute millis() time
+     */
+    void setTimedWake(unsigned long wakeTimeMilliseconds) {
+        hasTimedWake = true;
+        timedWakeMilliseconds = wakeTimeMilliseconds;
+    }
+
+    void clearTimedWake() {
+        hasTimedWake = false;
+    }
+
+    /**
+     * Call when the loop starts handling an event; the first call after a GPIO
+     * wake (before the next sleep) records the wake-to-action latency
+     */
+    void recordWakeToActionLatency() {
+        if (!isWakeActionPending) {
+            return;
+        }
+        isWakeActionPending = false;
+        unsigned long latency = (unsigned long)(esp_timer_get_time() - wakeTimestampMicroseconds);
+        numberOfLatencySamples++;
+        totalWakeToActionMicroseconds += latency;
+        if (latency > maximumWakeToActionMicroseconds) {
+            maximumWakeToActionMicroseconds = latency;
+        }
+    }
+
+    /**
+     * Light-sleep until the next event if the system is idle
+     * @param isSystemIdle Caller's view: nothing pending in BLE, UI or motion
+     * @return true if the chip slept (the loop can skip its idle delay)
+     */
+    bool enterLightSleepIfIdle(bool isSystemIdle) {
+        if (!systemConfiguration->enableLightSleepWhenIdle || !isSystemIdle) {
+            return false;
+        }
+
+        unsigned long now = millis();
+        if (now - timeOfLastActivityMilliseconds < (unsigned long)systemConfiguration->idleTimeBeforeSleepMilliseconds ||
+            now - timeOfLastWakeMilliseconds < (unsigned long)systemConfiguration->awakeWindowAfterWakeMilliseconds) {
+            return false;
+        }
+
+        unsigned long sleepMilliseconds = systemConfiguration->maximumLightSleepMilliseconds;
+        if (hasTimedWake) {
+            long untilTimedWake = (long)(timedWakeMilliseconds - now);
+            if (untilTimedWake <= 0) {
+                return false;
+            }
+            if ((unsigned long)untilTimedWake < sleepMilliseconds) {
+                sleepMilliseconds = untilTimedWake;
+            }
+        }
+
+        hardwareController->parkActuatorsForIdle();
+        configureWakeSources(sleepMilliseconds);
+        Serial.flush();
+        
+        // A GPIO wake that led to no action (IR noise, a button release) must
+        // not be charged to whatever happens after a later wake
+        isWakeActionPending = false;
+
+        int64_t sleepStartMicroseconds = esp_timer_get_time();
+        esp_err_t sleepResult = esp_light_sleep_start();
+        int64_t wakeMicroseconds = esp_timer_get_time();
+
+        disableWakeSources();
+        if (sleepResult != ESP_OK) {
+            // Nothing slept; retry once the idle time has passed again
+            numberOfRejectedSleeps++;
+            noteActivity();
+            return false;
+        }
+        totalSleepMicroseconds += (uint64_t)(wakeMicroseconds - sleepStartMicroseconds);
+        numberOfSleeps++;
+        timeOfLastWakeMilliseconds = millis();
+
+        esp_sleep_wakeup_cause_t wakeCause = esp_sleep_get_wakeup_cause();
+        if (wakeCause == ESP_SLEEP_WAKEUP_GPIO) {
+            numberOfGpioWakes++;
+            isWakeActionPending = true;
+            wakeTimestampMicroseconds = wakeMicroseconds;
+        } else if (wakeCause == ESP_SLEEP_WAKEUP_UART) {
+            // Someone is typing: stay up for the rest of the line
+            numberOfUartWakes++;
+            isWakeActionPending = false;
+            noteActivity();
+        } else {
+            numberOfTimerWakes++;
+            isWakeActionPending = false;
+        }
+        return true;
+    }
+
+    // ========================================================================
+    // Statistics
+    // ========================================================================
+
+    void resetPowerStatistics() {
+        isWakeActionPending = false;
+        wakeTimestampMicroseconds = 0;
+        numberOfLatencySamples = 0;
+        totalWakeToActionMicroseconds = 0;
+        maximumWakeToActionMicroseconds = 0;
+        statisticsStartMicroseconds = esp_timer_get_time();
+        totalSleepMicroseconds = 0;
+        numberOfSleeps = 0;
+        numberOfGpioWakes = 0;
+        numberOfTimerWakes = 0;
+        numberOfUartWakes = 0;
+        numberOfRejectedSleeps = 0;
+    }
+
+    /**
+     * @return Fraction of time spent in light sleep since the last reset (0-1)
+     */
+    float getSleepFraction() {
+        int64_t elapsed = esp_timer_get_time() - statisticsStartMicroseconds;
+        return (elapsed > 0) ? (float)((double)totalSleepMicroseconds / (double)elapsed) : 0;
+    }
+
+    float getEstimatedAverageCurrentMilliamps() {
+        float sleepFraction = getSleepFraction();
+        return POWER_ESTIMATED_ACTIVE_CURRENT_MILLIAMPS * (1.0 - sleepFraction) +
+               POWER_ESTIMATED_LIGHT_SLEEP_CURRENT_MILLIAMPS * sleepFraction;
+    }
+
+    /**
+     * @return Estimated reduction versus never sleeping, in percent
+     */
+    float getEstimatedCurrentReductionPercent() {
+        return 100.0 * (1.0 - getEstimatedAverageCurrentMilliamps() / POWER_ESTIMATED_ACTIVE_CURRENT_MILLIAMPS);
+    }
+
+    unsigned long getAverageWakeToActionMicroseconds() {
+        return numberOfLatencySamples > 0 ? (unsigned long)(totalWakeToActionMicroseconds / numberOfLatencySamples) : 0;
+    }
+
+    unsigned long getMaximumWakeToActionMicroseconds() {
+        return maximumWakeToActionMicroseconds;
+    }
+
+    template <typename Output>
+    void printPowerReport(Output& out) {
+        out.println("POWER REPORT:");
+        out.print("Time asleep: ");
+        out.print(getSleepFraction() * 100.0);
+        out.println(" %");
+        out.print("Sleeps: ");
+        out.print(numberOfSleeps);
+        out.print(" (GPIO wakes ");
+        out.print(numberOfGpioWakes);
+        out.print(", Serial wakes ");
+        out.print(numberOfUartWakes);
+        out.print(", timer wakes ");
+        out.print(numberOfTimerWakes);
+        out.print(", rejected ");
+        out.print(numberOfRejectedSleeps);
+        out.println(")");
+        out.print("Wake-to-action latency: avg ");
+        out.print(getAverageWakeToActionMicroseconds());
+        out.print(" us, max ");
+        out.print(maximumWakeToActionMicroseconds);
+        out.print(" us over ");
+        out.print(numberOfLatencySamples);
+        out.println(" wakes");
+        out.print("Estimated chip current: ");
+        out.print(getEstimatedAverageCurrentMilliamps());
+        out.print(" mA (");
+        out.print(getEstimatedCurrentReductionPercent());
+        out.println(" % below always-awake)");
+        out.print("Servo: ");
+        out.print(hardwareController->isServoAttached() ? "attached" : "detached");
+        out.print(", idle detaches ");
+        out.println(hardwareController->getNumberOfServoIdleDetaches());
+    }
+};
+
+#endif // POWER_MANAGER_H
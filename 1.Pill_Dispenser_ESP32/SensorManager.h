@@ -4,6 +4,7 @@
 #include <Arduino.h>
 #include "Config.h"
 #include "ConfigurationSettings.h"
+#include "SensorTrace.h"
 
 /**
  * SensorManager Class
@@ -12,26 +13,102 @@
  * - Home position switch detection
  * - IR pill sensor reading
  * - Rotary encoder position tracking with interrupts
+ * - Recording sensor transitions to a trace and replaying them in place of live pins
  * 
  * This class has no dependencies on actuators or display systems (low coupling).
+ * 
+ * ConfigurationType is SystemConfiguration (read at run time) or
+ * FixedSystemConfiguration (constants folded at compile time).
  */
-class SensorManager {
+template <typename ConfigurationType>
+class BasicSensorManager {
 private:
-    SystemConfiguration* systemConfiguration;
+    ConfigurationType* systemConfiguration;
     
     // Encoder state variables (must be volatile for ISR access)
     volatile long currentEncoderPositionCounter;
     volatile int lastEncoderChannelAState;
     
+    // Trace record/replay state
+    SensorTrace* sensorTrace;
+    volatile bool isRecordingSensorTrace;
+    bool isReplayingSensorTrace;
+    uint8_t replayedSensorLevels;
+    unsigned long replayClockStartMicroseconds;
+    unsigned long replayClockBaseMicroseconds;
+    
+    /**
+     * Read all traced pins into a SENSOR_TRACE_*_BIT mask
+     */
+    uint8_t readLiveSensorLevels() {
+        uint8_t levels = 0;
+        if (digitalRead(PIN_FOR_HOME_POSITION_SWITCH) == HIGH)   levels |= SENSOR_TRACE_HOME_SWITCH_BIT;
+        if (digitalRead(PIN_FOR_INFRARED_PILL_DETECTOR) == HIGH) levels |= SENSOR_TRACE_INFRARED_BIT;
+        if (digitalRead(PIN_FOR_ENCODER_CHANNEL_1) == HIGH)      levels |= SENSOR_TRACE_ENCODER_1_BIT;
+        if (digitalRead(PIN_FOR_ENCODER_CHANNEL_2) == HIGH)      levels |= SENSOR_TRACE_ENCODER_2_BIT;
+        return levels;
+    }
+    
+    /**
+     * Apply one replayed level change, feeding encoder edges to the decoder
+     */
+    void applyReplayedSensorLevels(uint8_t levels) {
+        uint8_t encoderBits = SENSOR_TRACE_ENCODER_1_BIT | SENSOR_TRACE_ENCODER_2_BIT;
+        if ((levels & encoderBits) != (replayedSensorLevels & encoderBits)) {
+            decodeEncoderChannels((levels & SENSOR_TRACE_ENCODER_1_BIT) ? HIGH : LOW,
+                                  (levels & SENSOR_TRACE_ENCODER_2_BIT) ? HIGH : LOW);
+        }
+        replayedSensorLevels = levels;
+    }
+    
+    /**
+     * Bring replayed levels up to the current replay time
+     */
+    void advanceSensorTraceReplay() {
+        unsigned long traceTime = replayClockBaseMicroseconds + (micros() - replayClockStartMicroseconds);
+        uint8_t levels;
+        while (sensorTrace->applyNextLevelChangeDueBy(traceTime, &levels)) {
+            applyReplayedSensorLevels(levels);
+        }
+    }
+    
+    /**
+     * Read a sensor pin from the live hardware or from the replayed trace
+     * @param pin One of the traced sensor pins
+     * @return HIGH or LOW
+     */
+    int readSensorPinLevel(int pin) {
+        if (!isReplayingSensorTrace) {
+            return digitalRead(pin);
+        }
+        
+        advanceSensorTraceReplay();
+        uint8_t bit = 0;
+        switch (pin) {
+            case PIN_FOR_HOME_POSITION_SWITCH:   bit = SENSOR_TRACE_HOME_SWITCH_BIT; break;
+            case PIN_FOR_INFRARED_PILL_DETECTOR: bit = SENSOR_TRACE_INFRARED_BIT; break;
+            case PIN_FOR_ENCODER_CHANNEL_1:      bit = SENSOR_TRACE_ENCODER_1_BIT; break;
+            case PIN_FOR_ENCODER_CHANNEL_2:      bit = SENSOR_TRACE_ENCODER_2_BIT; break;
+            default:                             return digitalRead(pin);
+        }
+        return (replayedSensorLevels & bit) ? HIGH : LOW;
+    }
+    
 public:
     /**
      * Constructor
      * @param config Pointer to system configuration
      */
-    SensorManager(SystemConfiguration* config) {
+    BasicSensorManager(ConfigurationType* config) {
         systemConfiguration = config;
         currentEncoderPositionCounter = 0;
         lastEncoderChannelAState = 0;
+        sensorTrace = nullptr;
+        isRecordingSensorTrace = false;
+        isReplayingSensorTrace = false;
+        replayedSensorLevels = 0;
+        replayClockStartMicroseconds = 0;
+        replayClockBaseMicroseconds = 0;
     }
     
     /**
@@ -59,7 +136,7 @@ public:
      */
     bool isHomePositionSwitchActivated() {
         // LOW = pressed (standard pull-up resistor behavior)
-        return digitalRead(PIN_FOR_HOME_POSITION_SWITCH) == LOW;
+        return readSensorPinLevel(PIN_FOR_HOME_POSITION_SWITCH) == LOW;
     }
     
     /**
@@ -67,7 +144,7 @@ public:
      * @return Raw digital pin state (HIGH=1, LOW=0)
      */
     int getRawHomeSwitchPinState() {
-        return digitalRead(PIN_FOR_HOME_POSITION_SWITCH);
+        return readSensorPinLevel(PIN_FOR_HOME_POSITION_SWITCH);
     }
     
     /**
@@ -94,7 +171,7 @@ public:
      * @return true if pill is detected (LOW = detected based on typical IR sensor behavior)
      */
     bool isPillCurrentlyDetectedByInfraredSensor() {
-        return digitalRead(PIN_FOR_INFRARED_PILL_DETECTOR) == LOW;
+        return readSensorPinLevel(PIN_FOR_INFRARED_PILL_DETECTOR) == LOW;
     }
     
     /**
@@ -121,6 +198,9 @@ public:
      * @return Current encoder position
      */
     long getCurrentEncoderPosition() {
+        if (isReplayingSensorTrace) {
+            advanceSensorTraceReplay();
+        }
         return currentEncoderPositionCounter;
     }
     
@@ -136,9 +216,26 @@ public:
      * Must be called from global ISR with IRAM_ATTR
      */
     void handleEncoderInterrupt() {
+        if (isReplayingSensorTrace) {
+            return;  // Encoder edges come from the trace during replay
+        }
+        
         int channelAState = digitalRead(PIN_FOR_ENCODER_CHANNEL_1);
         int channelBState = digitalRead(PIN_FOR_ENCODER_CHANNEL_2);
         
+        if (isRecordingSensorTrace) {
+            sensorTrace->recordLevels(readLiveSensorLevels(), micros());
+        }
+        
+        decodeEncoderChannels(channelAState, channelBState);
+    }
+    
+    /**
+     * Quadrature decode of one encoder sample
+     * @param channelAState Level of encoder channel 1
+     * @param channelBState Level of encoder channel 2
+     */
+    void decodeEncoderChannels(int channelAState, int channelBState) {
         if (channelAState != lastEncoderChannelAState) {
             if (channelBState != channelAState) {
                 currentEncoderPositionCounter++;
@@ -154,9 +251,105 @@ public:
      * Must be called from global ISR with IRAM_ATTR
      */
     void handleHomeSwitchInterrupt() {
+        if (isRecordingSensorTrace) {
+            sensorTrace->recordLevels(readLiveSensorLevels(), micros());
+        }
+    }
+    
+    /**
+     * IR detector interrupt service routine (attached only while recording)
+     * Must be called from global ISR with IRAM_ATTR
+     */
+    void handleInfraredSensorInterrupt() {
+        if (isRecordingSensorTrace) {
+            sensorTrace->recordLevels(readLiveSensorLevels(), micros());
+        }
+    }
+    
+    // ========================================================================
+    // Sensor Trace Record / Replay
+    // ========================================================================
+    
+    /**
+     * Provide the trace buffer used for recording and replay
+     * @param trace Statically allocated trace buffer
+     */
+    void attachSensorTrace(SensorTrace* trace) {
+        sensorTrace = trace;
+    }
+    
+    /**
+     * Start logging sensor transitions (home switch / IR interrupts must be attached by caller)
+     * @return false if no trace buffer is attached
+     */
+    bool startSensorTraceRecording() {
+        if (sensorTrace == nullptr) {
+            return false;
+        }
+        isReplayingSensorTrace = false;
+        sensorTrace->beginRecording(readLiveSensorLevels(), micros());
+        isRecordingSensorTrace = true;
+        return true;
+    }
+    
+    /**
+     * Start feeding the recorded trace to all sensor reads instead of live pins
+     * @return false if there is no valid trace
+     */
+    bool startSensorTraceReplay() {
+        if (sensorTrace == nullptr || !sensorTrace->rewindForReplay()) {
+            return false;
+        }
+        isRecordingSensorTrace = false;
+        replayedSensorLevels = sensorTrace->getReplayLevels();
+        lastEncoderChannelAState = (replayedSensorLevels & SENSOR_TRACE_ENCODER_1_BIT) ? HIGH : LOW;
+        replayClockBaseMicroseconds = 0;
+        replayClockStartMicroseconds = micros();
+        isReplayingSensorTrace = true;
+        return true;
+    }
+    
+    /**
+     * Stop recording or replay and return to live pins
+     */
+    void stopSensorTrace() {
+        isRecordingSensorTrace = false;
+        isReplayingSensorTrace = false;
+    }
+    
+    /**
+     * Mark the start of an operation (homing, dispense)
+     * Recording writes a marker; replay re-aligns its clock to the next marker
+     * so operation timing matches the recording regardless of when it was started.
+     */
+    void markTraceSynchronizationPoint() {
+        if (isRecordingSensorTrace) {
+            sensorTrace->recordSyncMarker(micros());
+        } else if (isReplayingSensorTrace) {
+            uint8_t levels;
+            while (sensorTrace->applyNextLevelChangeDueBy(0xFFFFFFFFUL, &levels)) {
+                applyReplayedSensorLevels(levels);
+            }
+            replayClockBaseMicroseconds = sensorTrace->skipToNextSyncMarker();
+            replayClockStartMicroseconds = micros();
+        }
+    }
+    
+    bool isSensorTraceRecording() {
+        return isRecordingSensorTrace;
+    }
+    
+    bool isSensorTraceReplaying() {
+        return isReplayingSensorTrace;
+    }
+    
+    SensorTrace* getSensorTrace() {
+        return sensorTrace;
     }
 };
 
+typedef BasicSensorManager<ControllerConfiguration> SensorManager;
+
 // Global pointer for ISR access (needed because ISRs can't be class members)
 SensorManager* globalSensorManagerInstance = nullptr;
 
@@ -175,5 +368,11 @@ void IRAM_ATTR homeSwitchInterruptServiceRoutine() {
     }
 }
 
+void IRAM_ATTR infraredSensorInterruptServiceRoutine() {
+    if (globalSensorManagerInstance != nullptr) {
+        globalSensorManagerInstance->handleInfraredSensorInterrupt();
+    }
+}
+
 #endif // SENSOR_MANAGER_H
 
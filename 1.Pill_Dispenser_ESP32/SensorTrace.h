@@ -0,0 +1,301 @@
+#ifndef SENSOR_TRACE_H
+#define SENSOR_TRACE_H
+
+#include <Arduino.h>
+#include <stdint.h>
+#include <stddef.h>
+
+// ============================================================================
+// Trace Format
+// ============================================================================
+// Header:  'S' 'T' 'R' <version> <initial levels>
+// Record:  <type:4 | levels:4> <delta microseconds, LEB128 varint>
+// A level change costs 2-4 bytes; a sync marker is written wherever
+// DispenserController starts an operation so replay can re-align its clock.
+#define SENSOR_TRACE_BUFFER_SIZE_BYTES      8192
+#define SENSOR_TRACE_FORMAT_VERSION         1
+#define SENSOR_TRACE_HEADER_SIZE_BYTES      5
+#define SENSOR_TRACE_LOAD_CHUNK_BYTES       32      // TRACE:LOAD chunk, one TRACE:DUMP line
+
+#define SENSOR_TRACE_HOME_SWITCH_BIT        0x01    // Raw level of PIN_FOR_HOME_POSITION_SWITCH
+#define SENSOR_TRACE_INFRARED_BIT           0x02    // Raw level of PIN_FOR_INFRARED_PILL_DETECTOR
+#define SENSOR_TRACE_ENCODER_1_BIT          0x04    // Raw level of PIN_FOR_ENCODER_CHANNEL_1
+#define SENSOR_TRACE_ENCODER_2_BIT          0x08    // Raw level of PIN_FOR_ENCODER_CHANNEL_2
+
+#define SENSOR_TRACE_RECORD_LEVEL_CHANGE    0x0
+#define SENSOR_TRACE_RECORD_SYNC_MARKER     0x1
+
+/**
+ * SensorTrace Class
+ *
+ * Compact binary log of timestamped sensor level transitions, plus a cursor
+ * for reading it back. Writing is allocation-free and safe to call from the
+ * sensor ISRs; records are appended under traceLock so a sync marker written
+ * by the main task cannot interleave with an edge. Reading is done from the
+ * main loop during replay.
+ */
+class SensorTrace {
+private:
+    uint8_t traceBytes[SENSOR_TRACE_BUFFER_SIZE_BYTES];
+    volatile size_t traceLength;
+    volatile bool hasOverflowed;
+    unsigned long lastRecordTimeMicroseconds;
+    uint8_t lastRecordedLevels;
+    portMUX_TYPE traceLock = portMUX_INITIALIZER_UNLOCKED;
+
+    // Replay cursor
+    size_t readPosition;
+    unsigned long readTimeMicroseconds;
+    uint8_t replayLevels;
+
+    bool appendRecord(uint8_t recordType, uint8_t levels, unsigned long timeMicroseconds) {
+        unsigned long delta = timeMicroseconds - lastRecordTimeMicroseconds;
+
+        // Worst case: 1 type byte + 5 varint bytes
+        if (traceLength + 6 > SENSOR_TRACE_BUFFER_SIZE_BYTES) {
+            hasOverflowed = true;
+            return false;
+        }
+
+        size_t position = traceLength;
+        traceBytes[position++] = (uint8_t)((recordType << 4) | (levels & 0x0F));
+        do {
+            uint8_t byteValue = delta & 0x7F;
+            delta >>= 7;
+            if (delta != 0) {
+                byteValue |= 0x80;
+            }
+            traceBytes[position++] = byteValue;
+        } while (delta != 0);
+
+        lastRecordTimeMicroseconds = timeMicroseconds;
+        traceLength = position;
+        return true;
+    }
+
+    /**
+     * Decode the record at readPosition without consuming it
+     * @return Bytes the record occupies, 0 if none/corrupt
+     */
+    size_t peekRecord(uint8_t* recordType, uint8_t* levels, unsigned long* delta) {
+        if (readPosition >= traceLength) {
+            return 0;
+        }
+        size_t position = readPosition;
+        uint8_t typeAndLevels = traceBytes[position++];
+        unsigned long value = 0;
+        int shift = 0;
+        while (position < traceLength && shift < 35) {
+            uint8_t byteValue = traceBytes[position++];
+            value |= (unsigned long)(byteValue & 0x7F) << shift;
+            shift += 7;
+            if ((byteValue & 0x80) == 0) {
+                *recordType = typeAndLevels >> 4;
+                *levels = typeAndLevels & 0x0F;
+                *delta = value;
+                return position - readPosition;
+            }
+        }
+        return 0;
+    }
+
+public:
+    SensorTrace() {
+        clearTrace();
+    }
+
+    void clearTrace() {
+        traceLength = 0;
+        hasOverflowed = false;
+        lastRecordTimeMicroseconds = 0;
+        lastRecordedLevels = 0;
+        readPosition = 0;
+        readTimeMicroseconds = 0;
+        replayLevels = 0;
+    }
+
+    // ========================================================================
+    // Recording
+    // ========================================================================
+
+    /**
+     * Start a new trace
+     * @param initialLevels Sensor levels at the start (SENSOR_TRACE_*_BIT mask)
+     * @param startTimeMicroseconds Timestamp of the start (micros())
+     */
+    void beginRecording(uint8_t initialLevels, unsigned long startTimeMicroseconds) {
+        clearTrace();
+        traceBytes[0] = 'S';
+        traceBytes[1] = 'T';
+        traceBytes[2] = 'R';
+        traceBytes[3] = SENSOR_TRACE_FORMAT_VERSION;
+        traceBytes[4] = initialLevels & 0x0F;
+        traceLength = SENSOR_TRACE_HEADER_SIZE_BYTES;
+        lastRecordTimeMicroseconds = startTimeMicroseconds;
+        lastRecordedLevels = initialLevels & 0x0F;
+    }
+
+    /**
+     * Record the current levels if they changed (call from ISRs)
+     */
+    void recordLevels(uint8_t levels, unsigned long timeMicroseconds) {
+        levels &= 0x0F;
+        portENTER_CRITICAL_ISR(&traceLock);
+        if (levels != lastRecordedLevels &&
+            appendRecord(SENSOR_TRACE_RECORD_LEVEL_CHANGE, levels, timeMicroseconds)) {
+            lastRecordedLevels = levels;
+        }
+        portEXIT_CRITICAL_ISR(&traceLock);
+    }
+
+    /**
+     * Record an operation start marker used to re-align replay (main task)
+     */
+    void recordSyncMarker(unsigned long timeMicroseconds) {
+        portENTER_CRITICAL(&traceLock);
+        appendRecord(SENSOR_TRACE_RECORD_SYNC_MARKER, lastRecordedLevels, timeMicroseconds);
+        portEXIT_CRITICAL(&traceLock);
+    }
+
+    // ========================================================================
+    // Access
+    // ========================================================================
+
+    const uint8_t* getTraceBytes() { return traceBytes; }
+    size_t getTraceLength() { return traceLength; }
+    bool didTraceOverflow() { return hasOverflowed; }
+
+    /**
+     * @return true if the buffer starts with a header of this format version
+     */
+    bool hasValidHeader() {
+        return traceLength >= SENSOR_TRACE_HEADER_SIZE_BYTES &&
+               traceBytes[0] == 'S' && traceBytes[1] == 'T' && traceBytes[2] == 'R' &&
+               traceBytes[3] == SENSOR_TRACE_FORMAT_VERSION;
+    }
+
+    /**
+     * Append part of a dumped trace (TRACE:LOAD); offset 0 starts a new trace
+     * Recording must be stopped while loading.
+     * @param offset Byte offset of the chunk, must equal the length loaded so far
+     * @return false if the chunk is out of order or does not fit
+     */
+    bool loadTraceChunk(size_t offset, const uint8_t* bytes, size_t length) {
+        if (offset == 0) {
+            clearTrace();
+        }
+        if (offset != traceLength || length > SENSOR_TRACE_BUFFER_SIZE_BYTES - offset) {
+            return false;
+        }
+        for (size_t i = 0; i < length; i++) {
+            traceBytes[offset + i] = bytes[i];
+        }
+        traceLength = offset + length;
+        return true;
+    }
+
+    /**
+     * Load a previously dumped trace in one piece
+     * @return true if the header is valid and the trace fits
+     */
+    bool loadTrace(const uint8_t* bytes, size_t length) {
+        if (!loadTraceChunk(0, bytes, length) || !hasValidHeader()) {
+            clearTrace();
+            return false;
+        }
+        return true;
+    }
+
+    // ========================================================================
+    // Replay
+    // ========================================================================
+
+    /**
+     * Rewind the replay cursor to the start of the trace
+     * @return false if there is no valid trace to replay
+     */
+    bool rewindForReplay() {
+        if (!hasValidHeader()) {
+            return false;
+        }
+        readPosition = SENSOR_TRACE_HEADER_SIZE_BYTES;
+        readTimeMicroseconds = 0;
+        replayLevels = traceBytes[4];
+        return true;
+    }
+
+    uint8_t getReplayLevels() { return replayLevels; }
+    unsigned long getReplayTimeMicroseconds() { return readTimeMicroseconds; }
+    bool isReplayFinished() { return readPosition >= traceLength; }
+
+    /**
+     * Apply the next level change due at or before a trace time
+     * @param traceTimeMicroseconds Elapsed trace time to advance to
+     * @param levels Receives the levels after the record
+     * @return true if a record was applied (call again until false)
+     */
+    bool applyNextLevelChangeDueBy(unsigned long traceTimeMicroseconds, uint8_t* levels) {
+        uint8_t recordType;
+        uint8_t recordLevels;
+        unsigned long delta;
+
+        size_t recordSize = peekRecord(&recordType, &recordLevels, &delta);
+        if (recordSize == 0 || readTimeMicroseconds + delta > traceTimeMicroseconds) {
+            return false;
+        }
+        if (recordType == SENSOR_TRACE_RECORD_SYNC_MARKER) {
+            return false;   // Markers are consumed only by skipToNextSyncMarker()
+        }
+        readPosition += recordSize;
+        readTimeMicroseconds += delta;
+        replayLevels = recordLevels;
+        *levels = recordLevels;
+        return true;
+    }
+
+    /**
+     * Jump the cursor past the next sync marker, applying intervening levels
+     * @return Trace time of the marker, or the current time if none remain
+     */
+    unsigned long skipToNextSyncMarker() {
+        uint8_t recordType;
+        uint8_t recordLevels;
+        unsigned long delta;
+
+        while (true) {
+            size_t recordSize = peekRecord(&recordType, &recordLevels, &delta);
+            if (recordSize == 0) {
+                return readTimeMicroseconds;
+            }
+            readPosition += recordSize;
+            readTimeMicroseconds += delta;
+            replayLevels = recordLevels;
+            if (recordType == SENSOR_TRACE_RECORD_SYNC_MARKER) {
+                return readTimeMicroseconds;
+            }
+        }
+    }
+
+    /**
+     * Dump the trace as hex lines between markers (Serial-safe transport)
+     */
+    template <typename Output>
+    void printTraceAsHex(Output& out) {
+        static const char hexDigits[] = "0123456789ABCDEF";
+        out.print("TRACE BEGIN ");
+        out.println((unsigned long)traceLength);
+        for (size_t i = 0; i < traceLength; i++) {
+            out.print(hexDigits[traceBytes[i] >> 4]);
+            out.print(hexDigits[traceBytes[i] & 0x0F]);
+            if ((i % 32) == 31) {
+                out.println();
+            }
+        }
+        if ((traceLength % 32) != 0) {
+            out.println();
+        }
+        out.println("TRACE END");
+    }
+};
+
+#endif // SENSOR_TRACE_H
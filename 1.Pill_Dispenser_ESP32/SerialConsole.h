@@ -0,0 +1,197 @@
+#ifndef SERIAL_CONSOLE_H
+#define SERIAL_CONSOLE_H
+
+#include <Arduino.h>
+
+// ============================================================================
+// Serial Console Limits
+// ============================================================================
+#define SERIAL_CONSOLE_LINE_LENGTH              96      // Longer lines are rejected
+#define SERIAL_CONSOLE_MAXIMUM_BYTES_PER_POLL   64      // Input read per loop pass
+#define SERIAL_CONSOLE_OUTPUT_BUFFER_SIZE       4096    // Queued output (reports, dumps)
+
+/**
+ * BufferedSerialWriter Class
+ *
+ * Print target that queues output in RAM and hands it to the UART only as
+ * fast as the UART accepts it, from serviceOutput() in the main loop.
+ * A report that fits the buffer returns at once; a larger one waits only
+ * while the buffer is full (counted as a stall).
+ */
+class BufferedSerialWriter : public Print {
+private:
+    HardwareSerial* serial;
+    uint8_t buffer[SERIAL_CONSOLE_OUTPUT_BUFFER_SIZE];
+    size_t readIndex;
+    size_t numberOfQueuedBytes;
+    unsigned long numberOfStalls;
+
+    void waitUntilSpaceAvailable() {
+        numberOfStalls++;
+        while (numberOfQueuedBytes == SERIAL_CONSOLE_OUTPUT_BUFFER_SIZE) {
+            serviceOutput();
+            if (numberOfQueuedBytes == SERIAL_CONSOLE_OUTPUT_BUFFER_SIZE) {
+                delay(1);
+            }
+        }
+    }
+
+public:
+    /**
+     * Constructor
+     * @param port UART the output ends up on
+     */
+    BufferedSerialWriter(HardwareSerial* port) {
+        serial = port;
+        readIndex = 0;
+        numberOfQueuedBytes = 0;
+        numberOfStalls = 0;
+    }
+
+    size_t write(uint8_t value) override {
+        if (numberOfQueuedBytes == SERIAL_CONSOLE_OUTPUT_BUFFER_SIZE) {
+            waitUntilSpaceAvailable();
+        }
+        buffer[(readIndex + numberOfQueuedBytes) % SERIAL_CONSOLE_OUTPUT_BUFFER_SIZE] = value;
+        numberOfQueuedBytes++;
+        return 1;
+    }
+
+    using Print::write;
+
+    /**
+     * Move as much queued output to the UART as it takes without blocking
+     * Call every loop.
+     */
+    void serviceOutput() {
+        int space = serial->availableForWrite();
+        while (space > 0 && numberOfQueuedBytes > 0) {
+            size_t chunk = min(numberOfQueuedBytes, SERIAL_CONSOLE_OUTPUT_BUFFER_SIZE - readIndex);
+            chunk = min(chunk, (size_t)space);
+            serial->write(buffer + readIndex, chunk);
+            readIndex = (readIndex + chunk) % SERIAL_CONSOLE_OUTPUT_BUFFER_SIZE;
+            numberOfQueuedBytes -= chunk;
+            space -= chunk;
+        }
+    }
+
+    /**
+     * Send everything queued (blocks until done)
+     */
+    void flush() override {
+        while (numberOfQueuedBytes > 0) {
+            serviceOutput();
+            if (numberOfQueuedBytes > 0) {
+                delay(1);
+            }
+        }
+        serial->flush();
+    }
+
+    bool hasPendingOutput() {
+        return numberOfQueuedBytes > 0;
+    }
+
+    unsigned long getNumberOfStalls() {
+        return numberOfStalls;
+    }
+};
+
+/**
+ * SerialConsole Class
+ *
+ * Collects Serial input into lines without blocking:
+ * - Reads at most SERIAL_CONSOLE_MAXIMUM_BYTES_PER_POLL bytes per call
+ * - CR, LF or CRLF ends a line; empty lines are ignored
+ * - A completed line is held (and no more input read) until it is consumed,
+ *   so a command that cannot run yet simply waits
+ * - Input is upper-cased so commands can be typed in either case
+ */
+class SerialConsole {
+private:
+    HardwareSerial* serial;
+    char lineBuffer[SERIAL_CONSOLE_LINE_LENGTH + 1];
+    int lineLength;
+    bool isLineComplete;
+    bool isDiscardingOverlongLine;
+    bool wasInputReceivedInLastPoll;
+
+public:
+    /**
+     * Constructor
+     * @param port UART to read commands from
+     */
+    SerialConsole(HardwareSerial* port) {
+        serial = port;
+        lineLength = 0;
+        lineBuffer[0] = '\0';
+        isLineComplete = false;
+        isDiscardingOverlongLine = false;
+        wasInputReceivedInLastPoll = false;
+    }
+
+    /**
+     * Read pending input
+     * @return true if a complete line is waiting in getLine()
+     */
+    bool pollForCompleteLine() {
+        wasInputReceivedInLastPoll = false;
+        for (int i = 0; i < SERIAL_CONSOLE_MAXIMUM_BYTES_PER_POLL && !isLineComplete; i++) {
+            if (serial->available() <= 0) {
+                break;
+            }
+            char character = (char)serial->read();
+            wasInputReceivedInLastPoll = true;
+
+            if (character == '\r' || character == '\n') {
+                if (isDiscardingOverlongLine) {
+                    isDiscardingOverlongLine = false;
+                    serial->println("ERROR: Line too long");
+                } else if (lineLength > 0) {
+                    lineBuffer[lineLength] = '\0';
+                    isLineComplete = true;
+                }
+                continue;
+            }
+
+            if (isDiscardingOverlongLine) {
+                continue;
+            }
+            if (lineLength >= SERIAL_CONSOLE_LINE_LENGTH) {
+                isDiscardingOverlongLine = true;
+                lineLength = 0;
+                continue;
+            }
+            if (character >= 'a' && character <= 'z') {
+                character -= 'a' - 'A';
+            }
+            lineBuffer[lineLength++] = character;
+        }
+        return isLineComplete;
+    }
+
+    /**
+     * @return true if the last pollForCompleteLine() read at least one byte
+     */
+    bool wasInputReceived() {
+        return wasInputReceivedInLastPoll;
+    }
+
+    /**
+     * @return The completed line (valid until consumeLine())
+     */
+    const char* getLine() {
+        return lineBuffer;
+    }
+
+    /**
+     * Drop the completed line and start reading the next one
+     */
+    void consumeLine() {
+        lineLength = 0;
+        lineBuffer[0] = '\0';
+        isLineComplete = false;
+    }
+};
+
+#endif // SERIAL_CONSOLE_H
@@ -0,0 +1,178 @@
+#ifndef SERVO_MOTION_MODEL_H
+#define SERVO_MOTION_MODEL_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/**
+ * ServoMotionModel Class
+ *
+ * Authoritative state of the servo trajectory, kept where the pulses are
+ * written so nothing has to read the PWM back:
+ * - Target: where the current move ends
+ * - Setpoint: the last pulse width commanded (the interpolated step)
+ * - Estimate: where the horn probably is, chasing the setpoint at a
+ *   constant slew rate, then settling for a fixed time
+ *
+ * The estimate is only trusted after the servo was seen to settle once:
+ * after boot, and after a detach in the middle of a move, the horn may be
+ * anywhere until a full fixed wait has passed.
+ *
+ * Slew rate and settle time are passed in on each call so the model works
+ * with either configuration type (0 slew = no model, waits stay fixed).
+ */
+class ServoMotionModel {
+private:
+    int targetMicroseconds;
+    int setpointMicroseconds;           // 0 until the first write
+    int estimatedMicroseconds;
+    unsigned long timeOfEstimateMilliseconds;
+    unsigned long timeOfArrivalMilliseconds;    // When the estimate reached the setpoint
+    bool isPositionKnown;
+    bool hasSettled;
+
+    /**
+     * Move the estimate toward the setpoint for the time since the last update
+     */
+    void advanceEstimate(unsigned long now, int slewMicrosecondsPerSecond) {
+        unsigned long elapsed = now - timeOfEstimateMilliseconds;
+        timeOfEstimateMilliseconds = now;
+        if (!isPositionKnown || slewMicrosecondsPerSecond <= 0 || estimatedMicroseconds == setpointMicroseconds) {
+            return;
+        }
+
+        unsigned long distance = (unsigned long)abs(setpointMicroseconds - estimatedMicroseconds);
+        unsigned long travelMilliseconds = (distance * 1000UL) / (unsigned long)slewMicrosecondsPerSecond;
+        if (elapsed >= travelMilliseconds) {
+            timeOfArrivalMilliseconds = now - (elapsed - travelMilliseconds);
+            estimatedMicroseconds = setpointMicroseconds;
+            return;
+        }
+        long travelled = (long)(elapsed * (unsigned long)slewMicrosecondsPerSecond / 1000UL);
+        estimatedMicroseconds += (setpointMicroseconds > estimatedMicroseconds) ? travelled : -travelled;
+    }
+
+public:
+    ServoMotionModel() {
+        targetMicroseconds = 0;
+        setpointMicroseconds = 0;
+        estimatedMicroseconds = 0;
+        timeOfEstimateMilliseconds = 0;
+        timeOfArrivalMilliseconds = 0;
+        isPositionKnown = false;
+        hasSettled = false;
+    }
+
+    void beginMove(int target) {
+        targetMicroseconds = target;
+    }
+
+    /**
+     * Record a pulse width written to the servo
+     * @param microseconds Pulse width written
+     * @param now millis()
+     * @param slewMicrosecondsPerSecond Modeled horn speed
+     */
+    void recordSetpoint(int microseconds, unsigned long now, int slewMicrosecondsPerSecond) {
+        advanceEstimate(now, slewMicrosecondsPerSecond);
+        if (microseconds == setpointMicroseconds) {
+            return;
+        }
+        setpointMicroseconds = microseconds;
+        hasSettled = false;
+    }
+
+    /**
+     * Record that the servo stopped being driven
+     * A horn still moving stops somewhere short of the setpoint.
+     */
+    void recordDetach(unsigned long now, int slewMicrosecondsPerSecond) {
+        advanceEstimate(now, slewMicrosecondsPerSecond);
+        if (estimatedMicroseconds != setpointMicroseconds) {
+            isPositionKnown = false;
+        }
+    }
+
+    /**
+     * Record that a full fixed wait passed since the last write
+     */
+    void markSettled(unsigned long now) {
+        estimatedMicroseconds = setpointMicroseconds;
+        timeOfEstimateMilliseconds = now;
+        timeOfArrivalMilliseconds = now;
+        isPositionKnown = setpointMicroseconds > 0;
+        hasSettled = true;
+    }
+
+    /**
+     * Time until the horn is modeled to be at rest on the setpoint
+     * @return Milliseconds (0 = settled), or -1 if the model cannot tell
+     */
+    long getRemainingSettleMilliseconds(unsigned long now, int slewMicrosecondsPerSecond, int settleMilliseconds) {
+        if (hasSettled) {
+            return 0;
+        }
+        if (!isPositionKnown || slewMicrosecondsPerSecond <= 0) {
+            return -1;
+        }
+        advanceEstimate(now, slewMicrosecondsPerSecond);
+        if (estimatedMicroseconds != setpointMicroseconds) {
+            unsigned long distance = (unsigned long)abs(setpointMicroseconds - estimatedMicroseconds);
+            return (long)((distance * 1000UL + slewMicrosecondsPerSecond - 1) / slewMicrosecondsPerSecond) +
+                   settleMilliseconds;
+        }
+        unsigned long sinceArrival = now - timeOfArrivalMilliseconds;
+        return (sinceArrival >= (unsigned long)settleMilliseconds) ? 0 : (long)(settleMilliseconds - sinceArrival);
+    }
+
+    /**
+     * Same model for a sweep that started from rest, without tracking state
+     * (DispenseSimulator)
+     * @param distanceMicroseconds Length of the sweep
+     * @param sweepMilliseconds Time spent writing the sweep's steps
+     * @return Remaining settle time after the last write, or -1 with no model
+     */
+    static long estimateSettleMillisecondsAfterSweep(int distanceMicroseconds, unsigned long sweepMilliseconds,
+                                                     int slewMicrosecondsPerSecond, int settleMilliseconds) {
+        if (slewMicrosecondsPerSecond <= 0) {
+            return -1;
+        }
+        unsigned long travelMilliseconds = ((unsigned long)abs(distanceMicroseconds) * 1000UL +
+                                            slewMicrosecondsPerSecond - 1) / slewMicrosecondsPerSecond;
+        long lagMilliseconds = (long)travelMilliseconds - (long)sweepMilliseconds;
+        if (lagMilliseconds < 0) {
+            lagMilliseconds = 0;
+        }
+        return lagMilliseconds + settleMilliseconds;
+    }
+
+    /**
+     * @return Modeled position while the horn still moves toward the
+     *         setpoint, 0 once it arrived or when the position is unknown
+     */
+    int getTravellingEstimateMicroseconds(unsigned long now, int slewMicrosecondsPerSecond) {
+        if (!isPositionKnown || hasSettled || slewMicrosecondsPerSecond <= 0) {
+            return 0;
+        }
+        advanceEstimate(now, slewMicrosecondsPerSecond);
+        return (estimatedMicroseconds != setpointMicroseconds) ? estimatedMicroseconds : 0;
+    }
+
+    int getTargetMicroseconds() {
+        return targetMicroseconds;
+    }
+
+    int getSetpointMicroseconds() {
+        return setpointMicroseconds;
+    }
+
+    int getEstimatedMicroseconds() {
+        return estimatedMicroseconds;
+    }
+
+    bool isEstimateKnown() {
+        return isPositionKnown;
+    }
+};
+
+#endif // SERVO_MOTION_MODEL_H
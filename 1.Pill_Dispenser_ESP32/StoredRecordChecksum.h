@@ -0,0 +1,32 @@
+#ifndef STORED_RECORD_CHECKSUM_H
+#define STORED_RECORD_CHECKSUM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <rom/crc.h>
+
+// ============================================================================
+// Stored Record Checksums
+// ============================================================================
+// Every record kept in NVS or the journal partition is checked with the ESP32
+// ROM CRC-32 (crc32_le, seed 0). Records with a 16-bit checksum field store
+// its low 16 bits. Use these helpers rather than a local CRC, so one record
+// format can be verified the same way by every reader.
+
+/**
+ * @param bytes Record bytes (checksum field zeroed or excluded)
+ * @param length Number of bytes covered
+ * @return Full CRC-32
+ */
+inline uint32_t calculateStoredRecordCrc32(const void* bytes, size_t length) {
+    return crc32_le(0, (const uint8_t*)bytes, (uint32_t)length);
+}
+
+/**
+ * @return Low 16 bits of calculateStoredRecordCrc32()
+ */
+inline uint16_t calculateStoredRecordChecksum(const void* bytes, size_t length) {
+    return (uint16_t)calculateStoredRecordCrc32(bytes, length);
+}
+
+#endif // STORED_RECORD_CHECKSUM_H
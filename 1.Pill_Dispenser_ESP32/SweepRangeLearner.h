@@ -0,0 +1,194 @@
+#ifndef SWEEP_RANGE_LEARNER_H
+#define SWEEP_RANGE_LEARNER_H
+
+#include <Arduino.h>
+#include "Config.h"
+#include "ConfigurationSettings.h"
+
+// ============================================================================
+// Sweep Learning
+// ============================================================================
+// Each compartment keeps the release positions of its last few pills; its
+// sweep ends a margin past the furthest of them. RAM only: every compartment
+// sweeps the full arc again after a reboot until it has been relearned.
+#define SWEEP_LEARNING_HISTORY_LENGTH           8
+#define SWEEP_LEARNING_MINIMUM_OBSERVATIONS     3   // Full sweeps until this many releases were seen
+#define SWEEP_LEARNING_MAXIMUM_MISSES           2   // Misses in a row on a short sweep that forget the range
+
+struct CompartmentSweepRange {
+    uint16_t releasePositions[SWEEP_LEARNING_HISTORY_LENGTH];  // Modeled horn position at the first IR edge (us)
+    uint8_t numberOfObservations;       // Valid entries, saturates at the history length
+    uint8_t nextObservationIndex;
+    uint8_t consecutiveMisses;          // Short sweeps in a row that released nothing
+    uint8_t reserved;
+    uint16_t widenedMicroseconds;       // Added by misses since the last observed release
+    uint32_t numberOfShortenedSweeps;
+    uint32_t numberOfShortenedMisses;
+};
+
+/**
+ * SweepRangeLearner Class
+ *
+ * Learns how far the servo has to sweep for each compartment:
+ * - DispenserController watches the IR sensor while the horn still travels
+ *   and reports where the horn was modeled to be at the first pill edge
+ * - Once a compartment has enough releases, its sweep ends
+ *   sweepLearningMarginMicroseconds past the furthest recent one
+ * - Every miss on a shortened sweep widens it by another margin; misses in
+ *   a row forget the compartment, which then sweeps the full arc again
+ *
+ * The pill falls for a while before the IR sees it and the horn keeps
+ * moving meanwhile, so a recorded position lies past the real release
+ * point: the error is on the side of sweeping too far.
+ */
+class SweepRangeLearner {
+private:
+    SystemConfiguration* systemConfiguration;
+    CompartmentSweepRange compartmentRanges[NUMBER_OF_COMPARTMENTS_IN_DISPENSER];
+
+    bool isValidCompartment(int compartmentNumber) {
+        return compartmentNumber >= 1 && compartmentNumber <= NUMBER_OF_COMPARTMENTS_IN_DISPENSER;
+    }
+
+    int getFurthestReleasePosition(const CompartmentSweepRange& range) {
+        int furthest = 0;
+        for (int i = 0; i < range.numberOfObservations; i++) {
+            if (range.releasePositions[i] > furthest) {
+                furthest = range.releasePositions[i];
+            }
+        }
+        return furthest;
+    }
+
+    void forgetCompartment(CompartmentSweepRange& range) {
+        range.numberOfObservations = 0;
+        range.nextObservationIndex = 0;
+        range.consecutiveMisses = 0;
+        range.widenedMicroseconds = 0;
+    }
+
+public:
+    SweepRangeLearner(SystemConfiguration* config) {
+        systemConfiguration = config;
+        memset(compartmentRanges, 0, sizeof(compartmentRanges));
+    }
+
+    /**
+     * @return true once the compartment sweeps less than the full arc
+     */
+    bool isRangeLearned(int compartmentNumber) {
+        return systemConfiguration->enableSweepRangeLearning && isValidCompartment(compartmentNumber) &&
+               compartmentRanges[compartmentNumber - 1].numberOfObservations >= SWEEP_LEARNING_MINIMUM_OBSERVATIONS;
+    }
+
+    /**
+     * Where the next sweep of a compartment should end
+     * @param minSafe Lowest servo position allowed
+     * @param maxSafe Full-arc end point
+     * @return Pulse width in microseconds (maxSafe until the range is learned)
+     */
+    int getSweepEndMicroseconds(int compartmentNumber, int minSafe, int maxSafe) {
+        if (!isRangeLearned(compartmentNumber)) {
+            return maxSafe;
+        }
+        const CompartmentSweepRange& range = compartmentRanges[compartmentNumber - 1];
+        long end = (long)getFurthestReleasePosition(range) + systemConfiguration->sweepLearningMarginMicroseconds +
+                   range.widenedMicroseconds;
+        return (int)constrain(end, (long)minSafe, (long)maxSafe);
+    }
+
+    /**
+     * Record where the horn was when the IR first saw a pill
+     * Only positions taken while the horn still moved say anything about
+     * the release; a pill seen after the horn stopped is not recorded.
+     * @param positionMicroseconds Modeled horn position
+     */
+    void recordReleasePosition(int compartmentNumber, int positionMicroseconds) {
+        if (!isValidCompartment(compartmentNumber) || positionMicroseconds <= 0) {
+            return;
+        }
+        CompartmentSweepRange& range = compartmentRanges[compartmentNumber - 1];
+        range.releasePositions[range.nextObservationIndex] = (uint16_t)positionMicroseconds;
+        range.nextObservationIndex = (range.nextObservationIndex + 1) % SWEEP_LEARNING_HISTORY_LENGTH;
+        if (range.numberOfObservations < SWEEP_LEARNING_HISTORY_LENGTH) {
+            range.numberOfObservations++;
+        }
+        range.widenedMicroseconds = 0;
+    }
+
+    /**
+     * Record the outcome of one sweep
+     * @param wasSweepShortened true if the sweep ended before maxSafe
+     * @param wasPillDetected true if the attempt counted at least one pill
+     */
+    void recordSweepOutcome(int compartmentNumber, bool wasSweepShortened, bool wasPillDetected) {
+        if (!isValidCompartment(compartmentNumber)) {
+            return;
+        }
+        CompartmentSweepRange& range = compartmentRanges[compartmentNumber - 1];
+        if (wasSweepShortened) {
+            range.numberOfShortenedSweeps++;
+        }
+        if (wasPillDetected) {
+            range.consecutiveMisses = 0;
+            return;
+        }
+        if (!wasSweepShortened) {
+            return;  // A full sweep that missed says nothing about the range
+        }
+
+        range.numberOfShortenedMisses++;
+        range.consecutiveMisses++;
+        if (range.consecutiveMisses >= SWEEP_LEARNING_MAXIMUM_MISSES) {
+            forgetCompartment(range);
+            return;
+        }
+        long widened = (long)range.widenedMicroseconds + systemConfiguration->sweepLearningMarginMicroseconds;
+        range.widenedMicroseconds = (uint16_t)min(widened, 65535L);
+    }
+
+    /**
+     * Sweep the full arc everywhere until relearned
+     */
+    void resetAllSweepRanges() {
+        for (int i = 0; i < NUMBER_OF_COMPARTMENTS_IN_DISPENSER; i++) {
+            forgetCompartment(compartmentRanges[i]);
+        }
+    }
+
+    uint32_t getNumberOfShortenedSweeps(int compartmentNumber) {
+        return isValidCompartment(compartmentNumber) ? compartmentRanges[compartmentNumber - 1].numberOfShortenedSweeps : 0;
+    }
+
+    uint32_t getNumberOfShortenedMisses(int compartmentNumber) {
+        return isValidCompartment(compartmentNumber) ? compartmentRanges[compartmentNumber - 1].numberOfShortenedMisses : 0;
+    }
+
+    template<typename Output>
+    void printSweepRanges(Output& out, int minSafe, int maxSafe) {
+        out.print("SWEEP RANGES");
+        out.println(systemConfiguration->enableSweepRangeLearning ? ":" : " (learning off):");
+        for (int compartmentNumber = 1; compartmentNumber <= systemConfiguration->numberOfCompartmentsInDispenser;
+             compartmentNumber++) {
+            const CompartmentSweepRange& range = compartmentRanges[compartmentNumber - 1];
+            out.print("  Compartment ");
+            out.print(compartmentNumber);
+            out.print(": end ");
+            out.print(getSweepEndMicroseconds(compartmentNumber, minSafe, maxSafe));
+            out.print(" us");
+            if (range.numberOfObservations > 0) {
+                out.print(", release <= ");
+                out.print(getFurthestReleasePosition(range));
+                out.print(" us (");
+                out.print(range.numberOfObservations);
+                out.print(" seen)");
+            }
+            out.print(", short ");
+            out.print(range.numberOfShortenedSweeps);
+            out.print(" / missed ");
+            out.println(range.numberOfShortenedMisses);
+        }
+    }
+};
+
+#endif // SWEEP_RANGE_LEARNER_H
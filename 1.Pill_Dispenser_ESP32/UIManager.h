@@ -5,26 +5,56 @@
 #include <LiquidCrystal.h>
 #include "Config.h"
 #include "ConfigurationSettings.h"
+#include "MessageCatalog.h"
 
 /**
  * Button action enumeration
+ * Compartment n's button reports COMPARTMENT_1_SELECTED + (n - 1)
  */
 enum ButtonAction {
     NO_BUTTON_PRESSED,
-    COMPARTMENT_1_SELECTED,
-    COMPARTMENT_2_SELECTED,
-    COMPARTMENT_3_SELECTED,
-    COMPARTMENT_4_SELECTED,
-    COMPARTMENT_5_SELECTED,
     NAVIGATION_BACK_PRESSED,
-    NAVIGATION_SELECT_PRESSED
+    NAVIGATION_SELECT_PRESSED,
+    COMPARTMENT_1_SELECTED
 };
 
+/**
+ * Direct-select button wiring: entry i selects compartment i + 1.
+ * Carousels with more compartments than buttons reach the rest with BACK.
+ */
+struct CompartmentButtonMapping {
+    int pin;
+    int inputMode;
+};
+
+static const CompartmentButtonMapping COMPARTMENT_BUTTON_MAPPINGS[] = {
+    {PIN_FOR_COMPARTMENT_BUTTON_1, INPUT_PULLUP},
+    {PIN_FOR_COMPARTMENT_BUTTON_2, INPUT_PULLUP},
+    {PIN_FOR_COMPARTMENT_BUTTON_3, INPUT_PULLUP},
+    {PIN_FOR_COMPARTMENT_BUTTON_4, INPUT},          // GPIO36 (VP) is input-only and lacks internal pull-ups
+    {PIN_FOR_COMPARTMENT_BUTTON_5, INPUT_PULLUP}
+};
+
+#define NUMBER_OF_COMPARTMENT_BUTTONS \
+    (int)(sizeof(COMPARTMENT_BUTTON_MAPPINGS) / sizeof(COMPARTMENT_BUTTON_MAPPINGS[0]))
+
+inline ButtonAction getButtonActionForCompartment(int compartmentNumber) {
+    return (ButtonAction)(COMPARTMENT_1_SELECTED + compartmentNumber - 1);
+}
+
+/**
+ * @return Compartment selected by the action (1-based), or 0 for other actions
+ */
+inline int getCompartmentNumberForButtonAction(ButtonAction action) {
+    return (action >= COMPARTMENT_1_SELECTED) ? (int)(action - COMPARTMENT_1_SELECTED) + 1 : 0;
+}
+
 /**
  * UIManager Class
  * 
  * Responsible for all user interface operations including:
- * - LCD display updates and formatting
+ * - LCD display updates and formatting (catalog messages, each row
+ *   rewritten only when its text changes)
  * - Button input handling with debouncing
  * - Status message display
  * 
@@ -35,10 +65,34 @@ private:
     SystemConfiguration* systemConfiguration;
     LiquidCrystal lcdDisplay;
     
+    // What each LCD row currently shows; rows are rewritten only when they change
+    char displayedRowText[LCD_NUMBER_OF_ROWS][LCD_NUMBER_OF_COLUMNS + 1];
+    
     // Button state tracking
     unsigned long timeOfLastButtonPressMilliseconds;
     int currentlySelectedCompartmentNumber;
     
+    void forgetDisplayedRows() {
+        for (int row = 0; row < LCD_NUMBER_OF_ROWS; row++) {
+            memset(displayedRowText[row], ' ', LCD_NUMBER_OF_COLUMNS);
+            displayedRowText[row][LCD_NUMBER_OF_COLUMNS] = '\0';
+        }
+    }
+    
+    /**
+     * Send a full-width row to the LCD unless it already shows that text
+     * @param paddedText Exactly LCD_NUMBER_OF_COLUMNS characters
+     */
+    void writeRowIfChanged(int row, const char* paddedText) {
+        if (row < 0 || row >= LCD_NUMBER_OF_ROWS ||
+            memcmp(displayedRowText[row], paddedText, LCD_NUMBER_OF_COLUMNS) == 0) {
+            return;
+        }
+        memcpy(displayedRowText[row], paddedText, LCD_NUMBER_OF_COLUMNS);
+        lcdDisplay.setCursor(0, row);
+        lcdDisplay.print(displayedRowText[row]);
+    }
+    
 public:
     /**
      * Constructor
@@ -54,6 +108,7 @@ public:
                     PIN_FOR_LCD_DATA_BIT_7) {
         timeOfLastButtonPressMilliseconds = 0;
         currentlySelectedCompartmentNumber = 1;
+        forgetDisplayedRows();
     }
     
     /**
@@ -63,14 +118,12 @@ public:
         // Initialize LCD
         lcdDisplay.begin(LCD_NUMBER_OF_COLUMNS, LCD_NUMBER_OF_ROWS);
         lcdDisplay.clear();
+        forgetDisplayedRows();
         
-        // Configure button pins with internal pull-up resistors
-        pinMode(PIN_FOR_COMPARTMENT_BUTTON_1, INPUT_PULLUP);
-        pinMode(PIN_FOR_COMPARTMENT_BUTTON_2, INPUT_PULLUP);
-        pinMode(PIN_FOR_COMPARTMENT_BUTTON_3, INPUT_PULLUP);
-        // Note: GPIO36 (VP) is input-only and lacks internal pull-ups
-        pinMode(PIN_FOR_COMPARTMENT_BUTTON_4, INPUT);
-        pinMode(PIN_FOR_COMPARTMENT_BUTTON_5, INPUT_PULLUP);
+        // Configure button pins (internal pull-ups where the pin has them)
+        for (int i = 0; i < NUMBER_OF_COMPARTMENT_BUTTONS; i++) {
+            pinMode(COMPARTMENT_BUTTON_MAPPINGS[i].pin, COMPARTMENT_BUTTON_MAPPINGS[i].inputMode);
+        }
         pinMode(PIN_FOR_NAVIGATION_BACK_BUTTON, INPUT_PULLUP);
         pinMode(PIN_FOR_NAVIGATION_SELECT_BUTTON, INPUT_PULLUP);
     }
@@ -83,35 +136,28 @@ public:
      * Clear the LCD display completely
      */
     void clearLCDDisplay() {
-        lcdDisplay.clear();
+        displayMessagesOnBothRows(MSG_NONE, MSG_NONE);
     }
     
     /**
      * Display initialization message
      */
     void displayInitializationMessage() {
-        lcdDisplay.clear();
-        lcdDisplay.setCursor(0, 0);
-        lcdDisplay.print("Pill Dispenser");
-        lcdDisplay.setCursor(0, 1);
-        lcdDisplay.print("Initializing...");
+        displayMessagesOnBothRows(MSG_PILL_DISPENSER, MSG_INITIALIZING);
     }
     
     /**
      * Display homing in progress message
      */
     void displayHomingInProgressMessage() {
-        lcdDisplay.clear();
-        lcdDisplay.setCursor(0, 0);
-        lcdDisplay.print("Homing...");
+        displayMessagesOnBothRows(MSG_HOMING, MSG_NONE);
     }
     
     /**
      * Display homing complete message
      */
     void displayHomingCompleteMessage() {
-        lcdDisplay.setCursor(0, 1);
-        lcdDisplay.print("Home: OK        ");
+        displayMessageOnRow(1, MSG_HOME_OK);
     }
     
     /**
@@ -120,18 +166,10 @@ public:
      * @param isBluetoothConnected Whether BLE device is connected
      */
     void displayReadyStatusWithCompartmentSelection(int selectedCompartment, bool isBluetoothConnected) {
-        lcdDisplay.clear();
-        lcdDisplay.setCursor(0, 0);
-        lcdDisplay.print("Slot: ");
-        lcdDisplay.print(selectedCompartment);
-        lcdDisplay.print(" Ready  ");
-        
-        lcdDisplay.setCursor(0, 1);
-        if (isBluetoothConnected) {
-            lcdDisplay.print("BLE: Connected  ");
-        } else {
-            lcdDisplay.print("BLE: Waiting... ");
-        }
+        LCDRowText rowText;
+        rowText.appendMessage(MSG_SLOT_LABEL).appendNumber(selectedCompartment).appendMessage(MSG_READY);
+        writeRowIfChanged(0, rowText.getPaddedText());
+        displayMessageOnRow(1, isBluetoothConnected ? MSG_BLE_CONNECTED : MSG_BLE_WAITING);
     }
     
     /**
@@ -139,64 +177,74 @@ public:
      * @param compartmentNumber Compartment being dispensed from
      */
     void displayDispensingInProgressMessage(int compartmentNumber) {
-        lcdDisplay.clear();
-        lcdDisplay.setCursor(0, 0);
-        lcdDisplay.print("Dispensing...   ");
-        lcdDisplay.setCursor(0, 1);
-        lcdDisplay.print("Slot ");
-        lcdDisplay.print(compartmentNumber);
-        lcdDisplay.print("          ");
+        displayMessageOnRow(0, MSG_DISPENSING);
+        displayMessageWithNumberOnRow(1, MSG_SLOT, compartmentNumber);
     }
     
     /**
      * Display success message
      */
     void displaySuccessMessage() {
-        lcdDisplay.clear();
-        lcdDisplay.setCursor(0, 0);
-        lcdDisplay.print("Success!        ");
+        displayMessagesOnBothRows(MSG_SUCCESS, MSG_NONE);
     }
     
     /**
      * Display failure/error message
      */
     void displayFailureMessage() {
-        lcdDisplay.clear();
-        lcdDisplay.setCursor(0, 0);
-        lcdDisplay.print("Failed!         ");
+        displayMessagesOnBothRows(MSG_FAILED, MSG_NONE);
     }
     
     /**
      * Display BLE connected status on second row
      */
     void displayBluetoothConnectedStatus() {
-        lcdDisplay.setCursor(0, 1);
-        lcdDisplay.print("BLE: Connected  ");
+        displayMessageOnRow(1, MSG_BLE_CONNECTED);
     }
     
     /**
      * Display BLE waiting status on second row
      */
     void displayBluetoothWaitingStatus() {
-        lcdDisplay.setCursor(0, 1);
-        lcdDisplay.print("BLE: Waiting... ");
+        displayMessageOnRow(1, MSG_BLE_WAITING);
     }
     
     /**
-     * Display custom message on LCD
+     * Display a catalog message on one row (padded/truncated to the row width)
      * @param row Row number (0 or 1)
-     * @param message Message to display (will be padded/truncated to 16 chars)
+     * @param id Message to display
      */
-    void displayCustomMessageOnRow(int row, String message) {
-        lcdDisplay.setCursor(0, row);
-        // Pad or truncate message to LCD width
-        while (message.length() < LCD_NUMBER_OF_COLUMNS) {
-            message += " ";
-        }
-        if (message.length() > LCD_NUMBER_OF_COLUMNS) {
-            message = message.substring(0, LCD_NUMBER_OF_COLUMNS);
-        }
-        lcdDisplay.print(message);
+    void displayMessageOnRow(int row, MessageId id) {
+        LCDRowText rowText;
+        rowText.appendMessage(id);
+        writeRowIfChanged(row, rowText.getPaddedText());
+    }
+    
+    /**
+     * Display "<message><number><suffix>" on one row, e.g. "Slot 3 empty"
+     * @param row Row number (0 or 1)
+     */
+    void displayMessageWithNumberOnRow(int row, MessageId id, long number, MessageId suffix = MSG_NONE) {
+        LCDRowText rowText;
+        rowText.appendMessage(id).appendNumber(number).appendMessage(suffix);
+        writeRowIfChanged(row, rowText.getPaddedText());
+    }
+    
+    /**
+     * Display two catalog messages, one per row
+     */
+    void displayMessagesOnBothRows(MessageId topRow, MessageId bottomRow) {
+        displayMessageOnRow(0, topRow);
+        displayMessageOnRow(1, bottomRow);
+    }
+    
+    /**
+     * Display already formatted text on one row
+     * @param row Row number (0 or 1)
+     * @param rowText Text built by the caller (padded here)
+     */
+    void displayTextOnRow(int row, LCDRowText& rowText) {
+        writeRowIfChanged(row, rowText.getPaddedText());
     }
     
     // ========================================================================
@@ -217,27 +265,14 @@ public:
         }
         
         // Check each button (LOW = pressed with pull-up resistor)
-        if (digitalRead(PIN_FOR_COMPARTMENT_BUTTON_1) == LOW) {
-            timeOfLastButtonPressMilliseconds = currentTimeMilliseconds;
-            return COMPARTMENT_1_SELECTED;
-        }
-        else if (digitalRead(PIN_FOR_COMPARTMENT_BUTTON_2) == LOW) {
-            timeOfLastButtonPressMilliseconds = currentTimeMilliseconds;
-            return COMPARTMENT_2_SELECTED;
-        }
-        else if (digitalRead(PIN_FOR_COMPARTMENT_BUTTON_3) == LOW) {
-            timeOfLastButtonPressMilliseconds = currentTimeMilliseconds;
-            return COMPARTMENT_3_SELECTED;
+        for (int i = 0; i < NUMBER_OF_COMPARTMENT_BUTTONS; i++) {
+            if (digitalRead(COMPARTMENT_BUTTON_MAPPINGS[i].pin) == LOW) {
+                timeOfLastButtonPressMilliseconds = currentTimeMilliseconds;
+                return getButtonActionForCompartment(i + 1);
+            }
         }
-        else if (digitalRead(PIN_FOR_COMPARTMENT_BUTTON_4) == LOW) {
-            timeOfLastButtonPressMilliseconds = currentTimeMilliseconds;
-            return COMPARTMENT_4_SELECTED;
-        }
-        else if (digitalRead(PIN_FOR_COMPARTMENT_BUTTON_5) == LOW) {
-            timeOfLastButtonPressMilliseconds = currentTimeMilliseconds;
-            return COMPARTMENT_5_SELECTED;
-        }
-        else if (digitalRead(PIN_FOR_NAVIGATION_BACK_BUTTON) == LOW) {
+        
+        if (digitalRead(PIN_FOR_NAVIGATION_BACK_BUTTON) == LOW) {
             timeOfLastButtonPressMilliseconds = currentTimeMilliseconds;
             return NAVIGATION_BACK_PRESSED;
         }
@@ -293,27 +328,16 @@ public:
      * @param maxCompartments Maximum number of compartments
      */
     void handleButtonActionAndUpdateSelection(ButtonAction action, int maxCompartments) {
+        int selectedCompartment = getCompartmentNumberForButtonAction(action);
+        if (selectedCompartment > 0) {
+            // Buttons wired beyond the carousel size are ignored
+            if (selectedCompartment <= maxCompartments) {
+                currentlySelectedCompartmentNumber = selectedCompartment;
+            }
+            return;
+        }
+        
         switch (action) {
-            case COMPARTMENT_1_SELECTED:
-                currentlySelectedCompartmentNumber = 1;
-                break;
-                
-            case COMPARTMENT_2_SELECTED:
-                currentlySelectedCompartmentNumber = 2;
-                break;
-                
-            case COMPARTMENT_3_SELECTED:
-                currentlySelectedCompartmentNumber = 3;
-                break;
-                
-            case COMPARTMENT_4_SELECTED:
-                currentlySelectedCompartmentNumber = 4;
-                break;
-                
-            case COMPARTMENT_5_SELECTED:
-                currentlySelectedCompartmentNumber = 5;
-                break;
-                
             case NAVIGATION_BACK_PRESSED:
                 decrementSelectedCompartmentWithWraparound(maxCompartments);
                 break;
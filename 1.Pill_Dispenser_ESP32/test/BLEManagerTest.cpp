@@ -0,0 +1,67 @@
+#include <gtest/gtest.h>
+#include <Arduino.h>
+#include <string>
+#include "BLEManager.h"
+
+// Collects replies written to the console
+class TextCapture : public Print {
+public:
+    std::string text;
+    size_t write(uint8_t value) override {
+        text += (char)value;
+        return 1;
+    }
+};
+
+class BLEManagerTest : public ::testing::Test {
+protected:
+    SystemConfiguration systemConfig;
+    BLEManager bleManager;
+    TextCapture console;
+
+    BLEManagerTest() : bleManager(&systemConfig) {}
+};
+
+TEST_F(BLEManagerTest, ConsoleAndBLECommandsAreBothKeptInArrivalOrder) {
+    ASSERT_TRUE(bleManager.submitCommandFromSerialConsole("STATUS", &console));
+    bleManager.parseBLECommandAndExtractParameters("DISPENSE:3:2");
+
+    BLECommand first = bleManager.getAndRemoveNextCommand();
+    EXPECT_EQ(BLECommand::STATUS, first.commandType);
+    EXPECT_TRUE(first.isFromSerialConsole);
+
+    BLECommand second = bleManager.getAndRemoveNextCommand();
+    EXPECT_EQ(BLECommand::DISPENSE, second.commandType);
+    EXPECT_EQ(3, second.compartmentNumber);
+    EXPECT_EQ(2, second.pillCount);
+    EXPECT_FALSE(second.isFromSerialConsole);
+
+    EXPECT_FALSE(bleManager.hasNewCommandAvailableToProcess());
+    EXPECT_EQ(BLECommand::NONE, bleManager.getAndRemoveNextCommand().commandType);
+}
+
+TEST_F(BLEManagerTest, FullQueueRejectsInsteadOfOverwriting) {
+    for (int i = 1; i <= BLE_COMMAND_QUEUE_CAPACITY; i++) {
+        ASSERT_TRUE(bleManager.submitCommandFromSerialConsole("DISPENSE:" + String(i), &console));
+    }
+    EXPECT_TRUE(bleManager.isCommandQueueFull());
+    EXPECT_FALSE(bleManager.submitCommandFromSerialConsole("HOME", &console));
+    EXPECT_NE(std::string::npos, console.text.find("Busy"));
+
+    for (int i = 1; i <= BLE_COMMAND_QUEUE_CAPACITY; i++) {
+        EXPECT_EQ(i, bleManager.getAndRemoveNextCommand().compartmentNumber);
+    }
+}
+
+TEST_F(BLEManagerTest, UnknownConsoleCommandIsReportedOnTheConsoleOnly) {
+    EXPECT_FALSE(bleManager.submitCommandFromSerialConsole("FROB", &console));
+    EXPECT_NE(std::string::npos, console.text.find("Unknown command: FROB"));
+    EXPECT_FALSE(bleManager.hasNewCommandAvailableToProcess());
+}
+
+TEST_F(BLEManagerTest, PendingDispenseIsFoundBehindOtherCommands) {
+    bleManager.parseBLECommandAndExtractParameters("STATUS");
+    EXPECT_FALSE(bleManager.isDispenseCommandPending());
+    bleManager.parseBLECommandAndExtractParameters("DISPENSE:1");
+    EXPECT_TRUE(bleManager.isDispenseCommandPending());
+}
@@ -0,0 +1,52 @@
+#include <gtest/gtest.h>
+#include "ConfigurationStore.h"
+
+class ConfigurationStoreTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        hostNvs().clear();
+    }
+
+    static std::vector<uint8_t>& storedRecordOf(int fieldId) {
+        return hostNvs()[std::string(CONFIGURATION_STORE_NAMESPACE) + "/f" + std::to_string(fieldId)];
+    }
+};
+
+TEST_F(ConfigurationStoreTest, StoredFieldIsAppliedAfterReboot) {
+    SystemConfiguration systemConfig;
+    ConfigurationStore configurationStore(&systemConfig);
+    configurationStore.beginAndLoadStoredConfiguration();
+    ASSERT_EQ(CONFIGURATION_UPDATE_OK, configurationStore.setFieldValue(12, 7));
+
+    SystemConfiguration rebootedConfig;
+    ConfigurationStore rebootedStore(&rebootedConfig);
+    EXPECT_EQ(1, rebootedStore.beginAndLoadStoredConfiguration());
+    EXPECT_EQ(7, rebootedConfig.servoStepMicroseconds);
+}
+
+TEST_F(ConfigurationStoreTest, RecordsUseTheSharedChecksum) {
+    SystemConfiguration systemConfig;
+    ConfigurationStore configurationStore(&systemConfig);
+    configurationStore.beginAndLoadStoredConfiguration();
+    ASSERT_EQ(CONFIGURATION_UPDATE_OK, configurationStore.setFieldValue(12, 7));
+
+    StoredConfigurationRecord record;
+    ASSERT_EQ(sizeof(record), storedRecordOf(12).size());
+    memcpy(&record, storedRecordOf(12).data(), sizeof(record));
+    uint16_t storedChecksum = record.checksum;
+    record.checksum = 0;
+    EXPECT_EQ(calculateStoredRecordChecksum(&record, sizeof(record)), storedChecksum);
+}
+
+TEST_F(ConfigurationStoreTest, CorruptRecordIsIgnored) {
+    SystemConfiguration systemConfig;
+    ConfigurationStore configurationStore(&systemConfig);
+    configurationStore.beginAndLoadStoredConfiguration();
+    ASSERT_EQ(CONFIGURATION_UPDATE_OK, configurationStore.setFieldValue(12, 7));
+    storedRecordOf(12)[4] ^= 0x01;
+
+    SystemConfiguration rebootedConfig;
+    ConfigurationStore rebootedStore(&rebootedConfig);
+    EXPECT_EQ(0, rebootedStore.beginAndLoadStoredConfiguration());
+    EXPECT_EQ(SystemConfiguration().servoStepMicroseconds, rebootedConfig.servoStepMicroseconds);
+}
@@ -0,0 +1,118 @@
+#include <gtest/gtest.h>
+#include "DispenseJobQueue.h"
+
+// Tue 2023-11-14 07:00 UTC (UTC offset 0, so local = UTC)
+static const uint32_t MORNING = 1699945200UL;
+static const uint32_t ONE_HOUR = 3600UL;
+
+class DispenseJobQueueTest : public ::testing::Test {
+protected:
+    SystemConfiguration systemConfig;
+    DoseScheduler doseScheduler;
+    DispenseJobQueue jobQueue;
+
+    DispenseJobQueueTest() : doseScheduler(&systemConfig) {}
+
+    void SetUp() override {
+        hostNvs().clear();
+        doseScheduler.beginAndLoadSchedule();
+        // Slot 0: 1 pill from compartment 2 every day at 08:00
+        ASSERT_TRUE(doseScheduler.setScheduleEntry(0, 8 * 60, 2, 1, MISSED_DOSE_DISPENSE_WITHIN_GRACE, MORNING));
+    }
+};
+
+TEST_F(DispenseJobQueueTest, PatientJobsRunBeforeMaintenanceInArrivalOrder) {
+    ASSERT_TRUE(jobQueue.enqueueJob(JOB_CALIBRATE));
+    ASSERT_TRUE(jobQueue.enqueueJob(JOB_BLE_DISPENSE, 1, 1));
+    ASSERT_TRUE(jobQueue.enqueueJob(JOB_MANUAL_HOME));
+    ASSERT_TRUE(jobQueue.enqueueJob(JOB_MANUAL_DISPENSE, 3, 1));
+
+    const DispenseJobType expectedOrder[] = { JOB_BLE_DISPENSE, JOB_MANUAL_DISPENSE, JOB_MANUAL_HOME, JOB_CALIBRATE };
+    for (int i = 0; i < 4; i++) {
+        DispenseJob job;
+        ASSERT_TRUE(jobQueue.takeNextJob(&job));
+        EXPECT_EQ(expectedOrder[i], job.type);
+    }
+    EXPECT_TRUE(jobQueue.isEmpty());
+}
+
+TEST_F(DispenseJobQueueTest, AbortedScheduledDoseFiresAgainTheNextDay) {
+    DoseDecision decision;
+    ASSERT_TRUE(doseScheduler.getNextDueDose(MORNING + ONE_HOUR, &decision));
+    ASSERT_TRUE(decision.shouldDispense);
+    ASSERT_TRUE(jobQueue.enqueueScheduledDose(decision));
+    ASSERT_TRUE(jobQueue.enqueueJob(JOB_CALIBRATE));
+
+    // ABORT before the dose got to run
+    EXPECT_EQ(2, jobQueue.clearAllJobs(&doseScheduler, MORNING + ONE_HOUR + 5));
+    EXPECT_TRUE(jobQueue.isEmpty());
+    EXPECT_EQ(1UL, doseScheduler.getOutcomeCount(DOSE_FAILED));
+
+    // Nothing more today; the same slot is due again at 08:00 tomorrow
+    EXPECT_FALSE(doseScheduler.getNextDueDose(MORNING + 12 * ONE_HOUR, &decision));
+    EXPECT_EQ(0, doseScheduler.getNextDoseSlot());
+    EXPECT_EQ((long)(DOSE_SCHEDULER_SECONDS_PER_DAY - 5),
+              doseScheduler.getSecondsUntilNextDose(MORNING + ONE_HOUR + 5));
+    ASSERT_TRUE(doseScheduler.getNextDueDose(MORNING + ONE_HOUR + DOSE_SCHEDULER_SECONDS_PER_DAY, &decision));
+    EXPECT_EQ(0, decision.dose.slot);
+    EXPECT_TRUE(decision.shouldDispense);
+    EXPECT_EQ(MORNING + ONE_HOUR + DOSE_SCHEDULER_SECONDS_PER_DAY, decision.dose.dueTime);
+}
+
+TEST_F(DispenseJobQueueTest, ClearingWithoutScheduledDosesRecordsNothing) {
+    ASSERT_TRUE(jobQueue.enqueueJob(JOB_BLE_HOME));
+    EXPECT_EQ(1, jobQueue.clearAllJobs(&doseScheduler, MORNING));
+    EXPECT_EQ(0UL, doseScheduler.getOutcomeCount(DOSE_FAILED));
+    EXPECT_EQ(0, doseScheduler.getNextDoseSlot());
+}
+
+TEST_F(DispenseJobQueueTest, RequeueReportsAPreemptedJobDroppedByAFullQueue) {
+    ASSERT_TRUE(jobQueue.enqueueJob(JOB_CALIBRATE));
+    DispenseJob preemptedJob;
+    ASSERT_TRUE(jobQueue.takeNextJob(&preemptedJob));
+
+    // Dispenses requested while it ran fill every slot
+    for (int i = 0; i < DISPENSE_JOB_QUEUE_CAPACITY; i++) {
+        ASSERT_TRUE(jobQueue.enqueueJob(JOB_BLE_DISPENSE, 1, 1));
+    }
+    EXPECT_FALSE(jobQueue.requeuePreemptedJob(preemptedJob));
+
+    DispenseJob job;
+    ASSERT_TRUE(jobQueue.takeNextJob(&job));
+    EXPECT_TRUE(jobQueue.requeuePreemptedJob(preemptedJob));
+    EXPECT_EQ(DISPENSE_JOB_QUEUE_CAPACITY, jobQueue.getNumberOfQueuedJobs());
+}
+
+TEST_F(DispenseJobQueueTest, ClockSyncWhileADoseWaitsDoesNotQueueItAgain) {
+    DoseDecision decision;
+    ASSERT_TRUE(doseScheduler.getNextDueDose(MORNING + ONE_HOUR, &decision));
+    ASSERT_TRUE(jobQueue.enqueueScheduledDose(decision));
+
+    // The phone reconnects and sends TIME while the dose is still queued
+    doseScheduler.synchronizeClock(MORNING + ONE_HOUR + 10, 0);
+    EXPECT_FALSE(doseScheduler.getNextDueDose(MORNING + ONE_HOUR + 20, &decision));
+
+    DispenseJob job;
+    ASSERT_TRUE(jobQueue.takeNextJob(&job));
+    EXPECT_EQ(DOSE_TAKEN_ON_TIME, doseScheduler.completeScheduledDose(job.doseDecision, 1, MORNING + ONE_HOUR + 30));
+    EXPECT_FALSE(doseScheduler.getNextDueDose(MORNING + ONE_HOUR + 40, &decision));
+
+    // Exactly one dose the next day
+    uint32_t nextDay = MORNING + ONE_HOUR + DOSE_SCHEDULER_SECONDS_PER_DAY;
+    ASSERT_TRUE(doseScheduler.getNextDueDose(nextDay, &decision));
+    doseScheduler.completeScheduledDose(decision, 1, nextDay);
+    EXPECT_FALSE(doseScheduler.getNextDueDose(nextDay + 10, &decision));
+}
+
+TEST_F(DispenseJobQueueTest, EntryReplacedWhileItsDoseWaitsKeepsItsNewerMark) {
+    DoseDecision decision;
+    ASSERT_TRUE(doseScheduler.getNextDueDose(MORNING + ONE_HOUR, &decision));
+
+    // Moved to 08:30 at 09:00: today's 08:30 is already past and must not fire
+    ASSERT_TRUE(doseScheduler.setScheduleEntry(0, 8 * 60 + 30, 2, 1, MISSED_DOSE_ALWAYS_DISPENSE,
+                                               MORNING + 2 * ONE_HOUR));
+    doseScheduler.completeScheduledDose(decision, 1, MORNING + 2 * ONE_HOUR + 10);
+    EXPECT_FALSE(doseScheduler.getNextDueDose(MORNING + 2 * ONE_HOUR + 20, &decision));
+    EXPECT_EQ((long)(DOSE_SCHEDULER_SECONDS_PER_DAY - ONE_HOUR / 2 - 20),
+              doseScheduler.getSecondsUntilNextDose(MORNING + 2 * ONE_HOUR + 20));
+}
@@ -0,0 +1,173 @@
+#include <gtest/gtest.h>
+#include "DispenseJournal.h"
+
+static const size_t SECTOR_SIZE = DISPENSE_JOURNAL_SECTOR_SIZE_BYTES;
+static const size_t RECORD_SIZE = sizeof(DispenseJournalRecord);
+static const size_t HEADER_SIZE = (sizeof(DispenseJournalSectorHeader) + RECORD_SIZE - 1) / RECORD_SIZE * RECORD_SIZE;
+static const int RECORDS_PER_SECTOR = (int)((SECTOR_SIZE - HEADER_SIZE) / RECORD_SIZE);
+
+class DispenseJournalTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        useSectors(4);
+    }
+
+    static void useSectors(int numberOfSectors) {
+        hostPartitionContents().assign(numberOfSectors * SECTOR_SIZE, 0xFF);
+    }
+
+    // Power cycle: a fresh journal recovers from whatever reached flash
+    static uint32_t countAfterReboot(int compartmentNumber, DispenseJournal* rebooted) {
+        EXPECT_TRUE(rebooted->beginAndRecoverCounts());
+        return rebooted->getRecoveredCountForCompartment(compartmentNumber);
+    }
+
+    static void appendAndFlush(DispenseJournal* journal, int numberOfRecords, int compartmentNumber, int pills) {
+        for (int i = 0; i < numberOfRecords; i++) {
+            journal->appendDispenseRecord(compartmentNumber, pills, pills);
+        }
+        ASSERT_TRUE(journal->flushPendingRecords());
+    }
+
+    static void writeSectorHeader(int sectorIndex, uint32_t sequenceNumber, uint32_t countForCompartment1) {
+        DispenseJournalSectorHeader header;
+        memset(&header, 0xFF, sizeof(header));
+        header.magic = DISPENSE_JOURNAL_MAGIC;
+        header.formatVersion = DISPENSE_JOURNAL_FORMAT_VERSION;
+        header.numberOfCompartments = NUMBER_OF_COMPARTMENTS_IN_DISPENSER;
+        header.sectorSequenceNumber = sequenceNumber;
+        memset(header.checkpointCounts, 0, sizeof(header.checkpointCounts));
+        header.checkpointCounts[0] = countForCompartment1;
+        header.checksum = 0;
+        header.checksum = calculateStoredRecordCrc32(&header, sizeof(header));
+        memcpy(hostPartitionContents().data() + sectorIndex * SECTOR_SIZE, &header, sizeof(header));
+    }
+};
+
+TEST_F(DispenseJournalTest, CountsAndResetSurviveAReboot) {
+    DispenseJournal journal;
+    ASSERT_TRUE(journal.beginAndRecoverCounts());
+    appendAndFlush(&journal, 3, 2, 1);
+    appendAndFlush(&journal, 1, 4, 2);
+
+    DispenseJournal rebooted;
+    EXPECT_EQ(3u, countAfterReboot(2, &rebooted));
+    EXPECT_EQ(2u, rebooted.getRecoveredCountForCompartment(4));
+    EXPECT_EQ(4, rebooted.getNumberOfRecoveredRecords());
+
+    rebooted.appendResetRecord();
+    appendAndFlush(&rebooted, 1, 4, 1);
+    DispenseJournal afterReset;
+    EXPECT_EQ(0u, countAfterReboot(2, &afterReset));
+    EXPECT_EQ(1u, afterReset.getRecoveredCountForCompartment(4));
+}
+
+TEST_F(DispenseJournalTest, UnflushedRecordsAreLost) {
+    DispenseJournal journal;
+    ASSERT_TRUE(journal.beginAndRecoverCounts());
+    appendAndFlush(&journal, 2, 1, 1);
+    journal.appendDispenseRecord(1, 1, 1);
+
+    DispenseJournal rebooted;
+    EXPECT_EQ(2u, countAfterReboot(1, &rebooted));
+}
+
+TEST_F(DispenseJournalTest, TornRecordIsSkippedAndLaterRecordsStillCount) {
+    DispenseJournal journal;
+    ASSERT_TRUE(journal.beginAndRecoverCounts());
+    appendAndFlush(&journal, 3, 1, 1);
+
+    // Power lost while the second record was programmed: some bits never cleared
+    DispenseJournalRecord torn;
+    size_t secondRecord = HEADER_SIZE + RECORD_SIZE;
+    memcpy(&torn, hostPartitionContents().data() + secondRecord, sizeof(torn));
+    torn.pillsDispensed = 0xFF;
+    memcpy(hostPartitionContents().data() + secondRecord, &torn, sizeof(torn));
+
+    DispenseJournal rebooted;
+    EXPECT_EQ(2u, countAfterReboot(1, &rebooted));
+    EXPECT_EQ(1, rebooted.getNumberOfSkippedRecords());
+
+    // New records go after the torn one, not over it
+    appendAndFlush(&rebooted, 1, 1, 1);
+    DispenseJournal again;
+    EXPECT_EQ(3u, countAfterReboot(1, &again));
+}
+
+TEST_F(DispenseJournalTest, FlushThatCrossesASectorRotatesWithACheckpoint) {
+    DispenseJournal journal;
+    ASSERT_TRUE(journal.beginAndRecoverCounts());
+    appendAndFlush(&journal, RECORDS_PER_SECTOR - 3, 3, 1);
+    EXPECT_EQ(0, journal.getCurrentSectorIndex());
+
+    // One batch: 3 records fill sector 0, the other 5 start sector 1
+    appendAndFlush(&journal, 8, 3, 1);
+    EXPECT_EQ(1, journal.getCurrentSectorIndex());
+
+    DispenseJournal rebooted;
+    EXPECT_EQ((uint32_t)RECORDS_PER_SECTOR + 5, countAfterReboot(3, &rebooted));
+    EXPECT_EQ(1, rebooted.getCurrentSectorIndex());
+    EXPECT_EQ(5, rebooted.getNumberOfRecoveredRecords());   // Only the newest sector is replayed
+}
+
+TEST_F(DispenseJournalTest, FullSectorRecoversAndRotatesOnTheNextFlush) {
+    DispenseJournal journal;
+    ASSERT_TRUE(journal.beginAndRecoverCounts());
+    appendAndFlush(&journal, RECORDS_PER_SECTOR, 5, 1);
+    EXPECT_EQ(0, journal.getCurrentSectorIndex());
+
+    DispenseJournal rebooted;
+    EXPECT_EQ((uint32_t)RECORDS_PER_SECTOR, countAfterReboot(5, &rebooted));
+    appendAndFlush(&rebooted, 1, 5, 1);
+    EXPECT_EQ(1, rebooted.getCurrentSectorIndex());
+
+    DispenseJournal again;
+    EXPECT_EQ((uint32_t)RECORDS_PER_SECTOR + 1, countAfterReboot(5, &again));
+}
+
+TEST_F(DispenseJournalTest, TornCheckpointFallsBackToThePreviousSector) {
+    DispenseJournal journal;
+    ASSERT_TRUE(journal.beginAndRecoverCounts());
+    appendAndFlush(&journal, RECORDS_PER_SECTOR, 1, 1);
+    appendAndFlush(&journal, 1, 1, 1);
+    ASSERT_EQ(1, journal.getCurrentSectorIndex());
+
+    // Power lost while the new sector's header was written
+    hostPartitionContents()[SECTOR_SIZE + offsetof(DispenseJournalSectorHeader, checkpointCounts)] = 0;
+
+    DispenseJournal rebooted;
+    EXPECT_EQ((uint32_t)RECORDS_PER_SECTOR, countAfterReboot(1, &rebooted));
+    EXPECT_EQ(0, rebooted.getCurrentSectorIndex());
+}
+
+TEST_F(DispenseJournalTest, SectorsAreReusedRoundRobin) {
+    useSectors(2);
+    DispenseJournal journal;
+    ASSERT_TRUE(journal.beginAndRecoverCounts());
+    for (int sector = 0; sector < 5; sector++) {
+        appendAndFlush(&journal, RECORDS_PER_SECTOR, 2, 1);
+        journal.serviceJournal();
+    }
+    appendAndFlush(&journal, 1, 2, 1);
+    EXPECT_EQ(1, journal.getCurrentSectorIndex());
+
+    DispenseJournal rebooted;
+    EXPECT_EQ((uint32_t)(5 * RECORDS_PER_SECTOR + 1), countAfterReboot(2, &rebooted));
+}
+
+TEST_F(DispenseJournalTest, NewestSectorIsFoundAcrossASequenceWrap) {
+    writeSectorHeader(0, 0xFFFFFFFEUL, 10);
+    writeSectorHeader(1, 0xFFFFFFFFUL, 20);
+    writeSectorHeader(2, 0, 30);            // Wrapped: newest
+    writeSectorHeader(3, 0xFFFFFFFDUL, 5);
+
+    DispenseJournal journal;
+    EXPECT_EQ(30u, countAfterReboot(1, &journal));
+    EXPECT_EQ(2, journal.getCurrentSectorIndex());
+
+    // The next rotation continues the sequence in sector 3
+    appendAndFlush(&journal, RECORDS_PER_SECTOR + 1, 1, 1);
+    EXPECT_EQ(3, journal.getCurrentSectorIndex());
+    DispenseJournal rebooted;
+    EXPECT_EQ((uint32_t)(30 + RECORDS_PER_SECTOR + 1), countAfterReboot(1, &rebooted));
+}
@@ -0,0 +1,92 @@
+#include <gtest/gtest.h>
+#include <Arduino.h>
+#include "DispenseSimulator.h"
+
+class DispenseSimulatorTest : public ::testing::Test {
+protected:
+    SystemConfiguration systemConfig;
+    DispenseSimulator simulator;
+
+    DispenseSimulatorTest() : simulator(&systemConfig) {}
+};
+
+TEST_F(DispenseSimulatorTest, SlicedRunMatchesOneShotRun) {
+    simulator.setRandomSeed(7);
+    simulator.configureSyntheticDoseSchedule(500, 60, 2);
+    int completedInOneShot = simulator.runSimulation();
+    unsigned long p99InOneShot = simulator.getLatencyPercentileMilliseconds(99);
+    unsigned long busyInOneShot = simulator.getTotalBusyMilliseconds();
+
+    simulator.setRandomSeed(7);
+    simulator.beginSimulation();
+    int numberOfSlices = 0;
+    while (simulator.runSimulationSlice(50)) {
+        numberOfSlices++;
+    }
+
+    EXPECT_GT(numberOfSlices, 10);
+    EXPECT_EQ(completedInOneShot, simulator.getCompletedDoseCount());
+    EXPECT_EQ(p99InOneShot, simulator.getLatencyPercentileMilliseconds(99));
+    EXPECT_EQ(busyInOneShot, simulator.getTotalBusyMilliseconds());
+}
+
+TEST_F(DispenseSimulatorTest, DoseCountIsClamped) {
+    simulator.configureSyntheticDoseSchedule(SIMULATOR_MAXIMUM_SYNTHETIC_DOSES * 10, 60, 1);
+    EXPECT_EQ(SIMULATOR_MAXIMUM_SYNTHETIC_DOSES, simulator.getSyntheticDoseCount());
+}
+
+TEST_F(DispenseSimulatorTest, PercentilesCoverDosesAfterTheFirstRecorded) {
+    // Doses far apart never queue, and a pill that never releases makes every
+    // dose take the same time; a wider IR window from dose 300 on only shows
+    // up if doses after the first 256 are sampled
+    SimulatedDoseRequest doses[1000];
+    for (int i = 0; i < 1000; i++) {
+        doses[i].arrivalTimeMilliseconds = (unsigned long)i * 600000UL;
+        doses[i].compartmentNumber = 1;
+        doses[i].pillCount = 1;
+    }
+    DispenserBehaviourModel neverReleases;
+    for (int i = 0; i < NUMBER_OF_COMPARTMENTS_IN_DISPENSER; i++) {
+        neverReleases.pillReleaseProbabilityForCompartment[i] = 0;
+    }
+    simulator.setBehaviourModel(neverReleases);
+
+    int shortTimeout = systemConfig.pillDetectionTimeoutMilliseconds;
+    simulator.configureRecordedDoseSchedule(doses, 300);
+    simulator.runSimulation();
+    unsigned long shortDoseLatency = simulator.getLatencyPercentileMilliseconds(50);
+
+    systemConfig.pillDetectionTimeoutMilliseconds = shortTimeout + 5000;
+    simulator.configureRecordedDoseSchedule(doses, 300);
+    simulator.runSimulation();
+    unsigned long longDoseLatency = simulator.getLatencyPercentileMilliseconds(50);
+    ASSERT_GT(longDoseLatency, shortDoseLatency);
+
+    // Mixed run: 300 short doses, then 700 long ones
+    systemConfig.pillDetectionTimeoutMilliseconds = shortTimeout;
+    simulator.configureRecordedDoseSchedule(doses, 1000);
+    simulator.beginSimulation();
+    while (simulator.isSimulationRunning()) {
+        if (simulator.getCompletedDoseCount() == 300) {
+            systemConfig.pillDetectionTimeoutMilliseconds = shortTimeout + 5000;
+        }
+        simulator.runSimulationSlice(1);
+    }
+    EXPECT_EQ(1000, simulator.getCompletedDoseCount());
+    EXPECT_EQ(longDoseLatency, simulator.getLatencyPercentileMilliseconds(50));
+    EXPECT_EQ(longDoseLatency, simulator.getLatencyPercentileMilliseconds(100));
+}
+
+TEST_F(DispenseSimulatorTest, DroppedDosesAreReported) {
+    simulator.configureSyntheticDoseSchedule(300, 100000, 1);
+    simulator.runSimulation();
+    ASSERT_GT(simulator.getDroppedDoseCount(), 0);
+    EXPECT_EQ(300, simulator.getCompletedDoseCount() + simulator.getDroppedDoseCount());
+
+    struct CapturedOutput : public Print {
+        std::string text;
+        size_t write(uint8_t c) override { text += (char)c; return 1; }
+    } output;
+    simulator.printSimulationReport(output);
+    EXPECT_NE(std::string::npos, output.text.find("WARNING: " + std::to_string(simulator.getDroppedDoseCount())));
+}
@@ -0,0 +1,106 @@
+#include <gtest/gtest.h>
+#include "DispenseStatistics.h"
+
+// Tue 2023-11-14 07:00 UTC
+static const uint32_t MORNING = 1699945200UL;
+static const uint32_t ONE_HOUR = DISPENSE_STATISTICS_SECONDS_PER_HOUR;
+static const uint32_t ONE_DAY = DOSE_SCHEDULER_SECONDS_PER_DAY;
+
+class DispenseStatisticsTest : public ::testing::Test {
+protected:
+    SystemConfiguration systemConfig;
+    DoseScheduler doseScheduler;
+    DispenseStatistics dispenseStatistics;
+
+    DispenseStatisticsTest() : doseScheduler(&systemConfig), dispenseStatistics(&doseScheduler) {}
+
+    void SetUp() override {
+        hostNvs().clear();
+        doseScheduler.beginAndLoadSchedule();
+        doseScheduler.synchronizeClock(MORNING, 0);
+    }
+};
+
+TEST_F(DispenseStatisticsTest, OutcomesAreClassified) {
+    dispenseStatistics.recordDispenseOutcome(1, 2, 2, 3, MORNING);     // Full, one retry
+    dispenseStatistics.recordDispenseOutcome(1, 3, 1, 5, MORNING);     // Partial
+    dispenseStatistics.recordDispenseOutcome(2, 1, 0, 3, MORNING);     // Failed
+
+    EXPECT_EQ(3u, dispenseStatistics.getTotalPillsDispensed());
+    EXPECT_EQ(3u, dispenseStatistics.getTotalRequests());
+    EXPECT_EQ(1u, dispenseStatistics.getTotalFullyServedRequests());
+    EXPECT_EQ(1u, dispenseStatistics.getTotalPartialRequests());
+    EXPECT_EQ(1u, dispenseStatistics.getTotalFailedRequests());
+    EXPECT_EQ(11u, dispenseStatistics.getTotalAttempts());
+    EXPECT_EQ(5u, dispenseStatistics.getTotalRetries());
+    EXPECT_EQ(3u, dispenseStatistics.getPillsDispensedForCompartment(1));
+    EXPECT_EQ(1u, dispenseStatistics.getFailedRequestsForCompartment(2));
+    EXPECT_NEAR(100.0 / 3, dispenseStatistics.getSuccessRatePercent(), 0.01);
+}
+
+TEST_F(DispenseStatisticsTest, SeededCountIsReplacedNotAdded) {
+    dispenseStatistics.seedCompartmentPillCount(3, 40);
+    dispenseStatistics.seedCompartmentPillCount(3, 25);
+    dispenseStatistics.recordDispenseOutcome(3, 1, 1, 1, MORNING);
+    EXPECT_EQ(26u, dispenseStatistics.getPillsDispensedForCompartment(3));
+    EXPECT_EQ(26u, dispenseStatistics.getTotalPillsDispensed());
+}
+
+TEST_F(DispenseStatisticsTest, HourlyBucketsRollOver) {
+    dispenseStatistics.recordDispenseOutcome(1, 1, 1, 1, MORNING);
+    dispenseStatistics.recordDispenseOutcome(1, 2, 2, 2, MORNING + ONE_HOUR - 1);
+    dispenseStatistics.recordDispenseOutcome(1, 1, 1, 1, MORNING + 3 * ONE_HOUR);
+
+    uint32_t now = MORNING + 3 * ONE_HOUR;
+    EXPECT_EQ(1u, dispenseStatistics.getHourlyBucket(now, 0).pillsDispensed);
+    EXPECT_EQ(0u, dispenseStatistics.getHourlyBucket(now, 1).numberOfRequests);
+    EXPECT_EQ(3u, dispenseStatistics.getHourlyBucket(now, 3).pillsDispensed);
+    EXPECT_EQ(2u, dispenseStatistics.getHourlyBucket(now, 3).numberOfRequests);
+
+    // 24 hours on, the 07:00 bucket slot is reused and the old hour reads empty
+    dispenseStatistics.recordDispenseOutcome(2, 1, 1, 1, MORNING + ONE_DAY);
+    now = MORNING + ONE_DAY;
+    EXPECT_EQ(1u, dispenseStatistics.getHourlyBucket(now, 0).pillsDispensed);
+    EXPECT_EQ(1u, dispenseStatistics.getHourlyBucket(now, 21).pillsDispensed);
+
+    // Nothing recorded for a day: every hour has aged out
+    uint32_t pillCounts[DISPENSE_STATISTICS_HOURLY_BUCKETS];
+    dispenseStatistics.getHourlyPillCounts(now + 2 * ONE_DAY, pillCounts);
+    for (int age = 0; age < DISPENSE_STATISTICS_HOURLY_BUCKETS; age++) {
+        EXPECT_EQ(0u, pillCounts[age]);
+    }
+}
+
+TEST_F(DispenseStatisticsTest, DailyBucketsRollOver) {
+    for (int day = 0; day < DISPENSE_STATISTICS_DAILY_BUCKETS + 2; day++) {
+        dispenseStatistics.recordDispenseOutcome(1, day + 1, day + 1, day + 1, MORNING + day * ONE_DAY);
+    }
+
+    uint32_t now = MORNING + (DISPENSE_STATISTICS_DAILY_BUCKETS + 1) * ONE_DAY;
+    uint32_t pillCounts[DISPENSE_STATISTICS_DAILY_BUCKETS];
+    dispenseStatistics.getDailyPillCounts(now, pillCounts);
+    for (int age = 0; age < DISPENSE_STATISTICS_DAILY_BUCKETS; age++) {
+        EXPECT_EQ((uint32_t)(DISPENSE_STATISTICS_DAILY_BUCKETS + 2 - age), pillCounts[age]);
+    }
+    // Past the window
+    EXPECT_EQ(0u, dispenseStatistics.getDailyBucket(now, DISPENSE_STATISTICS_DAILY_BUCKETS).numberOfRequests);
+}
+
+TEST_F(DispenseStatisticsTest, DaysFollowLocalMidnight) {
+    // UTC-8: 07:00 UTC is 23:00 the previous local day
+    doseScheduler.synchronizeClock(MORNING, -480);
+    dispenseStatistics.recordDispenseOutcome(1, 1, 1, 1, MORNING);
+    dispenseStatistics.recordDispenseOutcome(1, 1, 1, 1, MORNING + ONE_HOUR);
+
+    uint32_t now = MORNING + ONE_HOUR;
+    EXPECT_EQ(1u, dispenseStatistics.getDailyBucket(now, 0).pillsDispensed);
+    EXPECT_EQ(1u, dispenseStatistics.getDailyBucket(now, 1).pillsDispensed);
+}
+
+TEST_F(DispenseStatisticsTest, BucketCountersSaturate) {
+    for (int i = 0; i < 40; i++) {
+        dispenseStatistics.recordDispenseOutcome(1, 2000, 2000, 2000, MORNING);
+    }
+    EXPECT_EQ(0xFFFFu, dispenseStatistics.getHourlyBucket(MORNING, 0).pillsDispensed);
+    EXPECT_EQ(80000u, dispenseStatistics.getTotalPillsDispensed());
+}
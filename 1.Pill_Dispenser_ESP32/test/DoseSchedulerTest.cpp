@@ -0,0 +1,107 @@
+#include <gtest/gtest.h>
+#include "DoseScheduler.h"
+
+// Tue 2023-11-14 07:00 UTC
+static const uint32_t MORNING = 1699945200UL;
+static const uint32_t ONE_HOUR = 3600UL;
+static const uint32_t ONE_DAY = DOSE_SCHEDULER_SECONDS_PER_DAY;
+
+class DoseSchedulerTest : public ::testing::Test {
+protected:
+    SystemConfiguration systemConfig;
+    DoseScheduler doseScheduler;
+
+    DoseSchedulerTest() : doseScheduler(&systemConfig) {}
+
+    void SetUp() override {
+        hostNvs().clear();
+        doseScheduler.beginAndLoadSchedule();
+        doseScheduler.synchronizeClock(MORNING, 0);
+    }
+
+    // Power cycle, then the phone sends TIME
+    void rebootAt(DoseScheduler* rebooted, uint32_t now) {
+        rebooted->beginAndLoadSchedule();
+        rebooted->synchronizeClock(now, doseScheduler.getUtcOffsetMinutes());
+    }
+};
+
+TEST_F(DoseSchedulerTest, DosesFireInDueTimeOrder) {
+    ASSERT_TRUE(doseScheduler.setScheduleEntry(0, 9 * 60, 1, 1, MISSED_DOSE_DISPENSE_WITHIN_GRACE, MORNING));
+    ASSERT_TRUE(doseScheduler.setScheduleEntry(1, 8 * 60, 2, 1, MISSED_DOSE_DISPENSE_WITHIN_GRACE, MORNING));
+    ASSERT_TRUE(doseScheduler.setScheduleEntry(2, 8 * 60 + 30, 3, 1, MISSED_DOSE_DISPENSE_WITHIN_GRACE, MORNING));
+
+    const int expectedSlots[] = { 1, 2, 0 };
+    for (int i = 0; i < 3; i++) {
+        DoseDecision decision;
+        ASSERT_TRUE(doseScheduler.getNextDueDose(MORNING + 2 * ONE_HOUR, &decision));
+        EXPECT_EQ(expectedSlots[i], decision.dose.slot);
+        doseScheduler.completeScheduledDose(decision, 1, MORNING + 2 * ONE_HOUR);
+    }
+    DoseDecision decision;
+    EXPECT_FALSE(doseScheduler.getNextDueDose(MORNING + 2 * ONE_HOUR, &decision));
+}
+
+TEST_F(DoseSchedulerTest, LateDoseFollowsItsPolicy) {
+    ASSERT_TRUE(doseScheduler.setScheduleEntry(0, 8 * 60, 1, 1, MISSED_DOSE_DISPENSE_WITHIN_GRACE, MORNING));
+    ASSERT_TRUE(doseScheduler.setScheduleEntry(1, 8 * 60, 2, 1, MISSED_DOSE_SKIP_IF_LATE, MORNING));
+    ASSERT_TRUE(doseScheduler.setScheduleEntry(2, 8 * 60, 3, 1, MISSED_DOSE_ALWAYS_DISPENSE, MORNING));
+
+    // 08:30: within the 60 min grace, past the 2 min tolerance
+    uint32_t now = MORNING + ONE_HOUR + 30 * 60;
+    for (int i = 0; i < 3; i++) {
+        DoseDecision decision;
+        ASSERT_TRUE(doseScheduler.getNextDueDose(now, &decision));
+        EXPECT_EQ(30L * 60, decision.secondsLate);
+        EXPECT_EQ(decision.dose.slot != 1, decision.shouldDispense);
+        if (decision.shouldDispense) {
+            EXPECT_EQ(DOSE_TAKEN_LATE, doseScheduler.completeScheduledDose(decision, 1, now));
+        }
+    }
+    EXPECT_EQ(1UL, doseScheduler.getOutcomeCount(DOSE_MISSED));
+    EXPECT_EQ(2UL, doseScheduler.getOutcomeCount(DOSE_TAKEN_LATE));
+}
+
+TEST_F(DoseSchedulerTest, LongOutageCatchesUpOnlyTheLatestOccurrence) {
+    ASSERT_TRUE(doseScheduler.setScheduleEntry(0, 8 * 60, 1, 1, MISSED_DOSE_ALWAYS_DISPENSE, MORNING));
+
+    // Off for three days, back at 09:00
+    DoseScheduler rebooted(&systemConfig);
+    uint32_t now = MORNING + 3 * ONE_DAY + 2 * ONE_HOUR;
+    rebootAt(&rebooted, now);
+
+    DoseDecision decision;
+    ASSERT_TRUE(rebooted.getNextDueDose(now, &decision));
+    EXPECT_TRUE(decision.shouldDispense);
+    EXPECT_EQ(MORNING + 3 * ONE_DAY + ONE_HOUR, decision.dose.dueTime);
+    rebooted.completeScheduledDose(decision, 1, now);
+    EXPECT_FALSE(rebooted.getNextDueDose(now, &decision));
+}
+
+TEST_F(DoseSchedulerTest, HandledDoseIsNotRepeatedAfterAReboot) {
+    ASSERT_TRUE(doseScheduler.setScheduleEntry(0, 8 * 60, 1, 1, MISSED_DOSE_ALWAYS_DISPENSE, MORNING));
+    DoseDecision decision;
+    ASSERT_TRUE(doseScheduler.getNextDueDose(MORNING + ONE_HOUR, &decision));
+    doseScheduler.completeScheduledDose(decision, 1, MORNING + ONE_HOUR);
+
+    DoseScheduler rebooted(&systemConfig);
+    rebootAt(&rebooted, MORNING + 2 * ONE_HOUR);
+    EXPECT_EQ(1, rebooted.getNumberOfEnabledEntries());
+    EXPECT_FALSE(rebooted.getNextDueDose(MORNING + 2 * ONE_HOUR, &decision));
+    EXPECT_EQ(MORNING + ONE_DAY + ONE_HOUR, rebooted.getNextDoseDueTime());
+}
+
+TEST_F(DoseSchedulerTest, MinuteOfDayIsLocalTime) {
+    // UTC+2: 08:00 local is 06:00 UTC, so tomorrow's dose is next
+    doseScheduler.synchronizeClock(MORNING, 120);
+    ASSERT_TRUE(doseScheduler.setScheduleEntry(0, 8 * 60, 1, 1, MISSED_DOSE_DISPENSE_WITHIN_GRACE, MORNING));
+    EXPECT_EQ(MORNING - ONE_HOUR + ONE_DAY, doseScheduler.getNextDoseDueTime());
+}
+
+TEST_F(DoseSchedulerTest, DeletedEntryNeverFires) {
+    ASSERT_TRUE(doseScheduler.setScheduleEntry(0, 8 * 60, 1, 1, MISSED_DOSE_DISPENSE_WITHIN_GRACE, MORNING));
+    ASSERT_TRUE(doseScheduler.deleteScheduleEntry(0, MORNING + 60));
+    DoseDecision decision;
+    EXPECT_FALSE(doseScheduler.getNextDueDose(MORNING + ONE_HOUR, &decision));
+    EXPECT_EQ(-1, doseScheduler.getNextDoseSlot());
+}
@@ -0,0 +1,29 @@
+#include <gtest/gtest.h>
+#include "DispenserController.h"
+
+// USE_COMPILE_TIME_CONFIGURATION=1 builds these on the ESP32; instantiate
+// every member here so the compile-time path keeps building on the host too
+template class BasicHardwareController<FixedSystemConfiguration>;
+template class BasicSensorManager<FixedSystemConfiguration>;
+template class BasicDispenserController<FixedSystemConfiguration>;
+
+class FixedConfigurationControllersTest : public ::testing::Test {
+protected:
+    SystemConfiguration runtimeConfig;
+    FixedSystemConfiguration fixedConfig;
+    BasicHardwareController<SystemConfiguration> runtimeHardware;
+    BasicHardwareController<FixedSystemConfiguration> fixedHardware;
+    BasicSensorManager<FixedSystemConfiguration> fixedSensors;
+    BasicDispenserController<FixedSystemConfiguration> fixedDispenser;
+
+    FixedConfigurationControllersTest()
+        : runtimeHardware(&runtimeConfig), fixedHardware(&fixedConfig), fixedSensors(&fixedConfig),
+          fixedDispenser(&fixedConfig, &fixedHardware, &fixedSensors) {}
+};
+
+TEST_F(FixedConfigurationControllersTest, MatchesTheDefaultRuntimeConfiguration) {
+    EXPECT_EQ(runtimeHardware.calculateStepsForAngle(360.0), fixedHardware.calculateStepsForAngle(360.0));
+    EXPECT_EQ(runtimeHardware.calculateStepsForAngle(72.0), fixedHardware.calculateStepsForAngle(72.0));
+    EXPECT_EQ(runtimeHardware.getServoMinSafe(), fixedHardware.getServoMinSafe());
+    EXPECT_EQ(runtimeHardware.getServoMaxSafe(), fixedHardware.getServoMaxSafe());
+}
@@ -0,0 +1,27 @@
+#include <gtest/gtest.h>
+#include "HardwareController.h"
+
+// Library Manager ESP32Servo: no attach overload with an initial pulse
+struct UpstreamServo {
+    int attachedMinimum = 0;
+    int attachedMaximum = 0;
+    int attach(int, int minimum, int maximum) {
+        attachedMinimum = minimum;
+        attachedMaximum = maximum;
+        return 3;
+    }
+};
+
+TEST(ServoAttach, BundledLibraryAttachesAtTheInitialPulse) {
+    Servo servo;
+    EXPECT_EQ(0, attachServoWithInitialPulse(servo, PIN_FOR_SERVO_MOTOR_SIGNAL, 150, 2100, 900, 0));
+    EXPECT_EQ(PIN_FOR_SERVO_MOTOR_SIGNAL, servo.attachedPin);
+    EXPECT_EQ(900, servo.attachedInitialMicroseconds);
+}
+
+TEST(ServoAttach, UpstreamLibraryFallsBackToThreeArgumentAttach) {
+    UpstreamServo servo;
+    EXPECT_EQ(3, attachServoWithInitialPulse(servo, PIN_FOR_SERVO_MOTOR_SIGNAL, 150, 2100, 900, 0));
+    EXPECT_EQ(150, servo.attachedMinimum);
+    EXPECT_EQ(2100, servo.attachedMaximum);
+}
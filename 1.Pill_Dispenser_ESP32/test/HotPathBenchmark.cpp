@@ -0,0 +1,33 @@
+// Google Benchmark runner for the HotPathBenchmarks cases.
+// Same case bodies as the BENCH command on the ESP32, timed on the host CPU:
+// useful for comparing commits, not for absolute numbers on the device.
+#include <benchmark/benchmark.h>
+#include "HotPathBenchmarks.h"
+
+namespace {
+
+SystemConfiguration benchmarkConfiguration;
+
+void runHotPathCase(benchmark::State& state, int caseIndex) {
+    static HotPathBenchmarks benchmarks(&benchmarkConfiguration);
+    unsigned long iteration = 0;
+    for (auto _ : state) {
+        benchmarks.runCaseIteration(caseIndex, iteration++);
+    }
+    benchmark::DoNotOptimize(benchmarks.getBenchmarkSink());
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    for (int i = 0; i < HotPathBenchmarks::getNumberOfCases(); i++) {
+        benchmark::RegisterBenchmark(HotPathBenchmarks::getCaseName(i), runHotPathCase, i);
+    }
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+        return 1;
+    }
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -0,0 +1,97 @@
+#include <gtest/gtest.h>
+#include "PillInventory.h"
+
+// Tue 2023-11-14 07:00 UTC
+static const uint32_t MORNING = 1699945200UL;
+
+class PillInventoryTest : public ::testing::Test {
+protected:
+    SystemConfiguration systemConfig;
+    DoseScheduler doseScheduler;
+    PillInventory inventory;
+
+    PillInventoryTest() : doseScheduler(&systemConfig), inventory(&systemConfig, &doseScheduler) {}
+
+    void SetUp() override {
+        hostNvs().clear();
+        doseScheduler.beginAndLoadSchedule();
+        inventory.beginAndLoadInventory();
+    }
+};
+
+TEST_F(PillInventoryTest, DetectedPillsEmptyACompartment) {
+    inventory.synchronizeDispenseCount(2, 40);
+    ASSERT_TRUE(inventory.setFillLevel(2, 3, MORNING));
+    EXPECT_EQ(3, inventory.getRemainingPills(2));
+
+    inventory.recordPillsRemoved(2, 2);
+    EXPECT_EQ(1, inventory.getRemainingPills(2));
+    EXPECT_FALSE(inventory.isCompartmentKnownEmpty(2));
+    inventory.recordPillsRemoved(2, 5);
+    EXPECT_EQ(0, inventory.getRemainingPills(2));
+    EXPECT_TRUE(inventory.isCompartmentKnownEmpty(2));
+
+    EXPECT_EQ(PILL_INVENTORY_UNTRACKED, inventory.getRemainingPills(1));
+    EXPECT_FALSE(inventory.isCompartmentKnownEmpty(1));
+}
+
+TEST_F(PillInventoryTest, FillLevelSurvivesARebootWithTheJournalCount) {
+    inventory.synchronizeDispenseCount(3, 100);
+    ASSERT_TRUE(inventory.setFillLevel(3, 30, MORNING));
+    inventory.recordPillsRemoved(3, 4);
+
+    // The journal recovered 104 at boot
+    PillInventory rebooted(&systemConfig, &doseScheduler);
+    EXPECT_EQ(1, rebooted.beginAndLoadInventory());
+    rebooted.synchronizeDispenseCount(3, 104);
+    EXPECT_EQ(26, rebooted.getRemainingPills(3));
+}
+
+TEST_F(PillInventoryTest, ResetKeepsTheStockLevel) {
+    inventory.synchronizeDispenseCount(1, 50);
+    ASSERT_TRUE(inventory.setFillLevel(1, 20, MORNING));
+    inventory.recordPillsRemoved(1, 5);
+    inventory.rebaseAfterDispenseCountReset();
+    EXPECT_EQ(15, inventory.getRemainingPills(1));
+
+    PillInventory rebooted(&systemConfig, &doseScheduler);
+    rebooted.beginAndLoadInventory();
+    rebooted.synchronizeDispenseCount(1, 0);
+    EXPECT_EQ(15, rebooted.getRemainingPills(1));
+}
+
+TEST_F(PillInventoryTest, CountBelowTheBaselineNeverReadsEmpty) {
+    // Reset reached the journal but the baselines were not re-based
+    inventory.synchronizeDispenseCount(1, 50);
+    ASSERT_TRUE(inventory.setFillLevel(1, 20, MORNING));
+
+    PillInventory rebooted(&systemConfig, &doseScheduler);
+    rebooted.beginAndLoadInventory();
+    rebooted.synchronizeDispenseCount(1, 2);
+    EXPECT_EQ(20, rebooted.getRemainingPills(1));
+    EXPECT_FALSE(rebooted.isCompartmentKnownEmpty(1));
+}
+
+TEST_F(PillInventoryTest, LowStockIsReportedOncePerRefill) {
+    // 2 pills a day from compartment 4, 5 left: under 3 days
+    ASSERT_TRUE(doseScheduler.setScheduleEntry(0, 8 * 60, 4, 2, MISSED_DOSE_DISPENSE_WITHIN_GRACE, MORNING));
+    ASSERT_TRUE(inventory.setFillLevel(4, 20, MORNING));
+    EXPECT_EQ(0, inventory.takeLowStockAlert(MORNING));
+    EXPECT_FLOAT_EQ(10.0f, inventory.getPredictedDaysUntilEmpty(4, MORNING));
+
+    inventory.recordPillsRemoved(4, 15);
+    EXPECT_EQ(4, inventory.takeLowStockAlert(MORNING));
+    EXPECT_EQ(0, inventory.takeLowStockAlert(MORNING));
+
+    ASSERT_TRUE(inventory.setFillLevel(4, 6, MORNING));
+    EXPECT_EQ(4, inventory.takeLowStockAlert(MORNING));
+}
+
+TEST_F(PillInventoryTest, UnscheduledCompartmentUsesTheObservedRate) {
+    ASSERT_TRUE(inventory.setFillLevel(5, 40, MORNING));
+    inventory.recordPillsRemoved(5, 2);
+    EXPECT_FLOAT_EQ(0.0f, inventory.getPillsPerDay(5, MORNING + 3600));     // Too little history
+
+    EXPECT_FLOAT_EQ(4.0f, inventory.getPillsPerDay(5, MORNING + DOSE_SCHEDULER_SECONDS_PER_DAY / 2));
+    EXPECT_FLOAT_EQ(9.5f, inventory.getPredictedDaysUntilEmpty(5, MORNING + DOSE_SCHEDULER_SECONDS_PER_DAY / 2));
+}
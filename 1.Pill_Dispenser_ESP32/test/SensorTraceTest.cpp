@@ -0,0 +1,144 @@
+#include <gtest/gtest.h>
+#include <Arduino.h>
+#include <string>
+#include <sstream>
+#include "SensorManager.h"
+
+// Collects what printTraceAsHex writes
+class TextCapture : public Print {
+public:
+    std::string text;
+    size_t write(uint8_t value) override {
+        text += (char)value;
+        return 1;
+    }
+};
+
+static void setSensorPin(int pin, int level) {
+    hostPinLevels[pin & 63] = level;
+}
+
+/**
+ * Feed a TRACE:DUMP printout back in TRACE:LOAD chunks (one line each)
+ * @return false if a chunk was rejected
+ */
+static bool loadDumpedTrace(const std::string& dump, SensorTrace* trace) {
+    std::istringstream lines(dump);
+    std::string line;
+    size_t offset = 0;
+    while (std::getline(lines, line)) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (line.empty() || line.rfind("TRACE", 0) == 0) {
+            continue;
+        }
+        uint8_t chunk[SENSOR_TRACE_LOAD_CHUNK_BYTES];
+        size_t length = line.size() / 2;
+        if (length > sizeof(chunk)) {
+            return false;
+        }
+        for (size_t i = 0; i < length; i++) {
+            chunk[i] = (uint8_t)std::stoi(line.substr(2 * i, 2), nullptr, 16);
+        }
+        if (!trace->loadTraceChunk(offset, chunk, length)) {
+            return false;
+        }
+        offset += length;
+    }
+    return true;
+}
+
+class SensorTraceTest : public ::testing::Test {
+protected:
+    SystemConfiguration systemConfig;
+    SensorTrace recordedTrace;
+    SensorTrace loadedTrace;
+    SensorManager recorder;
+    SensorManager replayer;
+
+    SensorTraceTest() : recorder(&systemConfig), replayer(&systemConfig) {}
+
+    void SetUp() override {
+        setSensorPin(PIN_FOR_HOME_POSITION_SWITCH, HIGH);
+        setSensorPin(PIN_FOR_INFRARED_PILL_DETECTOR, HIGH);
+        setSensorPin(PIN_FOR_ENCODER_CHANNEL_1, HIGH);
+        setSensorPin(PIN_FOR_ENCODER_CHANNEL_2, HIGH);
+        hostMicroseconds = 1000000ULL;
+    }
+
+    // A dispense: sync marker, pill in the IR beam for 2.5 ms, one encoder edge
+    void recordDispense() {
+        recorder.attachSensorTrace(&recordedTrace);
+        ASSERT_TRUE(recorder.startSensorTraceRecording());
+        advanceHostClockMicroseconds(5000);
+        recorder.markTraceSynchronizationPoint();
+
+        advanceHostClockMicroseconds(1500);
+        setSensorPin(PIN_FOR_INFRARED_PILL_DETECTOR, LOW);
+        recorder.handleInfraredSensorInterrupt();
+        advanceHostClockMicroseconds(2500);
+        setSensorPin(PIN_FOR_INFRARED_PILL_DETECTOR, HIGH);
+        recorder.handleInfraredSensorInterrupt();
+        advanceHostClockMicroseconds(300);
+        setSensorPin(PIN_FOR_ENCODER_CHANNEL_1, LOW);
+        recorder.handleEncoderInterrupt();
+        recorder.stopSensorTrace();
+    }
+};
+
+TEST_F(SensorTraceTest, DumpedTraceReplaysWithTheRecordedTiming) {
+    recordDispense();
+
+    TextCapture dump;
+    recordedTrace.printTraceAsHex(dump);
+    ASSERT_TRUE(loadDumpedTrace(dump.text, &loadedTrace));
+    ASSERT_EQ(recordedTrace.getTraceLength(), loadedTrace.getTraceLength());
+    EXPECT_EQ(0, memcmp(recordedTrace.getTraceBytes(), loadedTrace.getTraceBytes(), loadedTrace.getTraceLength()));
+
+    // Live pins now disagree with the trace: reads must come from the trace
+    setSensorPin(PIN_FOR_INFRARED_PILL_DETECTOR, LOW);
+    replayer.attachSensorTrace(&loadedTrace);
+    ASSERT_TRUE(replayer.startSensorTraceReplay());
+    advanceHostClockMicroseconds(40000);    // Operation started later than in the recording
+    replayer.markTraceSynchronizationPoint();
+
+    EXPECT_FALSE(replayer.isPillCurrentlyDetectedByInfraredSensor());
+    advanceHostClockMicroseconds(1499);
+    EXPECT_FALSE(replayer.isPillCurrentlyDetectedByInfraredSensor());
+    advanceHostClockMicroseconds(1);
+    EXPECT_TRUE(replayer.isPillCurrentlyDetectedByInfraredSensor());
+    advanceHostClockMicroseconds(2499);
+    EXPECT_TRUE(replayer.isPillCurrentlyDetectedByInfraredSensor());
+    advanceHostClockMicroseconds(1);
+    EXPECT_FALSE(replayer.isPillCurrentlyDetectedByInfraredSensor());
+
+    EXPECT_EQ(0, replayer.getCurrentEncoderPosition());
+    advanceHostClockMicroseconds(300);
+    EXPECT_EQ(1, replayer.getCurrentEncoderPosition());
+    EXPECT_TRUE(loadedTrace.isReplayFinished());
+}
+
+TEST_F(SensorTraceTest, OutOfOrderChunkIsRejected) {
+    recordDispense();
+    const uint8_t* bytes = recordedTrace.getTraceBytes();
+
+    ASSERT_TRUE(loadedTrace.loadTraceChunk(0, bytes, 8));
+    EXPECT_FALSE(loadedTrace.loadTraceChunk(16, bytes + 16, 4));
+    EXPECT_EQ(8u, loadedTrace.getTraceLength());
+    EXPECT_TRUE(loadedTrace.loadTraceChunk(8, bytes + 8, 4));
+
+    // Offset 0 starts over
+    ASSERT_TRUE(loadedTrace.loadTraceChunk(0, bytes, 4));
+    EXPECT_EQ(4u, loadedTrace.getTraceLength());
+}
+
+TEST_F(SensorTraceTest, TraceWithoutAValidHeaderIsNotReplayed) {
+    const uint8_t wrongVersion[] = { 'S', 'T', 'R', SENSOR_TRACE_FORMAT_VERSION + 1, 0x0F };
+    EXPECT_FALSE(loadedTrace.loadTrace(wrongVersion, sizeof(wrongVersion)));
+    EXPECT_EQ(0u, loadedTrace.getTraceLength());
+
+    ASSERT_TRUE(loadedTrace.loadTraceChunk(0, wrongVersion, sizeof(wrongVersion)));
+    replayer.attachSensorTrace(&loadedTrace);
+    EXPECT_FALSE(replayer.startSensorTraceReplay());
+}
@@ -0,0 +1,83 @@
+#include <gtest/gtest.h>
+#include "ServoMotionModel.h"
+
+static const int SLEW = 1000;       // us per second: 1 us per ms
+static const int SETTLE = 100;      // ms
+
+class ServoMotionModelTest : public ::testing::Test {
+protected:
+    ServoMotionModel motionModel;
+
+    // Horn at rest on the pulse width at time `now`
+    void settleAt(int microseconds, unsigned long now) {
+        motionModel.beginMove(microseconds);
+        motionModel.recordSetpoint(microseconds, now, SLEW);
+        motionModel.markSettled(now);
+    }
+};
+
+TEST_F(ServoMotionModelTest, PositionIsUnknownUntilTheFirstFixedWait) {
+    motionModel.recordSetpoint(1500, 0, SLEW);
+    EXPECT_FALSE(motionModel.isEstimateKnown());
+    EXPECT_EQ(-1, motionModel.getRemainingSettleMilliseconds(10000, SLEW, SETTLE));
+
+    motionModel.markSettled(10000);
+    EXPECT_TRUE(motionModel.isEstimateKnown());
+    EXPECT_EQ(0, motionModel.getRemainingSettleMilliseconds(10000, SLEW, SETTLE));
+}
+
+TEST_F(ServoMotionModelTest, EstimateFollowsTheSlewRateThenSettles) {
+    settleAt(1500, 1000);
+    motionModel.beginMove(2000);
+    motionModel.recordSetpoint(2000, 1000, SLEW);
+    EXPECT_EQ(600, motionModel.getRemainingSettleMilliseconds(1000, SLEW, SETTLE));
+
+    EXPECT_EQ(1750, motionModel.getTravellingEstimateMicroseconds(1250, SLEW));
+    EXPECT_EQ(350, motionModel.getRemainingSettleMilliseconds(1250, SLEW, SETTLE));
+
+    EXPECT_EQ(0, motionModel.getTravellingEstimateMicroseconds(1500, SLEW));
+    EXPECT_EQ(2000, motionModel.getEstimatedMicroseconds());
+    EXPECT_EQ(100, motionModel.getRemainingSettleMilliseconds(1500, SLEW, SETTLE));
+    EXPECT_EQ(0, motionModel.getRemainingSettleMilliseconds(1600, SLEW, SETTLE));
+}
+
+TEST_F(ServoMotionModelTest, ArrivalTimeIsBackdatedWhenQueriedLate) {
+    settleAt(1500, 0);
+    motionModel.recordSetpoint(2000, 0, SLEW);
+    motionModel.getRemainingSettleMilliseconds(250, SLEW, SETTLE);
+
+    // Arrived at 500 ms, not when next asked at 550 ms
+    EXPECT_EQ(50, motionModel.getRemainingSettleMilliseconds(550, SLEW, SETTLE));
+}
+
+TEST_F(ServoMotionModelTest, DetachMidMoveForgetsThePosition) {
+    settleAt(1500, 0);
+    motionModel.recordSetpoint(2000, 0, SLEW);
+    motionModel.recordDetach(200, SLEW);
+    EXPECT_FALSE(motionModel.isEstimateKnown());
+
+    motionModel.recordSetpoint(1500, 5000, SLEW);
+    EXPECT_EQ(-1, motionModel.getRemainingSettleMilliseconds(5000, SLEW, SETTLE));
+    EXPECT_EQ(0, motionModel.getTravellingEstimateMicroseconds(5000, SLEW));
+}
+
+TEST_F(ServoMotionModelTest, DetachAfterArrivalKeepsThePosition) {
+    settleAt(1500, 0);
+    motionModel.recordSetpoint(1600, 0, SLEW);
+    motionModel.recordDetach(150, SLEW);
+    EXPECT_TRUE(motionModel.isEstimateKnown());
+    EXPECT_EQ(50, motionModel.getRemainingSettleMilliseconds(150, SLEW, SETTLE));
+}
+
+TEST_F(ServoMotionModelTest, ZeroSlewRateMeansNoModel) {
+    settleAt(1500, 0);
+    motionModel.recordSetpoint(2000, 0, 0);
+    EXPECT_EQ(-1, motionModel.getRemainingSettleMilliseconds(5000, 0, SETTLE));
+    EXPECT_EQ(-1, ServoMotionModel::estimateSettleMillisecondsAfterSweep(500, 300, 0, SETTLE));
+}
+
+TEST_F(ServoMotionModelTest, SweepEstimateAddsOnlyTheLag) {
+    EXPECT_EQ(300, ServoMotionModel::estimateSettleMillisecondsAfterSweep(500, 300, SLEW, SETTLE));
+    EXPECT_EQ(300, ServoMotionModel::estimateSettleMillisecondsAfterSweep(-500, 300, SLEW, SETTLE));
+    EXPECT_EQ(SETTLE, ServoMotionModel::estimateSettleMillisecondsAfterSweep(500, 600, SLEW, SETTLE));
+}
@@ -0,0 +1,98 @@
+#include <gtest/gtest.h>
+#include "SweepRangeLearner.h"
+
+static const int MIN_SAFE = 500;
+static const int MAX_SAFE = 2500;
+
+class SweepRangeLearnerTest : public ::testing::Test {
+protected:
+    SystemConfiguration systemConfig;
+    SweepRangeLearner sweepRangeLearner;
+
+    SweepRangeLearnerTest() : sweepRangeLearner(&systemConfig) {}
+
+    int getSweepEnd(int compartmentNumber) {
+        return sweepRangeLearner.getSweepEndMicroseconds(compartmentNumber, MIN_SAFE, MAX_SAFE);
+    }
+
+    void learn(int compartmentNumber, int positionMicroseconds, int times) {
+        for (int i = 0; i < times; i++) {
+            sweepRangeLearner.recordReleasePosition(compartmentNumber, positionMicroseconds);
+            sweepRangeLearner.recordSweepOutcome(compartmentNumber, false, true);
+        }
+    }
+};
+
+TEST_F(SweepRangeLearnerTest, FullArcUntilEnoughReleasesWereSeen) {
+    learn(1, 1800, SWEEP_LEARNING_MINIMUM_OBSERVATIONS - 1);
+    EXPECT_FALSE(sweepRangeLearner.isRangeLearned(1));
+    EXPECT_EQ(MAX_SAFE, getSweepEnd(1));
+
+    sweepRangeLearner.recordReleasePosition(1, 1700);
+    EXPECT_TRUE(sweepRangeLearner.isRangeLearned(1));
+    EXPECT_EQ(1800 + systemConfig.sweepLearningMarginMicroseconds, getSweepEnd(1));
+
+    // Other compartments are unaffected
+    EXPECT_EQ(MAX_SAFE, getSweepEnd(2));
+}
+
+TEST_F(SweepRangeLearnerTest, SweepEndIsClampedToTheSafeRange) {
+    learn(1, MAX_SAFE - 50, SWEEP_LEARNING_MINIMUM_OBSERVATIONS);
+    EXPECT_EQ(MAX_SAFE, getSweepEnd(1));
+}
+
+TEST_F(SweepRangeLearnerTest, OldReleasesAgeOutOfTheHistory) {
+    learn(1, 2000, 1);
+    learn(1, 1600, SWEEP_LEARNING_HISTORY_LENGTH - 1);
+    EXPECT_EQ(2000 + systemConfig.sweepLearningMarginMicroseconds, getSweepEnd(1));
+
+    learn(1, 1600, 1);
+    EXPECT_EQ(1600 + systemConfig.sweepLearningMarginMicroseconds, getSweepEnd(1));
+}
+
+TEST_F(SweepRangeLearnerTest, MissOnAShortSweepWidensItAndAReleaseResetsTheWidening) {
+    learn(1, 1600, SWEEP_LEARNING_MINIMUM_OBSERVATIONS);
+    int margin = systemConfig.sweepLearningMarginMicroseconds;
+
+    sweepRangeLearner.recordSweepOutcome(1, true, false);
+    EXPECT_EQ(1600 + 2 * margin, getSweepEnd(1));
+    EXPECT_EQ(1u, sweepRangeLearner.getNumberOfShortenedMisses(1));
+
+    sweepRangeLearner.recordReleasePosition(1, 1650);
+    sweepRangeLearner.recordSweepOutcome(1, true, true);
+    EXPECT_EQ(1650 + margin, getSweepEnd(1));
+    EXPECT_EQ(2u, sweepRangeLearner.getNumberOfShortenedSweeps(1));
+}
+
+TEST_F(SweepRangeLearnerTest, MissesInARowForgetTheCompartment) {
+    learn(1, 1600, SWEEP_LEARNING_MINIMUM_OBSERVATIONS);
+    for (int i = 0; i < SWEEP_LEARNING_MAXIMUM_MISSES; i++) {
+        sweepRangeLearner.recordSweepOutcome(1, true, false);
+    }
+    EXPECT_FALSE(sweepRangeLearner.isRangeLearned(1));
+    EXPECT_EQ(MAX_SAFE, getSweepEnd(1));
+}
+
+TEST_F(SweepRangeLearnerTest, MissOnAFullSweepSaysNothing) {
+    learn(1, 1600, SWEEP_LEARNING_MINIMUM_OBSERVATIONS);
+    for (int i = 0; i < SWEEP_LEARNING_MAXIMUM_MISSES; i++) {
+        sweepRangeLearner.recordSweepOutcome(1, false, false);
+    }
+    EXPECT_EQ(1600 + systemConfig.sweepLearningMarginMicroseconds, getSweepEnd(1));
+    EXPECT_EQ(0u, sweepRangeLearner.getNumberOfShortenedMisses(1));
+}
+
+TEST_F(SweepRangeLearnerTest, PositionsTakenAtRestAreIgnored) {
+    learn(1, 0, SWEEP_LEARNING_MINIMUM_OBSERVATIONS);
+    EXPECT_FALSE(sweepRangeLearner.isRangeLearned(1));
+}
+
+TEST_F(SweepRangeLearnerTest, LearningOffAlwaysSweepsTheFullArc) {
+    learn(1, 1600, SWEEP_LEARNING_MINIMUM_OBSERVATIONS);
+    systemConfig.enableSweepRangeLearning = false;
+    EXPECT_EQ(MAX_SAFE, getSweepEnd(1));
+
+    systemConfig.enableSweepRangeLearning = true;
+    sweepRangeLearner.resetAllSweepRanges();
+    EXPECT_EQ(MAX_SAFE, getSweepEnd(1));
+}
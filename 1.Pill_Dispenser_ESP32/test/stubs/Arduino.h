@@ -0,0 +1,197 @@
+#ifndef HOST_STUB_ARDUINO_H
+#define HOST_STUB_ARDUINO_H
+
+// ============================================================================
+// Host stand-in for the Arduino core
+// ============================================================================
+// Just enough of the ESP32 Arduino API for the firmware headers to build and
+// run on a desktop. Time is simulated: millis()/micros() return the host
+// clock below, and delay() advances it instead of sleeping.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <string>
+#include <algorithm>
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define CHANGE 3
+#define FALLING 4
+#define RISING 5
+#define DEC 10
+#define HEX 16
+#define IRAM_ATTR
+#define PROGMEM
+#define PSTR(s) (s)
+#define F(s) (s)
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+using std::min;
+using std::max;
+using std::abs;
+
+// Simulated clock (ArduinoStubs.cpp)
+extern unsigned long long hostMicroseconds;
+inline void advanceHostClockMicroseconds(unsigned long long microseconds) { hostMicroseconds += microseconds; }
+inline unsigned long millis() { return (unsigned long)(hostMicroseconds / 1000ULL); }
+inline unsigned long micros() { return (unsigned long)hostMicroseconds; }
+inline void delay(unsigned long milliseconds) { advanceHostClockMicroseconds(milliseconds * 1000ULL); }
+inline void delayMicroseconds(unsigned int microseconds) { advanceHostClockMicroseconds(microseconds); }
+inline void yield() {}
+
+// Pins read back the level last written (inputs idle HIGH)
+extern int hostPinLevels[64];
+inline void pinMode(int, int) {}
+inline int digitalRead(int pin) { return hostPinLevels[pin & 63]; }
+inline void digitalWrite(int pin, int level) { hostPinLevels[pin & 63] = level; }
+inline int digitalPinToInterrupt(int pin) { return pin; }
+inline void attachInterrupt(int, void (*)(), int) {}
+inline void detachInterrupt(int) {}
+inline void noInterrupts() {}
+inline void interrupts() {}
+
+// FreeRTOS critical sections: nothing preempts the host tests
+typedef int portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED 0
+#define portENTER_CRITICAL(mux) ((void)(mux))
+#define portEXIT_CRITICAL(mux) ((void)(mux))
+#define portENTER_CRITICAL_ISR(mux) ((void)(mux))
+#define portEXIT_CRITICAL_ISR(mux) ((void)(mux))
+inline long map(long x, long inMin, long inMax, long outMin, long outMax) {
+    return (x - inMin) * (outMax - outMin) / (inMax - inMin) + outMin;
+}
+inline long random(long upper) { return upper > 0 ? rand() % upper : 0; }
+inline long random(long lower, long upper) { return upper > lower ? lower + rand() % (upper - lower) : lower; }
+inline void randomSeed(unsigned long seed) { srand((unsigned)seed); }
+
+class String {
+public:
+    std::string s;
+    String() {}
+    String(const char* c) : s(c ? c : "") {}
+    String(const std::string& x) : s(x) {}
+    String(char c) : s(1, c) {}
+    String(int v) : s(std::to_string(v)) {}
+    String(unsigned int v) : s(std::to_string(v)) {}
+    String(long v) : s(std::to_string(v)) {}
+    String(unsigned long v) : s(std::to_string(v)) {}
+    String(long long v) : s(std::to_string(v)) {}
+    String(unsigned long long v) : s(std::to_string(v)) {}
+    String(double v, int decimals = 2) { char b[48]; snprintf(b, sizeof(b), "%.*f", decimals, v); s = b; }
+    unsigned int length() const { return s.size(); }
+    const char* c_str() const { return s.c_str(); }
+    bool startsWith(const String& p) const { return s.rfind(p.s, 0) == 0; }
+    bool endsWith(const String& p) const { return s.size() >= p.s.size() && s.compare(s.size() - p.s.size(), p.s.size(), p.s) == 0; }
+    int indexOf(char c, unsigned from = 0) const { size_t r = s.find(c, from); return r == std::string::npos ? -1 : (int)r; }
+    int indexOf(const String& c, unsigned from = 0) const { size_t r = s.find(c.s, from); return r == std::string::npos ? -1 : (int)r; }
+    String substring(unsigned a) const { return a > s.size() ? String() : String(s.substr(a)); }
+    String substring(unsigned a, unsigned b) const { return a > s.size() ? String() : String(s.substr(a, b > a ? b - a : 0)); }
+    long toInt() const { return atol(s.c_str()); }
+    float toFloat() const { return (float)atof(s.c_str()); }
+    void trim() {
+        size_t first = s.find_first_not_of(" \t\r\n");
+        size_t last = s.find_last_not_of(" \t\r\n");
+        s = (first == std::string::npos) ? std::string() : s.substr(first, last - first + 1);
+    }
+    void toUpperCase() { for (size_t i = 0; i < s.size(); i++) s[i] = (char)toupper((unsigned char)s[i]); }
+    bool equals(const String& o) const { return s == o.s; }
+    bool operator==(const String& o) const { return s == o.s; }
+    bool operator==(const char* o) const { return s == o; }
+    bool operator!=(const String& o) const { return s != o.s; }
+    bool operator!=(const char* o) const { return s != o; }
+    String& operator+=(const String& o) { s += o.s; return *this; }
+    String& operator+=(const char* o) { s += o; return *this; }
+    String& operator+=(char o) { s += o; return *this; }
+    char operator[](unsigned i) const { return s[i]; }
+    char charAt(unsigned i) const { return s[i]; }
+    void reserve(unsigned n) { s.reserve(n); }
+    friend String operator+(const String& a, const String& b) { return String(a.s + b.s); }
+    friend String operator+(const String& a, const char* b) { return String(a.s + b); }
+    friend String operator+(const char* a, const String& b) { return String(a + b.s); }
+};
+
+class Print {
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t) = 0;
+    virtual size_t write(const uint8_t* buffer, size_t size) { for (size_t i = 0; i < size; i++) write(buffer[i]); return size; }
+    size_t write(const char* text) { return write((const uint8_t*)text, strlen(text)); }
+    virtual int availableForWrite() { return 0; }
+    virtual void flush() {}
+
+    size_t print(const String& v) { return write(v.c_str()); }
+    size_t print(const char* v) { return write(v); }
+    size_t print(char v) { return write((uint8_t)v); }
+    size_t print(int v, int = DEC) { return print(String(v)); }
+    size_t print(unsigned int v, int = DEC) { return print(String(v)); }
+    size_t print(long v, int = DEC) { return print(String(v)); }
+    size_t print(unsigned long v, int = DEC) { return print(String(v)); }
+    size_t print(long long v, int = DEC) { return print(String(v)); }
+    size_t print(unsigned long long v, int = DEC) { return print(String(v)); }
+    size_t print(double v, int decimals = 2) { return print(String(v, decimals)); }
+    size_t println() { return write("\r\n"); }
+    template <typename T> size_t println(T v) { size_t n = print(v); return n + println(); }
+    template <typename T> size_t println(T v, int format) { size_t n = print(v, format); return n + println(); }
+    size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+};
+
+class Stream : public Print {
+public:
+    virtual int available() { return 0; }
+    virtual int read() { return -1; }
+    virtual int peek() { return -1; }
+};
+
+// Serial output goes to stdout; input is whatever a test queued
+class HardwareSerial : public Stream {
+public:
+    std::string pendingInput;
+    void begin(unsigned long) {}
+    size_t write(uint8_t c) override { fputc(c, stdout); return 1; }
+    using Print::write;
+    int availableForWrite() override { return 128; }
+    int available() override { return (int)pendingInput.size(); }
+    int read() override {
+        if (pendingInput.empty()) return -1;
+        int c = (unsigned char)pendingInput[0];
+        pendingInput.erase(0, 1);
+        return c;
+    }
+    int peek() override { return pendingInput.empty() ? -1 : (unsigned char)pendingInput[0]; }
+    operator bool() { return true; }
+};
+extern HardwareSerial Serial;
+
+class EspClass {
+public:
+    uint32_t getCycleCount() { return (uint32_t)(hostMicroseconds * 240ULL); }
+    uint32_t getFreeHeap() { return 200000; }
+    uint32_t getMinFreeHeap() { return 180000; }
+    uint32_t getMaxAllocHeap() { return 110000; }
+    uint32_t getHeapSize() { return 300000; }
+    uint32_t getCpuFreqMHz() { return 240; }
+    uint32_t getSketchSize() { return 0; }
+    uint32_t getFreeSketchSpace() { return 0; }
+    void restart() {}
+};
+extern EspClass ESP;
+
+#define ESP_LOGE(tag, ...)
+#define ESP_LOGW(tag, ...)
+#define ESP_LOGI(tag, ...)
+
+typedef void* TaskHandle_t;
+typedef unsigned int UBaseType_t;
+inline TaskHandle_t xTaskGetHandle(const char*) { return (TaskHandle_t)1; }
+inline UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t) { return 1000; }
+
+#endif // HOST_STUB_ARDUINO_H
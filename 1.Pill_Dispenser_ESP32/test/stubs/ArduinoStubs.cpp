@@ -0,0 +1,24 @@
+#include <Arduino.h>
+#include <stdarg.h>
+#include <sys/time.h>
+
+unsigned long long hostMicroseconds = 0;
+int hostPinLevels[64] = {
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1
+};
+HardwareSerial Serial;
+EspClass ESP;
+struct timeval hostTimeOfDay;
+
+size_t Print::printf(const char* format, ...) {
+    char buffer[256];
+    va_list arguments;
+    va_start(arguments, format);
+    int length = vsnprintf(buffer, sizeof(buffer), format, arguments);
+    va_end(arguments);
+    if (length < 0) {
+        return 0;
+    }
+    return write((const uint8_t*)buffer, std::min((size_t)length, sizeof(buffer) - 1));
+}
@@ -0,0 +1,8 @@
+#ifndef HOST_STUB_BLE2902_H
+#define HOST_STUB_BLE2902_H
+
+#include <BLEDevice.h>
+
+class BLE2902 : public BLEDescriptor {};
+
+#endif // HOST_STUB_BLE2902_H
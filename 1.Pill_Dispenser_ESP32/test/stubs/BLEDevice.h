@@ -0,0 +1,70 @@
+#ifndef HOST_STUB_BLE_DEVICE_H
+#define HOST_STUB_BLE_DEVICE_H
+
+#include <Arduino.h>
+
+// ESP32 BLE Arduino classes with no radio behind them: creating the server
+// returns nullptr, so only code paths that never start BLE can run on a host.
+class BLEServer;
+class BLECharacteristic;
+
+class BLEServerCallbacks {
+public:
+    virtual ~BLEServerCallbacks() {}
+    virtual void onConnect(BLEServer*) {}
+    virtual void onDisconnect(BLEServer*) {}
+};
+
+class BLECharacteristicCallbacks {
+public:
+    virtual ~BLECharacteristicCallbacks() {}
+    virtual void onWrite(BLECharacteristic*) {}
+};
+
+class BLEDescriptor {
+public:
+    virtual ~BLEDescriptor() {}
+};
+
+class BLECharacteristic {
+public:
+    enum { PROPERTY_READ = 1, PROPERTY_WRITE = 2, PROPERTY_NOTIFY = 4 };
+    void setValue(const char*) {}
+    void setValue(uint8_t*, size_t) {}
+    void setValue(const uint8_t*, size_t) {}
+    void notify() {}
+    String getValue() { return String(); }
+    void setCallbacks(BLECharacteristicCallbacks*) {}
+    void addDescriptor(BLEDescriptor*) {}
+};
+
+class BLEService {
+public:
+    BLECharacteristic* createCharacteristic(const char*, uint32_t) { return nullptr; }
+    void start() {}
+};
+
+class BLEServer {
+public:
+    void setCallbacks(BLEServerCallbacks*) {}
+    BLEService* createService(const char*) { return nullptr; }
+    void startAdvertising() {}
+};
+
+class BLEAdvertising {
+public:
+    void addServiceUUID(const char*) {}
+    void setScanResponse(bool) {}
+    void setMinPreferred(int) {}
+    void setMaxPreferred(int) {}
+};
+
+class BLEDevice {
+public:
+    static void init(const char*) {}
+    static BLEServer* createServer() { return nullptr; }
+    static BLEAdvertising* getAdvertising() { return nullptr; }
+    static void startAdvertising() {}
+};
+
+#endif // HOST_STUB_BLE_DEVICE_H
@@ -0,0 +1,2 @@
+// Part of the BLEDevice.h stand-in
+#include <BLEDevice.h>
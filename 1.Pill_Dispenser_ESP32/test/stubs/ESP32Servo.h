@@ -0,0 +1,29 @@
+#ifndef HOST_STUB_ESP32_SERVO_H
+#define HOST_STUB_ESP32_SERVO_H
+
+// The bundled ESP32Servo API, recording what was written
+class Servo {
+public:
+    int attachedPin = -1;
+    int attachedInitialMicroseconds = -1;
+    int microseconds = 0;
+    int numberOfWrites = 0;
+
+    int attach(int pin) { return attach(pin, 544, 2400); }
+    int attach(int pin, int minimum, int maximum) { return attach(pin, minimum, maximum, -1); }
+    int attach(int pin, int, int, int initialMicroseconds) {
+        attachedPin = pin;
+        attachedInitialMicroseconds = initialMicroseconds;
+        if (initialMicroseconds > 0) {
+            microseconds = initialMicroseconds;
+        }
+        return 0;
+    }
+    void detach() { attachedPin = -1; }
+    bool attached() { return attachedPin >= 0; }
+    void writeMicroseconds(int value) { microseconds = value; numberOfWrites++; }
+    int readMicroseconds() { return attached() ? microseconds : 0; }
+    void write(int value) { writeMicroseconds(value); }
+};
+
+#endif // HOST_STUB_ESP32_SERVO_H
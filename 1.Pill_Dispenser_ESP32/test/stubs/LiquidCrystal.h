@@ -0,0 +1,17 @@
+#ifndef HOST_STUB_LIQUID_CRYSTAL_H
+#define HOST_STUB_LIQUID_CRYSTAL_H
+
+#include <Arduino.h>
+
+// Display that discards everything written to it
+class LiquidCrystal : public Print {
+public:
+    LiquidCrystal(int, int, int, int, int, int) {}
+    void begin(int, int) {}
+    void clear() {}
+    void setCursor(int, int) {}
+    size_t write(uint8_t) override { return 1; }
+    using Print::write;
+};
+
+#endif // HOST_STUB_LIQUID_CRYSTAL_H
@@ -0,0 +1,78 @@
+#ifndef HOST_STUB_PREFERENCES_H
+#define HOST_STUB_PREFERENCES_H
+
+#include <Arduino.h>
+#include <map>
+#include <string>
+#include <vector>
+
+// NVS kept in RAM for the life of the test process, keyed "namespace/key"
+inline std::map<std::string, std::vector<uint8_t> >& hostNvs() {
+    static std::map<std::string, std::vector<uint8_t> > storage;
+    return storage;
+}
+
+class Preferences {
+private:
+    std::string nameSpace;
+
+    std::string makeKey(const char* key) { return nameSpace + "/" + key; }
+
+public:
+    bool begin(const char* name, bool = false, const char* = NULL) {
+        nameSpace = name;
+        return true;
+    }
+
+    void end() {}
+
+    bool clear() {
+        std::map<std::string, std::vector<uint8_t> >& storage = hostNvs();
+        std::string prefix = nameSpace + "/";
+        for (std::map<std::string, std::vector<uint8_t> >::iterator it = storage.begin(); it != storage.end();) {
+            if (it->first.compare(0, prefix.size(), prefix) == 0) {
+                it = storage.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        return true;
+    }
+
+    bool remove(const char* key) { return hostNvs().erase(makeKey(key)) > 0; }
+
+    bool isKey(const char* key) { return hostNvs().count(makeKey(key)) > 0; }
+
+    size_t putBytes(const char* key, const void* value, size_t length) {
+        const uint8_t* bytes = (const uint8_t*)value;
+        hostNvs()[makeKey(key)].assign(bytes, bytes + length);
+        return length;
+    }
+
+    size_t getBytes(const char* key, void* buffer, size_t maximumLength) {
+        std::map<std::string, std::vector<uint8_t> >::iterator it = hostNvs().find(makeKey(key));
+        if (it == hostNvs().end()) {
+            return 0;
+        }
+        size_t length = std::min(it->second.size(), maximumLength);
+        memcpy(buffer, it->second.data(), length);
+        return length;
+    }
+
+    size_t getBytesLength(const char* key) {
+        std::map<std::string, std::vector<uint8_t> >::iterator it = hostNvs().find(makeKey(key));
+        return it == hostNvs().end() ? 0 : it->second.size();
+    }
+
+    size_t putInt(const char* key, int32_t value) { return putBytes(key, &value, sizeof(value)); }
+
+    int32_t getInt(const char* key, int32_t defaultValue = 0) {
+        int32_t value = defaultValue;
+        if (getBytesLength(key) == sizeof(value)) {
+            getBytes(key, &value, sizeof(value));
+        }
+        return value;
+    }
+};
+
+#endif // HOST_STUB_PREFERENCES_H
@@ -0,0 +1,58 @@
+#ifndef HOST_STUB_ESP_PARTITION_H
+#define HOST_STUB_ESP_PARTITION_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <vector>
+
+#ifndef ESP_OK
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_FAIL -1
+#endif
+
+typedef enum { ESP_PARTITION_TYPE_APP, ESP_PARTITION_TYPE_DATA } esp_partition_type_t;
+typedef enum { ESP_PARTITION_SUBTYPE_ANY = 0xff } esp_partition_subtype_t;
+
+typedef struct {
+    esp_partition_type_t type;
+    esp_partition_subtype_t subtype;
+    uint32_t address;
+    uint32_t size;
+    char label[17];
+} esp_partition_t;
+
+// One RAM-backed data partition that answers to any label. Writes AND into
+// the contents like NOR flash, so only erased (0xFF) bytes can be programmed.
+inline std::vector<uint8_t>& hostPartitionContents() {
+    static std::vector<uint8_t> contents(64 * 1024, 0xFF);
+    return contents;
+}
+
+inline const esp_partition_t* esp_partition_find_first(esp_partition_type_t, esp_partition_subtype_t, const char*) {
+    static esp_partition_t partition = {ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, 0, 64 * 1024, "host"};
+    partition.size = (uint32_t)hostPartitionContents().size();
+    return &partition;
+}
+
+inline esp_err_t esp_partition_read(const esp_partition_t* partition, size_t offset, void* destination, size_t size) {
+    if (offset + size > partition->size) return ESP_FAIL;
+    memcpy(destination, hostPartitionContents().data() + offset, size);
+    return ESP_OK;
+}
+
+inline esp_err_t esp_partition_write(const esp_partition_t* partition, size_t offset, const void* source, size_t size) {
+    if (offset + size > partition->size) return ESP_FAIL;
+    const uint8_t* bytes = (const uint8_t*)source;
+    for (size_t i = 0; i < size; i++) hostPartitionContents()[offset + i] &= bytes[i];
+    return ESP_OK;
+}
+
+inline esp_err_t esp_partition_erase_range(const esp_partition_t* partition, size_t offset, size_t size) {
+    if (offset + size > partition->size) return ESP_FAIL;
+    memset(hostPartitionContents().data() + offset, 0xFF, size);
+    return ESP_OK;
+}
+
+#endif // HOST_STUB_ESP_PARTITION_H
@@ -0,0 +1,8 @@
+#ifndef HOST_STUB_ESP_TIMER_H
+#define HOST_STUB_ESP_TIMER_H
+
+#include <Arduino.h>
+
+inline int64_t esp_timer_get_time() { return (int64_t)hostMicroseconds; }
+
+#endif // HOST_STUB_ESP_TIMER_H
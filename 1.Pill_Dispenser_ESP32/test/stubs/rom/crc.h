@@ -0,0 +1,18 @@
+#ifndef HOST_STUB_ROM_CRC_H
+#define HOST_STUB_ROM_CRC_H
+
+#include <stdint.h>
+
+// Same CRC-32 (reflected, 0xEDB88320) as the ESP32 ROM
+inline uint32_t crc32_le(uint32_t crc, const uint8_t* buffer, uint32_t length) {
+    crc = ~crc;
+    for (uint32_t i = 0; i < length; i++) {
+        crc ^= buffer[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & (0U - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+#endif // HOST_STUB_ROM_CRC_H
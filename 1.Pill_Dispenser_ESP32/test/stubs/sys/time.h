@@ -0,0 +1,15 @@
+#ifndef HOST_STUB_SYS_TIME_H
+#define HOST_STUB_SYS_TIME_H
+
+// The real header, but settimeofday() only records the value: tests must never
+// set the clock of the machine they run on
+#include_next <sys/time.h>
+
+extern struct timeval hostTimeOfDay;
+inline int hostSetTimeOfDay(const struct timeval* value, const void*) {
+    hostTimeOfDay = *value;
+    return 0;
+}
+#define settimeofday hostSetTimeOfDay
+
+#endif // HOST_STUB_SYS_TIME_H
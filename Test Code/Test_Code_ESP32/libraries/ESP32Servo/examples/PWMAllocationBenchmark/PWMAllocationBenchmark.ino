@@ -0,0 +1,52 @@
+#include <ESP32Servo.h>
+
+// Times LEDC channel allocation: every PWM pin is attached, retuned and
+// detached over and over, and the average cost of each step is printed.
+int pins[] = { 2, 4, 5, 12, 13, 14, 15, 16 };
+const int numberOfPins = sizeof(pins) / sizeof(pins[0]);
+const int numberOfRounds = 1000;
+ESP32PWM pwm[numberOfPins];
+
+void setup() {
+	// Allow allocation of all timers
+	ESP32PWM::allocateTimer(0);
+	ESP32PWM::allocateTimer(1);
+	ESP32PWM::allocateTimer(2);
+	ESP32PWM::allocateTimer(3);
+	Serial.begin(115200);
+}
+
+void loop() {
+	unsigned long attachMicros = 0;
+	unsigned long adjustMicros = 0;
+	unsigned long detachMicros = 0;
+
+	for (int round = 0; round < numberOfRounds; round++) {
+		unsigned long start = micros();
+		for (int i = 0; i < numberOfPins; i++) {
+			pwm[i].attachPin(pins[i], 50, 10); // 50Hz servo timing
+		}
+		attachMicros += micros() - start;
+
+		start = micros();
+		for (int i = 0; i < numberOfPins; i++) {
+			pwm[i].adjustFrequency(50, 0.075); // shares the timer with the others
+		}
+		adjustMicros += micros() - start;
+
+		start = micros();
+		for (int i = 0; i < numberOfPins; i++) {
+			pwm[i].detachPin(pins[i]);
+		}
+		detachMicros += micros() - start;
+	}
+
+	long operations = (long) numberOfRounds * numberOfPins;
+	Serial.print("attach us/op: ");
+	Serial.println((float) attachMicros / operations, 3);
+	Serial.print("adjust us/op: ");
+	Serial.println((float) adjustMicros / operations, 3);
+	Serial.print("detach us/op: ");
+	Serial.println((float) detachMicros / operations, 3);
+	delay(5000);
+}
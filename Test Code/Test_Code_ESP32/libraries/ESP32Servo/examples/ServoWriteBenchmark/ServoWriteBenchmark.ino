@@ -0,0 +1,55 @@
+#include <ESP32Servo.h>
+
+// Counts CPU cycles per Servo::writeMicroseconds() while sweeping the way a
+// stepped servo move does, next to the double-precision conversion the
+// library used before, and prints the averages.
+// Leave the servo disconnected (or free to move) while this runs.
+Servo myservo;
+int servoPin = 18;
+const int minUs = 1000;
+const int maxUs = 2000;
+const int stepUs = 10;
+volatile int sink;
+
+// The previous usToTicks(), for comparison
+int doubleUsToTicks(int usec, int timerWidthTicks, int refreshCps) {
+	return (int) ((double) usec / ((double) REFRESH_USEC / (double) timerWidthTicks)
+			* (((double) refreshCps) / 50.0));
+}
+
+void setup() {
+	// Allow allocation of all timers
+	ESP32PWM::allocateTimer(0);
+	ESP32PWM::allocateTimer(1);
+	ESP32PWM::allocateTimer(2);
+	ESP32PWM::allocateTimer(3);
+	Serial.begin(115200);
+	myservo.setPeriodHertz(50);
+	myservo.attach(servoPin, minUs, maxUs);
+	myservo.setTimerWidth(16);
+}
+
+void loop() {
+	uint64_t writeCycles = 0;
+	uint64_t doubleCycles = 0;
+	long writes = 0;
+
+	for (int pass = 0; pass < 100; pass++) {
+		for (int us = minUs; us <= maxUs; us += stepUs) {
+			uint32_t start = ESP.getCycleCount();
+			myservo.writeMicroseconds(us);
+			writeCycles += (uint32_t) (ESP.getCycleCount() - start);
+
+			start = ESP.getCycleCount();
+			sink = doubleUsToTicks(us, 1 << myservo.readTimerWidth(), 50);
+			doubleCycles += (uint32_t) (ESP.getCycleCount() - start);
+			writes++;
+		}
+	}
+
+	Serial.print("writeMicroseconds cycles/write: ");
+	Serial.println((float) writeCycles / writes, 1);
+	Serial.print("double conversion alone cycles/write: ");
+	Serial.println((float) doubleCycles / writes, 1);
+	delay(5000);
+}
@@ -12,11 +12,26 @@
 int ESP32PWM::PWMCount = -1;              // the total number of attached servos
 bool  ESP32PWM::explicateAllocationMode=false;
 ESP32PWM * ESP32PWM::ChannelUsed[NUM_PWM]; // used to track whether a channel is in service
+uint32_t ESP32PWM::usedChannelMask = 0;
 long ESP32PWM::timerFreqSet[4] = { -1, -1, -1, -1 };
 int ESP32PWM::timerCount[4] = { 0, 0, 0, 0 };
 
 static const char* TAG = "ESP32PWM";
 
+// Timer-to-channel maps, from the LEDC mapping at the end of this file:
+// channel n runs on timer (n / 2) % 4. Channels past NUM_PWM are masked off.
+#define PWM_ALL_CHANNELS_MASK ((uint32_t) ((1UL << NUM_PWM) - 1))
+static const uint32_t timerChannelMasks[4] = {
+		0x0303 & PWM_ALL_CHANNELS_MASK,   // ledc 0, 1, 8, 9
+		0x0C0C & PWM_ALL_CHANNELS_MASK,   // ledc 2, 3, 10, 11
+		0x3030 & PWM_ALL_CHANNELS_MASK,   // ledc 4, 5, 12, 13
+		0xC0C0 & PWM_ALL_CHANNELS_MASK }; // ledc 6, 7, 14, 15
+static const int8_t timerIndexChannels[4][4] = {
+		{ 0, 1, 8, 9 },
+		{ 2, 3, 10, 11 },
+		{ 4, 5, 12, 13 },
+		{ 6, 7, 14, 15 } };
+
 // The ChannelUsed array elements are 0 if never used, 1 if in use, and -1 if used and disposed
 // (i.e., available for reuse)
 /**
@@ -38,6 +53,7 @@ void ESP32PWM::allocateTimer(int timerNumber){
 
 ESP32PWM::ESP32PWM() {
 	resolutionBits = 8;
+	maxDuty = (1 << resolutionBits) - 1;
 	pwmChannel = -1;
 	pin = -1;
 	myFreq = -1;
@@ -79,16 +95,18 @@ double ESP32PWM::_ledcSetupTimerFreq(uint8_t pin, double freq,
 }
 
 int ESP32PWM::timerAndIndexToChannel(int timerNum, int index) {
-	int localIndex = 0;
-	for (int j = 0; j < NUM_PWM; j++) {
-		if (((j / 2) % 4) == timerNum) {
-			if (localIndex == index) {
-				return j;
-			}
-			localIndex++;
-		}
-	}
-	return -1;
+	if (timerNum < 0 || timerNum > 3 || index < 0 || index > 3)
+		return -1;
+	int channel = timerIndexChannels[timerNum][index];
+	return channel < NUM_PWM ? channel : -1;
+}
+uint32_t ESP32PWM::timerChannelMask(int timerNum) {
+	if (timerNum < 0 || timerNum > 3)
+		return 0;
+	return timerChannelMasks[timerNum];
+}
+int ESP32PWM::lowestChannelInMask(uint32_t mask) {
+	return __builtin_ctz(mask); // mask must be non-zero
 }
 int ESP32PWM::allocatenext(double freq) {
 	long freqlocal = (long) freq;
@@ -103,23 +121,21 @@ int ESP32PWM::allocatenext(double freq) {
 				}
 				//Serial.println("Free channel timer "+String(i)+" at freq "+String(freq)+" remaining "+String(4-timerCount[i]));
 
-				timerNum = i;
-				for (int index=0; index<4; ++index)
+				uint32_t freeChannels = timerChannelMasks[i] & ~usedChannelMask;
+				if (freeChannels != 0)
 				{
-					int myTimerNumber = timerAndIndexToChannel(timerNum,index);
-					if ((myTimerNumber >= 0)  && (!ChannelUsed[myTimerNumber]))
-					{
-						pwmChannel = myTimerNumber;
-// 						Serial.println(
-// 							"PWM on ledc channel #" + String(pwmChannel)
-// 									+ " using 'timer " + String(timerNum)
-// 									+ "' to freq " + String(freq) + "Hz");
-						ChannelUsed[pwmChannel] = this;
-						timerCount[timerNum]++;
-						PWMCount++;
-						myFreq = freq;
-						return pwmChannel;
-					}
+					timerNum = i;
+					pwmChannel = lowestChannelInMask(freeChannels);
+// 					Serial.println(
+// 						"PWM on ledc channel #" + String(pwmChannel)
+// 								+ " using 'timer " + String(timerNum)
+// 								+ "' to freq " + String(freq) + "Hz");
+					ChannelUsed[pwmChannel] = this;
+					usedChannelMask |= (1UL << pwmChannel);
+					timerCount[timerNum]++;
+					PWMCount++;
+					myFreq = freq;
+					return pwmChannel;
 				}
 			} else {
 //				if(timerFreqSet[i]>0)
@@ -147,6 +163,7 @@ void ESP32PWM::deallocate() {
 	timerNum = -1;
 	attachedState = false;
 	ChannelUsed[pwmChannel] = NULL;
+	usedChannelMask &= ~(1UL << pwmChannel);
 	pwmChannel = -1;
 	PWMCount--;
 
@@ -163,6 +180,7 @@ double ESP32PWM::setup(double freq, uint8_t resolution_bits) {
 	checkFrequencyForSideEffects(freq);
 
 	resolutionBits = resolution_bits;
+	maxDuty = (1 << resolutionBits) - 1;
 	if (attached()) {
 #ifdef ESP_ARDUINO_VERSION_MAJOR
 #if ESP_ARDUINO_VERSION >= ESP_ARDUINO_VERSION_VAL(3, 0, 0)
@@ -190,12 +208,19 @@ double ESP32PWM::setup(double freq, uint8_t resolution_bits) {
 	return ledcSetup(getChannel(), freq, resolution_bits);
 #endif
 }
+// Same results as mapf() onto 0..maxDuty, without its general-range arithmetic
 double ESP32PWM::getDutyScaled() {
-	return mapf((double) myDuty, 0, (double) ((1 << resolutionBits) - 1), 0.0,
-			1.0);
+	if (myDuty >= maxDuty)
+		return 1.0;
+	return (double) myDuty / (double) maxDuty;
 }
 void ESP32PWM::writeScaled(double duty) {
-	write(mapf(duty, 0.0, 1.0, 0, (double) ((1 << resolutionBits) - 1)));
+	if (duty >= 1.0)
+		write(maxDuty);
+	else if (duty > 0.0)
+		write((uint32_t) (duty * (double) maxDuty));
+	else
+		write(0);
 }
 void ESP32PWM::write(uint32_t duty) {
 	myDuty = duty;
@@ -244,27 +269,30 @@ void ESP32PWM::adjustFrequency(double freq, double dutyScaled) {
 	if(dutyScaled<0)
 		dutyScaled=getDutyScaled();
 	writeScaled(dutyScaled);
-	for (int i = 0; i < timerCount[getTimer()]; i++) {
-		int pwm = timerAndIndexToChannel(getTimer(), i);
-		if (ChannelUsed[pwm] != NULL) {
-			if (ChannelUsed[pwm]->myFreq != freq) {
-				ChannelUsed[pwm]->adjustFrequencyLocal(freq,
-						ChannelUsed[pwm]->getDutyScaled());
-			}
+	// Only the channels in service on this timer
+	uint32_t channels = timerChannelMask(getTimer()) & usedChannelMask;
+	while (channels != 0) {
+		int pwm = lowestChannelInMask(channels);
+		channels &= channels - 1;
+		if (ChannelUsed[pwm]->myFreq != freq) {
+			ChannelUsed[pwm]->adjustFrequencyLocal(freq,
+					ChannelUsed[pwm]->getDutyScaled());
 		}
 	}
 }
 double ESP32PWM::writeTone(double freq) {
-	for (int i = 0; i < timerCount[getTimer()]; i++) {
-		int pwm = timerAndIndexToChannel(getTimer(), i);
-		if (ChannelUsed[pwm] != NULL) {
-			if (ChannelUsed[pwm]->myFreq != freq) {
-				ChannelUsed[pwm]->adjustFrequencyLocal(freq,
-						ChannelUsed[pwm]->getDutyScaled());
-			}
-			write(1 << (resolutionBits-1)); // writeScaled(0.5);
+	uint32_t channels = timerChannelMask(getTimer()) & usedChannelMask;
+	if (channels == 0)
+		return 0;
+	while (channels != 0) {
+		int pwm = lowestChannelInMask(channels);
+		channels &= channels - 1;
+		if (ChannelUsed[pwm]->myFreq != freq) {
+			ChannelUsed[pwm]->adjustFrequencyLocal(freq,
+					ChannelUsed[pwm]->getDutyScaled());
 		}
 	}
+	write(1 << (resolutionBits-1)); // writeScaled(0.5);
 
 	return 0;
 }
@@ -342,6 +370,29 @@ void ESP32PWM::attachPin(uint8_t pin, double freq, uint8_t resolution_bits) {
 	else
 		ESP_LOGE(TAG, "ERROR Pin Failed %d ",pin);
 }
+void ESP32PWM::attachPin(uint8_t pin, double freq, uint8_t resolution_bits,
+		uint32_t initialDuty) {
+
+	if (hasPwm(pin)){
+        this->pin = pin;
+		setup(freq, resolution_bits);
+#ifdef ESP_ARDUINO_VERSION_MAJOR
+#if ESP_ARDUINO_VERSION >= ESP_ARDUINO_VERSION_VAL(3, 0, 0)
+		// 3.x writes by pin, so the duty can only follow the attach
+		attachPin(pin);
+		write(initialDuty);
+#else
+		write(initialDuty);
+		attachPin(pin);
+#endif
+#else
+		write(initialDuty);
+		attachPin(pin);
+#endif
+	}
+	else
+		ESP_LOGE(TAG, "ERROR Pin Failed %d ",pin);
+}
 void ESP32PWM::detachPin(int pin) {
 #ifdef ESP_ARDUINO_VERSION_MAJOR
 #if ESP_ARDUINO_VERSION >= ESP_ARDUINO_VERSION_VAL(3, 0, 0)
@@ -379,34 +430,33 @@ void ESP32PWM::detachPin(int pin) {
 bool ESP32PWM::checkFrequencyForSideEffects(double freq) {
 
 	allocatenext(freq);
-	for (int i = 0; i < timerCount[getTimer()]; i++) {
-		int pwm = timerAndIndexToChannel(getTimer(), i);
-
-		if (pwm == pwmChannel)
-			continue;
-		if (ChannelUsed[pwm] != NULL)
-			if (ChannelUsed[pwm]->getTimer() == getTimer()) {
-				double diff = abs(ChannelUsed[pwm]->myFreq - freq);
-				if (abs(diff) > 0.1) {
-					ESP_LOGW(TAG, 
-							"\tWARNING PWM channel %d	\
-							 shares a timer with channel %d\n	\
-							\tchanging the frequency to %.3f		\
-							Hz will ALSO change channel %d	\
-							\n\tfrom its previous frequency of %.3f Hz\n "
-								,pwmChannel, pwm, freq, pwm, ChannelUsed[pwm]->myFreq);
-					ChannelUsed[pwm]->myFreq = freq;
-				}
-			}
+	uint32_t channels = timerChannelMask(getTimer()) & usedChannelMask
+			& ~(1UL << pwmChannel);
+	while (channels != 0) {
+		int pwm = lowestChannelInMask(channels);
+		channels &= channels - 1;
+		double diff = abs(ChannelUsed[pwm]->myFreq - freq);
+		if (abs(diff) > 0.1) {
+			ESP_LOGW(TAG, 
+					"\tWARNING PWM channel %d	\
+					 shares a timer with channel %d\n	\
+					\tchanging the frequency to %.3f		\
+					Hz will ALSO change channel %d	\
+					\n\tfrom its previous frequency of %.3f Hz\n "
+						,pwmChannel, pwm, freq, pwm, ChannelUsed[pwm]->myFreq);
+			ChannelUsed[pwm]->myFreq = freq;
+		}
 	}
 	return true;
 }
 
 ESP32PWM* pwmFactory(int pin) {
-	for (int i = 0; i < NUM_PWM; i++)
-		if (ESP32PWM::ChannelUsed[i] != NULL) {
-			if (ESP32PWM::ChannelUsed[i]->getPin() == pin)
-				return ESP32PWM::ChannelUsed[i];
-		}
+	uint32_t channels = ESP32PWM::usedChannelMask;
+	while (channels != 0) {
+		int i = __builtin_ctz(channels);
+		channels &= channels - 1;
+		if (ESP32PWM::ChannelUsed[i]->getPin() == pin)
+			return ESP32PWM::ChannelUsed[i];
+	}
 	return NULL;
 }
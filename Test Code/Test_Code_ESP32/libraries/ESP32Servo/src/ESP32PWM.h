@@ -32,8 +32,10 @@ private:
 	bool attachedState = false;
 	int pin;
 	uint8_t resolutionBits;
+	uint32_t maxDuty;                           // (1 << resolutionBits) - 1, kept with resolutionBits
 	double myFreq;
 	int allocatenext(double freq);
+	static int lowestChannelInMask(uint32_t mask);
 
 	static double _ledcSetupTimerFreq(uint8_t pin, double freq,
 		uint8_t bit_num, uint8_t channel);
@@ -63,6 +65,8 @@ public:
 
 	void detachPin(int pin);
 	void attachPin(uint8_t pin, double freq, uint8_t resolution_bits=10);
+	// as above, with the duty latched before the pin is connected so the first pulse has it
+	void attachPin(uint8_t pin, double freq, uint8_t resolution_bits, uint32_t initialDuty);
 	bool attached() {
 		return attachedState;
 	}
@@ -80,9 +84,16 @@ public:
 	uint32_t read();
 	double readFreq();
 	double getDutyScaled();
+	uint32_t getMaxDuty() {
+		return maxDuty;
+	}
 
 	//Timer data
 	static int timerAndIndexToChannel(int timer, int index);
+	static int channelToTimer(int channel) {
+		return (channel / 2) % 4;
+	}
+	static uint32_t timerChannelMask(int timer);
 	/**
 	 * allocateTimer
 	 * @param a timer number 0-3 indicating which timer to allocate in this library
@@ -100,6 +111,7 @@ public:
 	static int PWMCount;              // the total number of attached pwm
 	static int timerCount[4];
 	static ESP32PWM * ChannelUsed[NUM_PWM]; // used to track whether a channel is in service
+	static uint32_t usedChannelMask;        // bit n set while ChannelUsed[n] is in service
 	static long timerFreqSet[4];
 
 	// Helper functions
@@ -47,7 +47,9 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
 * The servo signal pins connect to any available GPIO pins on the ESP32, but not all pins are
 * GPIO pins.
 *
-* The ESP32 is a 32 bit processor that includes FP support; this code reflects that fact.
+* The ESP32 FPU is single precision only, so double math runs in software. The tick
+* scaling is precomputed as a 32.32 fixed point factor whenever the timer width, period
+* or min/max change, and each write is an integer multiply.
 */
 
 #include <ESP32Servo.h>
@@ -65,7 +67,8 @@ Servo::Servo()
 	this->pinNumber = -1;     // make it clear that we haven't attached a pin to this channel
 	this->min = DEFAULT_uS_LOW;
 	this->max = DEFAULT_uS_HIGH;
-	this->timer_width_ticks = pow(2,this->timer_width);
+	this->timer_width_ticks = 1 << this->timer_width;
+	updateTickScaling();
 
 }
 ESP32PWM * Servo::getPwm(){
@@ -80,6 +83,11 @@ int Servo::attach(int pin)
 }
 
 int Servo::attach(int pin, int min, int max)
+{
+    return (this->attach(pin, min, max, -1));
+}
+
+int Servo::attach(int pin, int min, int max, int initialUs)
 {
     ESP_LOGW(TAG, "Attempting to Attach servo on pin=%d min=%d max=%d",pin,min,max);
 
@@ -95,7 +103,7 @@ int Servo::attach(int pin, int min, int max)
             {
                 this->ticks = DEFAULT_PULSE_WIDTH_TICKS;
                 this->timer_width = DEFAULT_TIMER_WIDTH;
-                this->timer_width_ticks = pow(2,this->timer_width);
+                this->timer_width_ticks = 1 << this->timer_width;
             }
             this->pinNumber = pin;
 #ifdef ENFORCE_PINS
@@ -127,10 +135,22 @@ if(
             max = MAX_PULSE_WIDTH;
         this->min = min;     //store this value in uS
         this->max = max;    //store this value in uS
+        updateTickScaling();
         // Set up this channel
         // if you want anything other than default timer width, you must call setTimerWidth() before attach
 
-        pwm.attachPin(this->pinNumber,REFRESH_CPS, this->timer_width );   // GPIO pin assigned to channel
+        if (initialUs > 0)
+        {
+            // clamp as writeMicroseconds() does; the duty is set before the pin is connected
+            if (initialUs < this->min)
+                initialUs = this->min;
+            else if (initialUs > this->max)
+                initialUs = this->max;
+            this->ticks = usToTicks(initialUs);
+            pwm.attachPin(this->pinNumber, REFRESH_CPS, this->timer_width, this->ticks);
+        }
+        else
+            pwm.attachPin(this->pinNumber,REFRESH_CPS, this->timer_width );   // GPIO pin assigned to channel
         ESP_LOGW(TAG, "Success to Attach servo : %d on PWM %d",pin,pwm.getChannel());
 
         return pwm.getChannel();
@@ -164,6 +184,11 @@ void Servo::write(int value)
 
 void Servo::writeMicroseconds(int value)
 {
+    // the tick conversion is monotonic, so clamping first gives the same ticks
+    if (value < this->min)
+        value = this->min;
+    else if (value > this->max)
+        value = this->max;
     writeTicks(usToTicks(value));  // convert to ticks
 }
 
@@ -172,10 +197,10 @@ void Servo::writeTicks(int value)
     // calculate and store the values for the given channel
     if (this->attached())   // ensure channel is valid
     {
-        if (value < usToTicks(this->min))      // ensure ticks are in range
-            value = usToTicks(this->min);
-        else if (value > usToTicks(this->max))
-            value = usToTicks(this->max);
+        if (value < this->min_ticks)      // ensure ticks are in range
+            value = this->min_ticks;
+        else if (value > this->max_ticks)
+            value = this->max_ticks;
         this->ticks = value;
         // do the actual write
         pwm.write( this->ticks);
@@ -241,7 +266,8 @@ void Servo::setTimerWidth(int value)
     }
     
     this->timer_width = value;
-    this->timer_width_ticks = pow(2,this->timer_width);
+    this->timer_width_ticks = 1 << this->timer_width;
+    updateTickScaling();
     
     // If this is an attached servo, clean up
     if (this->attached())
@@ -257,14 +283,30 @@ int Servo::readTimerWidth()
     return (this->timer_width);
 }
 
+// ticks = usec * timer_width_ticks * REFRESH_CPS / (REFRESH_USEC * 50)
+void Servo::updateTickScaling()
+{
+    const uint64_t divisor = (uint64_t)REFRESH_USEC * 50;
+    uint64_t ticksPerSecond = (uint64_t)this->timer_width_ticks * (uint32_t)REFRESH_CPS;
+    // Rounded up so the truncated result is exact for pulses up to ~4000us
+    this->us_to_ticks_scale = ((ticksPerSecond << 32) + divisor - 1) / divisor;
+    this->min_ticks = usToTicks(this->min);
+    this->max_ticks = usToTicks(this->max);
+}
+
 int Servo::usToTicks(int usec)
 {
-    return (int)((double)usec / ((double)REFRESH_USEC / (double)this->timer_width_ticks)*(((double)REFRESH_CPS)/50.0));
+    if (usec <= 0)
+        return 0;
+    return (int)(((uint64_t)(uint32_t)usec * this->us_to_ticks_scale) >> 32);
 }
 
 int Servo::ticksToUs(int ticks)
 {
-    return (int)((double)ticks * ((double)REFRESH_USEC / (double)this->timer_width_ticks)/(((double)REFRESH_CPS)/50.0));
+    uint64_t ticksPerSecond = (uint64_t)this->timer_width_ticks * (uint32_t)REFRESH_CPS;
+    if (ticks <= 0 || ticksPerSecond == 0)
+        return 0;
+    return (int)((uint64_t)ticks * REFRESH_USEC * 50 / ticksPerSecond);
 }
 
  
@@ -36,6 +36,8 @@
  int attach(pin, min, max  ) - Attaches to a pin setting min and max
  values in microseconds; enforced minimum min is 500, enforced max
  is 2500. Other semantics same as attach().
+ int attach(pin, min, max, initialUs) - As above, but the first pulse is
+ already initialUs wide (re-attach a detached servo without a jump).
  void write () - Sets the servo angle in degrees; a value below 500 is
  treated as a value in degrees (0 to 180). These limit are enforced,
  i.e., values are treated as follows:
@@ -133,6 +135,7 @@ public:
 	// Arduino Servo Library calls
 	int attach(int pin); // attach the given pin to the next free channel, returns channel number or 0 if failure
 	int attach(int pin, int min, int max); // as above but also sets min and max values for writes.
+	int attach(int pin, int min, int max, int initialUs); // as above, first pulse is initialUs (no jump on re-attach)
 	void detach();
 	void write(int value); // if value is < MIN_PULSE_WIDTH its treated as an angle, otherwise as pulse width in microseconds
 	void writeMicroseconds(int value);     // Write pulse width in microseconds
@@ -153,6 +156,7 @@ public:
 private:
 	int usToTicks(int usec);
 	int ticksToUs(int ticks);
+	void updateTickScaling(); // recompute the values below after a width, period or min/max change
 //   static int ServoCount;                             // the total number of attached servos
 //   static int ChannelUsed[];                          // used to track whether a channel is in service
 //   int servoChannel = 0;                              // channel number for this servo
@@ -163,6 +167,9 @@ private:
 	int timer_width = DEFAULT_TIMER_WIDTH; // ESP32 allows variable width PWM timers
 	int ticks = DEFAULT_PULSE_WIDTH_TICKS; // current pulse width on this channel
 	int timer_width_ticks = DEFAULT_TIMER_WIDTH_TICKS; // no. of ticks at rollover; varies with width
+	uint64_t us_to_ticks_scale = 0;     // ticks per microsecond, 32.32 fixed point
+	int min_ticks = 0;                  // min and max converted to ticks
+	int max_ticks = 0;
 	ESP32PWM * getPwm(); // get the PWM object
 	ESP32PWM pwm;
 	int REFRESH_CPS = 50;
@@ -0,0 +1,208 @@
+/*
+ * ESP32PWMAllocationTest.cpp
+ *
+ * Host tests for the bitmap LEDC channel allocator in ESP32PWM: channel
+ * choice, reuse after free, exhaustion and timers shared by frequency.
+ * The allocator state is static, so every test frees what it allocated.
+ */
+
+#include <ESP32PWM.h>
+#include <gtest/gtest.h>
+#include <vector>
+
+static const int PWM_PINS[] = { 2, 4, 5, 12, 13, 14, 15, 16, 17, 18, 19, 21, 22, 23, 25, 26, 27, 32, 33 };
+static const int NUMBER_OF_PWM_PINS = sizeof(PWM_PINS) / sizeof(PWM_PINS[0]);
+
+class ESP32PWMAllocationTest: public ::testing::Test {
+protected:
+	std::vector<ESP32PWM*> attachedPwms;
+
+	ESP32PWM* attachAt(double freq) {
+		ESP32PWM* pwm = new ESP32PWM();
+		pwm->attachPin(PWM_PINS[attachedPwms.size()], freq, 10);
+		attachedPwms.push_back(pwm);
+		return pwm;
+	}
+
+	void detach(ESP32PWM* pwm) {
+		pwm->detachPin(pwm->getPin());
+	}
+
+	// Would allocatenext() find a channel, or halt?
+	static bool isChannelAvailableAt(double freq) {
+		for (int t = 0; t < 4; t++) {
+			bool freqMatches = ESP32PWM::timerFreqSet[t] == (long) freq || ESP32PWM::timerFreqSet[t] == -1;
+			if (freqMatches && ESP32PWM::timerCount[t] < 4)
+				return true;
+		}
+		return false;
+	}
+
+	// The mask, the channel table and the per-timer counts must agree
+	static void expectConsistentState() {
+		int used = 0;
+		for (int channel = 0; channel < NUM_PWM; channel++) {
+			bool isUsed = (ESP32PWM::usedChannelMask >> channel) & 1;
+			EXPECT_EQ(isUsed, ESP32PWM::ChannelUsed[channel] != NULL) << "channel " << channel;
+			if (isUsed) {
+				used++;
+				EXPECT_EQ(ESP32PWM::ChannelUsed[channel]->getChannel(), channel);
+				EXPECT_EQ(ESP32PWM::ChannelUsed[channel]->getTimer(), ESP32PWM::channelToTimer(channel));
+			}
+		}
+		EXPECT_EQ(used, ESP32PWM::PWMCount);
+		EXPECT_EQ(0u, ESP32PWM::usedChannelMask & ~(uint32_t) ((1UL << NUM_PWM) - 1));
+		for (int t = 0; t < 4; t++) {
+			int onTimer = __builtin_popcount(ESP32PWM::usedChannelMask & ESP32PWM::timerChannelMask(t));
+			EXPECT_EQ(onTimer, ESP32PWM::timerCount[t]) << "timer " << t;
+			if (onTimer == 0) {
+				EXPECT_EQ(-1, ESP32PWM::timerFreqSet[t]) << "timer " << t;
+			}
+		}
+	}
+
+	void SetUp() override {
+		ESP32PWM firstInstance; // the first constructor initializes the channel table
+		ASSERT_EQ(0, ESP32PWM::PWMCount);
+	}
+
+	void TearDown() override {
+		for (size_t i = 0; i < attachedPwms.size(); i++)
+			delete attachedPwms[i];
+		attachedPwms.clear();
+		EXPECT_EQ(0, ESP32PWM::PWMCount);
+		EXPECT_EQ(0u, ESP32PWM::usedChannelMask);
+		expectConsistentState();
+	}
+};
+
+TEST_F(ESP32PWMAllocationTest, TimerMasksMatchChannelMapping) {
+	uint32_t allChannels = 0;
+	for (int t = 0; t < 4; t++) {
+		uint32_t mask = ESP32PWM::timerChannelMask(t);
+		EXPECT_EQ(0u, allChannels & mask);
+		allChannels |= mask;
+		for (int i = 0; i < 4; i++) {
+			int channel = ESP32PWM::timerAndIndexToChannel(t, i);
+			ASSERT_GE(channel, 0);
+			EXPECT_TRUE((mask >> channel) & 1);
+			EXPECT_EQ(t, ESP32PWM::channelToTimer(channel));
+		}
+	}
+	EXPECT_EQ((uint32_t) ((1UL << NUM_PWM) - 1), allChannels);
+	EXPECT_EQ(0u, ESP32PWM::timerChannelMask(-1));
+	EXPECT_EQ(0u, ESP32PWM::timerChannelMask(4));
+}
+
+TEST_F(ESP32PWMAllocationTest, AllocatesLowestFreeChannelOfFirstFittingTimer) {
+	const int expectedChannels[] = { 0, 1, 8, 9, 2, 3 };
+	for (int i = 0; i < 6; i++) {
+		ESP32PWM* pwm = attachAt(50);
+		EXPECT_TRUE(pwm->attached());
+		EXPECT_EQ(expectedChannels[i], pwm->getChannel());
+		EXPECT_EQ(i < 4 ? 0 : 1, pwm->getTimer());
+	}
+	EXPECT_EQ(4, ESP32PWM::timerCount[0]);
+	EXPECT_EQ(2, ESP32PWM::timerCount[1]);
+	EXPECT_EQ(NUM_PWM - 6, ESP32PWM::channelsRemaining());
+	expectConsistentState();
+}
+
+TEST_F(ESP32PWMAllocationTest, FreedChannelIsReusedFirst) {
+	attachAt(50);
+	ESP32PWM* middle = attachAt(50);
+	attachAt(50);
+	ASSERT_EQ(1, middle->getChannel());
+
+	detach(middle);
+	EXPECT_FALSE(middle->attached());
+	EXPECT_EQ(-1, middle->getTimer());
+	EXPECT_EQ(0u, ESP32PWM::usedChannelMask & (1u << 1));
+	expectConsistentState();
+
+	EXPECT_EQ(1, attachAt(50)->getChannel());
+	expectConsistentState();
+}
+
+TEST_F(ESP32PWMAllocationTest, UsesEveryChannelOnceUntilExhausted) {
+	uint32_t seen = 0;
+	for (int i = 0; i < NUM_PWM; i++) {
+		ASSERT_TRUE(isChannelAvailableAt(50));
+		int channel = attachAt(50)->getChannel();
+		ASSERT_GE(channel, 0);
+		EXPECT_EQ(0u, seen & (1u << channel)) << "channel " << channel << " handed out twice";
+		seen |= 1u << channel;
+	}
+	EXPECT_EQ((uint32_t) ((1UL << NUM_PWM) - 1), ESP32PWM::usedChannelMask);
+	EXPECT_EQ(0, ESP32PWM::channelsRemaining());
+	// One more attach would halt in allocatenext(); callers check channelsRemaining() first
+	EXPECT_FALSE(isChannelAvailableAt(50));
+	EXPECT_FALSE(isChannelAvailableAt(1000));
+	expectConsistentState();
+
+	// Freeing the last timer's channels makes room for a new frequency there
+	for (int i = NUM_PWM - 4; i < NUM_PWM; i++)
+		detach(attachedPwms[i]);
+	EXPECT_EQ(-1, ESP32PWM::timerFreqSet[3]);
+	ESP32PWM* tone = attachAt(1000);
+	EXPECT_EQ(3, tone->getTimer());
+	EXPECT_EQ(6, tone->getChannel());
+	expectConsistentState();
+}
+
+TEST_F(ESP32PWMAllocationTest, TimersAreSharedOnlyAtTheSameFrequency) {
+	ESP32PWM* servoA = attachAt(50);
+	ESP32PWM* toneA = attachAt(1000);
+	ESP32PWM* servoB = attachAt(50);
+	ESP32PWM* toneB = attachAt(1000);
+
+	EXPECT_EQ(0, servoA->getTimer());
+	EXPECT_EQ(0, servoB->getTimer());
+	EXPECT_EQ(1, toneA->getTimer());
+	EXPECT_EQ(1, toneB->getTimer());
+	EXPECT_EQ(50, ESP32PWM::timerFreqSet[0]);
+	EXPECT_EQ(1000, ESP32PWM::timerFreqSet[1]);
+	EXPECT_EQ(3, toneB->getChannel());
+
+	// Retuning one channel retunes every channel in service on its timer
+	toneA->adjustFrequency(2000, 0.5);
+	EXPECT_EQ(2000, ESP32PWM::timerFreqSet[1]);
+	EXPECT_EQ(2000, toneB->readFreq());
+	EXPECT_EQ(50, servoA->readFreq());
+
+	// The last channel out releases the timer's frequency
+	detach(servoA);
+	EXPECT_EQ(50, ESP32PWM::timerFreqSet[0]);
+	detach(servoB);
+	EXPECT_EQ(-1, ESP32PWM::timerFreqSet[0]);
+	EXPECT_EQ(0, attachAt(200)->getTimer());
+	expectConsistentState();
+}
+
+TEST_F(ESP32PWMAllocationTest, StaysConsistentUnderRandomChurn) {
+	const double freqs[] = { 50, 50, 50, 1000, 1000, 330 };
+	ESP32PWM* byPin[NUMBER_OF_PWM_PINS] = { 0 };
+	unsigned seed = 12345;
+	for (int step = 0; step < 20000; step++) {
+		seed = seed * 1103515245u + 12345u;
+		int k = (seed >> 8) % NUMBER_OF_PWM_PINS;
+		if (byPin[k] == NULL) {
+			double freq = freqs[(seed >> 20) % 6];
+			if (!isChannelAvailableAt(freq))
+				continue;
+			byPin[k] = new ESP32PWM();
+			byPin[k]->attachPin(PWM_PINS[k], freq, 10);
+			ASSERT_TRUE(byPin[k]->attached());
+			EXPECT_EQ(freq, byPin[k]->readFreq());
+		} else {
+			byPin[k]->detachPin(PWM_PINS[k]);
+			delete byPin[k];
+			byPin[k] = NULL;
+		}
+		expectConsistentState();
+		if (HasFailure())
+			break;
+	}
+	for (int k = 0; k < NUMBER_OF_PWM_PINS; k++)
+		delete byPin[k];
+}
@@ -0,0 +1,144 @@
+/*
+ * ESP32ServoTickMathTest.cpp
+ *
+ * Host tests for the integer tick conversion in Servo. The reference is the
+ * library's previous double-precision path, kept here verbatim: every write
+ * must produce the same ticks, and every read the same microseconds and
+ * degrees, across the full angle and microsecond range of every timer width
+ * and refresh rate.
+ */
+
+#include <ESP32Servo.h>
+#include <gtest/gtest.h>
+
+// Previous Servo::usToTicks() / ticksToUs()
+static int referenceUsToTicks(int usec, int timerWidthTicks, int refreshCps) {
+	return (int) ((double) usec / ((double) REFRESH_USEC / (double) timerWidthTicks) * (((double) refreshCps) / 50.0));
+}
+
+static int referenceTicksToUs(int ticks, int timerWidthTicks, int refreshCps) {
+	return (int) ((double) ticks * ((double) REFRESH_USEC / (double) timerWidthTicks) / (((double) refreshCps) / 50.0));
+}
+
+// Previous writeMicroseconds(): convert, then clamp in ticks (writeTicks)
+static int referenceWriteMicroseconds(int value, int min, int max, int timerWidthTicks, int refreshCps) {
+	int ticks = referenceUsToTicks(value, timerWidthTicks, refreshCps);
+	int minTicks = referenceUsToTicks(min, timerWidthTicks, refreshCps);
+	int maxTicks = referenceUsToTicks(max, timerWidthTicks, refreshCps);
+	if (ticks < minTicks)
+		return minTicks;
+	if (ticks > maxTicks)
+		return maxTicks;
+	return ticks;
+}
+
+// Previous write(): small values are degrees, mapped onto min..max
+static int referenceWrite(int value, int min, int max, int timerWidthTicks, int refreshCps) {
+	if (value < MIN_PULSE_WIDTH) {
+		if (value < 0)
+			value = 0;
+		else if (value > 180)
+			value = 180;
+		value = map(value, 0, 180, min, max);
+	}
+	return referenceWriteMicroseconds(value, min, max, timerWidthTicks, refreshCps);
+}
+
+struct ServoSetup {
+	int refreshCps;
+	int timerWidth;
+	int min;
+	int max;
+};
+
+static const int REFRESH_RATES[] = { 50, 60, 100, 200, 330 };
+static const int PULSE_RANGES[][2] = { { DEFAULT_uS_LOW, DEFAULT_uS_HIGH }, { MIN_PULSE_WIDTH, MAX_PULSE_WIDTH }, { 1000, 2000 } };
+
+class ESP32ServoTickMathTest: public ::testing::TestWithParam<ServoSetup> {
+protected:
+	Servo servo;
+
+	void SetUp() override {
+		const ServoSetup& setup = GetParam();
+		servo.setPeriodHertz(setup.refreshCps);
+		servo.attach(4, setup.min, setup.max);
+		// attach() resets a fresh servo to the default width, so set it afterwards
+		servo.setTimerWidth(setup.timerWidth);
+		ASSERT_TRUE(servo.attached());
+		ASSERT_EQ(setup.timerWidth, servo.readTimerWidth());
+	}
+
+	void TearDown() override {
+		servo.detach();
+	}
+
+	int timerWidthTicks() {
+		return 1 << GetParam().timerWidth;
+	}
+};
+
+TEST_P(ESP32ServoTickMathTest, WriteMicrosecondsMatchesReferenceIncludingClamps) {
+	const ServoSetup& setup = GetParam();
+	for (int us = -100; us <= 3000; us++) {
+		servo.writeMicroseconds(us);
+		int expected = referenceWriteMicroseconds(us, setup.min, setup.max, timerWidthTicks(), setup.refreshCps);
+		ASSERT_EQ(expected, servo.readTicks()) << "us " << us;
+		ASSERT_EQ(referenceTicksToUs(expected, timerWidthTicks(), setup.refreshCps), servo.readMicroseconds())
+				<< "us " << us;
+	}
+}
+
+TEST_P(ESP32ServoTickMathTest, ClampsToMinAndMaxTicks) {
+	const ServoSetup& setup = GetParam();
+	servo.writeMicroseconds(0);
+	int minTicks = servo.readTicks();
+	servo.writeMicroseconds(100000);
+	int maxTicks = servo.readTicks();
+	EXPECT_EQ(referenceUsToTicks(setup.min, timerWidthTicks(), setup.refreshCps), minTicks);
+	EXPECT_EQ(referenceUsToTicks(setup.max, timerWidthTicks(), setup.refreshCps), maxTicks);
+
+	servo.writeTicks(minTicks - 1);
+	EXPECT_EQ(minTicks, servo.readTicks());
+	servo.writeTicks(maxTicks + 1);
+	EXPECT_EQ(maxTicks, servo.readTicks());
+}
+
+TEST_P(ESP32ServoTickMathTest, WriteAngleMatchesReferenceAndReadsBack) {
+	const ServoSetup& setup = GetParam();
+	double microsecondsPerTick = (double) REFRESH_USEC * 50.0 / ((double) timerWidthTicks() * setup.refreshCps);
+	int degreesPerTick = (int) ceil(microsecondsPerTick * 180.0 / (setup.max - setup.min));
+	for (int angle = -10; angle <= 190; angle++) {
+		servo.write(angle);
+		int expected = referenceWrite(angle, setup.min, setup.max, timerWidthTicks(), setup.refreshCps);
+		ASSERT_EQ(expected, servo.readTicks()) << "angle " << angle;
+
+		int referenceUs = referenceTicksToUs(expected, timerWidthTicks(), setup.refreshCps);
+		int referenceAngle = map(referenceUs, setup.min, setup.max, 0, 180);
+		ASSERT_EQ(referenceAngle, servo.read()) << "angle " << angle;
+
+		// Truncating to ticks and back loses at most one tick, plus a degree of rounding
+		int clampedAngle = angle < 0 ? 0 : (angle > 180 ? 180 : angle);
+		EXPECT_LE(abs(servo.read() - clampedAngle), degreesPerTick + 1) << "angle " << angle;
+	}
+}
+
+static std::vector<ServoSetup> allServoSetups() {
+	std::vector<ServoSetup> setups;
+	for (int r = 0; r < (int) (sizeof(REFRESH_RATES) / sizeof(REFRESH_RATES[0])); r++)
+		for (int width = MINIMUM_TIMER_WIDTH; width <= MAXIMUM_TIMER_WIDTH; width++)
+			for (int p = 0; p < (int) (sizeof(PULSE_RANGES) / sizeof(PULSE_RANGES[0])); p++)
+				setups.push_back({ REFRESH_RATES[r], width, PULSE_RANGES[p][0], PULSE_RANGES[p][1] });
+	return setups;
+}
+
+INSTANTIATE_TEST_SUITE_P(AllWidthsAndRates, ESP32ServoTickMathTest, ::testing::ValuesIn(allServoSetups()),
+		[](const ::testing::TestParamInfo<ServoSetup>& info) {
+			return std::to_string(info.param.refreshCps) + "Hz_" + std::to_string(info.param.timerWidth) + "bit_"
+					+ std::to_string(info.param.min) + "_" + std::to_string(info.param.max);
+		});
+
+TEST(ESP32ServoTickMath, DetachedServoReadsZero) {
+	Servo servo;
+	EXPECT_FALSE(servo.attached());
+	EXPECT_EQ(0, servo.readMicroseconds());
+}
@@ -0,0 +1,25 @@
+/*
+ * Arduino.h
+ *
+ * Host stand-in for the few Arduino core names the library uses.
+ */
+
+#ifndef TEST_STUBS_ARDUINO_H_
+#define TEST_STUBS_ARDUINO_H_
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+#include <stdio.h>
+
+#define ESP_LOGE(tag, ...)
+#define ESP_LOGW(tag, ...)
+#define ESP_LOGI(tag, ...)
+#define ESP_LOGD(tag, ...)
+
+typedef bool boolean;
+
+inline long map(long x, long in_min, long in_max, long out_min, long out_max) {
+	return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
+}
+
+#endif /* TEST_STUBS_ARDUINO_H_ */
@@ -0,0 +1,53 @@
+/*
+ * esp32-hal-ledc.h
+ *
+ * Host stand-in for the arduino-esp32 2.x LEDC API. Every call is logged in
+ * order so tests can check which channel a pin was set up, written and
+ * attached on.
+ */
+
+#ifndef TEST_STUBS_ESP32_HAL_LEDC_H_
+#define TEST_STUBS_ESP32_HAL_LEDC_H_
+#include <stdint.h>
+#include <vector>
+
+typedef enum {
+	NOTE_C, NOTE_Cs, NOTE_D, NOTE_Eb, NOTE_E, NOTE_F, NOTE_Fs, NOTE_G, NOTE_Gs, NOTE_A, NOTE_Bb, NOTE_B, NOTE_MAX
+} note_t;
+
+struct LedcCall {
+	enum Kind { SETUP, ATTACH, DETACH, WRITE, TONE } kind;
+	int channelOrPin;
+	uint32_t value;
+};
+
+inline std::vector<LedcCall>& ledcCalls() {
+	static std::vector<LedcCall> calls;
+	return calls;
+}
+
+inline double ledcSetup(uint8_t channel, double freq, uint8_t bits) {
+	ledcCalls().push_back({ LedcCall::SETUP, channel, bits });
+	return freq;
+}
+inline void ledcAttachPin(uint8_t pin, uint8_t channel) {
+	ledcCalls().push_back({ LedcCall::ATTACH, pin, channel });
+}
+inline void ledcDetachPin(uint8_t pin) {
+	ledcCalls().push_back({ LedcCall::DETACH, pin, 0 });
+}
+inline void ledcWrite(uint8_t channel, uint32_t duty) {
+	ledcCalls().push_back({ LedcCall::WRITE, channel, duty });
+}
+inline uint32_t ledcRead(uint8_t) {
+	return 0;
+}
+inline double ledcWriteTone(uint8_t channel, double freq) {
+	ledcCalls().push_back({ LedcCall::TONE, channel, (uint32_t) freq });
+	return freq;
+}
+inline double ledcWriteNote(uint8_t, note_t, uint8_t) {
+	return 0;
+}
+
+#endif /* TEST_STUBS_ESP32_HAL_LEDC_H_ */